@@ -0,0 +1,342 @@
+// asynclog.cpp
+
+#include "asynclog.h"
+#include <circle/timer.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+static const char From[] = "asynclog";
+
+#define DEFERRED_NOTE_MS	10		// show when an event was written this late
+
+CAsyncLog *CAsyncLog::s_pThis = 0;
+
+void TAsyncLogEvent::Add (double fArg)
+{
+	u64 nBits;
+	memcpy (&nBits, &fArg, sizeof nBits);
+
+	AddInteger (nBits);
+}
+
+// the string is copied as far as it fits, an offset behind the strings
+// marks one which did not fit at all
+void TAsyncLogEvent::Add (const char *pArg)
+{
+	if (pArg == 0)
+	{
+		pArg = "(null)";
+	}
+
+	unsigned nOffset = nStrings;
+	if (nOffset < ASYNC_LOG_STRINGS)
+	{
+		while (*pArg != '\0' && nStrings < ASYNC_LOG_STRINGS - 1)
+		{
+			Strings[nStrings++] = *pArg++;
+		}
+
+		Strings[nStrings++] = '\0';
+	}
+
+	AddInteger (nOffset);
+}
+
+CAsyncLog::CAsyncLog (void)
+:	m_bActive (false),
+	m_nIn (0),
+	m_nOut (0),
+	m_nSuppressed (0),
+	m_nDropped (0)
+{
+	for (unsigned i = 0; i < ASYNC_LOG_EVENTS; i++)
+	{
+		m_Ring[i].nSequence = i;
+	}
+
+	assert (s_pThis == 0);
+	s_pThis = this;
+}
+
+CAsyncLog::~CAsyncLog (void)
+{
+	Stop ();
+
+	s_pThis = 0;
+}
+
+void CAsyncLog::Start (void)
+{
+	__atomic_store_n (&m_bActive, true, __ATOMIC_RELEASE);
+}
+
+// events, which are committed on other cores while stopping, are lost
+void CAsyncLog::Stop (void)
+{
+	if (!__atomic_exchange_n (&m_bActive, false, __ATOMIC_ACQ_REL))
+	{
+		return;
+	}
+
+	Flush ();
+
+	if (m_nSuppressed != 0 || m_nDropped != 0)
+	{
+		CLogger::Get ()->Write (From, LogWarning, "%u messages suppressed, %u dropped",
+					m_nSuppressed, m_nDropped);
+	}
+}
+
+unsigned CAsyncLog::Drain (unsigned nMaxEvents)
+{
+	unsigned nEvents = 0;
+	for (; nEvents < nMaxEvents; nEvents++)
+	{
+		TAsyncLogEvent *pEvent = &m_Ring[m_nOut & (ASYNC_LOG_EVENTS - 1)];
+		if (__atomic_load_n (&pEvent->nSequence, __ATOMIC_ACQUIRE) != m_nOut + 1)
+		{
+			break;
+		}
+
+		Emit (pEvent);
+
+		__atomic_store_n (&pEvent->nSequence, m_nOut + ASYNC_LOG_EVENTS, __ATOMIC_RELEASE);
+		m_nOut++;
+	}
+
+	return nEvents;
+}
+
+bool CAsyncLog::IsEmpty (void) const
+{
+	const TAsyncLogEvent *pEvent = &m_Ring[m_nOut & (ASYNC_LOG_EVENTS - 1)];
+
+	return __atomic_load_n (&pEvent->nSequence, __ATOMIC_ACQUIRE) != m_nOut + 1;
+}
+
+// Bounded multi-producer queue: a slot can be claimed at position nPos, if
+// its sequence is nPos, it is ready for the consumer at nPos + 1 and free
+// again at nPos + ASYNC_LOG_EVENTS.
+TAsyncLogEvent *CAsyncLog::Begin (TAsyncLogSite *pSite)
+{
+	assert (pSite);
+
+	unsigned nNow = CTimer::GetClockTicks ();
+	if (nNow - pSite->nWindowStart >= ASYNC_LOG_WINDOW)
+	{
+		pSite->nWindowStart = nNow;
+		pSite->nCount = 0;
+	}
+
+	if (pSite->nCount >= ASYNC_LOG_BURST)
+	{
+		__atomic_add_fetch (&pSite->nSuppressed, 1, __ATOMIC_RELAXED);
+		__atomic_add_fetch (&m_nSuppressed, 1, __ATOMIC_RELAXED);
+
+		return 0;
+	}
+
+	pSite->nCount++;
+
+	unsigned nPos = __atomic_load_n (&m_nIn, __ATOMIC_RELAXED);
+	while (true)
+	{
+		TAsyncLogEvent *pEvent = &m_Ring[nPos & (ASYNC_LOG_EVENTS - 1)];
+		int nDiff = (int) (__atomic_load_n (&pEvent->nSequence, __ATOMIC_ACQUIRE) - nPos);
+		if (nDiff == 0)
+		{
+			// a failed exchange updates nPos
+			if (__atomic_compare_exchange_n (&m_nIn, &nPos, nPos + 1, true,
+							 __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+			{
+				pEvent->nTimestamp = nNow;
+				pEvent->pSite = pSite;
+				pEvent->nSuppressed = __atomic_exchange_n (&pSite->nSuppressed, 0,
+									   __ATOMIC_RELAXED);
+				pEvent->nArgs = 0;
+				pEvent->nStrings = 0;
+
+				return pEvent;
+			}
+		}
+		else if (nDiff < 0)
+		{
+			__atomic_add_fetch (&m_nDropped, 1, __ATOMIC_RELAXED);
+
+			return 0;			// full
+		}
+		else
+		{
+			nPos = __atomic_load_n (&m_nIn, __ATOMIC_RELAXED);
+		}
+	}
+}
+
+void CAsyncLog::Commit (TAsyncLogEvent *pEvent)
+{
+	assert (pEvent);
+
+	__atomic_store_n (&pEvent->nSequence, pEvent->nSequence + 1, __ATOMIC_RELEASE);
+}
+
+void CAsyncLog::Emit (const TAsyncLogEvent *pEvent)
+{
+	const TAsyncLogSite *pSite = pEvent->pSite;
+	assert (pSite);
+
+	unsigned nLength = Format (pEvent, m_Text, sizeof m_Text);
+
+	if (pEvent->nSuppressed != 0)
+	{
+		nLength += snprintf (&m_Text[nLength], sizeof m_Text - nLength,
+				     " (%u suppressed before)", pEvent->nSuppressed);
+	}
+
+	unsigned nDelay = (CTimer::GetClockTicks () - pEvent->nTimestamp) / 1000;
+	if (   nDelay >= DEFERRED_NOTE_MS
+	    && nLength < sizeof m_Text - 1)
+	{
+		snprintf (&m_Text[nLength], sizeof m_Text - nLength, " (deferred %u ms)", nDelay);
+	}
+
+	CLogger::Get ()->Write (pSite->pSource, pSite->Severity, "%s", m_Text);
+}
+
+// Formats like printf() with the recorded arguments. Length modifiers are
+// ignored, the arguments have been recorded at full width.
+unsigned CAsyncLog::Format (const TAsyncLogEvent *pEvent, char *pBuffer, unsigned nSize)
+{
+	assert (pEvent);
+	assert (pBuffer);
+	assert (nSize > 0);
+
+	const char *pFormat = pEvent->pSite->pFormat;
+	unsigned nLength = 0;
+	unsigned nArg = 0;
+
+	while (*pFormat != '\0' && nLength < nSize - 1)
+	{
+		if (*pFormat != '%')
+		{
+			pBuffer[nLength++] = *pFormat++;
+
+			continue;
+		}
+
+		if (pFormat[1] == '%')
+		{
+			pBuffer[nLength++] = '%';
+			pFormat += 2;
+
+			continue;
+		}
+
+		// flags, width and precision are kept, '*' is taken from the arguments
+		char Spec[48];
+		unsigned nSpec = 0;
+		Spec[nSpec++] = *pFormat++;
+		while (   *pFormat != '\0'
+		       && strchr ("-+ #0123456789.*", *pFormat) != 0
+		       && nSpec < 32)
+		{
+			if (*pFormat++ == '*')
+			{
+				int nValue = nArg < pEvent->nArgs ? (int) pEvent->Arg[nArg] : 0;
+				nArg++;
+
+				nSpec += snprintf (&Spec[nSpec], sizeof Spec - nSpec, "%d", nValue);
+			}
+			else
+			{
+				Spec[nSpec++] = pFormat[-1];
+			}
+		}
+
+		while (*pFormat != '\0' && strchr ("hlLqjzt", *pFormat) != 0)
+		{
+			pFormat++;
+		}
+
+		char chConversion = *pFormat;
+		if (chConversion == '\0')
+		{
+			break;
+		}
+		pFormat++;
+
+		if (nArg >= pEvent->nArgs)
+		{
+			pBuffer[nLength++] = '?';	// missing argument
+
+			continue;
+		}
+
+		char *pOut = &pBuffer[nLength];
+		unsigned nRoom = nSize - nLength;
+
+		u64 nValue = pEvent->Arg[nArg++];
+
+		int nResult = 0;
+		switch (chConversion)
+		{
+		case 'd':
+		case 'i':
+			strcpy (&Spec[nSpec], "lld");
+			nResult = snprintf (pOut, nRoom, Spec, (long long) nValue);
+			break;
+
+		case 'u':
+		case 'o':
+		case 'x':
+		case 'X':
+			Spec[nSpec++] = 'l';
+			Spec[nSpec++] = 'l';
+			Spec[nSpec++] = chConversion;
+			Spec[nSpec] = '\0';
+			nResult = snprintf (pOut, nRoom, Spec, (unsigned long long) nValue);
+			break;
+
+		case 'c':
+			strcpy (&Spec[nSpec], "c");
+			nResult = snprintf (pOut, nRoom, Spec, (int) nValue);
+			break;
+
+		case 's':
+			strcpy (&Spec[nSpec], "s");
+			nResult = snprintf (pOut, nRoom, Spec,
+					    nValue < pEvent->nStrings ? &pEvent->Strings[nValue] : "...");
+			break;
+
+		case 'p':
+			strcpy (&Spec[nSpec], "p");
+			nResult = snprintf (pOut, nRoom, Spec, (void *) (uintptr) nValue);
+			break;
+
+		case 'f':
+		case 'e':
+		case 'g':
+		case 'E':
+		case 'G': {
+			double fValue;
+			memcpy (&fValue, &nValue, sizeof fValue);
+
+			Spec[nSpec++] = chConversion;
+			Spec[nSpec] = '\0';
+			nResult = snprintf (pOut, nRoom, Spec, fValue);
+			} break;
+
+		default:
+			break;
+		}
+
+		if (nResult > 0)
+		{
+			nLength += (unsigned) nResult < nRoom ? nResult : nRoom - 1;
+		}
+	}
+
+	pBuffer[nLength] = '\0';
+
+	return nLength;
+}
@@ -0,0 +1,161 @@
+// asynclog.h
+//
+// Deferred logging. Include this instead of <circle/logger.h>, it replaces
+// LOGERR(), LOGWARN(), LOGNOTE() and LOGDBG() by macros, which record the
+// log site, a timestamp and the arguments into a lock-free ring, from any
+// core and in interrupt context. The main loop formats the events and
+// writes them to the Circle logger (screen or serial) when it is idle, so
+// that logging does not stall the boot or the menu. Each log site may write
+// ASYNC_LOG_BURST events per ASYNC_LOG_WINDOW, the others are suppressed.
+// Events are dropped if the ring is full; both are counted.
+//
+// String arguments are copied (up to ASYNC_LOG_STRINGS bytes per event),
+// other pointers are not followed. Before Start() and after Stop() the
+// macros write synchronously. LOGPANIC() is always synchronous.
+//
+#pragma once
+
+#include <circle/logger.h>
+#include <circle/types.h>
+
+#define ASYNC_LOG_EVENTS	256		// must be a power of 2
+#define ASYNC_LOG_ARGS		6
+#define ASYNC_LOG_STRINGS	48		// bytes, including the terminating nulls
+#define ASYNC_LOG_TEXT_MAX	256		// of a formatted message
+
+#define ASYNC_LOG_BURST		20		// events per site and window
+#define ASYNC_LOG_WINDOW	1000000		// us
+
+#define ASYNC_LOG_DRAIN_BATCH	4		// events written per main loop iteration
+
+struct TAsyncLogSite
+{
+	const char *pSource;
+	const char *pFormat;
+	TLogSeverity Severity;
+
+	// rate limiter, updated without a lock, so it is approximate if the
+	// site is used on several cores at the same time
+	unsigned nWindowStart;
+	unsigned nCount;
+	unsigned nSuppressed;			// since the last recorded event
+};
+
+struct TAsyncLogEvent
+{
+	unsigned nSequence;			// state of the ring slot
+	unsigned nTimestamp;			// CTimer::GetClockTicks()
+	TAsyncLogSite *pSite;
+	unsigned nSuppressed;			// at this site before this event
+
+	unsigned nArgs;
+	unsigned nStrings;			// bytes used in Strings
+	u64 Arg[ASYNC_LOG_ARGS];		// integer, double bits or offset in Strings
+	char Strings[ASYNC_LOG_STRINGS];
+
+	void Add (int nArg)			{ AddInteger (nArg); }
+	void Add (unsigned nArg)		{ AddInteger (nArg); }
+	void Add (long nArg)			{ AddInteger (nArg); }
+	void Add (unsigned long nArg)		{ AddInteger (nArg); }
+	void Add (long long nArg)		{ AddInteger (nArg); }
+	void Add (unsigned long long nArg)	{ AddInteger (nArg); }
+	void Add (double fArg);
+	void Add (const char *pArg);
+	void Add (const void *pArg)		{ AddInteger ((uintptr) pArg); }
+
+private:
+	void AddInteger (u64 nArg)
+	{
+		if (nArgs < ASYNC_LOG_ARGS)
+		{
+			Arg[nArgs++] = nArg;
+		}
+	}
+};
+
+class CAsyncLog
+{
+public:
+	CAsyncLog (void);
+	~CAsyncLog (void);
+
+	// the Circle logger must be initialized
+	void Start (void);
+	// writes the pending events, the following ones are written at once
+	void Stop (void);
+
+	// writes up to nMaxEvents events, returns the number written;
+	// on core 0 only, not in interrupt context
+	unsigned Drain (unsigned nMaxEvents);
+	void Flush (void)			{ while (Drain (ASYNC_LOG_EVENTS)) {} }
+
+	bool IsEmpty (void) const;
+
+	unsigned GetSuppressed (void) const	{ return m_nSuppressed; }
+	unsigned GetDropped (void) const	{ return m_nDropped; }
+
+	// used by the macros
+	template <typename... TArgs>
+	static void Write (TAsyncLogSite *pSite, TArgs... Args)
+	{
+		CAsyncLog *pThis = s_pThis;
+		if (   pThis == 0
+		    || !__atomic_load_n (&pThis->m_bActive, __ATOMIC_ACQUIRE))
+		{
+			CLogger::Get ()->Write (pSite->pSource, pSite->Severity, pSite->pFormat, Args...);
+
+			return;
+		}
+
+		TAsyncLogEvent *pEvent = pThis->Begin (pSite);
+		if (pEvent == 0)
+		{
+			return;
+		}
+
+		int Dummy[] = {0, (pEvent->Add (Args), 0)...};
+		(void) Dummy;
+
+		pThis->Commit (pEvent);
+	}
+
+private:
+	// returns 0 if the event is suppressed or dropped
+	TAsyncLogEvent *Begin (TAsyncLogSite *pSite);
+	void Commit (TAsyncLogEvent *pEvent);
+
+	void Emit (const TAsyncLogEvent *pEvent);
+	unsigned Format (const TAsyncLogEvent *pEvent, char *pBuffer, unsigned nSize);
+
+private:
+	volatile bool m_bActive;
+
+	TAsyncLogEvent m_Ring[ASYNC_LOG_EVENTS];
+	unsigned m_nIn;				// next position to claim by producers
+	unsigned m_nOut;			// next position to drain
+
+	unsigned m_nSuppressed;
+	unsigned m_nDropped;
+
+	char m_Text[ASYNC_LOG_TEXT_MAX];
+
+	static CAsyncLog *s_pThis;
+};
+
+#define ASYNC_LOG(severity, format, ...)						\
+	do										\
+	{										\
+		static TAsyncLogSite LogSite = {From, format, severity, 0, 0, 0};	\
+		CAsyncLog::Write (&LogSite, ##__VA_ARGS__);				\
+	}										\
+	while (0)
+
+#undef LOGERR
+#undef LOGWARN
+#undef LOGNOTE
+#undef LOGDBG
+
+#define LOGERR(...)	ASYNC_LOG (LogError, __VA_ARGS__)
+#define LOGWARN(...)	ASYNC_LOG (LogWarning, __VA_ARGS__)
+#define LOGNOTE(...)	ASYNC_LOG (LogNotice, __VA_ARGS__)
+#define LOGDBG(...)	ASYNC_LOG (LogDebug, __VA_ARGS__)
@@ -0,0 +1,331 @@
+// blockcache.cpp
+
+#include "blockcache.h"
+#include "asynclog.h"
+#include <assert.h>
+#include <string.h>
+
+#define LINE_MASK	((u64) BLOCK_CACHE_LINE_SECTORS - 1)
+
+LOGMODULE ("blockcache");
+
+CBlockCache::CBlockCache (void)
+:	m_pDevice (nullptr),
+	m_nSectors (0),
+	m_nPosition (0),
+	m_nNextSector (0),
+	m_nPinnedFirst (0),
+	m_nPinnedEnd (0),
+	m_nPinned (0),
+	m_nClock (0)
+{
+	static_assert (BLOCK_CACHE_PINNED_MAX < BLOCK_CACHE_LINES, "No lines left to evict");
+	static_assert ((BLOCK_CACHE_LINE_SECTORS & LINE_MASK) == 0, "Line size must be a power of 2");
+
+	memset (m_Lines, 0, sizeof m_Lines);
+	memset (&m_Stats, 0, sizeof m_Stats);
+}
+
+void CBlockCache::Setup (CDevice *pDevice)
+{
+	assert (pDevice);
+	assert (pDevice != this);
+	m_pDevice = pDevice;
+	m_nSectors = m_pDevice->GetSize () / BLOCK_CACHE_SECTOR_SIZE;
+
+	m_nPosition = 0;
+	m_nNextSector = ~(u64) 0;
+	m_nPinnedFirst = 0;
+	m_nPinnedEnd = 0;
+	m_nPinned = 0;
+
+	memset (m_Lines, 0, sizeof m_Lines);
+	memset (&m_Stats, 0, sizeof m_Stats);
+}
+
+void CBlockCache::Pin (u64 nFirstSector, u64 nCount)
+{
+	m_nPinnedFirst = nFirstSector;
+	m_nPinnedEnd = nFirstSector + nCount;
+
+	// the lines read while mounting
+	m_nPinned = 0;
+	for (TLine &rLine : m_Lines)
+	{
+		rLine.bPinned =    rLine.bValid
+				&& IsPinned (rLine.nSector)
+				&& m_nPinned < BLOCK_CACHE_PINNED_MAX;
+		m_nPinned += rLine.bPinned ? 1 : 0;
+	}
+}
+
+int CBlockCache::Read (void *pBuffer, size_t nCount)
+{
+	assert (m_pDevice);
+	assert (pBuffer);
+
+	if (   nCount % BLOCK_CACHE_SECTOR_SIZE != 0
+	    || m_nPosition % BLOCK_CACHE_SECTOR_SIZE != 0)
+	{
+		return -1;
+	}
+
+	u64 nSector = m_nPosition / BLOCK_CACHE_SECTOR_SIZE;
+	u64 nEnd = nSector + nCount / BLOCK_CACHE_SECTOR_SIZE;
+	bool bSequential = nSector == m_nNextSector;
+	m_Stats.nRequests++;
+
+	if (nEnd - nSector >= BLOCK_CACHE_LINE_SECTORS)
+	{
+		// the lines are updated on writes, so the card is current
+		m_Stats.nBypassed++;
+		if (!ReadDevice (pBuffer, nSector, nEnd - nSector))
+		{
+			return -1;
+		}
+	}
+	else
+	{
+		u8 *pTo = static_cast<u8 *> (pBuffer);
+		for (u64 nNext = nSector; nNext < nEnd; )
+		{
+			u64 nLineSector = nNext & ~LINE_MASK;
+
+			TLine *pLine = Find (nLineSector);
+			if (pLine != nullptr)
+			{
+				m_Stats.nHits++;
+			}
+			else
+			{
+				m_Stats.nMisses++;
+				if (!Fill (nLineSector, bSequential ? nEnd + BLOCK_CACHE_READ_AHEAD
+									 * BLOCK_CACHE_LINE_SECTORS
+								    : nEnd))
+				{
+					return -1;
+				}
+
+				pLine = Find (nLineSector);
+				assert (pLine != nullptr);
+			}
+
+			pLine->nLastUse = ++m_nClock;
+
+			unsigned nOffset = nNext - nLineSector;
+			unsigned nSectors = BLOCK_CACHE_LINE_SECTORS - nOffset;
+			if (nSectors > nEnd - nNext)
+			{
+				nSectors = nEnd - nNext;
+			}
+
+			memcpy (pTo, GetData (pLine) + nOffset * BLOCK_CACHE_SECTOR_SIZE,
+				nSectors * BLOCK_CACHE_SECTOR_SIZE);
+
+			pTo += nSectors * BLOCK_CACHE_SECTOR_SIZE;
+			nNext += nSectors;
+		}
+	}
+
+	m_nNextSector = nEnd;
+	m_nPosition += nCount;
+
+	return nCount;
+}
+
+int CBlockCache::Write (const void *pBuffer, size_t nCount)
+{
+	assert (m_pDevice);
+	assert (pBuffer);
+
+	if (   nCount % BLOCK_CACHE_SECTOR_SIZE != 0
+	    || m_nPosition % BLOCK_CACHE_SECTOR_SIZE != 0)
+	{
+		return -1;
+	}
+
+	u64 nSector = m_nPosition / BLOCK_CACHE_SECTOR_SIZE;
+	u64 nEnd = nSector + nCount / BLOCK_CACHE_SECTOR_SIZE;
+	bool bOK =    m_pDevice->Seek (m_nPosition) == m_nPosition
+		   && m_pDevice->Write (pBuffer, nCount) == (int) nCount;
+	m_Stats.nWrites++;
+
+	// a failed write may have changed some of the sectors
+	for (TLine &rLine : m_Lines)
+	{
+		if (   !rLine.bValid
+		    || rLine.nSector + BLOCK_CACHE_LINE_SECTORS <= nSector
+		    || rLine.nSector >= nEnd)
+		{
+			continue;
+		}
+
+		if (!bOK)
+		{
+			m_nPinned -= rLine.bPinned ? 1 : 0;
+			rLine.bValid = false;
+			rLine.bPinned = false;
+
+			continue;
+		}
+
+		u64 nFirst = rLine.nSector > nSector ? rLine.nSector : nSector;
+		u64 nLast = rLine.nSector + BLOCK_CACHE_LINE_SECTORS < nEnd
+			  ? rLine.nSector + BLOCK_CACHE_LINE_SECTORS : nEnd;
+		memcpy (GetData (&rLine) + (nFirst - rLine.nSector) * BLOCK_CACHE_SECTOR_SIZE,
+			static_cast<const u8 *> (pBuffer) + (nFirst - nSector) * BLOCK_CACHE_SECTOR_SIZE,
+			(nLast - nFirst) * BLOCK_CACHE_SECTOR_SIZE);
+	}
+
+	if (!bOK)
+	{
+		return -1;
+	}
+
+	m_nPosition += nCount;
+
+	return nCount;
+}
+
+u64 CBlockCache::Seek (u64 ullOffset)
+{
+	m_nPosition = ullOffset;
+
+	return m_nPosition;
+}
+
+u64 CBlockCache::GetSize (void) const
+{
+	assert (m_pDevice);
+
+	return m_pDevice->GetSize ();
+}
+
+void CBlockCache::Report (void) const
+{
+	unsigned nLookups = m_Stats.nHits + m_Stats.nMisses;
+
+	LOGNOTE ("%u reads, %u hits, %u misses (%u%% hit rate), %u bypassed",
+		 m_Stats.nRequests, m_Stats.nHits, m_Stats.nMisses,
+		 nLookups != 0 ? m_Stats.nHits * 100 / nLookups : 0, m_Stats.nBypassed);
+	LOGNOTE ("%u card reads (%u sectors), %u writes", m_Stats.nCommands, m_Stats.nSectors,
+		 m_Stats.nWrites);
+}
+
+CBlockCache::TLine *CBlockCache::Find (u64 nSector)
+{
+	for (TLine &rLine : m_Lines)
+	{
+		if (   rLine.bValid
+		    && rLine.nSector == nSector)
+		{
+			return &rLine;
+		}
+	}
+
+	return nullptr;
+}
+
+// reads the line of nSector and the following up to the one of nEnd with
+// one command, up to BLOCK_CACHE_RUN_MAX lines, stopping at a cached line
+bool CBlockCache::Fill (u64 nSector, u64 nEnd)
+{
+	assert ((nSector & LINE_MASK) == 0);
+
+	unsigned nLines = 1;
+	while (   nLines < BLOCK_CACHE_RUN_MAX
+	       && nSector + nLines * BLOCK_CACHE_LINE_SECTORS < nEnd
+	       && nSector + nLines * BLOCK_CACHE_LINE_SECTORS < m_nSectors
+	       && Find (nSector + nLines * BLOCK_CACHE_LINE_SECTORS) == nullptr)
+	{
+		nLines++;
+	}
+
+	u64 nCount = nLines * BLOCK_CACHE_LINE_SECTORS;
+	if (nSector + nCount > m_nSectors)
+	{
+		if (nSector >= m_nSectors)
+		{
+			return false;
+		}
+
+		nCount = m_nSectors - nSector;
+	}
+
+	memset (m_Run, 0, nLines * BLOCK_CACHE_LINE_SIZE);
+	if (!ReadDevice (m_Run, nSector, nCount))
+	{
+		return false;
+	}
+
+	for (unsigned i = 0; i < nLines; i++)
+	{
+		TLine *pLine = Allocate (nSector + i * BLOCK_CACHE_LINE_SECTORS);
+		memcpy (GetData (pLine), m_Run + i * BLOCK_CACHE_LINE_SIZE, BLOCK_CACHE_LINE_SIZE);
+	}
+
+	return true;
+}
+
+// evicts the least recently used line, a pinned line only for another one,
+// when BLOCK_CACHE_PINNED_MAX are pinned
+CBlockCache::TLine *CBlockCache::Allocate (u64 nSector)
+{
+	bool bPinned = IsPinned (nSector);
+	bool bFromPinned = bPinned && m_nPinned >= BLOCK_CACHE_PINNED_MAX;
+
+	TLine *pVictim = nullptr;
+	for (TLine &rLine : m_Lines)
+	{
+		if (rLine.bPinned != bFromPinned)
+		{
+			continue;
+		}
+
+		if (!rLine.bValid)
+		{
+			pVictim = &rLine;
+
+			break;
+		}
+
+		if (   pVictim == nullptr
+		    || rLine.nLastUse < pVictim->nLastUse)
+		{
+			pVictim = &rLine;
+		}
+	}
+
+	assert (pVictim != nullptr);
+	if (!bFromPinned && bPinned)
+	{
+		m_nPinned++;
+	}
+
+	pVictim->nSector = nSector;
+	pVictim->nLastUse = ++m_nClock;
+	pVictim->bValid = true;
+	pVictim->bPinned = bPinned;
+
+	return pVictim;
+}
+
+bool CBlockCache::IsPinned (u64 nSector) const
+{
+	return    nSector + BLOCK_CACHE_LINE_SECTORS > m_nPinnedFirst
+	       && nSector < m_nPinnedEnd;
+}
+
+bool CBlockCache::ReadDevice (void *pBuffer, u64 nSector, unsigned nCount)
+{
+	assert (m_pDevice);
+
+	m_Stats.nCommands++;
+	m_Stats.nSectors += nCount;
+
+	u64 nOffset = nSector * BLOCK_CACHE_SECTOR_SIZE;
+	size_t nSize = (size_t) nCount * BLOCK_CACHE_SECTOR_SIZE;
+
+	return    m_pDevice->Seek (nOffset) == nOffset
+	       && m_pDevice->Read (pBuffer, nSize) == (int) nSize;
+}
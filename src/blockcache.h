@@ -0,0 +1,101 @@
+// blockcache.h
+//
+// Read cache between FatFs and the SD card driver for the small, scattered
+// reads at boot (FAT, directories, ini files, index and image headers). It
+// is a CDevice, which is registered in place of the card, so the disk_read()
+// and disk_write() of Circle's FatFs glue go through it.
+//
+// The cache holds lines of BLOCK_CACHE_LINE_SECTORS sectors. A miss reads
+// the line (and the lines the request covers) with one multi-block command,
+// a miss directly after the previous request (a sequential run) reads
+// BLOCK_CACHE_READ_AHEAD more lines with it. Requests of a line or more
+// (image data) bypass the cache. Lines of the pinned range (the FAT) are not
+// evicted by other lines, up to BLOCK_CACHE_PINNED_MAX of them. Writes go
+// through to the card and update the cached lines.
+//
+// Like FatFs it must be used by one core at a time.
+//
+#pragma once
+
+#include <circle/device.h>
+#include <circle/types.h>
+
+#define BLOCK_CACHE_SECTOR_SIZE		512
+#define BLOCK_CACHE_LINE_SECTORS	8		// 4 KB
+#define BLOCK_CACHE_LINES		32
+#define BLOCK_CACHE_READ_AHEAD		3		// lines, on a sequential run
+#define BLOCK_CACHE_PINNED_MAX		8		// lines
+
+#define BLOCK_CACHE_LINE_SIZE		(BLOCK_CACHE_LINE_SECTORS * BLOCK_CACHE_SECTOR_SIZE)
+#define BLOCK_CACHE_RUN_MAX		(BLOCK_CACHE_READ_AHEAD + 2)	// lines per command
+
+struct TBlockCacheStats
+{
+	unsigned nRequests;			// reads
+	unsigned nHits;				// line lookups
+	unsigned nMisses;
+	unsigned nBypassed;			// reads of a line or more
+	unsigned nCommands;			// reads of the card
+	unsigned nSectors;			// read from the card
+	unsigned nWrites;
+};
+
+class CBlockCache : public CDevice
+{
+public:
+	CBlockCache (void);
+
+	// pDevice is the card, can be called again to drop all lines
+	void Setup (CDevice *pDevice);
+
+	// lines of nCount sectors from nFirstSector are kept
+	void Pin (u64 nFirstSector, u64 nCount);
+
+	int Read (void *pBuffer, size_t nCount) override;
+	int Write (const void *pBuffer, size_t nCount) override;
+	u64 Seek (u64 ullOffset) override;
+	u64 GetSize (void) const override;
+
+	const TBlockCacheStats &GetStats (void) const	{ return m_Stats; }
+
+	// writes the counters to the log
+	void Report (void) const;
+
+private:
+	struct TLine
+	{
+		u64 nSector;			// first, a multiple of BLOCK_CACHE_LINE_SECTORS
+		unsigned nLastUse;
+		bool bValid;
+		bool bPinned;
+	};
+
+	TLine *Find (u64 nSector);
+	bool Fill (u64 nSector, u64 nEnd);
+	TLine *Allocate (u64 nSector);
+
+	bool IsPinned (u64 nSector) const;
+
+	bool ReadDevice (void *pBuffer, u64 nSector, unsigned nCount);
+
+	u8 *GetData (const TLine *pLine)	{ return m_Data[pLine - m_Lines]; }
+
+private:
+	CDevice *m_pDevice;
+	u64 m_nSectors;				// of the card
+
+	u64 m_nPosition;			// set by Seek()
+	u64 m_nNextSector;			// after the previous read
+
+	u64 m_nPinnedFirst;
+	u64 m_nPinnedEnd;
+	unsigned m_nPinned;			// lines
+
+	unsigned m_nClock;
+	TLine m_Lines[BLOCK_CACHE_LINES];
+
+	TBlockCacheStats m_Stats;
+
+	alignas (64) u8 m_Data[BLOCK_CACHE_LINES][BLOCK_CACHE_LINE_SIZE];
+	alignas (64) u8 m_Run[BLOCK_CACHE_RUN_MAX * BLOCK_CACHE_LINE_SIZE];
+};
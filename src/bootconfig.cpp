@@ -0,0 +1,319 @@
+// bootconfig.cpp
+
+#include "bootconfig.h"
+#include "crc32.h"
+#include <ctype.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GPIO_PINS	54
+
+// key names are hashed at compile time (FNV-1a), so a lookup compares
+// hashes and the name only once
+static constexpr uint32_t KeyHash (const char *pKey)
+{
+	uint32_t nHash = 0x811C9DC5U;
+	while (*pKey)
+	{
+		nHash = (nHash ^ (uint8_t) *pKey++) * 0x01000193U;
+	}
+
+	return nHash;
+}
+
+struct TBootConfigKey
+{
+	const char *pName;
+	uint32_t nHash;
+	unsigned nFile;				// TBootConfigFile
+	size_t nOffset;				// of the u32 field in TBootConfig
+	uint32_t nDefault;
+	uint32_t nMin;
+	uint32_t nMax;
+};
+
+#define KEY(file, name, field, def, min, max) \
+	{name, KeyHash (name), BootConfigFile##file, offsetof (TBootConfig, field), def, min, max}
+#define BOOL(file, name, field, def)	KEY (file, name, field, def, 0, 1)
+#define PIN(file, name, field, def)	KEY (file, name, field, def, 0, GPIO_PINS - 1)
+
+static constexpr TBootConfigKey s_Keys[] =
+{
+	//   file	name			field			default		range
+	KEY  (Synth,	"MIDINote1",		nMIDINote[0],		36,		0, 127),
+	KEY  (Synth,	"MIDINote2",		nMIDINote[1],		38,		0, 127),
+	KEY  (Synth,	"MIDINote3",		nMIDINote[2],		40,		0, 127),
+	KEY  (Synth,	"MIDIChannel",		nMIDIChannel,		BOOT_CONFIG_MIDI_CHANNEL_OMNI, 0, 16),
+	KEY  (Synth,	"MIDINoteThreshold",	nMIDINoteThreshold,	1,		1, 127),
+	KEY  (Synth,	"MIDIButtonThreshold",	nMIDIButtonThreshold,	1,		1, 127),
+	KEY  (Synth,	"MIDIButtonPageNext",	nMIDIButtonPageNext,	BOOT_CONFIG_MIDI_NONE, 0, BOOT_CONFIG_MIDI_NONE),
+	KEY  (Synth,	"MIDIButtonPagePrev",	nMIDIButtonPagePrev,	BOOT_CONFIG_MIDI_NONE, 0, BOOT_CONFIG_MIDI_NONE),
+	KEY  (Synth,	"MIDIThresholdNote1",	nMIDINoteThresholds[0],	BOOT_CONFIG_THRESHOLD_GLOBAL, 0, 127),
+	KEY  (Synth,	"MIDIThresholdNote2",	nMIDINoteThresholds[1],	BOOT_CONFIG_THRESHOLD_GLOBAL, 0, 127),
+	KEY  (Synth,	"MIDIThresholdNote3",	nMIDINoteThresholds[2],	BOOT_CONFIG_THRESHOLD_GLOBAL, 0, 127),
+	KEY  (Synth,	"MIDIThresholdNext",	nMIDINextThreshold,	BOOT_CONFIG_THRESHOLD_GLOBAL, 0, 127),
+	KEY  (Synth,	"MIDIThresholdPrev",	nMIDIPrevThreshold,	BOOT_CONFIG_THRESHOLD_GLOBAL, 0, 127),
+	KEY  (Synth,	"MIDIThresholdSelect",	nMIDISelectThreshold,	BOOT_CONFIG_THRESHOLD_GLOBAL, 0, 127),
+	KEY  (Synth,	"MIDIThresholdPageNext", nMIDIPageNextThreshold, BOOT_CONFIG_THRESHOLD_GLOBAL, 0, 127),
+	KEY  (Synth,	"MIDIThresholdPagePrev", nMIDIPagePrevThreshold, BOOT_CONFIG_THRESHOLD_GLOBAL, 0, 127),
+	BOOL (Synth,	"MIDIProgramChange",	nMIDIProgramChange,	0),
+	BOOL (Synth,	"AutoBoot",		nAutoBoot,		0),
+	KEY  (Synth,	"AutoBootHoldTime",	nAutoBootHoldTime,	200,		1, 10000),
+	BOOL (Synth,	"RequireImageCRC",	nRequireImageCRC,	0),
+
+	KEY  (MiniDexed, "LCDColumns",		nLCDColumns,		16,		1, 40),
+	KEY  (MiniDexed, "LCDRows",		nLCDRows,		2,		1, 16),
+
+	KEY  (MiniDexed, "MIDIButtonNext",	nMIDIButtonNext,	47,		0, 127),
+	KEY  (MiniDexed, "MIDIButtonPrev",	nMIDIButtonPrev,	46,		0, 127),
+	KEY  (MiniDexed, "MIDIButtonSelect",	nMIDIButtonSelect,	49,		0, 127),
+	KEY  (MiniDexed, "MIDIBaudRate",	nMIDIBaudRate,		31250,		300, 4000000),
+
+	KEY  (MiniDexed, "SPIBus",		nSPIBus,		SPI_INACTIVE,	0, SPI_INACTIVE),
+	KEY  (MiniDexed, "SPIMode",		nSPIMode,		SPI_DEF_MODE,	0, 3),
+	KEY  (MiniDexed, "SPIClockKHz",		nSPIClockKHz,		SPI_DEF_CLOCK,	1, 125000),
+
+	BOOL (MiniDexed, "EncoderEnabled",	nEncoderEnabled,	0),
+	PIN  (MiniDexed, "EncoderPinClock",	nEncoderPinClock,	10),
+	PIN  (MiniDexed, "EncoderPinData",	nEncoderPinData,	9),
+	PIN  (MiniDexed, "GetButtonPinShortcut", nEncoderPinSwitch,	11),
+
+	PIN  (MiniDexed, "ButtonPinPrev",	nButtonPinPrev,		5),
+	PIN  (MiniDexed, "ButtonPinNext",	nButtonPinNext,		6),
+	PIN  (MiniDexed, "ButtonPinSelect",	nButtonPinSelect,	13),
+
+	KEY  (MiniDexed, "LCDI2CAddress",	nLCDI2CAddress,		0,		0, 0x7F),
+	PIN  (MiniDexed, "LCDPinData4",		nLCDPinData4,		22),
+	PIN  (MiniDexed, "LCDPinData5",		nLCDPinData5,		23),
+	PIN  (MiniDexed, "LCDPinData6",		nLCDPinData6,		24),
+	PIN  (MiniDexed, "LCDPinData7",		nLCDPinData7,		25),
+	PIN  (MiniDexed, "LCDPinEnable",	nLCDPinEnable,		4),
+	PIN  (MiniDexed, "LCDPinRegisterSelect", nLCDPinRegisterSelect,	27),
+	PIN  (MiniDexed, "LCDPinReadWrite",	nLCDPinReadWrite,	0),
+
+	KEY  (MiniDexed, "SSD1306LCDI2CAddress", nSSD1306I2CAddress,	0x3C,		0, 0x7F),
+	KEY  (MiniDexed, "SSD1306LCDWidth",	nSSD1306Width,		128,		1, 128),
+	KEY  (MiniDexed, "SSD1306LCDHeight",	nSSD1306Height,		32,		1, 64),
+	BOOL (MiniDexed, "SSD1306LCDRotate",	nSSD1306Rotate,		0),
+	BOOL (MiniDexed, "SSD1306LCDMirror",	nSSD1306Mirror,		0),
+
+	BOOL (MiniDexed, "ST7789Enabled",	nST7789Enabled,		0),
+	PIN  (MiniDexed, "ST7789Data",		nST7789Data,		0),
+	PIN  (MiniDexed, "ST7789Reset",		nST7789Reset,		0),
+	PIN  (MiniDexed, "ST7789Backlight",	nST7789Backlight,	0),
+	KEY  (MiniDexed, "ST7789Width",		nST7789Width,		240,		1, 480),
+	KEY  (MiniDexed, "ST7789Height",	nST7789Height,		240,		1, 480),
+	KEY  (MiniDexed, "ST7789Select",	nST7789Select,		0,		0, 1),
+	KEY  (MiniDexed, "ST7789Rotation",	nST7789Rotation,	0,		0, 270),
+	BOOL (MiniDexed, "ST7789SmallFont",	nST7789SmallFont,	0)
+};
+
+static const unsigned s_nKeys = sizeof s_Keys / sizeof s_Keys[0];
+
+static constexpr bool IsSchemaValid (void)
+{
+	for (unsigned i = 0; i < sizeof s_Keys / sizeof s_Keys[0]; i++)
+	{
+		const TBootConfigKey &rKey = s_Keys[i];
+		if (   rKey.nMin > rKey.nDefault || rKey.nDefault > rKey.nMax
+		    || rKey.nOffset % sizeof (uint32_t) != 0
+		    || rKey.nOffset >= sizeof (TBootConfig))
+		{
+			return false;
+		}
+
+		for (unsigned j = 0; j < i; j++)
+		{
+			if (s_Keys[j].nHash == rKey.nHash || s_Keys[j].nOffset == rKey.nOffset)
+			{
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+static_assert (IsSchemaValid (), "Duplicate key, duplicate field or default out of range");
+static_assert (sizeof s_Keys / sizeof s_Keys[0] == sizeof (TBootConfig) / sizeof (uint32_t),
+	       "Each field of TBootConfig needs a key");
+
+static const char *s_pFileName[BootConfigFileCount] =
+{
+	"synth.ini",
+	"minidexed.ini"
+};
+
+static uint32_t *GetField (TBootConfig *pConfig, const TBootConfigKey &rKey)
+{
+	return reinterpret_cast<uint32_t *> (reinterpret_cast<uint8_t *> (pConfig) + rKey.nOffset);
+}
+
+static const TBootConfigKey *FindKey (unsigned nFile, const char *pName)
+{
+	uint32_t nHash = KeyHash (pName);
+
+	for (unsigned i = 0; i < s_nKeys; i++)
+	{
+		if (   s_Keys[i].nHash == nHash
+		    && s_Keys[i].nFile == nFile
+		    && strcmp (s_Keys[i].pName, pName) == 0)
+		{
+			return &s_Keys[i];
+		}
+	}
+
+	return 0;
+}
+
+// compares letters and digits only, ignoring the case
+static bool IsSimilar (const char *pKey1, const char *pKey2)
+{
+	while (true)
+	{
+		while (*pKey1 && !isalnum ((unsigned char) *pKey1))
+		{
+			pKey1++;
+		}
+
+		while (*pKey2 && !isalnum ((unsigned char) *pKey2))
+		{
+			pKey2++;
+		}
+
+		if (!*pKey1 || !*pKey2)
+		{
+			return !*pKey1 && !*pKey2;
+		}
+
+		if (tolower ((unsigned char) *pKey1++) != tolower ((unsigned char) *pKey2++))
+		{
+			return false;
+		}
+	}
+}
+
+void BootConfigSetDefaults (TBootConfig *pConfig)
+{
+	for (unsigned i = 0; i < s_nKeys; i++)
+	{
+		*GetField (pConfig, s_Keys[i]) = s_Keys[i].nDefault;
+	}
+}
+
+TBootConfigResult BootConfigSet (TBootConfig *pConfig, unsigned nFile,
+				 const char *pKey, const char *pValue)
+{
+	const TBootConfigKey *pEntry = FindKey (nFile, pKey);
+	if (pEntry == 0)
+	{
+		if (BootConfigGetSimilarKey (pKey) != 0)
+		{
+			return BootConfigMisspelledKey;
+		}
+
+		// minidexed.ini belongs to MiniDexed, most keys are not ours
+		return nFile == BootConfigFileSynth ? BootConfigUnknownKey : BootConfigIgnored;
+	}
+
+	char *pEnd;
+	unsigned long nValue = strtoul (pValue, &pEnd, 0);
+	if (pEnd == pValue || *pEnd != '\0')
+	{
+		return BootConfigInvalidValue;
+	}
+
+	if (nValue < pEntry->nMin || nValue > pEntry->nMax)
+	{
+		return BootConfigOutOfRange;
+	}
+
+	*GetField (pConfig, *pEntry) = nValue;
+
+	return BootConfigOK;
+}
+
+const char *BootConfigGetResultText (TBootConfigResult Result)
+{
+	switch (Result)
+	{
+	case BootConfigOK:		return "OK";
+	case BootConfigIgnored:		return "Ignored";
+	case BootConfigUnknownKey:	return "Unknown key";
+	case BootConfigMisspelledKey:	return "Misspelled key";
+	case BootConfigInvalidValue:	return "Invalid value";
+	case BootConfigOutOfRange:	return "Value out of range";
+	}
+
+	return "Unknown error";
+}
+
+const char *BootConfigGetSimilarKey (const char *pKey)
+{
+	for (unsigned i = 0; i < s_nKeys; i++)
+	{
+		// a key in the wrong file counts as well
+		if (IsSimilar (s_Keys[i].pName, pKey))
+		{
+			return s_Keys[i].pName;
+		}
+	}
+
+	return 0;
+}
+
+const char *BootConfigGetFileName (unsigned nFile)
+{
+	return nFile < BootConfigFileCount ? s_pFileName[nFile] : "?";
+}
+
+unsigned BootConfigGetKeyCount (void)
+{
+	return s_nKeys;
+}
+
+const char *BootConfigGetKeyName (unsigned nKey, unsigned *pFile)
+{
+	if (nKey >= s_nKeys)
+	{
+		return 0;
+	}
+
+	if (pFile)
+	{
+		*pFile = s_Keys[nKey].nFile;
+	}
+
+	return s_Keys[nKey].pName;
+}
+
+uint32_t BootConfigGetValue (const TBootConfig *pConfig, unsigned nKey)
+{
+	return nKey < s_nKeys ? *GetField (const_cast<TBootConfig *> (pConfig), s_Keys[nKey]) : 0;
+}
+
+void BootConfigSeal (TBootConfigCache *pCache, const TBootConfigStamp *pStamps)
+{
+	TBootConfigHeader *pHeader = &pCache->Header;
+
+	memset (pHeader, 0, sizeof *pHeader);
+	pHeader->nMagic = BOOT_CONFIG_MAGIC;
+	pHeader->nVersion = BOOT_CONFIG_VERSION;
+	pHeader->nHeaderSize = sizeof (TBootConfigHeader);
+	pHeader->nConfigSize = sizeof (TBootConfig);
+	pHeader->nCRC = CRC32Update (0, &pCache->Config, sizeof (TBootConfig));
+	memcpy (pHeader->Stamp, pStamps, sizeof pHeader->Stamp);
+}
+
+bool BootConfigIsValid (const TBootConfigCache *pCache, const TBootConfigStamp *pStamps)
+{
+	const TBootConfigHeader *pHeader = &pCache->Header;
+
+	return    pHeader->nMagic == BOOT_CONFIG_MAGIC
+	       && pHeader->nVersion == BOOT_CONFIG_VERSION
+	       && pHeader->nHeaderSize == sizeof (TBootConfigHeader)
+	       && pHeader->nConfigSize == sizeof (TBootConfig)
+	       && memcmp (pHeader->Stamp, pStamps, sizeof pHeader->Stamp) == 0
+	       && pHeader->nCRC == CRC32Update (0, &pCache->Config, sizeof (TBootConfig));
+}
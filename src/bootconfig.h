@@ -0,0 +1,169 @@
+// bootconfig.h
+//
+// Settings of the boot menu from synth.ini and minidexed.ini as a typed
+// struct, and the format of the config cache, which keeps this struct on
+// the SD card. A valid cache is read into memory as is, the ini files are
+// only parsed if one of them changed (size or modification time) or the
+// cache is missing. tools/mkconfig compiles the cache on the host.
+//
+// The keys are described by a schema (see bootconfig.cpp), which gives the
+// field, default and valid range of each key. The ini files are applied in
+// one pass over their entries. Entries with unknown keys or invalid values
+// are reported. MiniDexed keys in minidexed.ini are not known to the menu,
+// so there only keys which look like a misspelled menu key are reported.
+//
+// Does not depend on Circle, the format is little endian.
+//
+#pragma once
+
+#include <stdint.h>
+
+#define BOOT_CONFIG_MAGIC	0x4643534DU	// "MSCF"
+#define BOOT_CONFIG_VERSION	6
+
+#define SPI_INACTIVE		255
+#define SPI_DEF_CLOCK		15000		// kHz
+#define SPI_DEF_MODE		0		// Default mode (0,1,2,3)
+
+#define BOOT_CONFIG_SYNTHS	3
+
+#define BOOT_CONFIG_MIDI_CHANNEL_OMNI	0
+#define BOOT_CONFIG_MIDI_NONE		128	// controller is not used
+#define BOOT_CONFIG_THRESHOLD_GLOBAL	0	// MIDINoteThreshold or MIDIButtonThreshold
+
+enum TBootConfigFile
+{
+	BootConfigFileSynth,			// synth.ini
+	BootConfigFileMiniDexed,		// minidexed.ini
+	BootConfigFileCount
+};
+
+struct TBootConfig
+{
+	// synth.ini
+	uint32_t nMIDINote[BOOT_CONFIG_SYNTHS];
+	uint32_t nMIDIChannel;			// 1..16 or BOOT_CONFIG_MIDI_CHANNEL_OMNI
+	uint32_t nMIDINoteThreshold;		// minimum velocity
+	uint32_t nMIDIButtonThreshold;		// minimum controller value
+	uint32_t nMIDIButtonPageNext;		// or BOOT_CONFIG_MIDI_NONE
+	uint32_t nMIDIButtonPagePrev;
+	uint32_t nMIDINoteThresholds[BOOT_CONFIG_SYNTHS]; // or BOOT_CONFIG_THRESHOLD_GLOBAL
+	uint32_t nMIDINextThreshold;		// of the controllers, as above
+	uint32_t nMIDIPrevThreshold;
+	uint32_t nMIDISelectThreshold;
+	uint32_t nMIDIPageNextThreshold;
+	uint32_t nMIDIPagePrevThreshold;
+	uint32_t nMIDIProgramChange;		// program N starts synth N+1
+	uint32_t nAutoBoot;			// start the synth launched last
+	uint32_t nAutoBootHoldTime;		// ms the select button is held for the menu
+	uint32_t nRequireImageCRC;		// images without a CRC are not started
+
+	// minidexed.ini
+	uint32_t nLCDColumns;
+	uint32_t nLCDRows;
+
+	uint32_t nMIDIButtonNext;
+	uint32_t nMIDIButtonPrev;
+	uint32_t nMIDIButtonSelect;
+	uint32_t nMIDIBaudRate;
+
+	uint32_t nSPIBus;
+	uint32_t nSPIMode;
+	uint32_t nSPIClockKHz;
+
+	uint32_t nEncoderEnabled;
+	uint32_t nEncoderPinClock;
+	uint32_t nEncoderPinData;
+	uint32_t nEncoderPinSwitch;
+
+	uint32_t nButtonPinPrev;
+	uint32_t nButtonPinNext;
+	uint32_t nButtonPinSelect;
+
+	uint32_t nLCDI2CAddress;
+	uint32_t nLCDPinData4;
+	uint32_t nLCDPinData5;
+	uint32_t nLCDPinData6;
+	uint32_t nLCDPinData7;
+	uint32_t nLCDPinEnable;
+	uint32_t nLCDPinRegisterSelect;
+	uint32_t nLCDPinReadWrite;
+
+	uint32_t nSSD1306I2CAddress;
+	uint32_t nSSD1306Width;
+	uint32_t nSSD1306Height;
+	uint32_t nSSD1306Rotate;
+	uint32_t nSSD1306Mirror;
+
+	uint32_t nST7789Enabled;
+	uint32_t nST7789Data;
+	uint32_t nST7789Reset;
+	uint32_t nST7789Backlight;
+	uint32_t nST7789Width;
+	uint32_t nST7789Height;
+	uint32_t nST7789Select;
+	uint32_t nST7789Rotation;
+	uint32_t nST7789SmallFont;
+};
+
+// identifies the version of an ini file the cache was built from
+struct TBootConfigStamp
+{
+	uint32_t nSize;
+	uint16_t nDate;				// FAT date and time
+	uint16_t nTime;
+};
+
+struct TBootConfigHeader
+{
+	uint32_t nMagic;
+	uint16_t nVersion;
+	uint16_t nHeaderSize;
+	uint32_t nConfigSize;			// sizeof (TBootConfig)
+	uint32_t nCRC;				// CRC-32 of the config
+	TBootConfigStamp Stamp[BootConfigFileCount];
+};
+
+struct TBootConfigCache
+{
+	TBootConfigHeader Header;
+	TBootConfig Config;
+};
+
+static_assert (sizeof (TBootConfigHeader) == 32, "TBootConfigHeader must be packed");
+static_assert (sizeof (TBootConfig) % 4 == 0, "TBootConfig must be packed");
+
+enum TBootConfigResult
+{
+	BootConfigOK,
+	BootConfigIgnored,			// unknown key, not worth reporting
+	BootConfigUnknownKey,
+	BootConfigMisspelledKey,		// looks like a known key
+	BootConfigInvalidValue,
+	BootConfigOutOfRange
+};
+
+// sets all settings to their defaults
+void BootConfigSetDefaults (TBootConfig *pConfig);
+
+// applies one entry of ini file nFile, pConfig is left alone on errors
+TBootConfigResult BootConfigSet (TBootConfig *pConfig, unsigned nFile,
+				 const char *pKey, const char *pValue);
+
+const char *BootConfigGetResultText (TBootConfigResult Result);
+
+// name of the known key (of any file) pKey looks like, or 0
+const char *BootConfigGetSimilarKey (const char *pKey);
+
+const char *BootConfigGetFileName (unsigned nFile);
+
+// the known keys in schema order, to walk over all settings
+unsigned BootConfigGetKeyCount (void);
+const char *BootConfigGetKeyName (unsigned nKey, unsigned *pFile = 0);
+uint32_t BootConfigGetValue (const TBootConfig *pConfig, unsigned nKey);
+
+// sets up the header for pStamps and the current pCache->Config
+void BootConfigSeal (TBootConfigCache *pCache, const TBootConfigStamp *pStamps);
+
+// the cache is intact and was built from the ini files with pStamps
+bool BootConfigIsValid (const TBootConfigCache *pCache, const TBootConfigStamp *pStamps);
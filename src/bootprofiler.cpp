@@ -0,0 +1,145 @@
+// bootprofiler.cpp
+
+#include "bootprofiler.h"
+#include <circle/logger.h>
+#include <circle/timer.h>
+#include <circle/sysconfig.h>
+#include <circle/multicore.h>
+#include <fatfs/ff.h>
+#include <stdio.h>
+#include <assert.h>
+
+LOGMODULE ("bootprofile");
+
+CBootProfiler::CBootProfiler (void)
+:	m_nNext (0)
+{
+}
+
+unsigned CBootProfiler::Begin (const char *pName)
+{
+	assert (pName);
+
+	unsigned hStage = __atomic_fetch_add (&m_nNext, 1, __ATOMIC_RELAXED);
+
+	TRecord *pRecord = &m_Records[hStage % BOOT_PROFILE_MAX_STAGES];
+	pRecord->pName = pName;
+#ifdef ARM_ALLOW_MULTI_CORE
+	pRecord->nCore = CMultiCoreSupport::ThisCore ();
+#else
+	pRecord->nCore = 0;
+#endif
+	pRecord->nEnd = 0;
+	pRecord->nStart = CTimer::GetClockTicks ();
+
+	return hStage;
+}
+
+void CBootProfiler::End (unsigned hStage)
+{
+	unsigned nNow = CTimer::GetClockTicks ();
+
+	// the record may have been overwritten in the meantime
+	if (m_nNext - hStage <= BOOT_PROFILE_MAX_STAGES)
+	{
+		m_Records[hStage % BOOT_PROFILE_MAX_STAGES].nEnd = nNow;
+	}
+}
+
+unsigned CBootProfiler::GetCount (void) const
+{
+	unsigned nNext = m_nNext;
+
+	return nNext < BOOT_PROFILE_MAX_STAGES ? nNext : BOOT_PROFILE_MAX_STAGES;
+}
+
+const CBootProfiler::TRecord *CBootProfiler::GetRecord (unsigned nIndex) const
+{
+	assert (nIndex < GetCount ());
+
+	return &m_Records[(m_nNext - GetCount () + nIndex) % BOOT_PROFILE_MAX_STAGES];
+}
+
+void CBootProfiler::Dump (const char *pTitle) const
+{
+	unsigned nCount = GetCount ();
+	if (nCount == 0)
+	{
+		return;
+	}
+
+	unsigned nFirst = GetRecord (0)->nStart;
+	unsigned nLast = nFirst;
+
+	for (unsigned i = 0; i < nCount; i++)
+	{
+		const TRecord *pRecord = GetRecord (i);
+		if (pRecord->nEnd == 0)
+		{
+			LOGNOTE ("%-16s core %u  start %8u us  (running)",
+				 pRecord->pName, pRecord->nCore, pRecord->nStart);
+
+			continue;
+		}
+
+		LOGNOTE ("%-16s core %u  start %8u us  %8u us",
+			 pRecord->pName, pRecord->nCore, pRecord->nStart,
+			 pRecord->nEnd - pRecord->nStart);
+
+		if ((int) (pRecord->nEnd - nLast) > 0)
+		{
+			nLast = pRecord->nEnd;
+		}
+	}
+
+	LOGNOTE ("%s took %u us (%u us since power-on)", pTitle, nLast - nFirst, nLast);
+}
+
+bool CBootProfiler::WriteCSV (const char *pFileName) const
+{
+	assert (pFileName);
+
+	FIL File;
+	if (f_open (&File, pFileName, FA_WRITE | FA_OPEN_APPEND) != FR_OK)
+	{
+		LOGWARN ("Cannot open %s", pFileName);
+
+		return false;
+	}
+
+	char Line[80];
+	UINT nWritten;
+	bool bOK = true;
+
+	if (f_size (&File) == 0)
+	{
+		int nLength = snprintf (Line, sizeof Line, "stage,core,start_us,duration_us\n");
+		bOK = f_write (&File, Line, nLength, &nWritten) == FR_OK;
+	}
+
+	for (unsigned i = 0; bOK && i < GetCount (); i++)
+	{
+		const TRecord *pRecord = GetRecord (i);
+		if (pRecord->nEnd == 0)
+		{
+			continue;
+		}
+
+		int nLength = snprintf (Line, sizeof Line, "%s,%u,%u,%u\n",
+					pRecord->pName, pRecord->nCore, pRecord->nStart,
+					pRecord->nEnd - pRecord->nStart);
+		bOK = f_write (&File, Line, nLength, &nWritten) == FR_OK;
+	}
+
+	if (f_close (&File) != FR_OK)
+	{
+		bOK = false;
+	}
+
+	if (!bOK)
+	{
+		LOGWARN ("Cannot write %s", pFileName);
+	}
+
+	return bOK;
+}
@@ -0,0 +1,44 @@
+// bootprofiler.h
+//
+// Records start and end stamps (CTimer::GetClockTicks(), microseconds since
+// power-on) of the boot stages into a fixed ring, without using the heap.
+// Stages may be recorded from any core.
+//
+#pragma once
+
+#include <circle/types.h>
+
+#define BOOT_PROFILE_MAX_STAGES	32
+#define BOOT_PROFILE_FILE	"SD:/boot_profile.csv"
+
+class CBootProfiler
+{
+public:
+	struct TRecord
+	{
+		const char *pName;
+		unsigned nCore;
+		unsigned nStart;
+		unsigned nEnd;			// 0 while the stage is running
+	};
+
+public:
+	CBootProfiler (void);
+
+	// returns a handle to be passed to End()
+	unsigned Begin (const char *pName);
+	void End (unsigned hStage);
+
+	// number of valid records (at most BOOT_PROFILE_MAX_STAGES)
+	unsigned GetCount (void) const;
+	// nIndex 0 is the oldest record still in the ring
+	const TRecord *GetRecord (unsigned nIndex) const;
+
+	void Dump (const char *pTitle = "Boot stages") const;
+	// appends one line per stage, writes the header if the file is new
+	bool WriteCSV (const char *pFileName = BOOT_PROFILE_FILE) const;
+
+private:
+	TRecord m_Records[BOOT_PROFILE_MAX_STAGES];
+	volatile unsigned m_nNext;
+};
@@ -0,0 +1,201 @@
+// bootstages.cpp
+
+#include "bootstages.h"
+#include "asynclog.h"
+#include "coresync.h"
+#include <circle/timer.h>
+#include <assert.h>
+
+LOGMODULE ("bootstages");
+
+CBootStages::CBootStages (const TBootStageInfo *pStages, unsigned nStages,
+			  TBootStageHandler *pHandler, void *pParam,
+			  CBootProfiler *pProfiler)
+:	m_pStages (pStages),
+	m_nStages (nStages),
+	m_pHandler (pHandler),
+	m_pParam (pParam),
+	m_pProfiler (pProfiler),
+	m_nDeadline (0),
+	m_bHelping (false),
+	m_nDoneMask (0),
+	m_nFailedMask (0),
+	m_nClaimedMask (0),
+	m_nDeferredMask (0)
+{
+	assert (m_pStages);
+	assert (m_nStages < BOOT_STAGES_MAX);
+	assert (m_pHandler);
+}
+
+bool CBootStages::Run (unsigned nCore, bool bAllCores)
+{
+	bool bOK = true;
+
+	for (unsigned nStage = 0; nStage < m_nStages; nStage++)
+	{
+		if (!bAllCores && m_pStages[nStage].nCore != nCore)
+		{
+			continue;
+		}
+
+		if (!RunStage (nStage))
+		{
+			bOK = false;
+		}
+	}
+
+	return bOK;
+}
+
+bool CBootStages::RunStage (unsigned nStage)
+{
+	assert (nStage < m_nStages);
+	const TBootStageInfo *pStage = &m_pStages[nStage];
+
+	if (__atomic_fetch_or (&m_nClaimedMask, BOOT_STAGE (nStage), __ATOMIC_ACQ_REL)
+	    & BOOT_STAGE (nStage))
+	{
+		return true;
+	}
+
+	assert (!(pStage->nDependencies & ~(BOOT_STAGE (nStage) - 1)));
+	if (   !WaitForDependencies (nStage, pStage->nDependencies)
+	    || IsTimedOut ())
+	{
+		if (IsTimedOut ())
+		{
+			LOGERR ("%s: Out of time", pStage->pName);
+		}
+		else
+		{
+			LOGERR ("%s: Dependency failed", pStage->pName);
+		}
+
+		__atomic_or_fetch (&m_nFailedMask, BOOT_STAGE (nStage), __ATOMIC_RELEASE);
+
+		return false;
+	}
+
+	// left for the Run() after Resume()
+	if (IsDeferred (nStage))
+	{
+		__atomic_and_fetch (&m_nClaimedMask, ~BOOT_STAGE (nStage), __ATOMIC_RELEASE);
+
+		return true;
+	}
+
+	unsigned hStage = 0;
+	if (m_pProfiler)
+	{
+		hStage = m_pProfiler->Begin (pStage->pName);
+	}
+
+	unsigned nStart = CTimer::GetClockTicks ();
+
+	bool bStageOK = (*m_pHandler) (nStage, m_pParam);
+
+	unsigned nDuration = CTimer::GetClockTicks () - nStart;
+
+	if (m_pProfiler)
+	{
+		m_pProfiler->End (hStage);
+	}
+
+	if (   pStage->nBudget != 0
+	    && nDuration > pStage->nBudget)
+	{
+		LOGWARN ("%s: Took %u us (budget %u us)", pStage->pName, nDuration, pStage->nBudget);
+	}
+
+	if (!bStageOK)
+	{
+		LOGERR ("%s: Failed", pStage->pName);
+
+		__atomic_or_fetch (&m_nFailedMask, BOOT_STAGE (nStage), __ATOMIC_RELEASE);
+
+		return false;
+	}
+
+	__atomic_or_fetch (&m_nDoneMask, BOOT_STAGE (nStage), __ATOMIC_RELEASE);
+
+	return true;
+}
+
+void CBootStages::Defer (u32 nStageMask)
+{
+#ifndef NDEBUG
+	for (unsigned nStage = 0; nStage < m_nStages; nStage++)
+	{
+		assert (   (nStageMask & BOOT_STAGE (nStage))
+			|| !(m_pStages[nStage].nDependencies & nStageMask));
+	}
+#endif
+
+	__atomic_or_fetch (&m_nDeferredMask, nStageMask, __ATOMIC_RELEASE);
+}
+
+void CBootStages::Resume (void)
+{
+	__atomic_store_n (&m_nDeferredMask, 0, __ATOMIC_RELEASE);
+}
+
+bool CBootStages::IsDone (unsigned nStage) const
+{
+	assert (nStage < m_nStages);
+
+	return AreDone (BOOT_STAGE (nStage));
+}
+
+bool CBootStages::AreDone (u32 nStageMask) const
+{
+	return (__atomic_load_n (&m_nDoneMask, __ATOMIC_ACQUIRE) & nStageMask) == nStageMask;
+}
+
+bool CBootStages::IsComplete (void) const
+{
+	u32 nAll = BOOT_STAGE (m_nStages) - 1;
+
+	return (  __atomic_load_n (&m_nDoneMask, __ATOMIC_ACQUIRE)
+		| __atomic_load_n (&m_nFailedMask, __ATOMIC_ACQUIRE)
+		| __atomic_load_n (&m_nDeferredMask, __ATOMIC_ACQUIRE)) == nAll;
+}
+
+bool CBootStages::WaitForDependencies (unsigned nStage, u32 nDependencies)
+{
+	while (   !AreDone (nDependencies)
+	       && !IsDeferred (nStage))
+	{
+		if (   (__atomic_load_n (&m_nFailedMask, __ATOMIC_ACQUIRE) & nDependencies)
+		    || IsTimedOut ())
+		{
+			return false;
+		}
+
+		if (m_bHelping)
+		{
+			u32 nUnclaimed = nDependencies & ~__atomic_load_n (&m_nClaimedMask, __ATOMIC_ACQUIRE);
+			if (nUnclaimed != 0)
+			{
+				RunStage (__builtin_ctz (nUnclaimed));
+
+				continue;
+			}
+		}
+
+		CoreYield ();
+	}
+
+	return true;
+}
+
+bool CBootStages::IsDeferred (unsigned nStage) const
+{
+	return __atomic_load_n (&m_nDeferredMask, __ATOMIC_ACQUIRE) & BOOT_STAGE (nStage);
+}
+
+bool CBootStages::IsTimedOut (void) const
+{
+	return    m_nDeadline != 0
+	       && (int) (CTimer::GetClockTicks () - m_nDeadline) > 0;
+}
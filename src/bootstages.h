@@ -0,0 +1,84 @@
+// bootstages.h
+//
+// Runs the boot stages of a static dependency graph on several cores. Each
+// stage is owned by one core, which runs its stages in table order and waits
+// for the dependencies of each stage, which may be owned by other cores. The
+// table order must be a topological order of the graph. Each stage runs once,
+// on the first core which claims it. With helping enabled a core, which waits
+// for a stage no core has claimed yet, runs it itself. An optional deadline
+// fails the stages, which could not start in time. Stages can be deferred,
+// they are skipped then until they are resumed and run again.
+//
+#pragma once
+
+#include <circle/types.h>
+#include "bootprofiler.h"
+
+#define BOOT_STAGES_MAX		32
+
+#define BOOT_STAGE(stage)	(1U << (stage))
+
+struct TBootStageInfo
+{
+	const char *pName;
+	unsigned nCore;
+	u32 nDependencies;		// mask of BOOT_STAGE()
+	unsigned nBudget = 0;		// us, a warning is logged if exceeded, 0 for none
+};
+
+typedef bool TBootStageHandler (unsigned nStage, void *pParam);
+
+class CBootStages
+{
+public:
+	CBootStages (const TBootStageInfo *pStages, unsigned nStages,
+		     TBootStageHandler *pHandler, void *pParam,
+		     CBootProfiler *pProfiler);
+
+	// runs the stages owned by nCore (all stages, if bAllCores is set),
+	// returns false if one of them failed or could not run
+	bool Run (unsigned nCore, bool bAllCores = false);
+
+	// nDeadline is a CTimer::GetClockTicks() value, 0 for none
+	void SetDeadline (unsigned nDeadline)	{ m_nDeadline = nDeadline; }
+	void EnableHelping (void)		{ m_bHelping = true; }
+
+	// the stages in nStageMask are skipped by Run(), also when they are
+	// already waiting for their dependencies; the stages, which depend on
+	// one of them, must be in nStageMask as well
+	void Defer (u32 nStageMask);
+	// the deferred stages can be run by the next Run() of their core
+	void Resume (void);
+
+	bool IsDone (unsigned nStage) const;
+	bool AreDone (u32 nStageMask) const;
+	// all stages have either succeeded, failed or are deferred
+	bool IsComplete (void) const;
+
+	// the deadline has passed, a stage, which waits, polls it to fail early
+	bool IsTimedOut (void) const;
+
+private:
+	// returns false if the stage failed or could not run, true if it
+	// succeeded or has been claimed by another core
+	bool RunStage (unsigned nStage);
+
+	// returns false if a dependency failed or the deadline has passed,
+	// returns early if nStage is deferred
+	bool WaitForDependencies (unsigned nStage, u32 nDependencies);
+	bool IsDeferred (unsigned nStage) const;
+
+private:
+	const TBootStageInfo *m_pStages;
+	unsigned m_nStages;
+	TBootStageHandler *m_pHandler;
+	void *m_pParam;
+	CBootProfiler *m_pProfiler;
+	unsigned m_nDeadline;
+	bool m_bHelping;
+
+	volatile u32 m_nDoneMask;
+	volatile u32 m_nFailedMask;
+	volatile u32 m_nClaimedMask;
+	volatile u32 m_nDeferredMask;
+};
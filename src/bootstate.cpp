@@ -0,0 +1,226 @@
+// bootstate.cpp
+
+#include "bootstate.h"
+#include <fatfs/diskio.h>
+#include "asynclog.h"
+#include <assert.h>
+#include <string.h>
+
+#define BOOT_STATE_SIZE		(BOOT_STATE_SLOTS * STATE_LOG_SECTOR_SIZE)
+
+LOGMODULE ("bootstate");
+
+CBootState::CBootState (void)
+:	m_Log (BOOT_STATE_SLOTS, ReadHandler, WriteHandler, this),
+	m_bReady (false),
+	m_bDirect (false)
+{
+	memset (&m_Data, 0, sizeof m_Data);
+}
+
+bool CBootState::Load (void)
+{
+	memset (&m_Data, 0, sizeof m_Data);
+	m_bReady = false;
+
+	FIL File;
+	bool bCreated = false;
+	if (f_open (&File, BOOT_STATE_FILE, FA_READ | FA_WRITE | FA_OPEN_EXISTING) == FR_OK)
+	{
+		if (f_size (&File) != BOOT_STATE_SIZE)
+		{
+			f_close (&File);
+
+			LOGWARN ("%s has a wrong size", BOOT_STATE_FILE);
+		}
+		else
+		{
+			m_bReady = true;
+		}
+	}
+
+	if (!m_bReady)
+	{
+		if (!Create (&File))
+		{
+			LOGWARN ("Cannot create %s", BOOT_STATE_FILE);
+
+			return false;
+		}
+
+		bCreated = true;
+	}
+
+	m_bDirect = FileGetExtent (&File, 0, BOOT_STATE_SIZE, &m_Extent);
+	f_close (&File);
+
+	if (!m_bDirect)
+	{
+		LOGWARN ("%s is fragmented", BOOT_STATE_FILE);
+	}
+
+	if (bCreated)
+	{
+		// the sectors may hold records of a deleted log
+		m_bReady = m_Log.Format ();
+
+		return false;
+	}
+
+	if (!m_Log.Recover (&m_Data, sizeof m_Data))
+	{
+		LOGWARN ("%s has no valid record", BOOT_STATE_FILE);
+
+		return false;
+	}
+
+	m_Data.LastSynth[sizeof m_Data.LastSynth - 1] = '\0';
+
+	if (m_Data.nLaunches != 0)
+	{
+		LOGNOTE ("%u launches (%u autoboot), last %u ms, %u..%u ms, average %u ms",
+			 m_Data.nLaunches, m_Data.nAutoBoots, m_Data.nLastLaunchTime,
+			 m_Data.nMinLaunchTime, m_Data.nMaxLaunchTime,
+			 m_Data.nTotalLaunchTime / m_Data.nLaunches);
+	}
+
+	return m_Data.LastSynth[0] != '\0';
+}
+
+bool CBootState::RecordLaunch (const char *pName, bool bAutoBoot, unsigned nLaunchTime)
+{
+	assert (pName);
+
+	if (strlen (pName) >= sizeof m_Data.LastSynth)
+	{
+		return false;
+	}
+
+	strcpy (m_Data.LastSynth, pName);
+
+	if (   m_Data.nLaunches == 0
+	    || nLaunchTime < m_Data.nMinLaunchTime)
+	{
+		m_Data.nMinLaunchTime = nLaunchTime;
+	}
+
+	if (nLaunchTime > m_Data.nMaxLaunchTime)
+	{
+		m_Data.nMaxLaunchTime = nLaunchTime;
+	}
+
+	m_Data.nLaunches++;
+	m_Data.nAutoBoots += bAutoBoot ? 1 : 0;
+	m_Data.nLastLaunchTime = nLaunchTime;
+	m_Data.nTotalLaunchTime += nLaunchTime;
+
+	if (   !m_bReady
+	    || !m_Log.Append (&m_Data, sizeof m_Data))
+	{
+		LOGWARN ("Cannot write %s", BOOT_STATE_FILE);
+
+		return false;
+	}
+
+	return true;
+}
+
+// the file is preallocated, contiguous if possible, its content is cleared
+// by CStateLog::Format()
+bool CBootState::Create (FIL *pFile)
+{
+	assert (pFile);
+
+	if (f_open (pFile, BOOT_STATE_FILE, FA_READ | FA_WRITE | FA_CREATE_ALWAYS) != FR_OK)
+	{
+		return false;
+	}
+
+#if FF_USE_EXPAND
+	if (f_expand (pFile, BOOT_STATE_SIZE, 1) == FR_OK)
+	{
+		return true;
+	}
+#endif
+
+	// no contiguous space, the clusters are allocated by writing
+	static const u8 Zero[STATE_LOG_SECTOR_SIZE] = {0};
+	for (unsigned i = 0; i < BOOT_STATE_SLOTS; i++)
+	{
+		UINT nWritten;
+		if (   f_write (pFile, Zero, sizeof Zero, &nWritten) != FR_OK
+		    || nWritten != sizeof Zero)
+		{
+			f_close (pFile);
+
+			return false;
+		}
+	}
+
+	if (f_sync (pFile) != FR_OK)
+	{
+		f_close (pFile);
+
+		return false;
+	}
+
+	return true;
+}
+
+bool CBootState::ReadHandler (unsigned nSector, unsigned nCount, void *pBuffer, void *pParam)
+{
+	CBootState *pThis = static_cast<CBootState *> (pParam);
+	assert (pThis);
+
+	// all slots with one multi-block read
+	if (pThis->m_bDirect)
+	{
+		return FileReadExtent (&pThis->m_Extent, nSector * STATE_LOG_SECTOR_SIZE, pBuffer,
+				       nCount * STATE_LOG_SECTOR_SIZE);
+	}
+
+	FIL File;
+	if (f_open (&File, BOOT_STATE_FILE, FA_READ | FA_OPEN_EXISTING) != FR_OK)
+	{
+		return false;
+	}
+
+	UINT nSize = nCount * STATE_LOG_SECTOR_SIZE;
+	UINT nRead;
+	bool bOK =    f_lseek (&File, nSector * STATE_LOG_SECTOR_SIZE) == FR_OK
+		   && f_read (&File, pBuffer, nSize, &nRead) == FR_OK
+		   && nRead == nSize;
+	f_close (&File);
+
+	return bOK;
+}
+
+bool CBootState::WriteHandler (unsigned nSector, const void *pBuffer, void *pParam)
+{
+	CBootState *pThis = static_cast<CBootState *> (pParam);
+	assert (pThis);
+
+	if (pThis->m_bDirect)
+	{
+		return disk_write (pThis->m_Extent.nDrive, static_cast<const BYTE *> (pBuffer),
+				   pThis->m_Extent.nFirstSector + nSector, 1) == RES_OK;
+	}
+
+	FIL File;
+	if (f_open (&File, BOOT_STATE_FILE, FA_WRITE | FA_OPEN_EXISTING) != FR_OK)
+	{
+		return false;
+	}
+
+	UINT nWritten;
+	bool bOK =    f_lseek (&File, nSector * STATE_LOG_SECTOR_SIZE) == FR_OK
+		   && f_write (&File, pBuffer, STATE_LOG_SECTOR_SIZE, &nWritten) == FR_OK
+		   && nWritten == STATE_LOG_SECTOR_SIZE;
+
+	if (f_close (&File) != FR_OK)
+	{
+		bOK = false;
+	}
+
+	return bOK;
+}
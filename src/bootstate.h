@@ -0,0 +1,65 @@
+// bootstate.h
+//
+// State of the boot menu, which is kept on the SD card across boots: the
+// synth launched last, which autoboot starts again, and statistics of the
+// launches. It is written on every launch, as a record of a CStateLog in a
+// preallocated file, which is accessed by its sectors directly, if it is
+// contiguous, so a launch writes one sector and no FAT or directory entry.
+//
+#pragma once
+
+#include <fatfs/ff.h>
+#include <circle/types.h>
+#include "statelog.h"
+#include "fileextent.h"
+#include "synthpack.h"
+
+#define BOOT_STATE_FILE		"SD:/bootstate.log"
+#define BOOT_STATE_SLOTS	16
+
+struct TBootStateData
+{
+	char LastSynth[SYNTH_PACK_NAME_MAX];	// "" if none
+	u32 nLaunches;
+	u32 nAutoBoots;
+	u32 nLastLaunchTime;			// ms from power-on to the synth being loaded
+	u32 nMinLaunchTime;
+	u32 nMaxLaunchTime;
+	u32 nTotalLaunchTime;			// of all launches, for the average
+};
+
+static_assert (sizeof (TBootStateData) <= STATE_LOG_DATA_MAX, "Boot state too large");
+
+class CBootState
+{
+public:
+	CBootState (void);
+
+	// returns false if there is no state yet
+	bool Load (void);
+
+	// "" if no synth has been launched yet
+	const char *GetLastSynth (void) const	{ return m_Data.LastSynth; }
+
+	const TBootStateData &GetData (void) const	{ return m_Data; }
+
+	// returns false if the state could not be written
+	bool RecordLaunch (const char *pName, bool bAutoBoot, unsigned nLaunchTime);
+
+private:
+	bool Create (FIL *pFile);
+
+	static bool ReadHandler (unsigned nSector, unsigned nCount, void *pBuffer, void *pParam);
+	static bool WriteHandler (unsigned nSector, const void *pBuffer, void *pParam);
+
+private:
+	TBootStateData m_Data;
+
+	CStateLog m_Log;
+	bool m_bReady;
+
+	// the file is contiguous and accessed by its sectors, otherwise it is
+	// accessed through FatFs
+	bool m_bDirect;
+	TFileExtent m_Extent;
+};
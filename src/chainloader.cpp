@@ -0,0 +1,504 @@
+// chainloader.cpp
+
+#include "chainloader.h"
+#include "fileextent.h"
+#include "crc32.h"
+#include "coresync.h"
+#include <circle/logger.h>
+#include <circle/memio.h>
+#include <circle/memorymap.h>
+#include <circle/synchronize.h>
+#include <circle/bcm2835.h>
+#include <circle/bcmpropertytags.h>
+#include <circle/timer.h>
+#include <fatfs/ff.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+LOGMODULE ("chainloader");
+
+volatile bool CChainLoader::s_bParkRequested = false;
+volatile u32 CChainLoader::s_nParkToken = 0;
+
+CChainLoader::CChainLoader (void)
+:	m_pStaging (nullptr),
+	m_nImageSize (0),
+	m_bCRCRequired (false)
+{
+	m_Name[0] = '\0';
+}
+
+CChainLoader::~CChainLoader (void)
+{
+	delete [] m_pStaging;
+	m_pStaging = nullptr;
+}
+
+bool CChainLoader::Load (const TSynthInfo *pSynth, TChainLoadCancelHandler *pCancelHandler,
+			 void *pCancelParam)
+{
+	assert (pSynth);
+	m_nImageSize = 0;
+	m_Name[0] = '\0';
+
+	char Path[64];
+	FIL File;
+	bool bCompressed;
+	size_t nSize = 0;
+	u32 nExpectedCRC = 0;
+	bool bHasCRC;				// nExpectedCRC is known
+	if (pSynth->bPacked)
+	{
+		// one seek to the image in the container
+		strcpy (Path, CHAINBOOT_PACK_NAME);
+
+		if (f_open (&File, Path, FA_READ | FA_OPEN_EXISTING) != FR_OK)
+		{
+			LOGERR ("Cannot open %s", Path);
+			return false;
+		}
+
+		if (f_lseek (&File, pSynth->nOffset) != FR_OK)
+		{
+			LOGERR ("%s: Cannot seek to %s", Path, pSynth->Name);
+			f_close (&File);
+			return false;
+		}
+
+		bCompressed = !!(pSynth->nFlags & SYNTH_PACK_COMPRESSED);
+		nSize = pSynth->nSize;
+
+		// 0 is unknown
+		nExpectedCRC = pSynth->nImageCRC;
+		bHasCRC = nExpectedCRC != 0;
+	}
+	else
+	{
+		// a compressed image is preferred
+		snprintf (Path, sizeof Path, "SD:/%s/" CHAINBOOT_IMAGE_NAME CHAINBOOT_PACKED_SUFFIX,
+			  pSynth->Name);
+
+		bCompressed = f_open (&File, Path, FA_READ | FA_OPEN_EXISTING) == FR_OK;
+		bHasCRC = false;		// the header of a compressed image has it
+		if (!bCompressed)
+		{
+			snprintf (Path, sizeof Path, "SD:/%s/" CHAINBOOT_IMAGE_NAME, pSynth->Name);
+
+			if (!ReadCRCFile (Path, &nExpectedCRC, &bHasCRC))
+			{
+				return false;
+			}
+
+			if (f_open (&File, Path, FA_READ | FA_OPEN_EXISTING) != FR_OK)
+			{
+				LOGERR ("Cannot open %s", Path);
+				return false;
+			}
+		}
+
+		nSize = f_size (&File);
+	}
+
+	if (!bCompressed && !bHasCRC && m_bCRCRequired)
+	{
+		LOGERR ("%s: %s: Image has no CRC", Path, pSynth->Name);
+		f_close (&File);
+		return false;
+	}
+
+	if (m_pStaging == nullptr)
+	{
+		// the heap starts above the kernel region, so the staging buffer
+		// never overlaps the relocation target
+		m_pStaging = new u8[KERNEL_MAX_SIZE];
+		assert (m_pStaging);
+		assert (((uintptr) m_pStaging & 15) == 0);
+	}
+
+	unsigned nStart = CTimer::GetClockTicks ();
+
+	u32 nCRC = 0;
+	bool bOK = bCompressed ? ReadCompressed (&File, Path, &nSize, &nCRC, pCancelHandler, pCancelParam)
+			       : ReadRaw (&File, Path, nSize, &nCRC, pCancelHandler, pCancelParam);
+	f_close (&File);
+	if (!bOK)
+	{
+		return false;
+	}
+
+	if (pSynth->bPacked && nSize != pSynth->nImageSize)
+	{
+		LOGERR ("%s: %s: Image size does not match the index", Path, pSynth->Name);
+		return false;
+	}
+
+	// ReadCompressed() has checked the CRC of its header already
+	if (   bHasCRC
+	    && nCRC != nExpectedCRC)
+	{
+		LOGERR ("%s: %s: Image is corrupt (CRC %08X, expected %08X)", Path, pSynth->Name,
+			nCRC, nExpectedCRC);
+		return false;
+	}
+	bool bVerified = bCompressed || bHasCRC;
+
+	// ChainBootRelocate() copies in 16 byte units
+	memset (m_pStaging + nSize, 0, ((nSize + 15) & ~15) - nSize);
+
+	unsigned nTime = CTimer::GetClockTicks () - nStart;
+	LOGNOTE ("%s: %s: %u bytes loaded in %u ms%s", Path, pSynth->Name, (unsigned) nSize,
+		 nTime / 1000, bVerified ? ", CRC OK" : "");
+
+	strncpy (m_Name, pSynth->Name, sizeof m_Name - 1);
+	m_Name[sizeof m_Name - 1] = '\0';
+	m_nImageSize = nSize;
+
+	return true;
+}
+
+// reads nSize bytes from the current position
+bool CChainLoader::ReadRaw (FIL *pFile, const char *pPath, size_t nSize, u32 *pCRC,
+			    TChainLoadCancelHandler *pCancelHandler, void *pCancelParam)
+{
+	*pCRC = 0;
+
+	if (nSize == 0 || nSize > KERNEL_MAX_SIZE)
+	{
+		LOGERR ("%s: Invalid image size (%u bytes)", pPath, (unsigned) nSize);
+		return false;
+	}
+
+	// a contiguous image is read with large multi-block requests straight
+	// into the staging buffer, in whole sectors, which fit, because
+	// KERNEL_MAX_SIZE is a multiple of the sector size
+	static_assert (KERNEL_MAX_SIZE % FILE_EXTENT_SECTOR_SIZE == 0, "Staging buffer too small");
+	TFileExtent Extent;
+	FSIZE_t nBase = f_tell (pFile);
+	if (FileGetExtent (pFile, nBase, nSize, &Extent))
+	{
+		for (size_t nOffset = 0; nOffset < nSize; nOffset += CHAINLOAD_DIRECT_CHUNK_SIZE)
+		{
+			if (   pCancelHandler != 0
+			    && (*pCancelHandler) (pCancelParam))
+			{
+				return false;
+			}
+
+			size_t nChunk = nSize - nOffset < CHAINLOAD_DIRECT_CHUNK_SIZE
+				      ? nSize - nOffset : CHAINLOAD_DIRECT_CHUNK_SIZE;
+			if (!FileReadExtent (&Extent, nOffset, m_pStaging + nOffset, nChunk))
+			{
+				LOGERR ("%s: Read failed", pPath);
+				return false;
+			}
+
+			*pCRC = CRC32Update (*pCRC, m_pStaging + nOffset, nChunk);
+		}
+
+		return true;
+	}
+
+	LOGWARN ("%s: Image is fragmented", pPath);
+
+	if (f_lseek (pFile, nBase) != FR_OK)
+	{
+		LOGERR ("%s: Cannot seek", pPath);
+		return false;
+	}
+
+	for (size_t nOffset = 0; nOffset < nSize; nOffset += CHAINLOAD_CHUNK_SIZE)
+	{
+		if (   pCancelHandler != 0
+		    && (*pCancelHandler) (pCancelParam))
+		{
+			return false;
+		}
+
+		UINT nChunk = nSize - nOffset < CHAINLOAD_CHUNK_SIZE ? nSize - nOffset
+								    : CHAINLOAD_CHUNK_SIZE;
+		UINT nRead = 0;
+		FRESULT Result = f_read (pFile, m_pStaging + nOffset, nChunk, &nRead);
+		if (Result != FR_OK || nRead != nChunk)
+		{
+			LOGERR ("%s: Read failed (%d)", pPath, (int) Result);
+			return false;
+		}
+
+		*pCRC = CRC32Update (*pCRC, m_pStaging + nOffset, nChunk);
+	}
+
+	return true;
+}
+
+// reads the image from the current position, each chunk is decoded by
+// m_Decoder, while the next one is read, and the CRC of the decoded image
+// is checked against the header
+bool CChainLoader::ReadCompressed (FIL *pFile, const char *pPath, size_t *pSize, u32 *pCRC,
+				   TChainLoadCancelHandler *pCancelHandler, void *pCancelParam)
+{
+	FSIZE_t nBase = f_tell (pFile);
+
+	TSynthImageHeader Header;
+	UINT nRead = 0;
+	if (   f_read (pFile, &Header, sizeof Header, &nRead) != FR_OK
+	    || nRead != sizeof Header
+	    || Header.nMagic != SYNTH_IMAGE_MAGIC
+	    || Header.nVersion != SYNTH_IMAGE_VERSION
+	    || Header.nHeaderSize < sizeof Header
+	    || Header.nChunkSize != SYNTH_IMAGE_CHUNK_SIZE
+	    || Header.nImageSize == 0
+	    || Header.nImageSize > KERNEL_MAX_SIZE
+	    || Header.nChunks != (Header.nImageSize + SYNTH_IMAGE_CHUNK_SIZE - 1) / SYNTH_IMAGE_CHUNK_SIZE)
+	{
+		LOGERR ("%s: Invalid header", pPath);
+		return false;
+	}
+
+	u32 ChunkSize[CHAINLOAD_MAX_CHUNKS];
+	UINT nTableSize = Header.nChunks * sizeof (u32);
+	if (   f_lseek (pFile, nBase + Header.nHeaderSize) != FR_OK
+	    || f_read (pFile, ChunkSize, nTableSize, &nRead) != FR_OK
+	    || nRead != nTableSize)
+	{
+		LOGERR ("%s: Cannot read chunk table", pPath);
+		return false;
+	}
+
+	bool bOK = true;
+	for (unsigned nChunk = 0; bOK && nChunk < Header.nChunks; nChunk++)
+	{
+		if (   pCancelHandler != 0
+		    && (*pCancelHandler) (pCancelParam))
+		{
+			bOK = false;
+			break;
+		}
+
+		size_t nOffset = nChunk * SYNTH_IMAGE_CHUNK_SIZE;
+		size_t nDestSize = Header.nImageSize - nOffset < SYNTH_IMAGE_CHUNK_SIZE
+				 ? Header.nImageSize - nOffset : SYNTH_IMAGE_CHUNK_SIZE;
+
+		bool bStored = !!(ChunkSize[nChunk] & SYNTH_IMAGE_STORED);
+		UINT nSize = ChunkSize[nChunk] & ~SYNTH_IMAGE_STORED;
+		if (nSize > SYNTH_IMAGE_CHUNK_SIZE)
+		{
+			LOGERR ("%s: Invalid chunk size", pPath);
+			bOK = false;
+			break;
+		}
+
+		u8 *pBuffer = m_Decoder.GetBuffer ();
+
+		FRESULT Result = f_read (pFile, pBuffer, nSize, &nRead);
+		if (Result != FR_OK || nRead != nSize)
+		{
+			LOGERR ("%s: Read failed (%d)", pPath, (int) Result);
+			bOK = false;
+			break;
+		}
+
+		m_Decoder.Submit (pBuffer, nSize, bStored, m_pStaging + nOffset, nDestSize);
+	}
+
+	// the staging buffer must not be written any more, when we return
+	if (!m_Decoder.Flush (pCRC) && bOK)
+	{
+		LOGERR ("%s: Invalid compressed data", pPath);
+		bOK = false;
+	}
+
+	if (   bOK
+	    && Header.nImageCRC == 0
+	    && m_bCRCRequired)
+	{
+		LOGERR ("%s: Image has no CRC", pPath);
+		bOK = false;
+	}
+
+	if (   bOK
+	    && Header.nImageCRC != 0
+	    && *pCRC != Header.nImageCRC)
+	{
+		LOGERR ("%s: Image is corrupt (CRC %08X, expected %08X)", pPath, *pCRC,
+			Header.nImageCRC);
+		bOK = false;
+	}
+
+	*pSize = Header.nImageSize;
+
+	return bOK;
+}
+
+bool CChainLoader::ReadCRCFile (const char *pPath, u32 *pCRC, bool *pFound)
+{
+	*pFound = false;
+
+	char CRCPath[64 + sizeof CHAINBOOT_CRC_SUFFIX];
+	snprintf (CRCPath, sizeof CRCPath, "%s" CHAINBOOT_CRC_SUFFIX, pPath);
+
+	FIL File;
+	if (f_open (&File, CRCPath, FA_READ | FA_OPEN_EXISTING) != FR_OK)
+	{
+		return true;
+	}
+
+	// 8 hex digits, anything after them (a file name) is ignored
+	char Text[8];
+	UINT nRead = 0;
+	bool bValid =    f_read (&File, Text, sizeof Text, &nRead) == FR_OK
+		      && nRead == sizeof Text;
+	f_close (&File);
+
+	u32 nCRC = 0;
+	for (unsigned i = 0; bValid && i < sizeof Text; i++)
+	{
+		char chDigit = Text[i];
+		if ('0' <= chDigit && chDigit <= '9')
+		{
+			nCRC = nCRC << 4 | (chDigit - '0');
+		}
+		else if ('a' <= (chDigit | 0x20) && (chDigit | 0x20) <= 'f')
+		{
+			nCRC = nCRC << 4 | ((chDigit | 0x20) - 'a' + 10);
+		}
+		else
+		{
+			bValid = false;
+		}
+	}
+
+	if (!bValid)
+	{
+		LOGERR ("%s: Invalid CRC", CRCPath);
+		return false;
+	}
+
+	*pCRC = nCRC;
+	*pFound = true;
+
+	return true;
+}
+
+bool CChainLoader::IsLoaded (const TSynthInfo *pSynth) const
+{
+	assert (pSynth);
+
+	return IsLoaded () && strcmp (m_Name, pSynth->Name) == 0;
+}
+
+void CChainLoader::Boot (unsigned nSecondaryCores)
+{
+	assert (nSecondaryCores < CORES);
+
+	if (!IsLoaded ())
+	{
+		return;
+	}
+
+#if AARCH == 64 && RASPPI <= 4
+	if (!WaitForParkedCores (nSecondaryCores))
+	{
+		return;
+	}
+
+	LOGNOTE ("Starting image at 0x%lX", (unsigned long) MEM_KERNEL_START);
+
+	// armstub8 passes the device tree address in x0, do the same
+	uintptr nDTB = read32 (CHAINBOOT_DTB_PTR);
+
+	Quiesce ();
+
+	// the image and everything else we wrote must be in memory, before
+	// the caches are switched off
+	CleanDataCache ();
+	InvalidateInstructionCache ();
+
+	ChainBootRelocate (MEM_KERNEL_START, (uintptr) m_pStaging, (m_nImageSize + 15) & ~15,
+			   nDTB, CHAINBOOT_PARK_PAGE);
+#else
+	LOGERR ("Chainloading is not supported on this model");
+#endif
+}
+
+void CChainLoader::ParkCore (unsigned nCore)
+{
+	assert (1 <= nCore && nCore < CORES);
+	assert (s_bParkRequested);
+
+#if AARCH == 64
+	DisableIRQs ();
+	DisableFIQs ();
+
+	CleanDataCache ();
+
+	ChainBootPark (CHAINBOOT_SPIN_TABLE + 8 * nCore, CHAINBOOT_PARK_ACK + 4 * nCore,
+		       s_nParkToken, CHAINBOOT_PARK_PAGE + CHAINBOOT_SLOT_SIZE * nCore);
+#else
+	for (;;)
+	{
+		asm volatile ("wfi");
+	}
+#endif
+}
+
+bool CChainLoader::WaitForParkedCores (unsigned nSecondaryCores)
+{
+	// the ack words are written with the MMU off, so we look for a fresh
+	// token rather than clearing them first
+	s_nParkToken = CTimer::GetClockTicks () | 1;
+	DataSyncBarrier ();
+	s_bParkRequested = true;
+	CoreSendEvent ();
+
+	unsigned nStart = CTimer::GetClockTicks ();
+	for (unsigned nCore = 1; nCore <= nSecondaryCores; nCore++)
+	{
+		uintptr nAck = CHAINBOOT_PARK_ACK + 4 * nCore;
+
+		for (;;)
+		{
+			CleanAndInvalidateDataCacheRange (nAck, sizeof (u32));
+			if (read32 (nAck) == s_nParkToken)
+			{
+				break;
+			}
+
+			if (CTimer::GetClockTicks () - nStart > CHAINBOOT_PARK_TIMEOUT)
+			{
+				LOGERR ("Core %u did not park", nCore);
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+void CChainLoader::Quiesce (void)
+{
+	DisableIRQs ();
+	DisableFIQs ();
+
+#if RASPPI <= 3
+	// the DWHCI controller would continue DMA into our memory
+	CBcmPropertyTags Tags;
+	TPropertyTagPowerState PowerState;
+	PowerState.nDeviceId = DEVICE_ID_USB_HCD;
+	PowerState.nState = POWER_STATE_OFF | POWER_STATE_WAIT;
+	Tags.GetTag (PROPTAG_SET_POWER_STATE, &PowerState, sizeof PowerState, 8);
+
+	write32 (ARM_IC_FIQ_CONTROL, 0);
+	write32 (ARM_IC_DISABLE_IRQS_1, (u32) -1);
+	write32 (ARM_IC_DISABLE_IRQS_2, (u32) -1);
+	write32 (ARM_IC_DISABLE_BASIC_IRQS, (u32) -1);
+#else
+	// the xHCI controller is reset by the next kernel via PCIe
+	write32 (ARM_GICD_BASE + 0x000, 0);			// GICD_CTLR
+	for (unsigned n = 0; n < 8; n++)
+	{
+		write32 (ARM_GICD_BASE + 0x180 + 4 * n, (u32) -1);	// GICD_ICENABLERn
+	}
+	write32 (ARM_GICC_BASE + 0x000, 0);			// GICC_CTLR
+#endif
+}
@@ -0,0 +1,130 @@
+// chainloader.h
+//
+// Loads a synth kernel image from the SD card and starts it in place of the
+// running boot menu, without going through a firmware reboot.
+//
+// The image is read into a staging buffer on the heap (which lies above
+// MEM_KERNEL_START + KERNEL_MAX_SIZE, so it is never overlapped by the new
+// kernel). A raw image, which is stored contiguously, is read by its
+// sectors with large multi-block requests (see fileextent.h). The CRC-32 of
+// the image is updated after each chunk, while the chunk is still in the
+// cache, and is checked against the CRC of the container index or of the
+// compressed image, so a corrupt image is rejected without another pass.
+// A raw image in a synth directory is checked against the CRC in the file
+// next to it with CHAINBOOT_CRC_SUFFIX (8 hex digits), if there is one.
+// Images without a CRC are rejected, if SetCRCRequired() was called.
+//
+// Boot() parks the secondary cores, quiesces the interrupt sources and
+// calls ChainBootRelocate(), which switches the MMU and caches off, moves
+// itself to CHAINBOOT_PARK_PAGE below the kernel load address, relocates the
+// image to MEM_KERNEL_START and jumps to it. Parked secondary cores poll the
+// armstub spin table from the same page, so the new kernel can start them
+// like the firmware would.
+//
+// ChainBootRelocate() and ChainBootPark() are the only target specific steps.
+// A host build may replace them to check the staged image and the parking
+// handshake.
+//
+#pragma once
+
+#include <circle/types.h>
+#include <circle/sysconfig.h>
+#include <fatfs/ff.h>
+#include "chunkdecoder.h"
+#include "synthimage.h"
+#include "synthcatalog.h"
+
+#define CHAINBOOT_PARK_PAGE	0x7F000		// trampoline slots, not used by Circle
+#define CHAINBOOT_SLOT_SIZE	0x100		// one slot per core
+#define CHAINBOOT_PARK_ACK	(CHAINBOOT_PARK_PAGE + 0xF00)	// one word per core
+#define CHAINBOOT_SPIN_TABLE	0xD8		// armstub8 spin_cpu0..3 mailboxes
+#define CHAINBOOT_DTB_PTR	0xF8		// armstub8 dtb_ptr32
+#define CHAINBOOT_PARK_TIMEOUT	100000		// us to wait for secondary cores
+
+#define CHAINLOAD_CHUNK_SIZE	0x10000		// read unit, Load() can be cancelled in between
+#define CHAINLOAD_DIRECT_CHUNK_SIZE 0x40000	// read unit of a contiguous raw image
+#define CHAINLOAD_NAME_MAX	32
+#define CHAINLOAD_MAX_CHUNKS	((KERNEL_MAX_SIZE + SYNTH_IMAGE_CHUNK_SIZE - 1) / SYNTH_IMAGE_CHUNK_SIZE)
+
+#define CHAINBOOT_PACKED_SUFFIX	".lz4"		// see synthimage.h
+#define CHAINBOOT_CRC_SUFFIX	".crc"		// CRC-32 of a raw image in hex
+
+#if RASPPI == 5
+	#define CHAINBOOT_IMAGE_NAME	"kernel_2712.img"
+	#define CHAINBOOT_PACK_NAME	"SD:/synths_2712.pak"
+#elif RASPPI == 4
+	#define CHAINBOOT_IMAGE_NAME	"kernel8-rpi4.img"
+	#define CHAINBOOT_PACK_NAME	"SD:/synths8-rpi4.pak"
+#else
+	#define CHAINBOOT_IMAGE_NAME	"kernel8.img"
+	#define CHAINBOOT_PACK_NAME	"SD:/synths8.pak"
+#endif
+
+// implemented in chainboot.S
+extern "C" void ChainBootRelocate (uintptr nDest, uintptr nSource, size_t nSize,
+				   uintptr nDTB, uintptr nSlot) __attribute__ ((noreturn));
+extern "C" void ChainBootPark (uintptr nMailbox, uintptr nAck, u32 nToken,
+			       uintptr nSlot) __attribute__ ((noreturn));
+
+// returns true to abort a running Load()
+typedef bool TChainLoadCancelHandler (void *pParam);
+
+class CChainLoader
+{
+public:
+	CChainLoader (void);
+	~CChainLoader (void);
+
+	// Load() rejects images, which have no CRC
+	void SetCRCRequired (bool bRequired)	{ m_bCRCRequired = bRequired; }
+
+	// reads the image of pSynth from CHAINBOOT_PACK_NAME or from
+	// "SD:/<name>/" CHAINBOOT_IMAGE_NAME (or the compressed image with
+	// CHAINBOOT_PACKED_SUFFIX, if present) into the staging buffer,
+	// pCancelHandler is polled between chunks; may run on a secondary core
+	bool Load (const TSynthInfo *pSynth, TChainLoadCancelHandler *pCancelHandler = 0,
+		   void *pCancelParam = 0);
+
+	bool IsLoaded (void) const	{ return m_nImageSize != 0; }
+	bool IsLoaded (const TSynthInfo *pSynth) const;
+	size_t GetImageSize (void) const { return m_nImageSize; }
+
+	// quiesces the system, waits until nSecondaryCores have called ParkCore()
+	// and starts the loaded image on all cores; returns only on failure,
+	// before anything has been touched that prevents a normal reboot
+	void Boot (unsigned nSecondaryCores);
+
+	// to be called on each secondary core (1..CORES-1) once Boot() requested
+	// it, does not return
+	static void ParkCore (unsigned nCore);
+
+	static bool IsParkRequested (void)	{ return s_bParkRequested; }
+
+	// its task may be started on an idle core to overlap decoding and reading
+	CChunkDecoder *GetDecoder (void)	{ return &m_Decoder; }
+
+private:
+	// *pCRC is set to the CRC-32 of the image
+	bool ReadRaw (FIL *pFile, const char *pPath, size_t nSize, u32 *pCRC,
+		      TChainLoadCancelHandler *pCancelHandler, void *pCancelParam);
+	bool ReadCompressed (FIL *pFile, const char *pPath, size_t *pSize, u32 *pCRC,
+			     TChainLoadCancelHandler *pCancelHandler, void *pCancelParam);
+
+	// reads the CRC file of the raw image pPath, *pFound is false, if there
+	// is none, returns false, if it is invalid
+	static bool ReadCRCFile (const char *pPath, u32 *pCRC, bool *pFound);
+
+	static bool WaitForParkedCores (unsigned nSecondaryCores);
+	static void Quiesce (void);
+
+private:
+	u8 *m_pStaging;
+	size_t m_nImageSize;
+	char m_Name[CHAINLOAD_NAME_MAX];	// of the loaded synth
+	bool m_bCRCRequired;
+
+	CChunkDecoder m_Decoder;
+
+	static volatile bool s_bParkRequested;
+	static volatile u32 s_nParkToken;
+};
@@ -0,0 +1,151 @@
+// chunkdecoder.cpp
+
+#include "chunkdecoder.h"
+#include "chainloader.h"
+#include "lz4.h"
+#include "crc32.h"
+#include "coresync.h"
+#include <string.h>
+#include <assert.h>
+
+CChunkDecoder::CChunkDecoder (void)
+:	m_nNextIn (0),
+	m_nNextOut (0),
+	m_bError (false),
+	m_nCRC (0),
+	m_bRunning (false)
+{
+	m_Slot[0].bFull = false;
+	m_Slot[1].bFull = false;
+}
+
+void CChunkDecoder::TaskHandler (void *pParam)
+{
+	CChunkDecoder *pThis = static_cast<CChunkDecoder *> (pParam);
+	assert (pThis != 0);
+
+	pThis->Run ();
+}
+
+u8 *CChunkDecoder::GetBuffer (void)
+{
+	TSlot *pSlot = &m_Slot[m_nNextIn];
+
+	while (__atomic_load_n (&pSlot->bFull, __ATOMIC_ACQUIRE))
+	{
+		CoreWaitForEvent ();
+	}
+
+	return pSlot->Buffer;
+}
+
+void CChunkDecoder::Submit (u8 *pBuffer, size_t nSize, bool bStored, u8 *pDest, size_t nDestSize)
+{
+	TSlot *pSlot = &m_Slot[m_nNextIn];
+	assert (pBuffer == pSlot->Buffer);
+	assert (nSize <= SYNTH_IMAGE_CHUNK_SIZE);
+	assert (!pSlot->bFull);
+
+	pSlot->nSize = nSize;
+	pSlot->bStored = bStored;
+	pSlot->pDest = pDest;
+	pSlot->nDestSize = nDestSize;
+
+	if (!IsRunning ())
+	{
+		DecodeSlot (pSlot);
+
+		return;
+	}
+
+	__atomic_store_n (&pSlot->bFull, true, __ATOMIC_RELEASE);
+	m_nNextIn ^= 1;
+
+	CoreSendEvent ();
+}
+
+bool CChunkDecoder::Flush (u32 *pCRC)
+{
+	for (unsigned i = 0; i < 2; i++)
+	{
+		while (__atomic_load_n (&m_Slot[i].bFull, __ATOMIC_ACQUIRE))
+		{
+			CoreWaitForEvent ();
+		}
+	}
+
+	bool bOK = !m_bError;
+	m_bError = false;
+
+	if (pCRC != 0)
+	{
+		*pCRC = m_nCRC;
+	}
+	m_nCRC = 0;
+
+	return bOK;
+}
+
+bool CChunkDecoder::IsRunning (void) const
+{
+	return __atomic_load_n (&m_bRunning, __ATOMIC_ACQUIRE);
+}
+
+bool CChunkDecoder::Decode (const TSlot *pSlot)
+{
+	if (pSlot->bStored)
+	{
+		if (pSlot->nSize != pSlot->nDestSize)
+		{
+			return false;
+		}
+
+		memcpy (pSlot->pDest, pSlot->Buffer, pSlot->nSize);
+
+		return true;
+	}
+
+	int nResult = LZ4Decompress (pSlot->Buffer, pSlot->nSize, pSlot->pDest, pSlot->nDestSize);
+
+	return nResult >= 0 && (size_t) nResult == pSlot->nDestSize;
+}
+
+// the chunks are decoded in order, so the CRC of the image can be continued
+void CChunkDecoder::DecodeSlot (const TSlot *pSlot)
+{
+	if (!Decode (pSlot))
+	{
+		m_bError = true;
+
+		return;
+	}
+
+	m_nCRC = CRC32Update (m_nCRC, pSlot->pDest, pSlot->nDestSize);
+}
+
+void CChunkDecoder::Run (void)
+{
+	__atomic_store_n (&m_bRunning, true, __ATOMIC_RELEASE);
+
+	// the loader is done before the cores are parked, so there is no
+	// submitted chunk left then
+	while (!CChainLoader::IsParkRequested ())
+	{
+		TSlot *pSlot = &m_Slot[m_nNextOut];
+		if (!__atomic_load_n (&pSlot->bFull, __ATOMIC_ACQUIRE))
+		{
+			CoreWaitForEvent ();
+
+			continue;
+		}
+
+		DecodeSlot (pSlot);
+
+		__atomic_store_n (&pSlot->bFull, false, __ATOMIC_RELEASE);
+		m_nNextOut ^= 1;
+
+		CoreSendEvent ();
+	}
+
+	__atomic_store_n (&m_bRunning, false, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,62 @@
+// chunkdecoder.h
+//
+// Decodes the chunks of a compressed synth image, while the loader reads
+// the next chunk from the SD card. The loader fills one of two input
+// buffers and submits it; the decoder task on a secondary core decodes it
+// into the staging buffer and frees it again. Without the task (not
+// started yet, single core) Submit() decodes the chunk itself.
+//
+// There is one loader at a time (core 0 or the prefetcher).
+//
+#pragma once
+
+#include <circle/types.h>
+#include "synthimage.h"
+
+class CChunkDecoder
+{
+public:
+	CChunkDecoder (void);
+
+	// TMenuCoreTask, pParam is the CChunkDecoder
+	static void TaskHandler (void *pParam);
+
+	// loader side: returns a free input buffer of SYNTH_IMAGE_CHUNK_SIZE
+	// bytes, waits for the decoder if required
+	u8 *GetBuffer (void);
+
+	// decodes the buffer from GetBuffer() into nDestSize bytes at pDest
+	void Submit (u8 *pBuffer, size_t nSize, bool bStored, u8 *pDest, size_t nDestSize);
+
+	// waits until all submitted chunks are decoded, returns false if one
+	// of them was invalid since the last call, *pCRC is set to the CRC-32
+	// of the data decoded since the last call
+	bool Flush (u32 *pCRC = 0);
+
+	bool IsRunning (void) const;
+
+private:
+	struct TSlot
+	{
+		u8 Buffer[SYNTH_IMAGE_CHUNK_SIZE];
+		size_t nSize;
+		bool bStored;
+		u8 *pDest;
+		size_t nDestSize;
+		volatile bool bFull;
+	};
+
+	static bool Decode (const TSlot *pSlot);
+	void DecodeSlot (const TSlot *pSlot);
+
+	void Run (void);
+
+private:
+	TSlot m_Slot[2];
+	unsigned m_nNextIn;			// owned by the loader
+	unsigned m_nNextOut;			// owned by the decoder
+
+	volatile bool m_bError;
+	u32 m_nCRC;				// written by the decoder, read after Flush()
+	volatile bool m_bRunning;
+};
@@ -0,0 +1,142 @@
+// configcache.cpp
+
+#include "configcache.h"
+#include <Properties/propertiesfatfsfile.h>
+#include "asynclog.h"
+#include <assert.h>
+
+LOGMODULE ("config");
+
+CConfigCache::CConfigCache (FATFS *pFileSystem)
+:	m_pFileSystem (pFileSystem),
+	m_bFromCache (false)
+{
+	assert (m_pFileSystem);
+}
+
+bool CConfigCache::Load (void)
+{
+	TBootConfigStamp Stamps[BootConfigFileCount];
+	bool bStamps = GetStamps (Stamps);
+
+	m_bFromCache = bStamps && ReadCache (Stamps);
+	if (m_bFromCache)
+	{
+		return true;
+	}
+
+	if (!ParseFiles ())
+	{
+		return false;
+	}
+
+	if (bStamps)
+	{
+		BootConfigSeal (&m_Cache, Stamps);
+		WriteCache ();
+	}
+
+	return true;
+}
+
+bool CConfigCache::GetStamps (TBootConfigStamp *pStamps) const
+{
+	for (unsigned nFile = 0; nFile < BootConfigFileCount; nFile++)
+	{
+		FILINFO Info;
+		if (f_stat (BootConfigGetFileName (nFile), &Info) != FR_OK)
+		{
+			return false;
+		}
+
+		pStamps[nFile].nSize = Info.fsize;
+		pStamps[nFile].nDate = Info.fdate;
+		pStamps[nFile].nTime = Info.ftime;
+	}
+
+	return true;
+}
+
+bool CConfigCache::ReadCache (const TBootConfigStamp *pStamps)
+{
+	FIL File;
+	if (f_open (&File, CONFIG_CACHE_FILE, FA_READ | FA_OPEN_EXISTING) != FR_OK)
+	{
+		return false;
+	}
+
+	UINT nRead;
+	FRESULT Result = f_read (&File, &m_Cache, sizeof m_Cache, &nRead);
+	f_close (&File);
+
+	if (   Result != FR_OK
+	    || nRead != sizeof m_Cache
+	    || !BootConfigIsValid (&m_Cache, pStamps))
+	{
+		LOGNOTE ("Config cache is outdated");
+
+		return false;
+	}
+
+	return true;
+}
+
+// one pass over the entries of each file, problems are reported but do not
+// stop the boot, the default is used instead
+bool CConfigCache::ParseFiles (void)
+{
+	BootConfigSetDefaults (&m_Cache.Config);
+
+	for (unsigned nFile = 0; nFile < BootConfigFileCount; nFile++)
+	{
+		const char *pFileName = BootConfigGetFileName (nFile);
+
+		CPropertiesFatFsFile Properties (pFileName, m_pFileSystem);
+		if (!Properties.Load ())
+		{
+			LOGERR ("Failed to load %s", pFileName);
+
+			return false;
+		}
+
+		for (bool bValid = Properties.SelectFirst (); bValid; bValid = Properties.SelectNext ())
+		{
+			const char *pKey = Properties.GetName ();
+			const char *pValue = Properties.GetValue ();
+
+			TBootConfigResult Result = BootConfigSet (&m_Cache.Config, nFile, pKey, pValue);
+			if (Result == BootConfigMisspelledKey)
+			{
+				LOGWARN ("%s: %s: Did you mean %s?", pFileName, pKey,
+					 BootConfigGetSimilarKey (pKey));
+			}
+			else if (Result != BootConfigOK && Result != BootConfigIgnored)
+			{
+				LOGWARN ("%s: %s=%s: %s", pFileName, pKey, pValue,
+					 BootConfigGetResultText (Result));
+			}
+		}
+	}
+
+	return true;
+}
+
+void CConfigCache::WriteCache (void) const
+{
+	FIL File;
+	if (f_open (&File, CONFIG_CACHE_FILE, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK)
+	{
+		LOGWARN ("Cannot create %s", CONFIG_CACHE_FILE);
+
+		return;
+	}
+
+	UINT nWritten;
+	if (   f_write (&File, &m_Cache, sizeof m_Cache, &nWritten) != FR_OK
+	    || nWritten != sizeof m_Cache)
+	{
+		LOGWARN ("Cannot write %s", CONFIG_CACHE_FILE);
+	}
+
+	f_close (&File);
+}
@@ -0,0 +1,40 @@
+// configcache.h
+//
+// Loads the TBootConfig of the boot menu. It is read from the config cache
+// on the SD card, if this is valid for the current synth.ini and
+// minidexed.ini. Otherwise both ini files are parsed and the cache is
+// written again for the next boot.
+//
+#pragma once
+
+#include <fatfs/ff.h>
+#include <circle/types.h>
+#include "bootconfig.h"
+
+#define CONFIG_CACHE_FILE	"config.bin"
+
+class CConfigCache
+{
+public:
+	CConfigCache (FATFS *pFileSystem);
+
+	// returns false if the ini files could not be loaded
+	bool Load (void);
+
+	const TBootConfig &Get (void) const	{ return m_Cache.Config; }
+
+	// the last Load() did not need to parse the ini files
+	bool IsFromCache (void) const		{ return m_bFromCache; }
+
+private:
+	bool GetStamps (TBootConfigStamp *pStamps) const;
+	bool ReadCache (const TBootConfigStamp *pStamps);
+	bool ParseFiles (void);
+	void WriteCache (void) const;
+
+private:
+	FATFS *m_pFileSystem;
+
+	TBootConfigCache m_Cache;
+	bool m_bFromCache;
+};
@@ -0,0 +1,18 @@
+// coresync.h
+//
+// The hints, with which the cores of the boot menu wait for each other: a
+// core, which waits for a flag, sleeps in CoreWaitForEvent() or spins with
+// CoreYield(), the core, which sets the flag, wakes it with CoreSendEvent().
+// On the host (tools) and on the single core ARMv6 the waits just spin.
+//
+#pragma once
+
+#if defined (__aarch64__) || (defined (__arm__) && __ARM_ARCH >= 7)
+	#define CoreSendEvent()		asm volatile ("dsb sy; sev" ::: "memory")
+	#define CoreWaitForEvent()	asm volatile ("wfe" ::: "memory")
+	#define CoreYield()		asm volatile ("yield" ::: "memory")
+#else
+	#define CoreSendEvent()		__atomic_thread_fence (__ATOMIC_SEQ_CST)
+	#define CoreWaitForEvent()	__atomic_signal_fence (__ATOMIC_SEQ_CST)
+	#define CoreYield()		__atomic_signal_fence (__ATOMIC_SEQ_CST)
+#endif
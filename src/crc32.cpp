@@ -0,0 +1,113 @@
+// crc32.cpp
+
+#include "crc32.h"
+#include <string.h>
+
+#ifdef CRC32_HARDWARE
+	#include <arm_acle.h>
+#endif
+
+#define CRC32_POLYNOMIAL	0xEDB88320U
+
+// Table.Entry[0] is the table of the bytewise CRC, Table.Entry[n] advances
+// it over n more zero bytes, so 8 bytes are looked up independently. It is
+// built at compile time, so the cores never race to build it.
+struct TCRC32Table
+{
+	uint32_t Entry[8][256];
+};
+
+static constexpr TCRC32Table BuildTable (void)
+{
+	TCRC32Table Table {};
+	for (uint32_t i = 0; i < 256; i++)
+	{
+		uint32_t nValue = i;
+		for (unsigned j = 0; j < 8; j++)
+		{
+			nValue = (nValue >> 1) ^ (nValue & 1 ? CRC32_POLYNOMIAL : 0);
+		}
+
+		Table.Entry[0][i] = nValue;
+	}
+
+	for (uint32_t i = 0; i < 256; i++)
+	{
+		for (unsigned n = 1; n < 8; n++)
+		{
+			uint32_t nPrev = Table.Entry[n-1][i];
+			Table.Entry[n][i] = Table.Entry[0][nPrev & 0xFF] ^ (nPrev >> 8);
+		}
+	}
+
+	return Table;
+}
+
+static constexpr TCRC32Table s_Table = BuildTable ();
+
+uint32_t CRC32Update (uint32_t nCRC, const void *pData, size_t nLength)
+{
+#ifdef CRC32_HARDWARE
+	return CRC32UpdateHardware (nCRC, pData, nLength);
+#else
+	return CRC32UpdatePortable (nCRC, pData, nLength);
+#endif
+}
+
+uint32_t CRC32UpdatePortable (uint32_t nCRC, const void *pData, size_t nLength)
+{
+	static_assert (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "Little endian only");
+
+	const uint8_t *pByte = static_cast<const uint8_t *> (pData);
+
+	nCRC = ~nCRC;
+	for (; nLength >= 8; nLength -= 8, pByte += 8)
+	{
+		uint32_t nLow, nHigh;
+		memcpy (&nLow, pByte, sizeof nLow);
+		memcpy (&nHigh, pByte + 4, sizeof nHigh);
+		nLow ^= nCRC;
+
+		nCRC =   s_Table.Entry[7][nLow & 0xFF]   ^ s_Table.Entry[6][(nLow >> 8) & 0xFF]
+		       ^ s_Table.Entry[5][(nLow >> 16) & 0xFF]  ^ s_Table.Entry[4][nLow >> 24]
+		       ^ s_Table.Entry[3][nHigh & 0xFF]  ^ s_Table.Entry[2][(nHigh >> 8) & 0xFF]
+		       ^ s_Table.Entry[1][(nHigh >> 16) & 0xFF] ^ s_Table.Entry[0][nHigh >> 24];
+	}
+
+	while (nLength--)
+	{
+		nCRC = s_Table.Entry[0][(nCRC ^ *pByte++) & 0xFF] ^ (nCRC >> 8);
+	}
+
+	return ~nCRC;
+}
+
+#ifdef CRC32_HARDWARE
+
+uint32_t CRC32UpdateHardware (uint32_t nCRC, const void *pData, size_t nLength)
+{
+	const uint8_t *pByte = static_cast<const uint8_t *> (pData);
+
+	nCRC = ~nCRC;
+	for (; nLength != 0 && ((uintptr_t) pByte & 7) != 0; nLength--)
+	{
+		nCRC = __crc32b (nCRC, *pByte++);
+	}
+
+	for (; nLength >= 8; nLength -= 8, pByte += 8)
+	{
+		uint64_t nWord;
+		memcpy (&nWord, pByte, sizeof nWord);	// a single load, it is aligned
+
+		nCRC = __crc32d (nCRC, nWord);
+	}
+
+	while (nLength--)
+	{
+		nCRC = __crc32b (nCRC, *pByte++);
+	}
+
+	return ~nCRC;
+}
+
+#endif
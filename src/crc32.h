@@ -0,0 +1,27 @@
+// crc32.h
+//
+// CRC-32 (IEEE 802.3, reflected, as used by zlib). Does not depend on
+// Circle, so the host tools share it with the boot menu.
+//
+// CRC32Update() uses the CRC32 instructions of ARMv8, if the compiler
+// targets a CPU with them (the Cortex-A53, A72 and A76 of the Raspberry Pi
+// 3, 4 and 5 have them), otherwise a table, which is processed 8 bytes at a
+// time. Both are available by name for the host tools.
+//
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __ARM_FEATURE_CRC32
+	#define CRC32_HARDWARE
+#endif
+
+// pass the result of the previous call as nCRC to continue a CRC, start with 0
+uint32_t CRC32Update (uint32_t nCRC, const void *pData, size_t nLength);
+
+uint32_t CRC32UpdatePortable (uint32_t nCRC, const void *pData, size_t nLength);
+
+#ifdef CRC32_HARDWARE
+uint32_t CRC32UpdateHardware (uint32_t nCRC, const void *pData, size_t nLength);
+#endif
@@ -0,0 +1,53 @@
+// debouncer.cpp
+
+#include "debouncer.h"
+#include <assert.h>
+
+CDebouncer::CDebouncer (unsigned nStableTime)
+:	m_nStableTime (nStableTime),
+	m_bTriggered (false),
+	m_bStable (false),
+	m_bSettling (false),
+	m_bCandidate (false),
+	m_nSince (0)
+{
+}
+
+void CDebouncer::InterruptHandler (void *pParam)
+{
+	CDebouncer *pThis = static_cast<CDebouncer *> (pParam);
+	assert (pThis != 0);
+
+	pThis->Trigger ();
+}
+
+CDebouncer::TEvent CDebouncer::Update (bool bActive, unsigned nNow)
+{
+	m_bTriggered = false;
+
+	if (bActive == m_bStable)
+	{
+		m_bSettling = false;
+
+		return EventNone;
+	}
+
+	if (!m_bSettling || bActive != m_bCandidate)
+	{
+		m_bSettling = true;
+		m_bCandidate = bActive;
+		m_nSince = nNow;
+
+		return EventNone;
+	}
+
+	if (nNow - m_nSince < m_nStableTime)
+	{
+		return EventNone;
+	}
+
+	m_bStable = bActive;
+	m_bSettling = false;
+
+	return bActive ? EventPressed : EventReleased;
+}
@@ -0,0 +1,46 @@
+// debouncer.h
+//
+// Non-blocking debouncer for one button. The GPIO edge interrupt only calls
+// Trigger(), the main loop calls Update() with the current level on each
+// pass and may sleep in between, a level, which is still settling, is
+// looked at again after the next timer tick.
+//
+#pragma once
+
+#include <circle/types.h>
+
+#define DEBOUNCE_TIME_US	20000
+
+class CDebouncer
+{
+public:
+	enum TEvent
+	{
+		EventNone,
+		EventPressed,
+		EventReleased
+	};
+
+public:
+	CDebouncer (unsigned nStableTime = DEBOUNCE_TIME_US);
+
+	// interrupt context: the level may have changed
+	void Trigger (void)		{ m_bTriggered = true; }
+	// TGPIOInterruptHandler, pParam is the CDebouncer
+	static void InterruptHandler (void *pParam);
+
+	// bActive is the current (raw) level, nNow from CTimer::GetClockTicks()
+	TEvent Update (bool bActive, unsigned nNow);
+
+	// an edge was seen since the last Update()
+	bool IsTriggered (void) const	{ return m_bTriggered; }
+
+private:
+	unsigned m_nStableTime;
+
+	volatile bool m_bTriggered;
+	bool m_bStable;			// debounced level
+	bool m_bSettling;		// raw level differs from m_bStable
+	bool m_bCandidate;		// raw level while settling
+	unsigned m_nSince;		// time m_bCandidate was first seen
+};
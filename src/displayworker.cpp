@@ -0,0 +1,111 @@
+// displayworker.cpp
+
+#include "displayworker.h"
+#include "chainloader.h"
+#include "asynclog.h"
+#include "coresync.h"
+#include <assert.h>
+
+#define SLOT_MASK	0x03
+#define SLOT_FRESH	0x04		// middle slot has not been shown yet
+
+LOGMODULE ("display");
+
+CDisplayWorker::CDisplayWorker (void)
+:	m_pDevice (0),
+	m_nBack (0),
+	m_nFront (1),
+	m_nMiddle (2),
+	m_bRunning (false),
+	m_bStop (false),
+	m_nFramesShown (0),
+	m_nFramesSkipped (0)
+{
+}
+
+void CDisplayWorker::Setup (CWriteBufferDevice *pDevice, unsigned nColumns, unsigned nRows)
+{
+	assert (pDevice != 0);
+	assert (!IsRunning ());
+
+	m_pDevice = pDevice;
+	m_Frame.SetSize (nColumns, nRows);
+
+	m_bStop = false;
+	__atomic_store_n (&m_bRunning, true, __ATOMIC_RELEASE);
+}
+
+void CDisplayWorker::TaskHandler (void *pParam)
+{
+	CDisplayWorker *pThis = static_cast<CDisplayWorker *> (pParam);
+	assert (pThis != 0);
+
+	pThis->Run ();
+}
+
+void CDisplayWorker::Publish (const TLCDCells &rCells)
+{
+	m_Slots[m_nBack] = rCells;
+
+	unsigned nOld = __atomic_exchange_n (&m_nMiddle, m_nBack | SLOT_FRESH, __ATOMIC_ACQ_REL);
+	if (nOld & SLOT_FRESH)
+	{
+		m_nFramesSkipped++;
+	}
+
+	m_nBack = nOld & SLOT_MASK;
+
+	CoreSendEvent ();
+}
+
+void CDisplayWorker::Stop (void)
+{
+	__atomic_store_n (&m_bStop, true, __ATOMIC_RELEASE);
+	CoreSendEvent ();
+
+	while (IsRunning ())
+	{
+		CoreYield ();
+	}
+
+	LOGNOTE ("%u frames shown, %u skipped", m_nFramesShown, m_nFramesSkipped);
+}
+
+void CDisplayWorker::Cancel (void)
+{
+	// Run() has not been entered, so there is nobody to wait for
+	__atomic_store_n (&m_bRunning, false, __ATOMIC_RELEASE);
+}
+
+bool CDisplayWorker::IsRunning (void) const
+{
+	return __atomic_load_n (&m_bRunning, __ATOMIC_ACQUIRE);
+}
+
+void CDisplayWorker::Run (void)
+{
+	assert (m_pDevice != 0);
+
+	while (   !__atomic_load_n (&m_bStop, __ATOMIC_ACQUIRE)
+	       && !CChainLoader::IsParkRequested ())
+	{
+		// a Publish() after this check leaves the event register set,
+		// so WFE returns at once
+		if (!(__atomic_load_n (&m_nMiddle, __ATOMIC_ACQUIRE) & SLOT_FRESH))
+		{
+			CoreWaitForEvent ();
+
+			continue;
+		}
+
+		m_nFront = __atomic_exchange_n (&m_nMiddle, m_nFront, __ATOMIC_ACQ_REL) & SLOT_MASK;
+
+		m_Frame.SetCells (m_Slots[m_nFront]);
+		m_Frame.Flush (m_pDevice);
+		m_pDevice->Update ();
+
+		m_nFramesShown++;
+	}
+
+	__atomic_store_n (&m_bRunning, false, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,56 @@
+// displayworker.h
+//
+// Flushes LCD frames on a secondary core, so that the menu never waits for
+// a slow display (ST7789 over SPI). The menu publishes complete frames,
+// the worker shows the latest one. The frames are exchanged via three
+// slots (back, middle, front) and an atomic index swap, so neither side
+// has to wait for the other. A frame which is replaced before the worker
+// could pick it up is skipped.
+//
+#pragma once
+
+#include <circle/writebuffer.h>
+#include <circle/types.h>
+#include "lcdframe.h"
+
+class CDisplayWorker
+{
+public:
+	CDisplayWorker (void);
+
+	// core 0, before the task is started: the worker owns pDevice from
+	// now on, until Stop() or Cancel() returns
+	void Setup (CWriteBufferDevice *pDevice, unsigned nColumns, unsigned nRows);
+
+	// TMenuCoreTask, pParam is the CDisplayWorker
+	static void TaskHandler (void *pParam);
+
+	// menu side, never blocks
+	void Publish (const TLCDCells &rCells);
+
+	// waits until the worker does not touch the device any more
+	void Stop (void);
+
+	// core 0, if the task could not be started: the device is given back
+	void Cancel (void);
+
+	bool IsRunning (void) const;
+
+private:
+	void Run (void);
+
+private:
+	CWriteBufferDevice *m_pDevice;
+	CLCDFrame m_Frame;
+
+	TLCDCells m_Slots[3];
+	unsigned m_nBack;			// owned by the menu
+	unsigned m_nFront;			// owned by the worker
+	volatile unsigned m_nMiddle;		// slot index | SLOT_FRESH
+
+	volatile bool m_bRunning;
+	volatile bool m_bStop;
+
+	unsigned m_nFramesShown;
+	volatile unsigned m_nFramesSkipped;
+};
@@ -0,0 +1,73 @@
+// fileextent.cpp
+
+#include "fileextent.h"
+#include <fatfs/diskio.h>
+#include <assert.h>
+
+bool FileGetExtent (FIL *pFile, FSIZE_t nOffset, FSIZE_t nSize, TFileExtent *pExtent)
+{
+	assert (pFile);
+	assert (pExtent);
+
+	if (   nOffset % FILE_EXTENT_SECTOR_SIZE != 0
+	    || nSize == 0
+	    || nOffset + nSize > f_size (pFile))
+	{
+		return false;
+	}
+
+	const FATFS *pFileSystem = pFile->obj.fs;
+	assert (pFileSystem);
+
+	// f_lseek() leaves the cluster of the byte before the offset in clust,
+	// so the end of the first sector in each cluster is sought, f_lseek()
+	// does not read a sector at a sector boundary
+	FSIZE_t nClusterSize = (FSIZE_t) pFileSystem->csize * FILE_EXTENT_SECTOR_SIZE;
+	if (f_lseek (pFile, nOffset + FILE_EXTENT_SECTOR_SIZE) != FR_OK)
+	{
+		return false;
+	}
+
+	DWORD nFirstCluster = pFile->clust;
+	if (nFirstCluster < 2)
+	{
+		return false;
+	}
+
+	FSIZE_t nFirstIndex = nOffset / nClusterSize;
+	for (FSIZE_t nIndex = nFirstIndex + 1; nIndex * nClusterSize < nOffset + nSize; nIndex++)
+	{
+		if (   f_lseek (pFile, nIndex * nClusterSize + FILE_EXTENT_SECTOR_SIZE) != FR_OK
+		    || pFile->clust != nFirstCluster + (nIndex - nFirstIndex))
+		{
+			return false;
+		}
+	}
+
+	pExtent->nDrive = pFileSystem->pdrv;
+	pExtent->nFirstSector =   pFileSystem->database
+				+ (LBA_t) (nFirstCluster - 2) * pFileSystem->csize
+				+ (LBA_t) (nOffset % nClusterSize) / FILE_EXTENT_SECTOR_SIZE;
+	pExtent->nSize = nSize;
+
+	return true;
+}
+
+bool FileReadExtent (const TFileExtent *pExtent, FSIZE_t nOffset, void *pBuffer, size_t nSize)
+{
+	assert (pExtent);
+	assert (pBuffer);
+	assert (nOffset % FILE_EXTENT_SECTOR_SIZE == 0);
+
+	if (   nSize == 0
+	    || nOffset + nSize > pExtent->nSize)
+	{
+		return false;
+	}
+
+	UINT nCount = (nSize + FILE_EXTENT_SECTOR_SIZE - 1) / FILE_EXTENT_SECTOR_SIZE;
+
+	return disk_read (pExtent->nDrive, static_cast<BYTE *> (pBuffer),
+			  pExtent->nFirstSector + nOffset / FILE_EXTENT_SECTOR_SIZE,
+			  nCount) == RES_OK;
+}
@@ -0,0 +1,32 @@
+// fileextent.h
+//
+// Direct access to a range of a file, which is stored in consecutive
+// clusters. FileGetExtent() walks the cluster chain of the range once and
+// resolves its first sector, FileReadExtent() then reads with multi-block
+// requests of the disk driver straight into the destination, without the
+// cluster boundaries, FAT lookups and sector buffer of f_read(). The file
+// must not be written, while its extent is used. Does not depend on
+// Circle, so the host tools can use it with a FatFs stand-in.
+//
+#pragma once
+
+#include <fatfs/ff.h>
+#include <stddef.h>
+
+#define FILE_EXTENT_SECTOR_SIZE	FF_MAX_SS
+
+struct TFileExtent
+{
+	BYTE nDrive;
+	LBA_t nFirstSector;			// of the range
+	FSIZE_t nSize;				// of the range
+};
+
+// returns true if the nSize bytes from nOffset (a multiple of the sector
+// size) of pFile are in consecutive clusters, the file position is changed
+bool FileGetExtent (FIL *pFile, FSIZE_t nOffset, FSIZE_t nSize, TFileExtent *pExtent);
+
+// reads nSize bytes from nOffset (a multiple of the sector size) of the
+// range with one request, whole sectors are read, so pBuffer must have
+// room for nSize rounded up to the sector size
+bool FileReadExtent (const TFileExtent *pExtent, FSIZE_t nOffset, void *pBuffer, size_t nSize);
@@ -0,0 +1,403 @@
+// handoff.h
+//
+// State the boot menu hands over to the synth it starts, so that the synth
+// can take over what the menu has found out already (the settings from
+// minidexed.ini the menu knows, the display it has initialized, the USB
+// MIDI devices it has enumerated and the boot profile) instead of finding
+// it out again. The menu writes the block to HANDOFF_ADDRESS just before
+// the synth is started, in the page below the chain boot trampolines,
+// which neither Circle nor the synth touch before they are up.
+//
+// The block is a header and a list of records of HandoffRecord... types,
+// each padded to 4 bytes. Unknown records are skipped by the reader, so
+// new records do not need a new HANDOFF_VERSION. All fields are little
+// endian.
+//
+// This header is all a synth needs, it does not depend on Circle or on
+// other files of the boot menu:
+//
+//	CHandoffReader Handoff;		// at HANDOFF_ADDRESS
+//	if (Handoff.IsValid ())
+//	{
+//		uint32_t nColumns;
+//		if (Handoff.GetConfig ("LCDColumns", &nColumns)) ...
+//		const THandoffDisplay *pDisplay = Handoff.GetDisplay ();
+//		...
+//		Handoff.Invalidate ();	// used once
+//	}
+//
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define HANDOFF_ADDRESS		0x7E000
+#define HANDOFF_SIZE		0x1000
+
+#define HANDOFF_MAGIC		0x4F48534DU	// "MSHO"
+#define HANDOFF_VERSION		1
+
+#define HANDOFF_MAX_AGE		10000000	// us from writing the block to reading it
+
+#define HANDOFF_KEY_MAX		24		// including the terminating null
+#define HANDOFF_NAME_MAX	16
+
+enum THandoffRecordType
+{
+	HandoffRecordConfig	= 1,		// THandoffConfig, one per setting
+	HandoffRecordDisplay	= 2,		// THandoffDisplay
+	HandoffRecordUSBMIDI	= 3,		// THandoffUSBMIDI, one per device
+	HandoffRecordStage	= 4,		// THandoffStage, one per boot stage
+	HandoffRecordSynth	= 5		// THandoffSynth
+};
+
+enum THandoffDisplayType
+{
+	HandoffDisplayNone,
+	HandoffDisplayHD44780,			// 4-bit GPIO
+	HandoffDisplayHD44780I2C,
+	HandoffDisplaySSD1306,
+	HandoffDisplayST7789
+};
+
+struct THandoffHeader
+{
+	uint32_t nMagic;
+	uint16_t nVersion;
+	uint16_t nHeaderSize;
+	uint32_t nSize;				// of the records
+	uint32_t nCRC;				// CRC-32 of the records
+	uint32_t nTimestamp;			// system timer (us) when written
+	uint32_t nRecords;
+};
+
+struct THandoffRecord
+{
+	uint16_t nType;				// THandoffRecordType
+	uint16_t nSize;				// of the data following, without padding
+};
+
+struct THandoffConfig
+{
+	char Key[HANDOFF_KEY_MAX];		// as in the ini file
+	uint32_t nValue;
+};
+
+struct THandoffDisplay
+{
+	uint8_t nType;				// THandoffDisplayType
+	uint8_t nI2CAddress;			// or 0
+	uint8_t nRotation;			// degrees / 90
+	uint8_t bInitialized;			// the menu left it initialized
+	uint16_t nColumns;			// characters
+	uint16_t nRows;
+	uint16_t nWidth;			// pixels, graphical displays only
+	uint16_t nHeight;
+};
+
+struct THandoffUSBMIDI
+{
+	uint8_t nDevice;			// "umidi<nDevice + 1>"
+	uint8_t nReserved;
+	uint16_t nVendor;			// USB vendor ID, 0 if unknown
+	uint16_t nProduct;
+	uint16_t nReserved2;
+};
+
+struct THandoffStage
+{
+	char Name[HANDOFF_NAME_MAX];
+	uint32_t nCore;
+	uint32_t nStart;			// us since power-on
+	uint32_t nDuration;			// us
+};
+
+struct THandoffSynth
+{
+	char Name[HANDOFF_NAME_MAX];		// of its directory
+	uint32_t nImageSize;
+	uint32_t nImageCRC;			// 0 if unknown
+};
+
+static_assert (sizeof (THandoffHeader) == 24, "THandoffHeader must be packed");
+static_assert (sizeof (THandoffRecord) == 4, "THandoffRecord must be packed");
+static_assert (sizeof (THandoffConfig) == 28, "THandoffConfig must be packed");
+static_assert (sizeof (THandoffDisplay) == 12, "THandoffDisplay must be packed");
+static_assert (sizeof (THandoffUSBMIDI) == 8, "THandoffUSBMIDI must be packed");
+static_assert (sizeof (THandoffStage) == 28, "THandoffStage must be packed");
+static_assert (sizeof (THandoffSynth) == 24, "THandoffSynth must be packed");
+
+// CRC-32 like crc32.h, the table is built at compile time to keep this
+// header alone
+struct THandoffCRCTable
+{
+	uint32_t Entry[256];
+};
+
+constexpr THandoffCRCTable HandoffCRCTable (void)
+{
+	THandoffCRCTable Table {};
+	for (uint32_t i = 0; i < 256; i++)
+	{
+		uint32_t nCRC = i;
+		for (unsigned j = 0; j < 8; j++)
+		{
+			nCRC = nCRC & 1 ? (nCRC >> 1) ^ 0xEDB88320 : nCRC >> 1;
+		}
+
+		Table.Entry[i] = nCRC;
+	}
+
+	return Table;
+}
+
+inline uint32_t HandoffCRC32 (const void *pData, size_t nLength)
+{
+	static constexpr THandoffCRCTable s_Table = HandoffCRCTable ();
+
+	const uint8_t *pByte = static_cast<const uint8_t *> (pData);
+	uint32_t nCRC = 0xFFFFFFFF;
+
+	while (nLength--)
+	{
+		nCRC = (nCRC >> 8) ^ s_Table.Entry[(nCRC ^ *pByte++) & 0xFF];
+	}
+
+	return ~nCRC;
+}
+
+// builds a block in memory, which is not touched before Finish()
+class CHandoffWriter
+{
+public:
+	CHandoffWriter (void *pBlock = reinterpret_cast<void *> (HANDOFF_ADDRESS),
+			size_t nBlockSize = HANDOFF_SIZE)
+	:	m_pBlock (static_cast<uint8_t *> (pBlock)),
+		m_nBlockSize (nBlockSize),
+		m_nUsed (sizeof (THandoffHeader)),
+		m_nRecords (0),
+		m_bOverflow (false)
+	{
+	}
+
+	// returns false if the block is full, the record is dropped then
+	bool Add (uint16_t nType, const void *pData, size_t nSize)
+	{
+		size_t nPadded = (sizeof (THandoffRecord) + nSize + 3) & ~(size_t) 3;
+		if (   nSize > 0xFFFF
+		    || m_nUsed + nPadded > m_nBlockSize)
+		{
+			m_bOverflow = true;
+
+			return false;
+		}
+
+		THandoffRecord Record = {nType, static_cast<uint16_t> (nSize)};
+		memcpy (m_pBlock + m_nUsed, &Record, sizeof Record);
+		memcpy (m_pBlock + m_nUsed + sizeof Record, pData, nSize);
+		memset (m_pBlock + m_nUsed + sizeof Record + nSize, 0,
+			nPadded - sizeof Record - nSize);
+
+		m_nUsed += nPadded;
+		m_nRecords++;
+
+		return true;
+	}
+
+	template <class T>
+	bool Add (uint16_t nType, const T &rData)
+	{
+		return Add (nType, &rData, sizeof rData);
+	}
+
+	// writes the header, returns the size of the block
+	size_t Finish (uint32_t nTimestamp)
+	{
+		THandoffHeader Header;
+		Header.nMagic = HANDOFF_MAGIC;
+		Header.nVersion = HANDOFF_VERSION;
+		Header.nHeaderSize = sizeof Header;
+		Header.nSize = m_nUsed - sizeof Header;
+		Header.nCRC = HandoffCRC32 (m_pBlock + sizeof Header, Header.nSize);
+		Header.nTimestamp = nTimestamp;
+		Header.nRecords = m_nRecords;
+		memcpy (m_pBlock, &Header, sizeof Header);
+
+		return m_nUsed;
+	}
+
+	bool HasOverflowed (void) const		{ return m_bOverflow; }
+
+private:
+	uint8_t *m_pBlock;
+	size_t m_nBlockSize;
+	size_t m_nUsed;
+	unsigned m_nRecords;
+	bool m_bOverflow;
+};
+
+class CHandoffReader
+{
+public:
+	// checks the block, nNow is the system timer (us) to check the age of
+	// the block against or 0 to accept any age
+	CHandoffReader (const void *pBlock = reinterpret_cast<const void *> (HANDOFF_ADDRESS),
+			size_t nBlockSize = HANDOFF_SIZE, uint32_t nNow = 0)
+	:	m_pRecords (0),
+		m_nSize (0)
+	{
+		const uint8_t *pStart = static_cast<const uint8_t *> (pBlock);
+
+		THandoffHeader Header;
+		if (nBlockSize < sizeof Header)
+		{
+			return;
+		}
+		memcpy (&Header, pStart, sizeof Header);
+
+		if (   Header.nMagic != HANDOFF_MAGIC
+		    || Header.nVersion != HANDOFF_VERSION
+		    || Header.nHeaderSize < sizeof Header
+		    || Header.nHeaderSize > nBlockSize
+		    || Header.nSize > nBlockSize - Header.nHeaderSize
+		    || HandoffCRC32 (pStart + Header.nHeaderSize, Header.nSize) != Header.nCRC)
+		{
+			return;
+		}
+
+		if (   nNow != 0
+		    && nNow - Header.nTimestamp > HANDOFF_MAX_AGE)
+		{
+			return;
+		}
+
+		// the records must fill the block exactly
+		const uint8_t *pRecords = pStart + Header.nHeaderSize;
+		size_t nOffset = 0;
+		unsigned nRecords = 0;
+		while (nOffset + sizeof (THandoffRecord) <= Header.nSize)
+		{
+			THandoffRecord Record;
+			memcpy (&Record, pRecords + nOffset, sizeof Record);
+
+			nOffset = (nOffset + sizeof Record + Record.nSize + 3) & ~(size_t) 3;
+			nRecords++;
+		}
+
+		if (   nOffset != Header.nSize
+		    || nRecords != Header.nRecords)
+		{
+			return;
+		}
+
+		m_pRecords = pRecords;
+		m_nSize = Header.nSize;
+	}
+
+	bool IsValid (void) const		{ return m_nSize != 0; }
+
+	// returns the nIndex-th record of nType and its size, or 0
+	const void *Find (uint16_t nType, size_t *pSize = 0, unsigned nIndex = 0) const
+	{
+		size_t nOffset = 0;
+		while (nOffset + sizeof (THandoffRecord) <= m_nSize)
+		{
+			THandoffRecord Record;
+			memcpy (&Record, m_pRecords + nOffset, sizeof Record);
+
+			size_t nData = nOffset + sizeof Record;
+			if (Record.nSize > m_nSize - nData)
+			{
+				break;
+			}
+
+			if (   Record.nType == nType
+			    && nIndex-- == 0)
+			{
+				if (pSize)
+				{
+					*pSize = Record.nSize;
+				}
+
+				return m_pRecords + nData;
+			}
+
+			nOffset = (nData + Record.nSize + 3) & ~(size_t) 3;
+		}
+
+		return 0;
+	}
+
+	// returns the record, if it has at least the size of T (newer versions
+	// may append fields)
+	template <class T>
+	const T *Get (uint16_t nType, unsigned nIndex = 0) const
+	{
+		size_t nSize;
+		const void *pData = Find (nType, &nSize, nIndex);
+
+		return pData != 0 && nSize >= sizeof (T) ? static_cast<const T *> (pData) : 0;
+	}
+
+	// one pass over the records, not Get() for each index
+	bool GetConfig (const char *pKey, uint32_t *pValue) const
+	{
+		size_t nOffset = 0;
+		while (nOffset < m_nSize)
+		{
+			THandoffRecord Record;
+			memcpy (&Record, m_pRecords + nOffset, sizeof Record);
+			nOffset += sizeof Record;
+
+			if (   Record.nType == HandoffRecordConfig
+			    && Record.nSize >= sizeof (THandoffConfig))
+			{
+				const THandoffConfig *pConfig =
+					reinterpret_cast<const THandoffConfig *> (m_pRecords + nOffset);
+				if (strncmp (pConfig->Key, pKey, HANDOFF_KEY_MAX) == 0)
+				{
+					*pValue = pConfig->nValue;
+
+					return true;
+				}
+			}
+
+			nOffset = (nOffset + Record.nSize + 3) & ~(size_t) 3;
+		}
+
+		return false;
+	}
+
+	const THandoffDisplay *GetDisplay (void) const
+	{
+		return Get<THandoffDisplay> (HandoffRecordDisplay);
+	}
+
+	const THandoffUSBMIDI *GetUSBMIDIDevice (unsigned nIndex) const
+	{
+		return Get<THandoffUSBMIDI> (HandoffRecordUSBMIDI, nIndex);
+	}
+
+	const THandoffStage *GetStage (unsigned nIndex) const
+	{
+		return Get<THandoffStage> (HandoffRecordStage, nIndex);
+	}
+
+	const THandoffSynth *GetSynth (void) const
+	{
+		return Get<THandoffSynth> (HandoffRecordSynth);
+	}
+
+	// clears the magic, so that the block is not used again after a reboot,
+	// which keeps the memory
+	static void Invalidate (void *pBlock = reinterpret_cast<void *> (HANDOFF_ADDRESS))
+	{
+		uint32_t nMagic = 0;
+		memcpy (pBlock, &nMagic, sizeof nMagic);
+	}
+
+private:
+	const uint8_t *m_pRecords;
+	size_t m_nSize;
+};
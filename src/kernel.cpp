@@ -2,17 +2,22 @@
 /* kernel.cpp */
 #include "circle_stdlib_app.h"
 #include "kernel.h"
-#include <circle/logger.h>
+#include "asynclog.h"
 
 
 #define DelayMs(x) m_Timer.MsDelay(x)
 
-LOGMODULE ("kernel");
+#define TEARDOWN_TASK_TIMEOUT 1000  // us until the previous task of a core returned
 
-extern "C" void start_synth(const char* name); // implemented in each synth's kernel.cpp
+LOGMODULE ("kernel");
 
 CKernel* CKernel::s_pThis = nullptr;
 
+static constexpr size_t Max(size_t nA, size_t nB)
+{
+    return nA > nB ? nA : nB;
+}
+
 CKernel::CKernel()
     : CStdlibAppStdio ("MultiSynth","sdmc"),
       m_LCD(nullptr),
@@ -23,13 +28,19 @@ CKernel::CKernel()
       m_I2CMaster(CMachineInfo::Get ()->GetDevice (DeviceI2CMaster), TRUE),
       m_SPIMaster(nullptr),
       m_Serial(&m_Interrupt, &m_Timer),
-      m_Logger(LogDebug, &m_Timer, TRUE),
-      m_pUSBMIDIDevice(nullptr),
-      m_pMiniDexedConfig(nullptr),
-      m_pConfig(nullptr),
-      m_bShouldStartSynth(false)
+      m_bShouldStartSynth(false),
+      m_ConfigCache(&m_FileSystem),
+      m_Config(m_ConfigCache.Get()),
+      m_BootStages(MenuStages, BootStageCount, BootStageHandler, this, &m_BootProfiler),
+      m_Teardown(TeardownStages, TeardownStageCount, TeardownStageHandler, this, &m_TeardownProfiler)
+#ifdef ARM_ALLOW_MULTI_CORE
+      , m_Prefetcher(&m_ChainLoader)
+#endif
     {
         s_pThis = this;
+
+        m_SerialMIDIParser.RegisterMessageHandler(MIDIMessageHandler, this, MIDI_PORT_SERIAL);
+        m_USBMIDIPorts.RegisterMessageHandler(MIDIMessageHandler, this, MIDI_PORT_USB_FIRST);
     }
 
 CKernel::~CKernel() 
@@ -39,21 +50,96 @@ CKernel::~CKernel()
 
 bool CKernel::Initialize()
     {
+        // all devices of the menu with the largest display (ST7789)
+        static_assert(  MenuArenaSize<CScreenDevice>()
+                      + MenuArenaSize<CSPIMaster>()
+                      + Max(MenuArenaSize<CSSD1306Device>(),
+                            Max(MenuArenaSize<CST7789Display>() + MenuArenaSize<CST7789Device>(),
+                                MenuArenaSize<CHD44780Device>()))
+                      + MenuArenaSize<CWriteBufferDevice>()
+                      + MenuArenaSize<CKY040>()
+                      + ButtonCount * MenuArenaSize<CGPIOPin>()
+                      + MenuArenaSize<CUSBHCIDevice>() <= MENU_ARENA_SIZE,
+                      "MENU_ARENA_SIZE is too small");
+
+        unsigned hStage = m_BootProfiler.Begin("stdlib");
         if (!CStdlibAppStdio::Initialize())
 	    {
 		return FALSE;
 	    }
+        m_BootProfiler.End(hStage);
+
+        mLogger.RegisterPanicHandler (PanicHandler);
+
+        LOGNOTE("Logger started");
+
+        // from here on log messages are written by the main loop
+        m_AsyncLog.Start();
+
+        // a block left from before a reboot must not reach the next synth
+        CHandoffReader::Invalidate();
+
+    m_bUSBMIDIInitialized = false;
+
+#ifdef ARM_ALLOW_MULTI_CORE
+    // the secondary cores start with their own stages (USB) right away,
+    // core 0 returns as soon as the menu stages are done
+    m_pCores = new CMenuCores (CMemorySystem::Get (), &m_BootStages);
+    if (!m_pCores->Initialize ())
+    {
+        LOGERR("Cannot start secondary cores");
+        m_AsyncLog.Stop();
+        return FALSE;
+    }
+
+    if (!m_BootStages.Run(0))
+#else
+    if (!m_BootStages.Run(0, true))
+#endif
+    {
+        m_AsyncLog.Stop();
+        return FALSE;
+    }
+
+    return TRUE;
+}
 
-        m_pScreen = new CScreenDevice(m_Options.GetWidth(), m_Options.GetHeight());
-        if (!m_pScreen->Initialize()) {
+bool CKernel::BootStageHandler(unsigned nStage, void* pParam)
+{
+    CKernel* pThis = static_cast<CKernel*>(pParam);
+    assert(pThis != 0);
+
+    switch (nStage)
+    {
+    case BootStageDevices:  return pThis->InitDevices();
+    case BootStageMount:    return pThis->MountSD();
+    case BootStageConfig:   return pThis->LoadConfig();
+    case BootStageMode:     return pThis->SelectBootMode();
+    case BootStageScreen:   return pThis->InitScreen();
+    case BootStageCatalog:  return pThis->m_Catalog.Load(CHAINBOOT_PACK_NAME, pThis->m_Config.nMIDINote);
+    case BootStageActions:  return pThis->BuildMIDIActions();
+    case BootStageSPI:      return pThis->InitSPI();
+    case BootStageLCD:      return pThis->LCDinit();
+    case BootStageInput:    return pThis->InitInput();
+    case BootStageSerial:   return pThis->InitSerial();
+    case BootStageUSB:      return pThis->InitUSB();
+    default:                return false;
+    }
+}
+
+bool CKernel::InitScreen()
+{
+        m_pScreen = m_Arena.New<CScreenDevice>(mOptions.GetWidth(), mOptions.GetHeight());
+        if (!m_pScreen || !m_pScreen->Initialize()) {
             LOGERR("HDMI init failed!");
             return false;
         }
 
-        mLogger.RegisterPanicHandler (PanicHandler);
+        return true;
+}
 
-        LOGNOTE("Logger started");
-    
+bool CKernel::InitDevices()
+{
         if (!m_Timer.Initialize() ||
             !m_GPIOManager.Initialize() ||
             !m_I2CMaster.Initialize() )
@@ -61,30 +147,173 @@ bool CKernel::Initialize()
             return FALSE;
         }
 
-    	//const char* items[SYNTH_ITEM_COUNT] = {"MiniDexed", "MiniJV880", "MT-32Pi"};
-    	//int selected = 0;
-    
+        return TRUE;
+}
+
+bool CKernel::MountSD()
+{
+    // FatFs finds the card by its name on mount, the cache takes its place
+    CDeviceNameService* pNameService = CDeviceNameService::Get();
+    CDevice* pCard = pNameService->GetDevice("emmc1", TRUE);
+    if (pCard != nullptr && pCard != &m_BlockCache) {
+        m_BlockCache.Setup(pCard);
+        pNameService->RemoveDevice("emmc1", TRUE);
+        pNameService->AddDevice("emmc1", &m_BlockCache, TRUE);
+    }
+
         FRESULT res = f_mount(&m_FileSystem, "SD:", 1);  // "0:" - номер тома
     if (res != FR_OK) {
-        m_Logger.Write(GetKernelName(), LogError, "Failed to mount SD card");
+        LOGERR("Failed to mount SD card");
         return false;
     }
-    
-    m_pConfig = new CPropertiesFatFsFile("synth.ini", &m_FileSystem);
-    if (!m_pConfig->Load()) {
-        LOGERR("Failed to load synth.ini");
+
+    // the FAT is read again for every file
+    m_BlockCache.Pin(m_FileSystem.fatbase, m_FileSystem.fsize);
+
+    return true;
+}
+
+bool CKernel::LoadConfig()
+{
+    // the ini files are parsed only if they changed since the last boot
+    if (!m_ConfigCache.Load()) {
         return FALSE;
     }
 
-    m_pMiniDexedConfig = new CPropertiesFatFsFile("minidexed.ini", &m_FileSystem);
-    if (!m_pMiniDexedConfig->Load()) {
-        LOGERR("Failed to load minidexed.ini");
-        return FALSE;
+    LOGNOTE("Config loaded from %s", m_ConfigCache.IsFromCache() ? "cache" : "ini files");
+
+	m_LCDColumns = m_Config.nLCDColumns;
+    m_LCDRows = m_Config.nLCDRows;
+
+    m_ChainLoader.SetCRCRequired(!!m_Config.nRequireImageCRC);
+
+    return TRUE;
+}
+
+// Autoboot starts the synth launched last, unless the select button is
+// held at power-on. The stages only the menu needs are deferred then, they
+// are brought up by ResumeMenu(), if the synth cannot be started.
+bool CKernel::SelectBootMode()
+{
+    m_bAutoBoot = false;
+
+    // also preselects the synth in the menu
+    if (!m_BootState.Load() || !m_Config.nAutoBoot)
+    {
+        return TRUE;
+    }
+
+    if (IsMenuRequested())
+    {
+        LOGNOTE("Autoboot skipped, select button held");
+        return TRUE;
+    }
+
+    m_bAutoBoot = true;
+    m_BootStages.Defer(MENU_STAGES_DEFERRED);
+
+    return TRUE;
+}
+
+// The select button is held for nAutoBootHoldTime ms. This takes only as
+// long, if it is, otherwise it returns at the first sample, which finds the
+// button released.
+bool CKernel::IsMenuRequested()
+{
+    CGPIOPin Button(m_Config.nButtonPinSelect, GPIOModeInputPullUp);
+    CTimer::SimpleusDelay(100);         // pull-up settling
+
+    for (unsigned i = 0; i < m_Config.nAutoBootHoldTime; i++)
+    {
+        // buttons are active low
+        if (Button.Read() != LOW)
+        {
+            return FALSE;
+        }
+
+        CTimer::SimpleusDelay(1000);
+    }
+
+    return TRUE;
+}
+
+// A threshold of a single mapping, which is not set in synth.ini, falls
+// back to the global one.
+static unsigned GetThreshold(u32 nThreshold, u32 nGlobal)
+{
+    return nThreshold != BOOT_CONFIG_THRESHOLD_GLOBAL ? nThreshold : nGlobal;
+}
+
+// The config and the catalog do not change until the next boot, so the
+// table is built once. Earlier mappings win over later ones.
+bool CKernel::BuildMIDIActions()
+{
+    unsigned nChannel = m_Config.nMIDIChannel;
+    unsigned nButton = m_Config.nMIDIButtonThreshold;
+
+    m_MIDIActions.Clear();
+
+    const struct
+    {
+        u32 nController;
+        TMIDIAction Action;
+        u32 nThreshold;
+    }
+    Buttons[] =
+    {
+        {m_Config.nMIDIButtonNext,      MIDIActionNext,         m_Config.nMIDINextThreshold},
+        {m_Config.nMIDIButtonPrev,      MIDIActionPrev,         m_Config.nMIDIPrevThreshold},
+        {m_Config.nMIDIButtonSelect,    MIDIActionSelect,       m_Config.nMIDISelectThreshold},
+        {m_Config.nMIDIButtonPageNext,  MIDIActionPageNext,     m_Config.nMIDIPageNextThreshold},
+        {m_Config.nMIDIButtonPagePrev,  MIDIActionPagePrev,     m_Config.nMIDIPagePrevThreshold}
+    };
+
+    for (const auto &rButton : Buttons)
+    {
+        if (   rButton.nController != BOOT_CONFIG_MIDI_NONE
+            && !m_MIDIActions.Map(MIDIActionTypeControl, nChannel, rButton.nController,
+                                  rButton.Action, 0, GetThreshold(rButton.nThreshold, nButton)))
+        {
+            LOGWARN("MIDI controller %u is used twice", rButton.nController);
+        }
     }
 
-	unsigned nSPIMaster = m_pMiniDexedConfig->GetNumber("SPIBus()",SPI_INACTIVE);
-	unsigned nSPIMode = m_pMiniDexedConfig->GetNumber("SPIMode", SPI_DEF_MODE);
-	unsigned long nSPIClock = 1000 * m_pMiniDexedConfig->GetNumber("SPIClockKHz", SPI_DEF_CLOCK);
+    for (unsigned i = 0; i < m_Catalog.GetCount(); i++)
+    {
+        u8 nNote = m_Catalog.Get(i)->nMIDINote;
+        if (nNote != SYNTH_PACK_NO_NOTE)
+        {
+            // MIDIThresholdNoteN applies to the note of MIDINoteN, whichever
+            // synth has it
+            unsigned nThreshold = m_Config.nMIDINoteThreshold;
+            for (unsigned j = 0; j < BOOT_CONFIG_SYNTHS; j++)
+            {
+                if (m_Config.nMIDINote[j] == nNote)
+                {
+                    nThreshold = GetThreshold(m_Config.nMIDINoteThresholds[j], nThreshold);
+                    break;
+                }
+            }
+
+            // the first synth with a note wins, as in the catalog
+            m_MIDIActions.Map(MIDIActionTypeNoteOn, nChannel, nNote, MIDIActionLaunch,
+                              i, nThreshold);
+        }
+
+        if (m_Config.nMIDIProgramChange && i < 128)
+        {
+            m_MIDIActions.Map(MIDIActionTypeProgram, nChannel, i, MIDIActionLaunch, i);
+        }
+    }
+
+    return TRUE;
+}
+
+bool CKernel::InitSPI()
+{
+	unsigned nSPIMaster = m_Config.nSPIBus;
+	unsigned nSPIMode = m_Config.nSPIMode;
+	unsigned long nSPIClock = 1000 * m_Config.nSPIClockKHz;
 
 #if RASPPI<4
 	// By default older RPI versions use SPI 0.
@@ -101,32 +330,26 @@ bool CKernel::Initialize()
 	{
 		unsigned nCPHA = (nSPIMode & 1) ? 1 : 0;
 		unsigned nCPOL = (nSPIMode & 2) ? 1 : 0;
-		m_SPIMaster = new CSPIMaster (nSPIClock, nCPOL, nCPHA, nSPIMaster);
-		if (!m_SPIMaster->Initialize())
+		m_SPIMaster = m_Arena.New<CSPIMaster> (nSPIClock, nCPOL, nCPHA, nSPIMaster);
+		if (m_SPIMaster && !m_SPIMaster->Initialize())
 		{
-			delete (m_SPIMaster);
+			m_Arena.Delete (m_SPIMaster);
 			m_SPIMaster = nullptr;
 		}
 	}
 
-    //unsigned synth = m_pConfig->GetNumber("synth", 0);
-
-	m_LCDColumns = m_pMiniDexedConfig->GetNumber("LCDColumns", 16);
-    m_LCDRows = m_pMiniDexedConfig->GetNumber("LCDRows", 2);
-
-    if (!LCDinit())
-	    {
-		return FALSE;
-	    }
-    
+    return true;
+}
 
-	if (m_pMiniDexedConfig->GetNumber("EncoderEnabled", 0))
+bool CKernel::InitInput()
+{
+	if (m_Config.nEncoderEnabled)
 	{
-		m_pRotaryEncoder = new CKY040 (m_pMiniDexedConfig->GetNumber("EncoderPinClock", 10),
-					       m_pMiniDexedConfig->GetNumber("EncoderPinData", 9),
-					       m_pMiniDexedConfig->GetNumber("GetButtonPinShortcut", 11),
-					       &m_GPIOManager);
-		if (!m_pRotaryEncoder->Initialize ())
+		m_pRotaryEncoder = m_Arena.New<CKY040> (m_Config.nEncoderPinClock,
+							m_Config.nEncoderPinData,
+							m_Config.nEncoderPinSwitch,
+							&m_GPIOManager);
+		if (!m_pRotaryEncoder || !m_pRotaryEncoder->Initialize ())
 		{
 			return false;
 		}
@@ -137,19 +360,32 @@ bool CKernel::Initialize()
 		LOGNOTE ("Rotary encoder initialized");
 	} 
 
-    m_PinLeft.AssignPin(m_pMiniDexedConfig->GetNumber("ButtonPinPrev", 5));
-    m_PinLeft.SetMode(GPIOModeInput, true);
-    m_PinLeft.SetPullMode(GPIOPullModeUp);
+    const unsigned ButtonPins[ButtonCount] =
+    {
+        m_Config.nButtonPinPrev,
+        m_Config.nButtonPinNext,
+        m_Config.nButtonPinSelect
+    };
 
-    m_PinRight.AssignPin(m_pMiniDexedConfig->GetNumber("ButtonPinNext", 6));
-    m_PinRight.SetMode(GPIOModeInput, true);
-    m_PinRight.SetPullMode(GPIOPullModeUp);
+    // both edges only wake up the main loop, which debounces the level
+    for (unsigned i = 0; i < ButtonCount; i++)
+    {
+        m_pButtonPin[i] = m_Arena.New<CGPIOPin>(ButtonPins[i], GPIOModeInputPullUp, &m_GPIOManager);
+        if (!m_pButtonPin[i])
+        {
+            return false;
+        }
+        m_pButtonPin[i]->ConnectInterrupt(CDebouncer::InterruptHandler, &m_ButtonDebouncer[i]);
+        m_pButtonPin[i]->EnableInterrupt(GPIOInterruptOnFallingEdge);
+        m_pButtonPin[i]->EnableInterrupt2(GPIOInterruptOnRisingEdge);
+    }
 
-    m_PinSelect.AssignPin(m_pMiniDexedConfig->GetNumber("ButtonPinSelect", 13));
-    m_PinSelect.SetMode(GPIOModeInput, true);
-    m_PinSelect.SetPullMode(GPIOPullModeUp);
+    return true;
+}
 
-	if (!m_Serial.Initialize(m_pMiniDexedConfig->GetNumber("MIDIBaudRate", 31250)))
+bool CKernel::InitSerial()
+{
+	if (!m_Serial.Initialize(m_Config.nMIDIBaudRate))
     {
         LOGERR("\nSerial MIDI init failed!");
         m_Timer.MsDelay(2000);
@@ -159,19 +395,13 @@ bool CKernel::Initialize()
 	ser_options &= ~(SERIAL_OPTION_ONLCR);
 	m_Serial.SetOptions(ser_options);
 
-	// Load MIDI control mappings from config
-    m_midiNext = m_pMiniDexedConfig->GetNumber("MIDIButtonNext", 47);
-    m_midiPrev = m_pMiniDexedConfig->GetNumber("MIDIButtonPrev", 46);
-    m_midiSelect = m_pMiniDexedConfig->GetNumber("MIDIButtonSelect", 49);
-    m_midiNotes[0] = m_pConfig->GetNumber("MIDINote1", 36);
-    m_midiNotes[1] = m_pConfig->GetNumber("MIDINote2", 38);
-    m_midiNotes[2] = m_pConfig->GetNumber("MIDINote3", 40);
-
-    m_pUSBMIDIDevice = nullptr;
-    m_bUSBMIDIInitialized = false;
+    return TRUE;
+}
 
-    m_pUSB = new CUSBHCIDevice (&mInterrupt, &mTimer, TRUE);
-	if (!m_pUSB->Initialize ())
+bool CKernel::InitUSB()
+{
+    m_pUSB = m_Arena.New<CUSBHCIDevice> (&mInterrupt, &mTimer, TRUE);
+	if (!m_pUSB || !m_pUSB->Initialize ())
 	{
 		return FALSE;
 	}
@@ -182,89 +412,268 @@ bool CKernel::Initialize()
 CStdlibApp::TShutdownMode CKernel::Run()
 {
     m_bShouldStartSynth = false;
-    m_SelectedSynth = 0;
-	const char* synths[SYNTH_ITEM_COUNT] = {"minidexed", "minijv880", "mt32pi"};
+    int nLastSynth = m_Catalog.Find(m_BootState.GetLastSynth());
+    m_SelectedSynth = nLastSynth >= 0 ? nLastSynth : 0;
+
+    if (m_bAutoBoot)
+    {
+        // returns only if the synth could not be started
+        if (!AutoBoot())
+        {
+            return ShutdownReboot; // devices are down already, let the firmware do it
+        }
+
+        if (!ResumeMenu())
+        {
+            return ShutdownHalt;
+        }
+    }
+
     UpdateDisplay();
         
     while (true)
         {
-        if (!m_bUSBMIDIInitialized)
+        // devices are looked up once, then only when the device tree changed
+        if (m_BootStages.IsDone(BootStageUSB))
         {
-            CheckUSBMIDI();
+            if (m_pUSB->UpdatePlugAndPlay() || !m_bUSBMIDIInitialized)
+            {
+                m_USBMIDIPorts.Update();
+                m_bUSBMIDIInitialized = true;
+            }
         }
 
-        if (m_PinRight.Read() == LOW) {
-        DelayMs(200); // Простейшая антидребезговая задержка
-        m_SelectedSynth = (m_SelectedSynth + 1) % SYNTH_ITEM_COUNT;
-        UpdateDisplay();
-    }
-    else if (m_PinLeft.Read() == LOW) {
-        DelayMs(200);
-        m_SelectedSynth = (m_SelectedSynth + SYNTH_ITEM_COUNT - 1) % SYNTH_ITEM_COUNT;
-        UpdateDisplay();
-    }
-    else if (m_PinSelect.Read() == LOW) {
-        DelayMs(200);
-        m_bShouldStartSynth = true;
-    }
+        if (!m_bBootProfileWritten && m_BootStages.IsComplete())
+        {
+            m_BootProfiler.Dump();
+            m_BootProfiler.WriteCSV();
+            m_bBootProfileWritten = true;
+
+#ifdef ARM_ALLOW_MULTI_CORE
+            // core 1 is done with USB, compressed images are decoded there
+            if (   !m_ChainLoader.GetDecoder()->IsRunning()
+                && !m_pCores->StartTask(MENU_CORE_DECODE, CChunkDecoder::TaskHandler,
+                                        m_ChainLoader.GetDecoder()))
+            {
+                LOGERR("Cannot start decoder");
+            }
+
+            // from here on the prefetcher is the only user of the SD card
+            StartPrefetch();
+#endif
+        }
+
+        ServiceButtons();
+        ServiceEncoder();
+
+        ProcessMIDIInput();
             
-        if (m_bShouldStartSynth) {
-            Deinit();
-            start_synth(synths[m_SelectedSynth]);
-            return ShutdownReboot;
-            //return; 
+        // USB must not be destroyed, while it is coming up on core 1, so
+        // a synth selected before is started, once all stages are done
+        if (m_bShouldStartSynth && m_BootStages.IsComplete()) {
+            start_synth(m_Catalog.Get(m_SelectedSynth)->Name);
+            // start_synth() returns only if the synth could not be started
+            if (m_ChainLoader.IsLoaded()) {
+                return ShutdownReboot; // devices are down already, let the firmware do it
+            }
+            m_bShouldStartSynth = false;
+#ifdef ARM_ALLOW_MULTI_CORE
+            if (m_bBootProfileWritten) {
+                StartPrefetch();
+            }
+#endif
+            UpdateDisplay();
         }
 
-            ProcessMIDIInput();
-            m_Timer.MsDelay(10);
+            if (IsDisplayUpdateDue()) {
+                m_bUpdateDisplay = false;
+                UpdateDisplay();
+            }
+
+            m_AsyncLog.Drain(ASYNC_LOG_DRAIN_BATCH);
+
+            WaitForEvent();
         }
         
 }
 
-void CKernel::HandleEncoderEvent(CKY040::TEvent Event)
+// Returns false if the menu has been shut down, but the synth could not
+// be started, true if the menu can continue.
+bool CKernel::AutoBoot()
+{
+    const char* pName = m_BootState.GetLastSynth();
+    if (m_Catalog.Find(pName) < 0)
     {
-        
+        LOGWARN("Autoboot: %s not found", pName);
+        return true;
+    }
 
-    switch (Event)
-        {
-        case CKY040::EventClockwise:
-            m_SelectedSynth = (m_SelectedSynth + 1) % SYNTH_ITEM_COUNT;
-            UpdateDisplay();
-            break;
+    LOGNOTE("Autoboot: %s", pName);
 
-        case CKY040::EventCounterclockwise:
-            m_SelectedSynth = (m_SelectedSynth + SYNTH_ITEM_COUNT - 1) % SYNTH_ITEM_COUNT;
-            UpdateDisplay();
-            break;
+#ifdef ARM_ALLOW_MULTI_CORE
+    // core 1 is not busy with USB, it decodes while the image is read
+    if (!m_pCores->StartTask(MENU_CORE_DECODE, CChunkDecoder::TaskHandler,
+                             m_ChainLoader.GetDecoder()))
+    {
+        LOGWARN("Cannot start decoder");
+    }
+#endif
 
-        case CKY040::EventSwitchClick:
-            m_bShouldStartSynth = true;
-            break;
+    start_synth(pName);
 
-        default:
-            break;
-        }
+    return !m_ChainLoader.IsLoaded();
+}
+
+// Brings up the deferred stages, after autoboot did not start the synth.
+bool CKernel::ResumeMenu()
+{
+    LOGNOTE("Bringing up the menu");
+
+    m_bAutoBoot = false;
+    m_BootStages.Resume();
+
+#ifdef ARM_ALLOW_MULTI_CORE
+    // core 1 may still be running the decoder, core 0 takes USB then
+    if (m_ChainLoader.GetDecoder()->IsRunning()
+        || !m_pCores->StartTask(MenuStages[BootStageUSB].nCore, BootStageTask, this))
+    {
+        return m_BootStages.Run(0, true);
     }
-	
-static void EncoderEventStub(CKY040::TEvent Event, void* pParam)
+
+    return m_BootStages.Run(0);
+#else
+    return m_BootStages.Run(0, true);
+#endif
+}
+
+#ifdef ARM_ALLOW_MULTI_CORE
+void CKernel::BootStageTask(void* pParam)
 {
     CKernel* pThis = static_cast<CKernel*>(pParam);
-    pThis->HandleEncoderEvent(Event);
+    assert(pThis != 0);
+
+    pThis->m_BootStages.Run(CMultiCoreSupport::ThisCore());
 }
 
+void CKernel::StartPrefetch()
+{
+    assert(m_pCores);
+
+    m_Prefetcher.Setup();
+    m_Prefetcher.Select(m_Catalog.Get(m_SelectedSynth));
+    if (!m_pCores->StartTask(MENU_CORE_PREFETCH, CPrefetcher::TaskHandler, &m_Prefetcher))
+    {
+        LOGERR("Cannot start prefetcher");
+        m_Prefetcher.Cancel();
+    }
+}
+#endif
+
+void CKernel::ServiceButtons()
+{
+    unsigned nNow = CTimer::GetClockTicks();
+
+    for (unsigned i = 0; i < ButtonCount; i++)
+    {
+        if (!m_pButtonPin[i])
+            continue;
+
+        // buttons are active low
+        if (m_ButtonDebouncer[i].Update(m_pButtonPin[i]->Read() == LOW, nNow) == CDebouncer::EventPressed)
+        {
+            switch (i)
+            {
+            case ButtonPrev:    MoveSelection(-1);              break;
+            case ButtonNext:    MoveSelection(1);               break;
+            case ButtonSelect:  m_bShouldStartSynth = true;     break;
+            }
+        }
+    }
+}
+
+// Sleeps until the next interrupt (GPIO edge, serial receive, USB, timer
+// tick), unless there is already something to do. IRQs are masked while
+// checking, a pending IRQ still ends WFI. A button which is still settling,
+// a deferred display update or a synth selected while USB is still coming
+// up is looked at again on the next timer tick.
+void CKernel::WaitForEvent()
+{
+    DisableIRQs();
+
+    bool bIdle =    !IsDisplayUpdateDue()
+                 && !(m_bShouldStartSynth && m_BootStages.IsComplete())
+                 && m_USBMIDIQueue.IsEmpty()
+                 && m_AsyncLog.IsEmpty()
+                 && m_Serial.AvailableForRead() == 0;
+
+    for (unsigned i = 0; bIdle && i < ButtonCount; i++)
+    {
+        bIdle = !m_ButtonDebouncer[i].IsTriggered();
+    }
+
+    bIdle =    bIdle
+            && __atomic_load_n(&m_nEncoderDelta, __ATOMIC_RELAXED) == 0
+            && !__atomic_load_n(&m_bEncoderClicked, __ATOMIC_RELAXED);
+
+    if (bIdle)
+    {
+        asm volatile ("wfi");
+    }
+
+    EnableIRQs();
+}
+
+// Called from the GPIO IRQ, so it only records the event. The selection,
+// the display and the prefetcher belong to the main loop, which applies
+// the event in ServiceEncoder().
+void CKernel::HandleEncoderEvent(CKY040::TEvent Event)
+{
+    switch (Event)
+    {
+    case CKY040::EventClockwise:
+        __atomic_add_fetch(&m_nEncoderDelta, 1, __ATOMIC_RELAXED);
+        break;
+
+    case CKY040::EventCounterclockwise:
+        __atomic_sub_fetch(&m_nEncoderDelta, 1, __ATOMIC_RELAXED);
+        break;
+
+    case CKY040::EventSwitchClick:
+        __atomic_store_n(&m_bEncoderClicked, true, __ATOMIC_RELAXED);
+        break;
+
+    default:
+        break;
+    }
+}
+
+// steps turned since the last call are applied at once
+void CKernel::ServiceEncoder()
+{
+    int nDelta = __atomic_exchange_n(&m_nEncoderDelta, 0, __ATOMIC_RELAXED);
+    if (nDelta != 0)
+    {
+        MoveSelection(nDelta);
+    }
+
+    if (__atomic_exchange_n(&m_bEncoderClicked, false, __ATOMIC_RELAXED))
+    {
+        m_bShouldStartSynth = true;
+    }
+}
 
 bool CKernel::LCDinit() 
     {
-		unsigned i2caddr = m_pMiniDexedConfig->GetNumber("LCDI2CAddress", 0);
-		unsigned ssd1306addr = m_pMiniDexedConfig->GetNumber("SSD1306LCDI2CAddress", 0x3c);
-		bool st7789 = m_pMiniDexedConfig->GetNumber("ST7789Enabled", 0);
+		unsigned i2caddr = m_Config.nLCDI2CAddress;
+		unsigned ssd1306addr = m_Config.nSSD1306I2CAddress;
+		bool st7789 = m_Config.nST7789Enabled;
 		if (ssd1306addr != 0) {
-			m_pSSD1306 = new CSSD1306Device (m_pMiniDexedConfig->GetNumber("SSD1306LCDWidth", 128), 
-											 m_pMiniDexedConfig->GetNumber("SSD1306LCDHeight", 32),
+			m_pSSD1306 = m_Arena.New<CSSD1306Device> (m_Config.nSSD1306Width,
+											 m_Config.nSSD1306Height,
 											 &m_I2CMaster, ssd1306addr,
-											 m_pMiniDexedConfig->GetNumber("SSD1306LCDRotate", 0), 
-											 m_pMiniDexedConfig->GetNumber("SSD1306LCDMirror", 0));
-			if (!m_pSSD1306->Initialize ())
+											 m_Config.nSSD1306Rotate,
+											 m_Config.nSSD1306Mirror);
+			if (!m_pSSD1306 || !m_pSSD1306->Initialize ())
 			{
 				LOGNOTE("LCD: SSD1306 initialization failed");
 				return false;
@@ -280,25 +689,25 @@ bool CKernel::LCDinit()
 				return false;
 			}
 
-			unsigned long nSPIClock = 1000 * m_pMiniDexedConfig->GetNumber("SPIClockKHz", SPI_DEF_CLOCK);
-			unsigned nSPIMode = m_pMiniDexedConfig->GetNumber("SPIMode", SPI_DEF_MODE);
+			unsigned long nSPIClock = 1000 * m_Config.nSPIClockKHz;
+			unsigned nSPIMode = m_Config.nSPIMode;
 			unsigned nCPHA = (nSPIMode & 1) ? 1 : 0;
 			unsigned nCPOL = (nSPIMode & 2) ? 1 : 0;
 			LOGNOTE("SPI: CPOL=%u; CPHA=%u; CLK=%u",nCPOL,nCPHA,nSPIClock);
-			m_pST7789Display = new CST7789Display (m_SPIMaster,
-							m_pMiniDexedConfig->GetNumber("ST7789Data", 0),
-							m_pMiniDexedConfig->GetNumber("ST7789Reset", 0),
-							m_pMiniDexedConfig->GetNumber("ST7789Backlight", 0 ),
-							m_pMiniDexedConfig->GetNumber("ST7789Width", 240),
-							m_pMiniDexedConfig->GetNumber("ST7789Height", 240),
+			m_pST7789Display = m_Arena.New<CST7789Display> (m_SPIMaster,
+							m_Config.nST7789Data,
+							m_Config.nST7789Reset,
+							m_Config.nST7789Backlight,
+							m_Config.nST7789Width,
+							m_Config.nST7789Height,
 							nCPOL, nCPHA, nSPIClock,
-							m_pMiniDexedConfig->GetNumber("ST7789Select", 0));
-			if (m_pST7789Display->Initialize())
+							m_Config.nST7789Select);
+			if (m_pST7789Display && m_pST7789Display->Initialize())
 			{
-				m_pST7789Display->SetRotation (m_pMiniDexedConfig->GetNumber("ST7789Rotation", 0));
-				bool bLargeFont = !(m_pMiniDexedConfig->GetNumber("ST7789SmallFont", 0));
-				m_pST7789 = new CST7789Device (m_SPIMaster, m_pST7789Display, m_pMiniDexedConfig->GetNumber("LCDColumns", 0), m_pMiniDexedConfig->GetNumber("LCDRows", 0), Font8x16, bLargeFont, bLargeFont);
-				if (m_pST7789->Initialize())
+				m_pST7789Display->SetRotation (m_Config.nST7789Rotation);
+				bool bLargeFont = !m_Config.nST7789SmallFont;
+				m_pST7789 = m_Arena.New<CST7789Device> (m_SPIMaster, m_pST7789Display, m_LCDColumns, m_LCDRows, Font8x16, bLargeFont, bLargeFont);
+				if (m_pST7789 && m_pST7789->Initialize())
 				{
 					LOGNOTE ("LCD: ST7789");
 					m_LCD = m_pST7789;
@@ -306,8 +715,8 @@ bool CKernel::LCDinit()
 				else
 				{
 					LOGNOTE ("LCD: Failed to initalize ST7789 character device");
-					delete (m_pST7789);
-					delete (m_pST7789Display);
+					m_Arena.Delete (m_pST7789);
+					m_Arena.Delete (m_pST7789Display);
 					m_pST7789 = nullptr;
 					m_pST7789Display = nullptr;
 					return false;
@@ -316,23 +725,23 @@ bool CKernel::LCDinit()
 			else
 			{
 				LOGNOTE ("LCD: Failed to initialize ST7789 display");
-				delete (m_pST7789Display);
+				m_Arena.Delete (m_pST7789Display);
 				m_pST7789Display = nullptr;
 				return false;
 			}
 		}
 		else if (i2caddr == 0)
 		{
-			m_pHD44780 = new CHD44780Device (m_pMiniDexedConfig->GetNumber("LCDColumns", 16), 
-												m_pMiniDexedConfig->GetNumber("LCDRows", 2),
-												m_pMiniDexedConfig->GetNumber("LCDPinData4", 22),
-												m_pMiniDexedConfig->GetNumber("LCDPinData5", 23),
-												m_pMiniDexedConfig->GetNumber("LCDPinData6",24 ),
-												m_pMiniDexedConfig->GetNumber("LCDPinData7", 25),
-												m_pMiniDexedConfig->GetNumber("LCDPinEnable", 4),
-												m_pMiniDexedConfig->GetNumber("LCDPinRegisterSelect", 27),
-												m_pMiniDexedConfig->GetNumber("LCDPinReadWrite", 0));
-			if (!m_pHD44780->Initialize ())
+			m_pHD44780 = m_Arena.New<CHD44780Device> (m_LCDColumns,
+												m_LCDRows,
+												m_Config.nLCDPinData4,
+												m_Config.nLCDPinData5,
+												m_Config.nLCDPinData6,
+												m_Config.nLCDPinData7,
+												m_Config.nLCDPinEnable,
+												m_Config.nLCDPinRegisterSelect,
+												m_Config.nLCDPinReadWrite);
+			if (!m_pHD44780 || !m_pHD44780->Initialize ())
 			{
 				LOGNOTE("LCD: HD44780 initialization failed");
 				return false;
@@ -342,10 +751,10 @@ bool CKernel::LCDinit()
 		}
 		else
 		{
-			m_pHD44780 = new CHD44780Device (&m_I2CMaster, i2caddr,
-							m_pMiniDexedConfig->GetNumber("LCDColumns", 16), 
-                            m_pMiniDexedConfig->GetNumber("LCDRows", 2));
-			if (!m_pHD44780->Initialize ())
+			m_pHD44780 = m_Arena.New<CHD44780Device> (&m_I2CMaster, i2caddr,
+							m_LCDColumns,
+                            m_LCDRows);
+			if (!m_pHD44780 || !m_pHD44780->Initialize ())
 			{
 				LOGNOTE("LCD: HD44780 (I2C) initialization failed");
 				return false;
@@ -355,14 +764,35 @@ bool CKernel::LCDinit()
 		}
 		assert (m_LCD);
 
-		m_pLCDBuffered = new CWriteBufferDevice (m_LCD);
-		assert (m_pLCDBuffered);
+		m_pLCDBuffered = m_Arena.New<CWriteBufferDevice> (m_LCD);
+		if (!m_pLCDBuffered)
+		{
+			return false;
+		}
 		// clear sceen and go to top left corner
 		LCDWrite ("\x1B[H\x1B[J");		// cursor home and clear screen
 		LCDWrite ("\x1B[?25l\x1B""d+");		// cursor off, autopage mode
 		LCDWrite ("Multisynth\nLoading...");
 		m_pLCDBuffered->Update ();
 
+		// the first UpdateDisplay() redraws everything
+		m_LCDFrame.SetSize (m_LCDColumns, m_LCDRows);
+
+#ifdef ARM_ALLOW_MULTI_CORE
+		// a full ST7789 redraw takes milliseconds of SPI transfers, which
+		// are done by another core from now on
+		if (m_pST7789)
+		{
+			assert (m_pCores);
+			m_DisplayWorker.Setup (m_pLCDBuffered, m_LCDColumns, m_LCDRows);
+			if (!m_pCores->StartTask (MENU_CORE_DISPLAY, CDisplayWorker::TaskHandler, &m_DisplayWorker))
+			{
+				LOGERR ("Cannot start display worker");
+				m_DisplayWorker.Cancel ();
+			}
+		}
+#endif
+
 		LOGNOTE ("LCD initialized");
         return true;
 	}
@@ -381,220 +811,429 @@ void CKernel::UpdateDisplay()
 {
     if (!m_LCD || !m_pLCDBuffered) return;
     
-    const char* synthNames[SYNTH_ITEM_COUNT] = {"MiniDexed", "MiniJV880", "MT-32Pi"};
-    const char* currentName = synthNames[m_SelectedSynth];
-    
-    // Формируем строку вывода
-    char displayLine[32] = {0}; // Буфер с запасом
-    snprintf(displayLine, sizeof(displayLine), "%s %s %s",
-             (m_SelectedSynth > 0) ? "<" : " ",
-             currentName,
-             (m_SelectedSynth < SYNTH_ITEM_COUNT-1) ? ">" : " ");
-    
-    // Очистка и вывод
-    LCDWrite("\x1B[H\x1B[J"); // Clear screen
-    LCDWrite("\x1B[?25l");    // Hide cursor
-    LCDWrite("Select Synth\n");
-    LCDWrite(displayLine);
-    
-    m_pLCDBuffered->Update();
-}
+    // only the cells which differ from the last frame are sent
+    m_LCDFrame.Clear();
 
-bool CKernel::CheckUSBMIDI()
-{
-    if (CDeviceNameService::Get()->GetDevice("umidi1", FALSE) == nullptr)
+    unsigned nRows = m_LCDFrame.GetRows();
+    unsigned nCount = m_Catalog.GetCount();
+    if (nRows <= 2)
     {
-        LOGNOTE("USB MIDI device not found yet...");
-        return false;
+        // Формируем строку вывода
+        char displayLine[LCD_FRAME_MAX_COLUMNS + 1];
+        snprintf(displayLine, sizeof(displayLine), "%s %s %s",
+                 (m_SelectedSynth > 0) ? "<" : " ",
+                 m_Catalog.Get(m_SelectedSynth)->Title,
+                 (m_SelectedSynth < (int) nCount-1) ? ">" : " ");
+
+        m_LCDFrame.Print(0, "Select Synth");
+        m_LCDFrame.Print(nRows - 1, displayLine);
+    }
+    else
+    {
+        // one page of synths below the title, the selected one is marked
+        char line[LCD_FRAME_MAX_COLUMNS + 1];
+        snprintf(line, sizeof(line), "%u/%u", m_SelectedSynth + 1, nCount);
+        unsigned nLength = strlen(line);
+        unsigned nColumns = m_LCDFrame.GetColumns();
+        m_LCDFrame.Print(0, "Select Synth");
+        m_LCDFrame.Print(0, line, nColumns > nLength ? nColumns - nLength : 0);
+
+        unsigned nPageSize = GetPageSize();
+        unsigned nFirst = m_SelectedSynth - m_SelectedSynth % nPageSize;
+        for (unsigned i = 0; i < nPageSize && nFirst + i < nCount; i++)
+        {
+            snprintf(line, sizeof(line), "%c%s",
+                     nFirst + i == (unsigned) m_SelectedSynth ? '>' : ' ',
+                     m_Catalog.Get(nFirst + i)->Title);
+            m_LCDFrame.Print(1 + i, line);
+        }
     }
 
-    m_pUSBMIDIDevice = (CUSBMIDIDevice*)CDeviceNameService::Get()->GetDevice("umidi1", FALSE);
-    if (m_pUSBMIDIDevice !=0)
+#ifdef ARM_ALLOW_MULTI_CORE
+    if (m_DisplayWorker.IsRunning())
     {
-        m_pUSBMIDIDevice->RegisterPacketHandler(USBMIDIMessageHandler);
-        m_pUSBMIDIDevice->RegisterRemovedHandler(DeviceRemovedHandler, this);
-        m_bUSBMIDIInitialized = true;
-        LOGNOTE("USB MIDI device registered");
-        return true;
+        m_DisplayWorker.Publish(m_LCDFrame.GetCells());
+    }
+    else
+#endif
+    {
+        m_LCDFrame.Flush(m_pLCDBuffered);
+        m_pLCDBuffered->Update();
     }
 
-    return false;
+    m_nLastDisplayUpdate = CTimer::GetClockTicks();
+}
+
+// Selection changes arriving faster than the frame period are coalesced
+// into one redraw.
+bool CKernel::IsDisplayUpdateDue() const
+{
+    return m_bUpdateDisplay
+        && CTimer::GetClockTicks() - m_nLastDisplayUpdate >= DISPLAY_FRAME_PERIOD_US;
 }
 
 void CKernel::ProcessMIDIInput()
 {
     u8 serialBuffer[64];
     int serialBytes = m_Serial.Read(serialBuffer, sizeof(serialBuffer));
-    ProcessRawMIDIData(serialBuffer, serialBytes);  // Общая обработка
+    if (serialBytes > 0)
+    {
+        m_SerialMIDIParser.Parse(serialBuffer, serialBytes);
+    }
+
+    TMIDIEvent Event;
+    while (m_SerialMIDIQueue.Dequeue(&Event))
+    {
+        HandleMIDIPacket(Event.Message, Event.nLength);
+    }
 
+    while (m_USBMIDIQueue.Dequeue(&Event))
+    {
+        HandleMIDIPacket(Event.Message, Event.nLength);
+    }
 }
 
-void CKernel::USBMIDIMessageHandler(unsigned nCable, u8 *pPacket, unsigned nLength)
+void CKernel::MoveSelection(int nDelta)
 {
-    CKernel* pThis = s_pThis;
-    if (pThis)
-        pThis->HandleMIDIPacket(pPacket, nLength);
-}
+    int nCount = m_Catalog.GetCount();
+    m_SelectedSynth = ((m_SelectedSynth + nDelta) % nCount + nCount) % nCount;
+    m_bUpdateDisplay = true;
 
-void CKernel::DeviceRemovedHandler(CDevice *pDevice, void *pContext) {
-  LOGERR("USB DeviceRemovedHandler");
+#ifdef ARM_ALLOW_MULTI_CORE
+    m_Prefetcher.Select(m_Catalog.Get(m_SelectedSynth));
+#endif
+}
 
-  CKernel *pThis = static_cast<CKernel *>(pContext);
-  assert(pThis != 0);
+// synths shown at once by UpdateDisplay()
+unsigned CKernel::GetPageSize() const
+{
+    unsigned nRows = m_LCDFrame.GetRows();
 
-  if (pDevice == pThis->m_pUSBMIDIDevice)
-    pThis->m_pUSBMIDIDevice = 0;
+    return nRows > 2 ? nRows - 1 : 1;
 }
 
 void CKernel::HandleMIDIPacket(u8 *pPacket, unsigned nLength)
 {
     if (nLength < 1) return;
 
-    const u8 status = pPacket[0] & 0xF0;
-    //const u8 channel = pPacket[0] & 0x0F;
+    unsigned nParam;
+    switch (m_MIDIActions.Lookup(pPacket, nLength, &nParam))
+    {
+    case MIDIActionNext:        MoveSelection(1);                       break;
+    case MIDIActionPrev:        MoveSelection(-1);                      break;
+    case MIDIActionPageNext:    MoveSelection(GetPageSize());           break;
+    case MIDIActionPagePrev:    MoveSelection(-(int) GetPageSize());    break;
+    case MIDIActionSelect:      m_bShouldStartSynth = true;             break;
+
+    case MIDIActionLaunch:
+        m_SelectedSynth = nParam;
+        m_bShouldStartSynth = true;
+        break;
+
+    default:
+        break;
+    }
+}
+
+// Called from the main loop for the serial port and in interrupt context
+// for USB, so only queue the message for HandleMIDIPacket().
+void CKernel::MIDIMessageHandler(unsigned nPort, const u8 *pMessage, unsigned nLength, void *pParam)
+{
+    CKernel* pThis = static_cast<CKernel*>(pParam);
+    assert(pThis != 0);
 
-    // Control Change
-    if (status == 0xB0 && nLength >= 3)
+    // SysEx is not used by the menu
+    if (nLength > sizeof(TMIDIEvent::Message))
+        return;
+
+    TMIDIEvent Event;
+    Event.nTimestamp = CTimer::GetClockTicks();
+    Event.nLength = nLength;
+    memcpy(Event.Message, pMessage, nLength);
+
+    if (nPort == MIDI_PORT_SERIAL)
+    {
+        Event.nSource = MIDISourceSerial;
+        Event.nDevice = 0;
+        Event.nCable = 0;
+        pThis->m_SerialMIDIQueue.Enqueue(Event);
+    }
+    else
     {
-        if (pPacket[2] > 0) // Only on non-zero values
+        Event.nSource = MIDISourceUSB;
+        Event.nDevice = (nPort - MIDI_PORT_USB_FIRST) / USB_MIDI_CABLES;
+        Event.nCable = (nPort - MIDI_PORT_USB_FIRST) % USB_MIDI_CABLES;
+        pThis->m_USBMIDIQueue.Enqueue(Event);
+    }
+}
+
+// Shuts the menu down in the order of TeardownStages, before pSynth is
+// started. Returns false if a stage failed or did not finish within
+// TEARDOWN_BUDGET.
+bool CKernel::Deinit(const TSynthInfo* pSynth)
+{
+    m_pStartingSynth = pSynth;
+    m_Teardown.SetDeadline((CTimer::GetClockTicks() + TEARDOWN_BUDGET) | 1);
+
+#ifdef ARM_ALLOW_MULTI_CORE
+    // core 0 runs the stages of a core, which is not free in time
+    m_Teardown.EnableHelping();
+    StartTeardownTask(TEARDOWN_CORE_SD);
+
+    bool bOK = m_Teardown.Run(0);
+#else
+    bool bOK = m_Teardown.Run(0, true);
+#endif
+
+    m_TeardownProfiler.Dump("Teardown");
+
+    return bOK;
+}
+
+bool CKernel::TeardownStageHandler(unsigned nStage, void* pParam)
+{
+    CKernel* pThis = static_cast<CKernel*>(pParam);
+    assert(pThis != 0);
+
+    switch (nStage)
+    {
+    case TeardownStageLog:
+        // the following messages are written at once
+        pThis->m_AsyncLog.Stop();
+        return true;
+
+    case TeardownStageHandoff:
+        // a synth, which does not know the block, starts as before
+        if (!pThis->WriteHandoff(pThis->m_pStartingSynth))
         {
-            if (pPacket[1] == m_midiNext)
-            {
-                m_SelectedSynth = (m_SelectedSynth + 1) % SYNTH_ITEM_COUNT;
-                UpdateDisplay();
-            }
-            else if (pPacket[1] == m_midiPrev)
-            {
-                m_SelectedSynth = (m_SelectedSynth + SYNTH_ITEM_COUNT - 1) % SYNTH_ITEM_COUNT;
-                UpdateDisplay();
-            }
-            else if (pPacket[1] == m_midiSelect)
+            LOGWARN("Handoff block is incomplete");
+        }
+        return true;
+
+    case TeardownStageDisplay:
+#ifdef ARM_ALLOW_MULTI_CORE
+        if (pThis->m_DisplayWorker.IsRunning())
+        {
+            pThis->m_DisplayWorker.Stop();
+        }
+#endif
+        return true;
+
+    case TeardownStageInput:
+        for (unsigned i = 0; i < ButtonCount; i++)
+        {
+            if (pThis->m_pButtonPin[i])
             {
-                m_bShouldStartSynth = true;
+                pThis->m_pButtonPin[i]->DisableInterrupt();
+                pThis->m_pButtonPin[i]->DisableInterrupt2();
+                pThis->m_pButtonPin[i]->DisconnectInterrupt();
             }
         }
-    }
-    // Note On
-    else if (status == 0x90 && nLength >= 3 && pPacket[2] > 0)
-    {
-        for (int i = 0; i < SYNTH_ITEM_COUNT; i++)
+        return true;
+
+    case TeardownStageUSB:
+        // Run() starts a synth only after USB came up, so this does not
+        // wait, unless the menu is shut down otherwise
+        while (!pThis->m_BootStages.IsComplete())
         {
-            if (pPacket[1] == m_midiNotes[i])
+            if (pThis->m_Teardown.IsTimedOut())
             {
-                m_SelectedSynth = i;
-                m_bShouldStartSynth = true;
-                break;
+                LOGERR("USB is still starting");
+                return false;
             }
         }
+        pThis->m_Arena.Delete(pThis->m_pUSB);
+        pThis->m_pUSB = nullptr;
+        // both producers are gone now, the counts are final
+        if (pThis->m_USBMIDIQueue.GetOverflows() + pThis->m_SerialMIDIQueue.GetOverflows() != 0)
+        {
+            LOGWARN("MIDI events dropped: %u USB, %u serial",
+                    pThis->m_USBMIDIQueue.GetOverflows(), pThis->m_SerialMIDIQueue.GetOverflows());
+        }
+        if (pThis->m_USBMIDIPorts.GetSysExOverflows() + pThis->m_SerialMIDIParser.GetSysExOverflows() != 0)
+        {
+            LOGWARN("SysEx messages longer than %u bytes dropped: %u USB, %u serial",
+                    MIDI_SYSEX_MAX_SIZE, pThis->m_USBMIDIPorts.GetSysExOverflows(),
+                    pThis->m_SerialMIDIParser.GetSysExOverflows());
+        }
+        return true;
+
+    case TeardownStageSD:
+        return f_unmount("SD:") == FR_OK;
+
+    case TeardownStageDevices:
+        // the others at once, in reverse order of construction
+        pThis->m_Arena.Report();
+        pThis->m_Arena.Reset();
+        pThis->m_pScreen = nullptr;
+        pThis->m_LCD = nullptr;
+        pThis->m_pLCDBuffered = nullptr;
+        pThis->m_pSSD1306 = nullptr;
+        pThis->m_pST7789 = nullptr;
+        pThis->m_pST7789Display = nullptr;
+        pThis->m_pHD44780 = nullptr;
+        pThis->m_pRotaryEncoder = nullptr;
+        for (unsigned i = 0; i < ButtonCount; i++)
+        {
+            pThis->m_pButtonPin[i] = nullptr;
+        }
+        pThis->m_SPIMaster = nullptr;
+        return true;
+
+    case TeardownStageVerify:
+        return pThis->VerifyTeardown();
+
+    default:
+        return false;
     }
-    // System Real-Time Messages (просто пропускаем)
-    else if (status == 0xF8)
+}
+
+// Hands the settings, the display, the USB MIDI devices and the boot
+// profile over to the synth (see handoff.h). Runs before the USB and
+// display devices are destroyed. Returns false if not all records fit.
+bool CKernel::WriteHandoff(const TSynthInfo* pSynth)
+{
+    CHandoffWriter Handoff;
+
+    for (unsigned i = 0; i < BootConfigGetKeyCount(); i++)
     {
-        
+        THandoffConfig Config;
+        strncpy(Config.Key, BootConfigGetKeyName(i), sizeof Config.Key);
+        Config.Key[sizeof Config.Key - 1] = '\0';
+        Config.nValue = BootConfigGetValue(&m_Config, i);
+        Handoff.Add(HandoffRecordConfig, Config);
     }
-    // Active Sensing
-    else if (status == 0xFE)
+
+    THandoffDisplay Display;
+    memset(&Display, 0, sizeof Display);
+    Display.bInitialized = m_LCD != nullptr;
+    Display.nColumns = m_LCDColumns;
+    Display.nRows = m_LCDRows;
+    if (m_pSSD1306)
     {
-        
+        Display.nType = HandoffDisplaySSD1306;
+        Display.nI2CAddress = m_Config.nSSD1306I2CAddress;
+        Display.nRotation = m_Config.nSSD1306Rotate ? 2 : 0;
+        Display.nWidth = m_Config.nSSD1306Width;
+        Display.nHeight = m_Config.nSSD1306Height;
     }
-    // System Exclusive (начало)
-    else if (pPacket[0] == 0xF0)
+    else if (m_pST7789)
     {
-        
+        Display.nType = HandoffDisplayST7789;
+        Display.nRotation = m_Config.nST7789Rotation / 90;
+        Display.nWidth = m_Config.nST7789Width;
+        Display.nHeight = m_Config.nST7789Height;
     }
-    // System Exclusive (окончание)
-    else if (pPacket[0] == 0xF7)
+    else if (m_pHD44780)
     {
-        
+        Display.nType = m_Config.nLCDI2CAddress ? HandoffDisplayHD44780I2C : HandoffDisplayHD44780;
+        Display.nI2CAddress = m_Config.nLCDI2CAddress;
+    }
+    Handoff.Add(HandoffRecordDisplay, Display);
+
+    for (unsigned i = 0; i < USB_MIDI_DEVICES; i++)
+    {
+        u16 usVendor, usProduct;
+        if (m_USBMIDIPorts.GetDeviceIdentity(i, &usVendor, &usProduct))
+        {
+            THandoffUSBMIDI Device;
+            memset(&Device, 0, sizeof Device);
+            Device.nDevice = i;
+            Device.nVendor = usVendor;
+            Device.nProduct = usProduct;
+            Handoff.Add(HandoffRecordUSBMIDI, Device);
+        }
     }
+
+    for (unsigned i = 0; i < m_BootProfiler.GetCount(); i++)
+    {
+        const CBootProfiler::TRecord* pRecord = m_BootProfiler.GetRecord(i);
+        assert(pRecord != 0);
+
+        THandoffStage Stage;
+        strncpy(Stage.Name, pRecord->pName, sizeof Stage.Name);
+        Stage.Name[sizeof Stage.Name - 1] = '\0';
+        Stage.nCore = pRecord->nCore;
+        Stage.nStart = pRecord->nStart;
+        Stage.nDuration = pRecord->nEnd ? pRecord->nEnd - pRecord->nStart : 0;
+        Handoff.Add(HandoffRecordStage, Stage);
+    }
+
+    if (pSynth)
+    {
+        THandoffSynth Synth;
+        strncpy(Synth.Name, pSynth->Name, sizeof Synth.Name);
+        Synth.Name[sizeof Synth.Name - 1] = '\0';
+        Synth.nImageSize = pSynth->nImageSize;
+        Synth.nImageCRC = pSynth->nImageCRC;
+        Handoff.Add(HandoffRecordSynth, Synth);
+    }
+
+    size_t nSize = Handoff.Finish(CTimer::GetClockTicks());
+    LOGNOTE("Handoff block: %u bytes", (unsigned) nSize);
+
+    return !Handoff.HasOverflowed();
 }
 
-void CKernel::ProcessRawMIDIData(u8* pData, int nBytes)
+bool CKernel::VerifyTeardown()
 {
-    if (nBytes <= 0 || !pData) return;
+    bool bOK = true;
 
-    // MIDI parsing state
-    static u8 status = 0;
-    static int msgIndex = 0;
-    static u8 msg[3];
-    static int msgLen = 3; // Default length
+    if (m_Arena.GetUsed() != 0)
+    {
+        LOGERR("Devices left in the arena");
+        bOK = false;
+    }
 
-    for (int i = 0; i < nBytes; ++i)
+    if (!m_AsyncLog.IsEmpty())
     {
-        u8 byte = pData[i];
+        LOGERR("Log messages left");
+        bOK = false;
+    }
 
-        // Status byte handling
-        if (byte & 0x80)
-        {
-            status = byte;
-            //int msgIndex = 0;
-            msgLen = ((status & 0xF0) == 0xC0 || (status & 0xF0) == 0xD0) ? 2 : 3;
-        }
+#ifdef ARM_ALLOW_MULTI_CORE
+    if (m_DisplayWorker.IsRunning() || m_Prefetcher.IsRunning())
+    {
+        LOGERR("Display worker or prefetcher still running");
+        bOK = false;
+    }
+#endif
 
-        // Store data bytes
-        if ((size_t)msgIndex < sizeof(msg))
-            msg[msgIndex++] = byte;
+    return bOK;
+}
 
-        // Process complete message
-        if (msgIndex >= msgLen)
-        {
-            const u8 type = status & 0xF0;
-            
-            // Control Change
-            if (type == 0xB0 && msg[2] > 0) // CC with value > 0
-            {
-                if (msg[1] == m_midiNext)
-                {
-                    m_SelectedSynth = (m_SelectedSynth + 1) % SYNTH_ITEM_COUNT;
-                    UpdateDisplay();
-                }
-                else if (msg[1] == m_midiPrev)
-                {
-                    m_SelectedSynth = (m_SelectedSynth + SYNTH_ITEM_COUNT - 1) % SYNTH_ITEM_COUNT;
-                    UpdateDisplay();
-                }
-                else if (msg[1] == m_midiSelect)
-                {
-                    m_bShouldStartSynth = true;
-                }
-            }
-            // Note On
-            else if (type == 0x90 && msg[2] > 0)
-            {
-                for (int i = 0; i < SYNTH_ITEM_COUNT; i++)
-                {
-                    if (msg[1] == m_midiNotes[i])
-                    {
-                        m_SelectedSynth = i;
-                        m_bShouldStartSynth = true;
-                        break;
-                    }
-                }
-            }
+#ifdef ARM_ALLOW_MULTI_CORE
+void CKernel::TeardownTask(void* pParam)
+{
+    CKernel* pThis = static_cast<CKernel*>(pParam);
+    assert(pThis != 0);
 
-            msgIndex = 0; // Reset for next message
-        }
-    }
+    pThis->m_Teardown.Run(CMultiCoreSupport::ThisCore());
 }
 
-void CKernel::Deinit()
+// the previous task of the core may just be returning, otherwise core 0
+// takes the stages of the core
+void CKernel::StartTeardownTask(unsigned nCore)
+{
+    assert(m_pCores);
+
+    unsigned nStart = CTimer::GetClockTicks();
+    while (!m_pCores->StartTask(nCore, TeardownTask, this))
     {
-        delete m_pSSD1306;
-        delete m_pST7789;
-        delete m_pST7789Display;
-        delete m_pHD44780;
-        delete m_pLCDBuffered; 
-        delete m_pMiniDexedConfig;
-        delete m_pConfig;
-        delete m_pRotaryEncoder;
-        delete m_SPIMaster;
-        f_unmount("0:");
+        if (CTimer::GetClockTicks() - nStart > TEARDOWN_TASK_TIMEOUT)
+        {
+            return;
+        }
     }
+}
+#endif
 
 void CKernel::PanicHandler (void)
 {
 	LOGNOTE ("panic!");
 
+	s_pThis->m_AsyncLog.Stop ();
+
 	EnableIRQs ();
 
 	if (s_pThis->mbScreenAvailable)
@@ -604,23 +1243,59 @@ void CKernel::PanicHandler (void)
 }
 
 extern "C" void start_synth(const char* name) {
-    //static int synth_counter = 0;
-    /*CKernel kernel;
-    
-    // Используем логгер через экземпляр класса
-    kernel.m_Logger.Write("MultiSynth", LogNotice, 
-                         "Starting synth: %s (call #%d)", 
-                         name, ++synth_counter);
-
-    while (true) {
-        kernel.ProcessMIDIInput();
-        kernel.m_Timer.MsDelay(10);
-        
-        if (kernel.ReadButton(kernel.m_PinSelect)) {
-            break;
-        }
+    CKernel* pKernel = CKernel::s_pThis;
+    assert(pKernel != 0);
+
+    int nSynth = pKernel->m_Catalog.Find(name);
+    if (nSynth < 0) {
+        LOGERR("Unknown synth %s", name);
+        return;
     }
-    */
-    LOGNOTE("Synth started");
+    const TSynthInfo* pSynth = pKernel->m_Catalog.Get(nSynth);
+
+    unsigned nStart = CTimer::GetClockTicks();
+    unsigned hStage = pKernel->m_BootProfiler.Begin("load");
+
+    // load before Deinit(), which unmounts the SD card, unless the image
+    // has been prefetched already
+#ifdef ARM_ALLOW_MULTI_CORE
+    bool bLoaded = pKernel->m_Prefetcher.Finish(pSynth);
+    pKernel->m_Prefetcher.Report();
+#else
+    bool bLoaded = false;
+#endif
+    if (!bLoaded) {
+        bLoaded = pKernel->m_ChainLoader.Load(pSynth);
+    }
+    pKernel->m_BootProfiler.End(hStage);
+    pKernel->m_BlockCache.Report();
+    if (!bLoaded) {
+        LOGERR("Cannot load %s", name);
+        return;
+    }
+
+    // started again on the next autoboot, the time is up to here, the
+    // state cannot be written after the SD card has been unmounted
+    pKernel->m_BootState.RecordLaunch(name, pKernel->m_bAutoBoot,
+                                      CTimer::GetClockTicks() / 1000);
+
+    if (pKernel->m_bAutoBoot) {
+        pKernel->m_BootProfiler.Dump("Autoboot");
+    }
+
+    LOGNOTE("Starting synth: %s", name);
+    if (!pKernel->Deinit(pSynth)) {
+        LOGERR("Cannot shut the menu down");
+        return;
+    }
+
+    unsigned nNow = CTimer::GetClockTicks();
+    LOGNOTE("Time to launch: %u ms (%u ms since power-on)", (nNow - nStart) / 1000, nNow / 1000);
+
+#ifdef ARM_ALLOW_MULTI_CORE
+    pKernel->m_ChainLoader.Boot(CORES - 1);
+#else
+    pKernel->m_ChainLoader.Boot(0);
+#endif
 }
 MULTI_CORE_APPLICATION(CKernel);
\ No newline at end of file
@@ -24,18 +24,40 @@
 #include <sensor/ky040.h>
 #include <fatfs/ff.h>
 #include <Properties/propertiesfatfsfile.h>
+#include "chainloader.h"
+#include "bootprofiler.h"
+#include "bootstages.h"
+#include "menustages.h"
+#include "bootstate.h"
+#include "teardown.h"
+#include "menucores.h"
+#include "midiqueue.h"
+#include "midiparser.h"
+#include "usbmidiports.h"
+#include "debouncer.h"
+#include "lcdframe.h"
+#include "displayworker.h"
+#include "configcache.h"
+#include "prefetcher.h"
+#include "blockcache.h"
+#include "synthcatalog.h"
+#include "midiactions.h"
+#include "asynclog.h"
+#include "menuarena.h"
+#include "handoff.h"
 #include <cstdio>
 #include <array>
 #include <stdarg.h>
 
-#define MAX_MIDI_MESSAGE 128
-#define SYNTH_ITEM_COUNT 3
+#define MIDI_QUEUE_SIZE 64
+#define MIDI_PORT_SERIAL 0
+#define MIDI_PORT_USB_FIRST 1           // USB_MIDI_PORTS ports, see usbmidiports.h
 #define MULTI_CORE_APPLICATION(className) \
     className Kernel; \
     void kernel_main(void) { Kernel.Run(); }
-#define SPI_INACTIVE	255
-#define SPI_DEF_CLOCK	15000	// kHz
-#define SPI_DEF_MODE	0		// Default mode (0,1,2,3)
+#define DISPLAY_FRAME_PERIOD_US	20000
+
+extern "C" void start_synth(const char* name);
 
 class CKernel : public CStdlibAppStdio
 {
@@ -44,14 +66,12 @@ public:
     virtual ~CKernel(void);
     bool Initialize(void);
     TShutdownMode Run(void);
-    bool CheckUSBMIDI(void);
     const char* GetKernelName() const { return "MultiSynth"; }
     bool LCDinit(void);
     void LCDWrite(const char *pString);
     bool ShouldExit() const { return m_bShouldExit; }
     void SetExitFlag(bool flag) { m_bShouldExit = flag; }
-    CGPIOPin m_PinSelect;
-    CLogger* GetLogger() { return &m_Logger; }
+    CLogger* GetLogger() { return &mLogger; }
     void HandleEncoderEvent(CKY040::TEvent Event);
  
 
@@ -60,16 +80,17 @@ private:
     bool m_bShouldExit = false;
     unsigned m_LCDColumns;
     unsigned m_LCDRows;
-    const std::array<const char*, SYNTH_ITEM_COUNT> m_SynthNames = {"MiniDexed", "MiniJV880", "MT-32Pi"};
 
 private:
-    CScreenDevice* m_pScreen;
+    CScreenDevice* m_pScreen = nullptr;
     CCharDevice *m_LCD;
     CWriteBufferDevice *m_pLCDBuffered = nullptr;
     CSSD1306Device* m_pSSD1306 = nullptr;
     CST7789Device* m_pST7789 = nullptr;
     CST7789Display* m_pST7789Display = nullptr;
     CHD44780Device* m_pHD44780 = nullptr;
+    CLCDFrame m_LCDFrame;
+    unsigned m_nLastDisplayUpdate = 0;
 
     CInterruptSystem m_Interrupt;
 public:
@@ -79,41 +100,100 @@ private:
     CI2CMaster m_I2CMaster;
     CSPIMaster* m_SPIMaster = nullptr;
     CSerialDevice m_Serial;
-    CLogger m_Logger;
-    CUSBMIDIDevice* m_pUSBMIDIDevice;
-    CPropertiesFatFsFile* m_pMiniDexedConfig; 
-    CPropertiesFatFsFile* m_pConfig;
 protected:
     int m_SelectedSynth = 0;
     bool m_bShouldStartSynth = false;
 private:    
     
     CKY040* m_pRotaryEncoder = nullptr;
+    int m_nEncoderDelta = 0;                // steps from the IRQ, applied by Run()
+    bool m_bEncoderClicked = false;
+    CBlockCache m_BlockCache;
     FATFS m_FileSystem;
-    CUSBHCIDevice* m_pUSB;
+    CConfigCache m_ConfigCache;
+    const TBootConfig &m_Config;
+    CUSBHCIDevice* m_pUSB = nullptr;
     //CUSBDevice* m_pUSBDevice; 
     
+    static bool BootStageHandler(unsigned nStage, void* pParam);
+    bool InitScreen(void);
+    bool InitDevices(void);
+    bool MountSD(void);
+    bool LoadConfig(void);
+    bool SelectBootMode(void);
+    bool IsMenuRequested(void);
+    bool BuildMIDIActions(void);
+    bool InitSPI(void);
+    bool InitInput(void);
+    bool InitSerial(void);
+    bool InitUSB(void);
+
+    bool AutoBoot(void);
+    bool ResumeMenu(void);
+#ifdef ARM_ALLOW_MULTI_CORE
+    static void BootStageTask(void* pParam);
+#endif
+
     void UpdateDisplay(void);
-    void ProcessRawMIDIData(u8* pData, int nBytes);
-    void Deinit(void);
+    bool IsDisplayUpdateDue(void) const;
+    static void MIDIMessageHandler(unsigned nPort, const u8 *pMessage, unsigned nLength, void *pParam);
+    bool Deinit(const TSynthInfo* pSynth);
+    bool WriteHandoff(const TSynthInfo* pSynth);
+    static bool TeardownStageHandler(unsigned nStage, void* pParam);
+    bool VerifyTeardown(void);
+#ifdef ARM_ALLOW_MULTI_CORE
+    static void TeardownTask(void* pParam);
+    void StartTeardownTask(unsigned nCore);
+#endif
     void ProcessMIDIInput(void);
     void HandleMIDIPacket(u8* pPacket, unsigned nLength);
-    static void USBMIDIMessageHandler(unsigned nCable, u8 *pPacket,
-                                       unsigned nLength);
-    static void DeviceRemovedHandler(CDevice *pDevice, void *pContext);
+    void MoveSelection(int nDelta);
+    unsigned GetPageSize(void) const;
     static void EncoderEventStub(CKY040::TEvent Event, void* pParam) {
         static_cast<CKernel*>(pParam)->HandleEncoderEvent(Event);
     }
 
     // Button pins
-    CGPIOPin m_PinLeft;
-    CGPIOPin m_PinRight;
-    unsigned m_midiNext = 0;
-    unsigned m_midiPrev = 0;
-    unsigned m_midiSelect = 0;
-    unsigned m_midiNotes[SYNTH_ITEM_COUNT];
-    u8  m_MIDIBuffer[MAX_MIDI_MESSAGE];
+    enum TButton
+    {
+        ButtonPrev,
+        ButtonNext,
+        ButtonSelect,
+        ButtonCount
+    };
+    CGPIOPin* m_pButtonPin[ButtonCount] = {nullptr};
+    CDebouncer m_ButtonDebouncer[ButtonCount];
+    void ServiceButtons(void);
+    void ServiceEncoder(void);
+    void WaitForEvent(void);
+    CMIDIActionTable m_MIDIActions;
     bool m_bUSBMIDIInitialized = false;
+    CMIDIEventQueue<MIDI_QUEUE_SIZE> m_USBMIDIQueue;
+    CMIDIEventQueue<MIDI_QUEUE_SIZE> m_SerialMIDIQueue;
+    CMIDIParser m_SerialMIDIParser;
+    CUSBMIDIPorts m_USBMIDIPorts;
+    volatile bool m_bUpdateDisplay = false;
+
+    CSynthCatalog m_Catalog;
+    CChainLoader m_ChainLoader;
+    CBootProfiler m_BootProfiler;
+    CAsyncLog m_AsyncLog;
+    CMenuArena m_Arena;                 // the devices of the menu
+    CBootStages m_BootStages;
+    CBootState m_BootState;
+    bool m_bAutoBoot = false;
+    CBootProfiler m_TeardownProfiler;
+    CBootStages m_Teardown;
+    const TSynthInfo* m_pStartingSynth = nullptr;
+    bool m_bBootProfileWritten = false;
+#ifdef ARM_ALLOW_MULTI_CORE
+    CMenuCores* m_pCores = nullptr;
+    CDisplayWorker m_DisplayWorker;
+    CPrefetcher m_Prefetcher;
+    void StartPrefetch(void);
+#endif
 
     static CKernel* s_pThis;
+
+    friend void start_synth(const char* name);
 };
\ No newline at end of file
@@ -0,0 +1,93 @@
+// lcdframe.cpp
+
+#include "lcdframe.h"
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+CLCDFrame::CLCDFrame (void)
+:	m_nColumns (0),
+	m_nRows (0),
+	m_bValid (false)
+{
+}
+
+void CLCDFrame::SetSize (unsigned nColumns, unsigned nRows)
+{
+	m_nColumns = nColumns < LCD_FRAME_MAX_COLUMNS ? nColumns : LCD_FRAME_MAX_COLUMNS;
+	m_nRows = nRows < LCD_FRAME_MAX_ROWS ? nRows : LCD_FRAME_MAX_ROWS;
+
+	Clear ();
+	Invalidate ();
+}
+
+void CLCDFrame::Clear (void)
+{
+	memset (m_Back.Cell, ' ', sizeof m_Back.Cell);
+}
+
+void CLCDFrame::Print (unsigned nRow, const char *pText, unsigned nColumn)
+{
+	assert (pText);
+
+	if (nRow >= m_nRows)
+	{
+		return;
+	}
+
+	for (; *pText != '\0' && nColumn < m_nColumns; pText++, nColumn++)
+	{
+		m_Back.Cell[nRow][nColumn] = *pText;
+	}
+}
+
+unsigned CLCDFrame::Flush (CDevice *pDevice)
+{
+	assert (pDevice);
+
+	unsigned nBytes = 0;
+
+	for (unsigned nRow = 0; nRow < m_nRows; nRow++)
+	{
+		const char *pBack = m_Back.Cell[nRow];
+		char *pFront = m_Front.Cell[nRow];
+
+		unsigned nColumn = 0;
+		while (nColumn < m_nColumns)
+		{
+			if (m_bValid && pBack[nColumn] == pFront[nColumn])
+			{
+				nColumn++;
+
+				continue;
+			}
+
+			// extend the run over short unchanged gaps
+			unsigned nEnd = nColumn + 1;
+			unsigned nLastChanged = nColumn;
+			while (nEnd < m_nColumns && nEnd - nLastChanged <= LCD_FRAME_MIN_GAP)
+			{
+				if (!m_bValid || pBack[nEnd] != pFront[nEnd])
+				{
+					nLastChanged = nEnd;
+				}
+
+				nEnd++;
+			}
+			nEnd = nLastChanged + 1;
+
+			char Escape[16];
+			int nLength = snprintf (Escape, sizeof Escape, "\x1B[%u;%uH", nRow + 1, nColumn + 1);
+			pDevice->Write (Escape, nLength);
+			pDevice->Write (&pBack[nColumn], nEnd - nColumn);
+			nBytes += nLength + nEnd - nColumn;
+
+			memcpy (&pFront[nColumn], &pBack[nColumn], nEnd - nColumn);
+			nColumn = nEnd;
+		}
+	}
+
+	m_bValid = true;
+
+	return nBytes;
+}
@@ -0,0 +1,56 @@
+// lcdframe.h
+//
+// Shadow character grid for a CCharDevice. The menu prints into the back
+// buffer, Flush() compares it with what is on the display and only sends
+// the changed cells, addressed with the "\E[row;colH" escape sequence.
+//
+#pragma once
+
+#include <circle/device.h>
+#include <circle/types.h>
+
+#define LCD_FRAME_MAX_COLUMNS	40
+#define LCD_FRAME_MAX_ROWS	16
+
+// unchanged cells shorter than this between two changed runs are resent,
+// because that is cheaper than a cursor move
+#define LCD_FRAME_MIN_GAP	6
+
+struct TLCDCells
+{
+	char Cell[LCD_FRAME_MAX_ROWS][LCD_FRAME_MAX_COLUMNS];
+};
+
+class CLCDFrame
+{
+public:
+	CLCDFrame (void);
+
+	// sizes above the maximum are clipped
+	void SetSize (unsigned nColumns, unsigned nRows);
+	unsigned GetColumns (void) const	{ return m_nColumns; }
+	unsigned GetRows (void) const		{ return m_nRows; }
+
+	// fills the back buffer with spaces
+	void Clear (void);
+	// prints pText into the back buffer, clipped at the end of the row
+	void Print (unsigned nRow, const char *pText, unsigned nColumn = 0);
+
+	// whole back buffer, to pass a frame to another owner of the display
+	const TLCDCells &GetCells (void) const	{ return m_Back; }
+	void SetCells (const TLCDCells &rCells)	{ m_Back = rCells; }
+
+	// the display content is unknown, the next Flush() sends all cells
+	void Invalidate (void)			{ m_bValid = false; }
+
+	// sends the changed cells to pDevice, returns the number of bytes written
+	unsigned Flush (CDevice *pDevice);
+
+private:
+	unsigned m_nColumns;
+	unsigned m_nRows;
+	bool m_bValid;
+
+	TLCDCells m_Back;
+	TLCDCells m_Front;
+};
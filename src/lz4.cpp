@@ -0,0 +1,106 @@
+// lz4.cpp
+
+#include "lz4.h"
+#include <stdint.h>
+#include <string.h>
+
+#define LZ4_MIN_MATCH	4
+
+// reads the continuation bytes of a length, returns false on overrun
+static bool ReadLength (const uint8_t **ppIn, const uint8_t *pInEnd, size_t *pLength)
+{
+	uint8_t uchByte;
+	do
+	{
+		if (*ppIn >= pInEnd)
+		{
+			return false;
+		}
+
+		uchByte = *(*ppIn)++;
+		*pLength += uchByte;
+	}
+	while (uchByte == 255);
+
+	return true;
+}
+
+int LZ4Decompress (const void *pSource, size_t nSourceSize, void *pDest, size_t nDestSize)
+{
+	const uint8_t *pIn = static_cast<const uint8_t *> (pSource);
+	const uint8_t *pInEnd = pIn + nSourceSize;
+	uint8_t *pOutStart = static_cast<uint8_t *> (pDest);
+	uint8_t *pOut = pOutStart;
+	uint8_t *pOutEnd = pOut + nDestSize;
+
+	while (pIn < pInEnd)
+	{
+		unsigned nToken = *pIn++;
+
+		size_t nLiterals = nToken >> 4;
+		if (   nLiterals == 15
+		    && !ReadLength (&pIn, pInEnd, &nLiterals))
+		{
+			return -1;
+		}
+
+		if (   nLiterals > (size_t) (pInEnd - pIn)
+		    || nLiterals > (size_t) (pOutEnd - pOut))
+		{
+			return -1;
+		}
+
+		memcpy (pOut, pIn, nLiterals);
+		pIn += nLiterals;
+		pOut += nLiterals;
+
+		// the last sequence has literals only
+		if (pIn == pInEnd)
+		{
+			break;
+		}
+
+		if (pInEnd - pIn < 2)
+		{
+			return -1;
+		}
+
+		size_t nOffset = pIn[0] | pIn[1] << 8;
+		pIn += 2;
+
+		if (nOffset == 0 || nOffset > (size_t) (pOut - pOutStart))
+		{
+			return -1;
+		}
+
+		size_t nMatch = nToken & 15;
+		if (   nMatch == 15
+		    && !ReadLength (&pIn, pInEnd, &nMatch))
+		{
+			return -1;
+		}
+
+		nMatch += LZ4_MIN_MATCH;
+		if (nMatch > (size_t) (pOutEnd - pOut))
+		{
+			return -1;
+		}
+
+		const uint8_t *pMatch = pOut - nOffset;
+		if (nOffset >= nMatch)
+		{
+			memcpy (pOut, pMatch, nMatch);
+			pOut += nMatch;
+		}
+		else
+		{
+			// overlapping match repeats the last nOffset bytes
+			while (nMatch--)
+			{
+				*pOut++ = *pMatch++;
+			}
+		}
+	}
+
+	return pOut - pOutStart;
+}
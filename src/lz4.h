@@ -0,0 +1,13 @@
+// lz4.h
+//
+// Decoder for the LZ4 block format (no frame format). Checks all bounds,
+// so a damaged block fails cleanly. Does not depend on Circle, the host
+// tools use it too.
+//
+#pragma once
+
+#include <stddef.h>
+
+// returns the number of bytes written to pDest, or -1 if the block is
+// invalid or does not fit into nDestSize bytes
+int LZ4Decompress (const void *pSource, size_t nSourceSize, void *pDest, size_t nDestSize);
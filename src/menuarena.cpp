@@ -0,0 +1,137 @@
+// menuarena.cpp
+
+#include "menuarena.h"
+#include "asynclog.h"
+#include <assert.h>
+
+LOGMODULE ("arena");
+
+alignas (MENU_ARENA_ALIGN) static u8 s_Storage[MENU_ARENA_SIZE];
+
+CMenuArena::CMenuArena (void)
+:	m_nUsed (0),
+	m_nHighWater (0),
+	m_nObjects (0),
+	m_nFailed (0)
+{
+}
+
+CMenuArena::~CMenuArena (void)
+{
+	Reset ();
+}
+
+void CMenuArena::Delete (void *pObject)
+{
+	if (pObject == 0)
+	{
+		return;
+	}
+
+	unsigned nObjects = __atomic_load_n (&m_nObjects, __ATOMIC_ACQUIRE);
+	for (unsigned i = 0; i < nObjects; i++)
+	{
+		TObject *pEntry = &m_Objects[i];
+		if (   pEntry->pObject == pObject
+		    && pEntry->pDestroy != 0)
+		{
+			TDestroy *pDestroy = pEntry->pDestroy;
+			pEntry->pDestroy = 0;
+
+			(*pDestroy) (pObject);
+
+			return;
+		}
+	}
+
+	assert (0);
+}
+
+void CMenuArena::Reset (void)
+{
+	for (unsigned i = m_nObjects; i-- > 0;)
+	{
+		TObject *pEntry = &m_Objects[i];
+		if (pEntry->pDestroy != 0)
+		{
+			TDestroy *pDestroy = pEntry->pDestroy;
+			pEntry->pDestroy = 0;
+
+			(*pDestroy) (pEntry->pObject);
+		}
+	}
+
+	m_nHighWater = GetHighWater ();
+	m_nUsed = 0;
+	m_nObjects = 0;
+}
+
+size_t CMenuArena::GetHighWater (void) const
+{
+	return m_nUsed > m_nHighWater ? m_nUsed : m_nHighWater;
+}
+
+void CMenuArena::Report (void) const
+{
+	LOGNOTE ("%u of %u bytes used by %u objects (%u failed), peak %u bytes",
+		 (unsigned) m_nUsed, MENU_ARENA_SIZE, m_nObjects, m_nFailed,
+		 (unsigned) GetHighWater ());
+}
+
+// Bump allocation without a lock, the objects are counted first, so that a
+// failing allocation does not take memory.
+void *CMenuArena::Allocate (size_t nSize, size_t nAlign, unsigned *pObject)
+{
+	assert (pObject);
+	if (nAlign < MENU_ARENA_ALIGN)
+	{
+		nAlign = MENU_ARENA_ALIGN;
+	}
+	assert ((nAlign & (nAlign - 1)) == 0);
+
+	unsigned nObject = __atomic_fetch_add (&m_nObjects, 1, __ATOMIC_RELAXED);
+	if (nObject >= MENU_ARENA_OBJECTS)
+	{
+		__atomic_fetch_sub (&m_nObjects, 1, __ATOMIC_RELAXED);
+		__atomic_add_fetch (&m_nFailed, 1, __ATOMIC_RELAXED);
+
+		return 0;
+	}
+
+	m_Objects[nObject].pObject = 0;
+	m_Objects[nObject].pDestroy = 0;
+
+	size_t nUsed = __atomic_load_n (&m_nUsed, __ATOMIC_RELAXED);
+	size_t nStart;
+	do
+	{
+		// the storage itself is aligned to MENU_ARENA_ALIGN only
+		uintptr nAddress = (uintptr) &s_Storage[nUsed];
+		nStart = nUsed + (((nAddress + nAlign - 1) & ~(uintptr) (nAlign - 1)) - nAddress);
+		if (nStart + nSize > MENU_ARENA_SIZE)
+		{
+			// the object entry stays unused
+			__atomic_add_fetch (&m_nFailed, 1, __ATOMIC_RELAXED);
+
+			return 0;
+		}
+	}
+	while (!__atomic_compare_exchange_n (&m_nUsed, &nUsed,
+					     (nStart + nSize + MENU_ARENA_ALIGN - 1)
+					     & ~(size_t) (MENU_ARENA_ALIGN - 1),
+					     true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+	*pObject = nObject;
+
+	return &s_Storage[nStart];
+}
+
+void CMenuArena::AddObject (unsigned nObject, void *pObject, TDestroy *pDestroy)
+{
+	assert (nObject < MENU_ARENA_OBJECTS);
+	assert (pObject);
+	assert (pDestroy);
+
+	m_Objects[nObject].pObject = pObject;
+	__atomic_store_n (&m_Objects[nObject].pDestroy, pDestroy, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,87 @@
+// menuarena.h
+//
+// Static memory for the devices of the boot menu. They are constructed in
+// place and destroyed all at once, in reverse order, before a synth is
+// started, so that the menu leaves no fragmented heap behind and its peak
+// use is fixed at link time. The arena is part of the .bss section of the
+// menu, which the image of the synth replaces. Memory the devices allocate
+// themselves still comes from the heap.
+//
+#pragma once
+
+#include <circle/types.h>
+#include <new>
+
+#define MENU_ARENA_SIZE		(64 * 1024)
+#define MENU_ARENA_OBJECTS	32
+#define MENU_ARENA_ALIGN	16		// at least, for all objects
+
+// arena space an object of type T takes at most
+template <class T>
+constexpr size_t MenuArenaSize (void)
+{
+	return   ((sizeof (T) + MENU_ARENA_ALIGN - 1) & ~(size_t) (MENU_ARENA_ALIGN - 1))
+	       + (alignof (T) > MENU_ARENA_ALIGN ? alignof (T) - MENU_ARENA_ALIGN : 0);
+}
+
+class CMenuArena
+{
+public:
+	CMenuArena (void);
+	~CMenuArena (void);
+
+	// constructs an object, returns 0 if the arena is exhausted;
+	// may be called on any core
+	template <class T, typename... TArgs>
+	T *New (TArgs &&... Args)
+	{
+		unsigned nObject;
+		void *pMemory = Allocate (sizeof (T), alignof (T), &nObject);
+		if (pMemory == 0)
+		{
+			return 0;
+		}
+
+		T *pObject = new (pMemory) T (static_cast<TArgs &&> (Args)...);
+		AddObject (nObject, pObject, Destroy<T>);
+
+		return pObject;
+	}
+
+	// destroys an object now, its memory is freed by Reset()
+	void Delete (void *pObject);
+
+	// destroys all objects, on core 0 when the other cores do not use them
+	void Reset (void);
+
+	size_t GetUsed (void) const		{ return m_nUsed; }
+	size_t GetHighWater (void) const;
+
+	void Report (void) const;
+
+private:
+	typedef void TDestroy (void *pObject);
+
+	template <class T>
+	static void Destroy (void *pObject)
+	{
+		static_cast<T *> (pObject)->~T ();
+	}
+
+	void *Allocate (size_t nSize, size_t nAlign, unsigned *pObject);
+	void AddObject (unsigned nObject, void *pObject, TDestroy *pDestroy);
+
+private:
+	struct TObject
+	{
+		void *pObject;
+		TDestroy *pDestroy;		// 0 if destroyed (or still being built)
+	};
+
+	size_t m_nUsed;
+	size_t m_nHighWater;			// of previous uses, see GetHighWater()
+	unsigned m_nObjects;
+	unsigned m_nFailed;
+
+	TObject m_Objects[MENU_ARENA_OBJECTS];
+};
@@ -0,0 +1,70 @@
+// menucores.cpp
+
+#include "menucores.h"
+
+#ifdef ARM_ALLOW_MULTI_CORE
+
+#include "chainloader.h"
+#include "coresync.h"
+#include <assert.h>
+
+CMenuCores::CMenuCores (CMemorySystem *pMemorySystem, CBootStages *pBootStages)
+:	CMultiCoreSupport (pMemorySystem),
+	m_pBootStages (pBootStages)
+{
+	assert (m_pBootStages);
+
+	for (unsigned nCore = 0; nCore < CORES; nCore++)
+	{
+		m_pTask[nCore] = 0;
+		m_pTaskParam[nCore] = 0;
+	}
+}
+
+CMenuCores::~CMenuCores (void)
+{
+}
+
+void CMenuCores::Run (unsigned nCore)
+{
+	assert (nCore > 0);
+
+	m_pBootStages->Run (nCore);
+
+	while (!CChainLoader::IsParkRequested ())
+	{
+		TMenuCoreTask *pTask = __atomic_load_n (&m_pTask[nCore], __ATOMIC_ACQUIRE);
+		if (pTask != 0)
+		{
+			(*pTask) (m_pTaskParam[nCore]);
+
+			__atomic_store_n (&m_pTask[nCore], (TMenuCoreTask *) 0, __ATOMIC_RELEASE);
+
+			continue;
+		}
+
+		CoreWaitForEvent ();
+	}
+
+	CChainLoader::ParkCore (nCore);
+}
+
+bool CMenuCores::StartTask (unsigned nCore, TMenuCoreTask *pTask, void *pParam)
+{
+	assert (0 < nCore && nCore < CORES);
+	assert (pTask != 0);
+
+	if (__atomic_load_n (&m_pTask[nCore], __ATOMIC_ACQUIRE) != 0)
+	{
+		return false;
+	}
+
+	m_pTaskParam[nCore] = pParam;
+	__atomic_store_n (&m_pTask[nCore], pTask, __ATOMIC_RELEASE);
+
+	CoreSendEvent ();
+
+	return true;
+}
+
+#endif
@@ -0,0 +1,42 @@
+// menucores.h
+//
+// Secondary cores of the boot menu. They run their boot stages, then run
+// tasks handed to them by core 0 (e.g. the display worker), until the
+// chainloader asks them to park and then hand themselves over to it.
+//
+#pragma once
+
+#include <circle/sysconfig.h>
+
+#ifdef ARM_ALLOW_MULTI_CORE
+
+#include <circle/multicore.h>
+#include "bootstages.h"
+
+#define MENU_CORE_DECODE	1		// runs CChunkDecoder, after USB is up
+#define MENU_CORE_DISPLAY	2		// runs CDisplayWorker
+#define MENU_CORE_PREFETCH	3		// runs CPrefetcher
+
+// a task must return soon after CChainLoader::IsParkRequested() is set
+typedef void TMenuCoreTask (void *pParam);
+
+class CMenuCores : public CMultiCoreSupport
+{
+public:
+	CMenuCores (CMemorySystem *pMemorySystem, CBootStages *pBootStages);
+	~CMenuCores (void);
+
+	void Run (unsigned nCore) override;
+
+	// runs pTask on nCore once its boot stages are done, returns false if
+	// the core has a task pending already
+	bool StartTask (unsigned nCore, TMenuCoreTask *pTask, void *pParam);
+
+private:
+	CBootStages *m_pBootStages;
+
+	TMenuCoreTask * volatile m_pTask[CORES];
+	void * volatile m_pTaskParam[CORES];
+};
+
+#endif
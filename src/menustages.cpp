@@ -0,0 +1,22 @@
+// menustages.cpp
+
+#include "menustages.h"
+
+// The table order is a valid order of the dependency graph.
+const TBootStageInfo MenuStages[BootStageCount] =
+{
+	// name			core	dependencies
+	{"timer/gpio/i2c",	0,	0},
+	{"mount",		0,	0},
+	{"config",		0,	BOOT_STAGE (BootStageMount)},
+	{"mode",		0,	BOOT_STAGE (BootStageDevices) | BOOT_STAGE (BootStageConfig)},
+	{"screen",		0,	BOOT_STAGE (BootStageMode)},
+	{"catalog",		0,	BOOT_STAGE (BootStageConfig)},
+	{"midi actions",	0,	BOOT_STAGE (BootStageCatalog)},
+	{"spi",			0,	BOOT_STAGE (BootStageConfig)},
+	{"lcd",			0,	  BOOT_STAGE (BootStageDevices) | BOOT_STAGE (BootStageConfig)
+					| BOOT_STAGE (BootStageSPI)},
+	{"encoder/buttons",	0,	BOOT_STAGE (BootStageDevices) | BOOT_STAGE (BootStageConfig)},
+	{"serial",		0,	BOOT_STAGE (BootStageConfig)},
+	{"usb",			1,	BOOT_STAGE (BootStageMode)}
+};
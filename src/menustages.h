@@ -0,0 +1,40 @@
+// menustages.h
+//
+// The boot stages of the menu, run by CBootStages. Core 0 brings up
+// everything the menu needs, USB enumerates on core 1 meanwhile.
+//
+// The mode stage decides, whether the synth launched last is started again
+// at once (autoboot, see synth.ini). The stages in MENU_STAGES_DEFERRED are
+// only needed by the menu itself, they are deferred then and only run, if
+// the menu is shown after all.
+//
+#pragma once
+
+#include "bootstages.h"
+
+enum TBootStage
+{
+	BootStageDevices,			// timer, GPIO, I2C
+	BootStageMount,
+	BootStageConfig,
+	BootStageMode,				// menu or autoboot
+	BootStageScreen,
+	BootStageCatalog,
+	BootStageActions,
+	BootStageSPI,
+	BootStageLCD,
+	BootStageInput,
+	BootStageSerial,
+	BootStageUSB,
+	BootStageCount
+};
+
+#define MENU_STAGES_DEFERRED	(  BOOT_STAGE (BootStageScreen)		\
+				 | BOOT_STAGE (BootStageActions)	\
+				 | BOOT_STAGE (BootStageSPI)		\
+				 | BOOT_STAGE (BootStageLCD)		\
+				 | BOOT_STAGE (BootStageInput)		\
+				 | BOOT_STAGE (BootStageSerial)		\
+				 | BOOT_STAGE (BootStageUSB))
+
+extern const TBootStageInfo MenuStages[BootStageCount];
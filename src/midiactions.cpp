@@ -0,0 +1,92 @@
+// midiactions.cpp
+
+#include "midiactions.h"
+#include <string.h>
+#include <assert.h>
+
+// -1 if the message type cannot be mapped
+const int8_t CMIDIActionTable::s_TypeIndex[8] =
+{
+	-1,				// 0x80 Note Off
+	MIDIActionTypeNoteOn,		// 0x90
+	-1,				// 0xA0 Polyphonic Key Pressure
+	MIDIActionTypeControl,		// 0xB0
+	MIDIActionTypeProgram,		// 0xC0
+	-1,				// 0xD0 Channel Pressure
+	-1,				// 0xE0 Pitch Bend
+	-1				// 0xF0 System
+};
+
+CMIDIActionTable::CMIDIActionTable (void)
+{
+	Clear ();
+}
+
+void CMIDIActionTable::Clear (void)
+{
+	memset (m_Table, 0, sizeof m_Table);	// MIDIActionNone
+}
+
+bool CMIDIActionTable::Map (TMIDIActionType Type, unsigned nChannel, unsigned nData1,
+			    TMIDIAction Action, unsigned nParam, unsigned nThreshold)
+{
+	if (   Type >= MIDIActionTypeCount
+	    || nChannel > MIDI_ACTION_CHANNELS
+	    || nData1 > 127
+	    || Action == MIDIActionNone || Action >= MIDIActionCount
+	    || nParam > 0xFFFF
+	    || nThreshold > 127)
+	{
+		return false;
+	}
+
+	unsigned nFirst = nChannel == MIDI_ACTION_OMNI ? 0 : nChannel - 1;
+	unsigned nLast = nChannel == MIDI_ACTION_OMNI ? MIDI_ACTION_CHANNELS - 1 : nChannel - 1;
+
+	bool bOK = true;
+	for (unsigned i = nFirst; i <= nLast; i++)
+	{
+		TMIDIActionEntry *pEntry = &m_Table[Type][i][nData1];
+		if (pEntry->nAction != MIDIActionNone)
+		{
+			bOK = false;
+
+			continue;
+		}
+
+		pEntry->nAction = Action;
+		pEntry->nThreshold = nThreshold > 0 ? nThreshold : 1;
+		pEntry->nParam = nParam;
+	}
+
+	return bOK;
+}
+
+TMIDIAction CMIDIActionTable::Lookup (const uint8_t *pMessage, unsigned nLength,
+				      unsigned *pParam) const
+{
+	assert (pMessage != 0 || nLength == 0);
+	assert (pParam);
+
+	if (nLength < 2 || !(pMessage[0] & 0x80))
+	{
+		return MIDIActionNone;
+	}
+
+	int nType = s_TypeIndex[(pMessage[0] >> 4) & 0x07];
+	if (nType < 0)
+	{
+		return MIDIActionNone;
+	}
+
+	const TMIDIActionEntry &rEntry = m_Table[nType][pMessage[0] & 0x0F][pMessage[1] & 0x7F];
+	if (   nType != MIDIActionTypeProgram
+	    && (nLength < 3 || pMessage[2] < rEntry.nThreshold))
+	{
+		return MIDIActionNone;
+	}
+
+	*pParam = rEntry.nParam;
+
+	return static_cast<TMIDIAction> (rEntry.nAction);
+}
@@ -0,0 +1,67 @@
+// midiactions.h
+//
+// Maps MIDI messages to actions of the boot menu. The table is indexed by
+// message type, channel and the first data byte, so that a message is
+// dispatched with one lookup. It is built at boot from the config and the
+// synth catalog, which change only between boots. A mapping applies on one
+// channel or on all, a message triggers it only if its second data byte
+// (velocity, controller value) reaches the threshold of the mapping.
+//
+// Does not depend on Circle.
+//
+#pragma once
+
+#include <stdint.h>
+
+#define MIDI_ACTION_CHANNELS	16
+#define MIDI_ACTION_OMNI	0		// channel, all channels
+
+enum TMIDIAction
+{
+	MIDIActionNone,
+	MIDIActionNext,
+	MIDIActionPrev,
+	MIDIActionPageNext,
+	MIDIActionPagePrev,
+	MIDIActionSelect,			// starts the selected synth
+	MIDIActionLaunch,			// starts the synth given by the parameter
+	MIDIActionCount
+};
+
+enum TMIDIActionType
+{
+	MIDIActionTypeNoteOn,
+	MIDIActionTypeControl,
+	MIDIActionTypeProgram,			// has no threshold
+	MIDIActionTypeCount
+};
+
+struct TMIDIActionEntry
+{
+	uint8_t nAction;			// TMIDIAction
+	uint8_t nThreshold;
+	uint16_t nParam;
+};
+
+class CMIDIActionTable
+{
+public:
+	CMIDIActionTable (void);
+
+	void Clear (void);
+
+	// nChannel is 1..16 or MIDI_ACTION_OMNI, thresholds below 1 are raised
+	// to 1; an existing mapping is kept, returns false then or if a
+	// parameter is out of range
+	bool Map (TMIDIActionType Type, unsigned nChannel, unsigned nData1,
+		  TMIDIAction Action, unsigned nParam = 0, unsigned nThreshold = 1);
+
+	// pMessage[0] is the status byte, returns MIDIActionNone if the message
+	// is not mapped or below the threshold
+	TMIDIAction Lookup (const uint8_t *pMessage, unsigned nLength, unsigned *pParam) const;
+
+private:
+	TMIDIActionEntry m_Table[MIDIActionTypeCount][MIDI_ACTION_CHANNELS][128];
+
+	static const int8_t s_TypeIndex[8];	// by status 0x80..0xF0
+};
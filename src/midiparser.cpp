@@ -0,0 +1,213 @@
+// midiparser.cpp
+
+#include "midiparser.h"
+#include <assert.h>
+
+#define MIDI_SYSEX_START	0xF0
+#define MIDI_SYSEX_END		0xF7
+#define MIDI_REALTIME_FIRST	0xF8
+
+// total message length including the status byte
+const u8 CMIDIParser::s_ChannelLength[8] =
+{
+	3,	// 0x80 Note Off
+	3,	// 0x90 Note On
+	3,	// 0xA0 Polyphonic Key Pressure
+	3,	// 0xB0 Control Change
+	2,	// 0xC0 Program Change
+	2,	// 0xD0 Channel Pressure
+	3,	// 0xE0 Pitch Bend
+	0	// 0xF0 System, see below
+};
+
+// 0 marks undefined status bytes, which are ignored
+const u8 CMIDIParser::s_SystemLength[16] =
+{
+	0,	// 0xF0 SysEx start, handled separately
+	2,	// 0xF1 MTC Quarter Frame
+	3,	// 0xF2 Song Position Pointer
+	2,	// 0xF3 Song Select
+	0,	// 0xF4 undefined
+	0,	// 0xF5 undefined
+	1,	// 0xF6 Tune Request
+	0,	// 0xF7 SysEx end, handled separately
+	1,	// 0xF8 Timing Clock
+	0,	// 0xF9 undefined
+	1,	// 0xFA Start
+	1,	// 0xFB Continue
+	1,	// 0xFC Stop
+	0,	// 0xFD undefined
+	1,	// 0xFE Active Sensing
+	1	// 0xFF System Reset
+};
+
+CMIDIParser::CMIDIParser (void)
+:	m_nPort (0),
+	m_pHandler (0),
+	m_pParam (0),
+	m_nSysExOverflows (0)
+{
+	Reset ();
+}
+
+void CMIDIParser::RegisterMessageHandler (TMIDIMessageHandler *pHandler, void *pParam,
+					  unsigned nPort)
+{
+	m_pHandler = pHandler;
+	m_pParam = pParam;
+	m_nPort = nPort;
+}
+
+void CMIDIParser::Reset (void)
+{
+	m_uchStatus = 0;
+	m_nIndex = 0;
+	m_nLength = 0;
+	m_bInSysEx = false;
+	m_bSysExOverflow = false;
+	m_nSysExLength = 0;
+}
+
+void CMIDIParser::Parse (const u8 *pData, unsigned nLength)
+{
+	assert (pData != 0 || nLength == 0);
+
+	while (nLength--)
+	{
+		Parse (*pData++);
+	}
+}
+
+void CMIDIParser::Parse (u8 uchByte)
+{
+	// realtime messages may appear anywhere and do not affect the state
+	if (uchByte >= MIDI_REALTIME_FIRST)
+	{
+		if (s_SystemLength[uchByte & 0x0F])
+		{
+			Emit (&uchByte, 1);
+		}
+
+		return;
+	}
+
+	if (uchByte & 0x80)
+	{
+		// any status byte terminates a SysEx message
+		if (m_bInSysEx)
+		{
+			EndSysEx (uchByte == MIDI_SYSEX_END);
+
+			if (uchByte == MIDI_SYSEX_END)
+			{
+				return;
+			}
+		}
+
+		m_nIndex = 0;
+
+		if (uchByte < 0xF0)
+		{
+			m_uchStatus = uchByte;
+			m_nLength = s_ChannelLength[(uchByte >> 4) & 0x07];
+			m_Message[m_nIndex++] = uchByte;
+
+			return;
+		}
+
+		// system common messages cancel the running status
+		m_uchStatus = 0;
+		m_nLength = 0;
+
+		if (uchByte == MIDI_SYSEX_START)
+		{
+			m_bInSysEx = true;
+			m_bSysExOverflow = false;
+			m_SysEx[0] = uchByte;
+			m_nSysExLength = 1;
+
+			return;
+		}
+
+		unsigned nLength = s_SystemLength[uchByte & 0x0F];
+		if (nLength == 1)
+		{
+			Emit (&uchByte, 1);
+		}
+		else if (nLength > 1)
+		{
+			m_nLength = nLength;
+			m_Message[m_nIndex++] = uchByte;
+		}
+
+		return;
+	}
+
+	// data byte
+	if (m_bInSysEx)
+	{
+		// keep room for the end byte
+		if (m_nSysExLength < MIDI_SYSEX_MAX_SIZE - 1)
+		{
+			m_SysEx[m_nSysExLength++] = uchByte;
+		}
+		else
+		{
+			m_bSysExOverflow = true;
+		}
+
+		return;
+	}
+
+	if (m_nIndex == 0)
+	{
+		if (m_uchStatus == 0)
+		{
+			return;			// no status to continue
+		}
+
+		m_Message[m_nIndex++] = m_uchStatus;
+		m_nLength = s_ChannelLength[(m_uchStatus >> 4) & 0x07];
+	}
+
+	m_Message[m_nIndex++] = uchByte;
+
+	if (m_nIndex >= m_nLength)
+	{
+		Emit (m_Message, m_nLength);
+
+		m_nIndex = 0;
+		if (m_uchStatus == 0)
+		{
+			m_nLength = 0;		// system common, no running status
+		}
+	}
+}
+
+void CMIDIParser::Emit (const u8 *pMessage, unsigned nLength)
+{
+	if (m_pHandler != 0)
+	{
+		(*m_pHandler) (m_nPort, pMessage, nLength, m_pParam);
+	}
+}
+
+void CMIDIParser::EndSysEx (bool bComplete)
+{
+	m_bInSysEx = false;
+
+	if (m_bSysExOverflow)
+	{
+		m_nSysExOverflows++;
+
+		return;
+	}
+
+	// an unterminated message is passed on as is
+	if (bComplete)
+	{
+		m_SysEx[m_nSysExLength++] = MIDI_SYSEX_END;
+	}
+
+	Emit (m_SysEx, m_nSysExLength);
+}
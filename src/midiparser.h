@@ -0,0 +1,61 @@
+// midiparser.h
+//
+// Streaming MIDI 1.0 byte parser for one port. Handles running status,
+// realtime bytes interleaved anywhere (also inside other messages and
+// SysEx) and SysEx messages of any length into a bounded buffer. It does
+// not allocate memory, a parser instance is kept per port (serial, USB
+// cable).
+//
+#pragma once
+
+#include <circle/types.h>
+
+#define MIDI_SYSEX_MAX_SIZE	256
+
+// pMessage[0] is the status byte, SysEx messages include 0xF0 and 0xF7
+typedef void TMIDIMessageHandler (unsigned nPort, const u8 *pMessage, unsigned nLength,
+				  void *pParam);
+
+class CMIDIParser
+{
+public:
+	CMIDIParser (void);
+
+	// nPort is passed back to the handler
+	void RegisterMessageHandler (TMIDIMessageHandler *pHandler, void *pParam = 0,
+				     unsigned nPort = 0);
+
+	void Parse (const u8 *pData, unsigned nLength);
+	void Parse (u8 uchByte);
+
+	// drops a partial message and the running status
+	void Reset (void);
+
+	// SysEx messages that did not fit into the buffer (and were dropped)
+	unsigned GetSysExOverflows (void) const	{ return m_nSysExOverflows; }
+
+private:
+	void Emit (const u8 *pMessage, unsigned nLength);
+	void EndSysEx (bool bComplete);
+
+private:
+	unsigned m_nPort;
+	TMIDIMessageHandler *m_pHandler;
+	void *m_pParam;
+
+	u8 m_uchStatus;			// running status, 0 if none
+	u8 m_Message[3];
+	unsigned m_nIndex;		// bytes in m_Message
+	unsigned m_nLength;		// expected length of the current message
+
+	bool m_bInSysEx;
+	bool m_bSysExOverflow;
+	unsigned m_nSysExLength;
+	unsigned m_nSysExOverflows;
+	u8 m_SysEx[MIDI_SYSEX_MAX_SIZE];
+
+	// message length for status bytes 0x80..0xFF, by high nibble (0x80..0xE0)
+	// and by low nibble for system messages (0xF0..0xFF)
+	static const u8 s_ChannelLength[8];
+	static const u8 s_SystemLength[16];
+};
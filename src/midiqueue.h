@@ -0,0 +1,94 @@
+// midiqueue.h
+//
+// Fixed capacity, lock-free single producer / single consumer queue of
+// decoded MIDI messages. One queue per source, so that an interrupt handler
+// (USB) or the serial poll can hand messages to the main loop without locks.
+//
+#pragma once
+
+#include <circle/types.h>
+#include <assert.h>
+
+enum TMIDISource
+{
+	MIDISourceSerial,
+	MIDISourceUSB,
+	MIDISourceUnknown
+};
+
+struct TMIDIEvent
+{
+	unsigned nTimestamp;		// CTimer::GetClockTicks() on arrival
+	u8 nSource;			// TMIDISource
+	u8 nDevice;			// USB only, 0-based
+	u8 nCable;
+	u8 nLength;			// valid bytes in Message
+	u8 Message[3];
+};
+
+template <unsigned nSize>		// must be a power of 2
+class CMIDIEventQueue
+{
+	static_assert (nSize >= 2 && (nSize & (nSize - 1)) == 0, "nSize must be a power of 2");
+
+public:
+	CMIDIEventQueue (void)
+	:	m_nIn (0),
+		m_nOut (0),
+		m_nOverflows (0)
+	{
+	}
+
+	// producer side, returns false (and drops the event) if the queue is full
+	bool Enqueue (const TMIDIEvent &rEvent)
+	{
+		unsigned nIn = __atomic_load_n (&m_nIn, __ATOMIC_RELAXED);
+		if (nIn - __atomic_load_n (&m_nOut, __ATOMIC_ACQUIRE) >= nSize)
+		{
+			m_nOverflows++;
+
+			return false;
+		}
+
+		m_Events[nIn & (nSize - 1)] = rEvent;
+		__atomic_store_n (&m_nIn, nIn + 1, __ATOMIC_RELEASE);
+
+		return true;
+	}
+
+	// consumer side, returns false if the queue is empty
+	bool Dequeue (TMIDIEvent *pEvent)
+	{
+		assert (pEvent);
+
+		unsigned nOut = __atomic_load_n (&m_nOut, __ATOMIC_RELAXED);
+		if (nOut == __atomic_load_n (&m_nIn, __ATOMIC_ACQUIRE))
+		{
+			return false;
+		}
+
+		*pEvent = m_Events[nOut & (nSize - 1)];
+		__atomic_store_n (&m_nOut, nOut + 1, __ATOMIC_RELEASE);
+
+		return true;
+	}
+
+	bool IsEmpty (void) const
+	{
+		return   __atomic_load_n (&m_nIn, __ATOMIC_ACQUIRE)
+		      == __atomic_load_n (&m_nOut, __ATOMIC_ACQUIRE);
+	}
+
+	// written by the producer only
+	unsigned GetOverflows (void) const
+	{
+		return m_nOverflows;
+	}
+
+private:
+	TMIDIEvent m_Events[nSize];
+
+	unsigned m_nIn;			// written by the producer only
+	unsigned m_nOut;		// written by the consumer only
+	volatile unsigned m_nOverflows;
+};
@@ -0,0 +1,156 @@
+// prefetcher.cpp
+
+#include "prefetcher.h"
+#include "asynclog.h"
+#include "coresync.h"
+#include <string.h>
+#include <assert.h>
+
+LOGMODULE ("prefetch");
+
+CPrefetcher::CPrefetcher (CChainLoader *pChainLoader)
+:	m_pChainLoader (pChainLoader),
+	m_pRequested (0),
+	m_nGeneration (0),
+	m_nLoading (0),
+	m_nDone (0),
+	m_bRunning (false),
+	m_bStop (false),
+	m_nHits (0),
+	m_nPartialHits (0),
+	m_nMisses (0)
+{
+	assert (m_pChainLoader);
+}
+
+void CPrefetcher::Setup (void)
+{
+	assert (!IsRunning ());
+
+	m_bStop = false;
+	__atomic_store_n (&m_bRunning, true, __ATOMIC_RELEASE);
+}
+
+void CPrefetcher::TaskHandler (void *pParam)
+{
+	CPrefetcher *pThis = static_cast<CPrefetcher *> (pParam);
+	assert (pThis != 0);
+
+	pThis->Run ();
+}
+
+void CPrefetcher::Select (const TSynthInfo *pSynth)
+{
+	assert (pSynth);
+
+	m_pRequested = pSynth;
+	__atomic_add_fetch (&m_nGeneration, 1, __ATOMIC_RELEASE);
+
+	CoreSendEvent ();
+}
+
+bool CPrefetcher::Finish (const TSynthInfo *pSynth)
+{
+	assert (pSynth);
+
+	if (IsRunning ())
+	{
+		unsigned nGeneration = __atomic_load_n (&m_nGeneration, __ATOMIC_ACQUIRE);
+
+		const TSynthInfo *pRequested = m_pRequested;
+		if (pRequested == 0 || strcmp (pRequested->Name, pSynth->Name) != 0)
+		{
+			// selected without being highlighted (MIDI note)
+			m_nMisses++;
+		}
+		else if (__atomic_load_n (&m_nDone, __ATOMIC_ACQUIRE) == nGeneration)
+		{
+			m_nHits++;
+		}
+		else
+		{
+			m_nPartialHits++;
+
+			while (   IsRunning ()
+			       && __atomic_load_n (&m_nDone, __ATOMIC_ACQUIRE) != nGeneration)
+			{
+				CoreYield ();
+			}
+		}
+
+		__atomic_store_n (&m_bStop, true, __ATOMIC_RELEASE);
+		CoreSendEvent ();
+
+		while (IsRunning ())
+		{
+			CoreYield ();
+		}
+	}
+	else
+	{
+		m_nMisses++;
+	}
+
+	return m_pChainLoader->IsLoaded (pSynth);
+}
+
+void CPrefetcher::Cancel (void)
+{
+	m_pRequested = 0;
+	__atomic_store_n (&m_bRunning, false, __ATOMIC_RELEASE);
+}
+
+bool CPrefetcher::IsRunning (void) const
+{
+	return __atomic_load_n (&m_bRunning, __ATOMIC_ACQUIRE);
+}
+
+void CPrefetcher::Report (void) const
+{
+	unsigned nTotal = m_nHits + m_nPartialHits + m_nMisses;
+
+	LOGNOTE ("%u hits, %u partial hits, %u misses (%u%% hit rate)",
+		 m_nHits, m_nPartialHits, m_nMisses,
+		 nTotal > 0 ? 100 * (m_nHits + m_nPartialHits) / nTotal : 0);
+}
+
+void CPrefetcher::Run (void)
+{
+	while (   !__atomic_load_n (&m_bStop, __ATOMIC_ACQUIRE)
+	       && !CChainLoader::IsParkRequested ())
+	{
+		unsigned nGeneration = __atomic_load_n (&m_nGeneration, __ATOMIC_ACQUIRE);
+		if (   nGeneration == __atomic_load_n (&m_nDone, __ATOMIC_RELAXED)
+		    || m_pRequested == 0)
+		{
+			CoreWaitForEvent ();
+
+			continue;
+		}
+
+		const TSynthInfo *pSynth = m_pRequested;
+		__atomic_store_n (&m_nLoading, nGeneration, __ATOMIC_RELEASE);
+
+		// the staging buffer may still hold this synth from an earlier
+		// selection
+		if (!m_pChainLoader->IsLoaded (pSynth))
+		{
+			m_pChainLoader->Load (pSynth, CancelHandler, this);
+		}
+
+		// a cancelled load is superseded by a newer generation anyway
+		__atomic_store_n (&m_nDone, nGeneration, __ATOMIC_RELEASE);
+	}
+
+	__atomic_store_n (&m_bRunning, false, __ATOMIC_RELEASE);
+}
+
+bool CPrefetcher::CancelHandler (void *pParam)
+{
+	CPrefetcher *pThis = static_cast<CPrefetcher *> (pParam);
+	assert (pThis != 0);
+
+	return    __atomic_load_n (&pThis->m_nGeneration, __ATOMIC_ACQUIRE) != pThis->m_nLoading
+	       || __atomic_load_n (&pThis->m_bStop, __ATOMIC_ACQUIRE)
+	       || CChainLoader::IsParkRequested ();
+}
@@ -0,0 +1,61 @@
+// prefetcher.h
+//
+// Loads the synth highlighted in the menu into the chainloader staging
+// buffer on a secondary core, so that Select can start it without reading
+// the SD card first. A new selection cancels a running load at the next
+// chunk and restarts it for the new synth.
+//
+// While the prefetcher task runs it is the only user of FatFs and of the
+// chainloader, Finish() stops it before core 0 takes over again.
+//
+#pragma once
+
+#include <circle/types.h>
+#include "chainloader.h"
+
+class CPrefetcher
+{
+public:
+	CPrefetcher (CChainLoader *pChainLoader);
+
+	// core 0, before the task is started
+	void Setup (void);
+
+	// TMenuCoreTask, pParam is the CPrefetcher
+	static void TaskHandler (void *pParam);
+
+	// the highlighted synth has changed, pSynth must stay valid
+	void Select (const TSynthInfo *pSynth);
+
+	// Select was pressed for pSynth: waits for a running prefetch of it,
+	// stops the task and returns true if pSynth is in the staging buffer
+	bool Finish (const TSynthInfo *pSynth);
+
+	// core 0, if the task could not be started: Run() has not been
+	// entered, so there is nothing to stop
+	void Cancel (void);
+
+	bool IsRunning (void) const;
+
+	// writes the hit rate to the log
+	void Report (void) const;
+
+private:
+	void Run (void);
+	static bool CancelHandler (void *pParam);
+
+private:
+	CChainLoader *m_pChainLoader;
+
+	const TSynthInfo * volatile m_pRequested;
+	volatile unsigned m_nGeneration;	// incremented by Select()
+	volatile unsigned m_nLoading;		// generation being loaded
+	volatile unsigned m_nDone;		// last generation loaded (or failed)
+
+	volatile bool m_bRunning;
+	volatile bool m_bStop;
+
+	unsigned m_nHits;			// image was ready
+	unsigned m_nPartialHits;		// image was being loaded
+	unsigned m_nMisses;
+};
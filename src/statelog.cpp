@@ -0,0 +1,143 @@
+// statelog.cpp
+
+#include "statelog.h"
+#include "crc32.h"
+#include <assert.h>
+#include <string.h>
+
+CStateLog::CStateLog (unsigned nSlots, TStateLogReadHandler *pReadHandler,
+		      TStateLogWriteHandler *pWriteHandler, void *pParam)
+:	m_nSlots (nSlots),
+	m_pReadHandler (pReadHandler),
+	m_pWriteHandler (pWriteHandler),
+	m_pParam (pParam),
+	m_nSequence (0),
+	m_nNextSlot (0),
+	m_bReady (false)
+{
+	assert (0 < m_nSlots && m_nSlots <= STATE_LOG_SLOTS_MAX);
+	assert (m_pReadHandler);
+	assert (m_pWriteHandler);
+}
+
+bool CStateLog::Format (void)
+{
+	memset (&m_Records[0], 0, sizeof m_Records[0]);
+
+	for (unsigned nSlot = 0; nSlot < m_nSlots; nSlot++)
+	{
+		if (!(*m_pWriteHandler) (nSlot, &m_Records[0], m_pParam))
+		{
+			return false;
+		}
+	}
+
+	m_nSequence = 0;
+	m_nNextSlot = 0;
+	m_bReady = true;
+
+	return true;
+}
+
+bool CStateLog::Recover (void *pData, size_t nSize)
+{
+	assert (pData);
+	assert (nSize <= STATE_LOG_DATA_MAX);
+
+	m_nSequence = 0;
+	m_nNextSlot = 0;
+	m_bReady = false;
+
+	if (!(*m_pReadHandler) (0, m_nSlots, m_Records, m_pParam))
+	{
+		return false;
+	}
+
+	m_bReady = true;
+
+	int nNewest = -1;
+	for (unsigned nSlot = 0; nSlot < m_nSlots; nSlot++)
+	{
+		const TStateLogRecord *pRecord = &m_Records[nSlot];
+		if (!IsValid (pRecord))
+		{
+			continue;
+		}
+
+		// the sequence wraps around
+		if (   nNewest < 0
+		    || (int32_t) (pRecord->Header.nSequence - m_nSequence) > 0)
+		{
+			nNewest = nSlot;
+			m_nSequence = pRecord->Header.nSequence;
+		}
+	}
+
+	if (nNewest < 0)
+	{
+		return false;
+	}
+
+	m_nNextSlot = (nNewest + 1) % m_nSlots;
+
+	const TStateLogRecord *pRecord = &m_Records[nNewest];
+	size_t nCopy = pRecord->Header.nSize < nSize ? pRecord->Header.nSize : nSize;
+	memcpy (pData, pRecord->Data, nCopy);
+	memset (static_cast<uint8_t *> (pData) + nCopy, 0, nSize - nCopy);
+
+	return true;
+}
+
+bool CStateLog::Append (const void *pData, size_t nSize)
+{
+	assert (m_bReady);
+	assert (pData);
+	assert (nSize <= STATE_LOG_DATA_MAX);
+
+	uint32_t nSequence = m_nSequence + 1;
+	if (nSequence == 0)
+	{
+		nSequence = 1;
+	}
+
+	TStateLogRecord *pRecord = &m_Records[0];
+	memset (pRecord, 0, sizeof *pRecord);
+	pRecord->Header.nMagic = STATE_LOG_MAGIC;
+	pRecord->Header.nVersion = STATE_LOG_VERSION;
+	pRecord->Header.nSize = nSize;
+	pRecord->Header.nSequence = nSequence;
+	memcpy (pRecord->Data, pData, nSize);
+	pRecord->Header.nCRC = GetCRC (pRecord);
+
+	// on failure the slot may be torn, it is written again next time
+	if (!(*m_pWriteHandler) (m_nNextSlot, pRecord, m_pParam))
+	{
+		return false;
+	}
+
+	m_nSequence = nSequence;
+	m_nNextSlot = (m_nNextSlot + 1) % m_nSlots;
+
+	return true;
+}
+
+bool CStateLog::IsValid (const TStateLogRecord *pRecord)
+{
+	assert (pRecord);
+
+	return    pRecord->Header.nMagic == STATE_LOG_MAGIC
+	       && pRecord->Header.nVersion == STATE_LOG_VERSION
+	       && pRecord->Header.nSize <= STATE_LOG_DATA_MAX
+	       && pRecord->Header.nSequence != 0
+	       && pRecord->Header.nCRC == GetCRC (pRecord);
+}
+
+uint32_t CStateLog::GetCRC (const TStateLogRecord *pRecord)
+{
+	TStateLogHeader Header = pRecord->Header;
+	Header.nCRC = 0;
+
+	uint32_t nCRC = CRC32Update (0, &Header, sizeof Header);
+
+	return CRC32Update (nCRC, pRecord->Data, pRecord->Header.nSize);
+}
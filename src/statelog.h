@@ -0,0 +1,88 @@
+// statelog.h
+//
+// Log of checksummed records of one sector each in a fixed range of sectors
+// (slots). Each record holds the whole state, a new one is appended to the
+// slot after the newest record and the log wraps around, when it is full,
+// overwriting the oldest record, so no record has to be copied and each
+// sector is written only every nSlots-th time. Recover() reads all slots
+// with one request and takes the valid record with the highest sequence
+// number, a record torn by a power loss fails its CRC and the one before it
+// is used. Does not depend on Circle, so the host tools share it with the
+// boot menu.
+//
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define STATE_LOG_SECTOR_SIZE	512
+#define STATE_LOG_SLOTS_MAX	16
+
+#define STATE_LOG_MAGIC		0x4C53534D	// "MSSL"
+#define STATE_LOG_VERSION	1
+
+struct TStateLogHeader
+{
+	uint32_t nMagic;
+	uint16_t nVersion;
+	uint16_t nSize;			// of the data following
+	uint32_t nSequence;		// from 1, 0 is never used
+	uint32_t nCRC;			// of the header with nCRC = 0 and the data
+};
+
+#define STATE_LOG_DATA_MAX	(STATE_LOG_SECTOR_SIZE - sizeof (TStateLogHeader))
+
+struct TStateLogRecord
+{
+	TStateLogHeader Header;
+	uint8_t Data[STATE_LOG_DATA_MAX];
+};
+
+static_assert (sizeof (TStateLogRecord) == STATE_LOG_SECTOR_SIZE, "Record must fill a sector");
+
+// nSector is relative to the first slot, return false on an I/O error
+typedef bool TStateLogReadHandler (unsigned nSector, unsigned nCount, void *pBuffer, void *pParam);
+typedef bool TStateLogWriteHandler (unsigned nSector, const void *pBuffer, void *pParam);
+
+class CStateLog
+{
+public:
+	CStateLog (unsigned nSlots, TStateLogReadHandler *pReadHandler,
+		   TStateLogWriteHandler *pWriteHandler, void *pParam);
+
+	// clears all slots, for a log, which has just been allocated and may
+	// hold stale records
+	bool Format (void);
+
+	// copies the data of the newest valid record to pData, the rest of
+	// nSize is zeroed, if the record is shorter (from an older version),
+	// returns false if there is no valid record or on an I/O error
+	bool Recover (void *pData, size_t nSize);
+
+	// writes one sector, Recover() or Format() must have been called
+	bool Append (const void *pData, size_t nSize);
+
+	// of the newest record, 0 if there is none
+	uint32_t GetSequence (void) const	{ return m_nSequence; }
+
+	// slot, which the next record goes to
+	unsigned GetNextSlot (void) const	{ return m_nNextSlot; }
+
+	static bool IsValid (const TStateLogRecord *pRecord);
+
+private:
+	static uint32_t GetCRC (const TStateLogRecord *pRecord);
+
+private:
+	unsigned m_nSlots;
+	TStateLogReadHandler *m_pReadHandler;
+	TStateLogWriteHandler *m_pWriteHandler;
+	void *m_pParam;
+
+	uint32_t m_nSequence;
+	unsigned m_nNextSlot;
+	bool m_bReady;
+
+	// all slots for Recover(), the first one for Append()
+	alignas (64) TStateLogRecord m_Records[STATE_LOG_SLOTS_MAX];
+};
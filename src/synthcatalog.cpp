@@ -0,0 +1,443 @@
+// synthcatalog.cpp
+
+#include "synthcatalog.h"
+#include "chainloader.h"
+#include "bootconfig.h"
+#include "crc32.h"
+#include "asynclog.h"
+#include <circle/memorymap.h>
+#include <fatfs/ff.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+LOGMODULE ("catalog");
+
+static const struct
+{
+	const char *pTitle;
+	const char *pName;
+}
+s_Builtin[BOOT_CONFIG_SYNTHS] =
+{
+	{"MiniDexed",	"minidexed"},
+	{"MiniJV880",	"minijv880"},
+	{"MT-32Pi",	"mt32pi"}
+};
+
+// used by LoadIndex() and WriteIndex() on core 0 only
+static TSynthPackEntry s_Block[SYNTH_CATALOG_BLOCK];
+
+CSynthCatalog::CSynthCatalog (void)
+:	m_nCount (0),
+	m_bPacked (false),
+	m_bFromCache (false)
+{
+}
+
+bool CSynthCatalog::Load (const char *pPackPath, const u32 *pBuiltinNotes)
+{
+	assert (pPackPath);
+	assert (pBuiltinNotes);
+
+	m_bPacked = LoadIndex (pPackPath, 0);
+	if (!m_bPacked)
+	{
+		u32 nStamp = GetDirectoryStamp (pBuiltinNotes);
+
+		m_bFromCache =    nStamp != 0
+			       && LoadIndex (SYNTH_CATALOG_CACHE_FILE, nStamp);
+		if (!m_bFromCache)
+		{
+			if (ScanDirectories (pBuiltinNotes))
+			{
+				if (!WriteIndex (SYNTH_CATALOG_CACHE_FILE, nStamp))
+				{
+					LOGWARN ("Cannot write %s", SYNTH_CATALOG_CACHE_FILE);
+				}
+			}
+			else
+			{
+				LoadBuiltin (pBuiltinNotes);
+			}
+		}
+	}
+
+	LOGNOTE ("%u synths (%s)", m_nCount,
+		   m_bPacked ? pPackPath
+		 : m_bFromCache ? SYNTH_CATALOG_CACHE_FILE : "scanned");
+
+	return m_nCount > 0;
+}
+
+const TSynthInfo *CSynthCatalog::Get (unsigned nIndex) const
+{
+	assert (nIndex < m_nCount);
+
+	return &m_Synths[nIndex];
+}
+
+int CSynthCatalog::Find (const char *pName) const
+{
+	assert (pName);
+
+	for (unsigned i = 0; i < m_nCount; i++)
+	{
+		if (strcmp (m_Synths[i].Name, pName) == 0)
+		{
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+// reads the header and the index, the images are not touched
+bool CSynthCatalog::LoadIndex (const char *pPath, u32 nStamp)
+{
+	FIL File;
+	if (f_open (&File, pPath, FA_READ | FA_OPEN_EXISTING) != FR_OK)
+	{
+		return false;
+	}
+
+	TSynthPackHeader Header;
+	UINT nRead;
+	if (   f_read (&File, &Header, sizeof Header, &nRead) != FR_OK
+	    || nRead != sizeof Header
+	    || Header.nMagic != SYNTH_PACK_MAGIC
+	    || Header.nVersion != SYNTH_PACK_VERSION
+	    || Header.nHeaderSize < sizeof Header
+	    || Header.nEntrySize != sizeof (TSynthPackEntry)
+	    || Header.nEntries == 0)
+	{
+		LOGERR ("%s: Invalid header", pPath);
+		f_close (&File);
+
+		return false;
+	}
+
+	if (Header.nStamp != nStamp)
+	{
+		f_close (&File);
+
+		return false;			// outdated cache
+	}
+
+	if (Header.nEntries > SYNTH_CATALOG_MAX)
+	{
+		LOGWARN ("%s: Only %u of %u synths are used", pPath,
+			 SYNTH_CATALOG_MAX, (unsigned) Header.nEntries);
+	}
+
+	// the index is read in blocks, all of it is needed for its CRC
+	unsigned nCount = 0;
+	u32 nCRC = 0;
+
+	bool bOK = f_lseek (&File, Header.nHeaderSize) == FR_OK;
+	for (unsigned nFirst = 0; bOK && nFirst < Header.nEntries; nFirst += SYNTH_CATALOG_BLOCK)
+	{
+		unsigned nEntries = Header.nEntries - nFirst;
+		if (nEntries > SYNTH_CATALOG_BLOCK)
+		{
+			nEntries = SYNTH_CATALOG_BLOCK;
+		}
+
+		UINT nBytes = nEntries * sizeof (TSynthPackEntry);
+		bOK =    f_read (&File, s_Block, nBytes, &nRead) == FR_OK
+		      && nRead == nBytes;
+		if (!bOK)
+		{
+			break;
+		}
+
+		nCRC = CRC32Update (nCRC, s_Block, nBytes);
+
+		for (unsigned i = 0; i < nEntries && nCount < SYNTH_CATALOG_MAX; i++)
+		{
+			const TSynthPackEntry *pEntry = &s_Block[i];
+
+			// images are always started at MEM_KERNEL_START
+			if (pEntry->nLoadAddress != MEM_KERNEL_START)
+			{
+				LOGWARN ("%.*s: Unsupported load address 0x%X",
+					 SYNTH_PACK_NAME_MAX, pEntry->Name, pEntry->nLoadAddress);
+
+				continue;
+			}
+
+			TSynthInfo *pInfo = &m_Synths[nCount++];
+
+			memcpy (pInfo->Title, pEntry->Title, sizeof pInfo->Title);
+			pInfo->Title[sizeof pInfo->Title - 1] = '\0';
+			memcpy (pInfo->Name, pEntry->Name, sizeof pInfo->Name);
+			pInfo->Name[sizeof pInfo->Name - 1] = '\0';
+			pInfo->nMIDINote = pEntry->nMIDINote;
+			pInfo->bPacked = !(pEntry->nFlags & SYNTH_PACK_EXTERNAL);
+			pInfo->nFlags = pEntry->nFlags & SYNTH_PACK_COMPRESSED;
+			pInfo->nOffset = pEntry->nOffset;
+			pInfo->nSize = pEntry->nSize;
+			pInfo->nImageSize = pEntry->nImageSize;
+			pInfo->nImageCRC = pEntry->nImageCRC;
+		}
+	}
+
+	f_close (&File);
+
+	if (!bOK || nCRC != Header.nIndexCRC)
+	{
+		LOGERR ("%s: Invalid index", pPath);
+		m_nCount = 0;
+
+		return false;
+	}
+
+	m_nCount = nCount;
+
+	return nCount > 0;
+}
+
+// writes the scanned synths as an index without images
+bool CSynthCatalog::WriteIndex (const char *pPath, u32 nStamp)
+{
+	TSynthPackHeader Header;
+	memset (&Header, 0, sizeof Header);
+	Header.nMagic = SYNTH_PACK_MAGIC;
+	Header.nVersion = SYNTH_PACK_VERSION;
+	Header.nHeaderSize = sizeof Header;
+	Header.nEntries = m_nCount;
+	Header.nEntrySize = sizeof (TSynthPackEntry);
+	Header.nStamp = nStamp;
+
+	// the entries are converted twice, to get the CRC before writing them
+	for (unsigned nPass = 0; nPass < 2; nPass++)
+	{
+		FIL File;
+		if (nPass == 1)
+		{
+			if (f_open (&File, pPath, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK)
+			{
+				return false;
+			}
+
+			UINT nWritten;
+			if (   f_write (&File, &Header, sizeof Header, &nWritten) != FR_OK
+			    || nWritten != sizeof Header)
+			{
+				f_close (&File);
+
+				return false;
+			}
+		}
+
+		for (unsigned nFirst = 0; nFirst < m_nCount; nFirst += SYNTH_CATALOG_BLOCK)
+		{
+			unsigned nEntries = m_nCount - nFirst;
+			if (nEntries > SYNTH_CATALOG_BLOCK)
+			{
+				nEntries = SYNTH_CATALOG_BLOCK;
+			}
+
+			memset (s_Block, 0, sizeof s_Block);
+			for (unsigned i = 0; i < nEntries; i++)
+			{
+				const TSynthInfo *pInfo = &m_Synths[nFirst + i];
+				TSynthPackEntry *pEntry = &s_Block[i];
+
+				memcpy (pEntry->Title, pInfo->Title, sizeof pEntry->Title);
+				memcpy (pEntry->Name, pInfo->Name, sizeof pEntry->Name);
+				pEntry->nLoadAddress = MEM_KERNEL_START;
+				pEntry->nMIDINote = pInfo->nMIDINote;
+				pEntry->nFlags = SYNTH_PACK_EXTERNAL;
+			}
+
+			UINT nBytes = nEntries * sizeof (TSynthPackEntry);
+			if (nPass == 0)
+			{
+				Header.nIndexCRC = CRC32Update (Header.nIndexCRC, s_Block, nBytes);
+
+				continue;
+			}
+
+			UINT nWritten;
+			if (   f_write (&File, s_Block, nBytes, &nWritten) != FR_OK
+			    || nWritten != nBytes)
+			{
+				f_close (&File);
+
+				return false;
+			}
+		}
+
+		if (nPass == 1)
+		{
+			return f_close (&File) == FR_OK;
+		}
+	}
+
+	return false;
+}
+
+static bool IsSynthDirectory (const FILINFO *pInfo)
+{
+	return    (pInfo->fattrib & (AM_DIR | AM_HID | AM_SYS)) == AM_DIR
+	       && pInfo->fname[0] != '.';
+}
+
+// a directory is a synth, if it has the packed or the raw image
+static bool HasImage (const char *pDirectory)
+{
+	char Path[SYNTH_PACK_NAME_MAX + 40];
+	snprintf (Path, sizeof Path, "SD:/%s/" CHAINBOOT_IMAGE_NAME CHAINBOOT_PACKED_SUFFIX,
+		  pDirectory);
+
+	FILINFO Info;
+	if (f_stat (Path, &Info) == FR_OK)
+	{
+		return true;
+	}
+
+	Path[strlen (Path) - strlen (CHAINBOOT_PACKED_SUFFIX)] = '\0';
+
+	return f_stat (Path, &Info) == FR_OK;
+}
+
+// The stamp covers the names and the creation times of the directories and
+// the MIDI notes of the built-in synths. Only the root directory is listed,
+// the images are not looked up, so that validating the cache does not cost
+// as much as a scan. Replacing or removing an image does not need a rescan,
+// the loader opens the image, when the synth is started, and fails, if it
+// has gone. An image added to a directory without one is found after
+// SYNTH_CATALOG_CACHE_FILE has been deleted.
+u32 CSynthCatalog::GetDirectoryStamp (const u32 *pBuiltinNotes)
+{
+	DIR Directory;
+	if (f_opendir (&Directory, "SD:/") != FR_OK)
+	{
+		return 0;
+	}
+
+	u32 nStamp = CRC32Update (0, pBuiltinNotes, BOOT_CONFIG_SYNTHS * sizeof *pBuiltinNotes);
+
+	FILINFO Info;
+	while (   f_readdir (&Directory, &Info) == FR_OK
+	       && Info.fname[0] != '\0')
+	{
+		if (IsSynthDirectory (&Info))
+		{
+			nStamp = CRC32Update (nStamp, Info.fname, strlen (Info.fname));
+			nStamp = CRC32Update (nStamp, &Info.fdate, sizeof Info.fdate);
+			nStamp = CRC32Update (nStamp, &Info.ftime, sizeof Info.ftime);
+		}
+	}
+
+	f_closedir (&Directory);
+
+	return nStamp != 0 ? nStamp : 1;
+}
+
+// The built-in synths come first in their usual order, the others are
+// sorted by name.
+bool CSynthCatalog::ScanDirectories (const u32 *pBuiltinNotes)
+{
+	m_nCount = 0;
+
+	DIR Directory;
+	if (f_opendir (&Directory, "SD:/") != FR_OK)
+	{
+		return false;
+	}
+
+	FILINFO Info;
+	while (   f_readdir (&Directory, &Info) == FR_OK
+	       && Info.fname[0] != '\0')
+	{
+		if (!IsSynthDirectory (&Info))
+		{
+			continue;
+		}
+
+		if (strlen (Info.fname) >= SYNTH_PACK_NAME_MAX)
+		{
+			LOGWARN ("%s: Name too long", Info.fname);
+
+			continue;
+		}
+
+		if (!HasImage (Info.fname))
+		{
+			continue;
+		}
+
+		if (m_nCount == SYNTH_CATALOG_MAX)
+		{
+			LOGWARN ("Only %u synths are used", SYNTH_CATALOG_MAX);
+
+			break;
+		}
+
+		TSynthInfo *pInfo = &m_Synths[m_nCount++];
+		memset (pInfo, 0, sizeof *pInfo);
+
+		strncpy (pInfo->Title, Info.fname, sizeof pInfo->Title - 1);
+		strcpy (pInfo->Name, Info.fname);
+		pInfo->nMIDINote = SYNTH_PACK_NO_NOTE;
+		pInfo->bPacked = false;
+	}
+
+	f_closedir (&Directory);
+
+	unsigned nFirst = 0;
+	for (unsigned i = 0; i < BOOT_CONFIG_SYNTHS; i++)
+	{
+		int nIndex = Find (s_Builtin[i].pName);
+		if (nIndex < 0)
+		{
+			continue;
+		}
+
+		TSynthInfo Synth = m_Synths[nIndex];
+		m_Synths[nIndex] = m_Synths[nFirst];
+
+		strncpy (Synth.Title, s_Builtin[i].pTitle, sizeof Synth.Title - 1);
+		Synth.nMIDINote = pBuiltinNotes[i];
+		m_Synths[nFirst++] = Synth;
+	}
+
+	Sort (nFirst);
+
+	return m_nCount > 0;
+}
+
+// insertion sort, runs only after the directories have changed
+void CSynthCatalog::Sort (unsigned nFirst)
+{
+	for (unsigned i = nFirst + 1; i < m_nCount; i++)
+	{
+		TSynthInfo Synth = m_Synths[i];
+
+		unsigned j = i;
+		for (; j > nFirst && strcmp (m_Synths[j-1].Name, Synth.Name) > 0; j--)
+		{
+			m_Synths[j] = m_Synths[j-1];
+		}
+
+		m_Synths[j] = Synth;
+	}
+}
+
+void CSynthCatalog::LoadBuiltin (const u32 *pNotes)
+{
+	for (unsigned i = 0; i < BOOT_CONFIG_SYNTHS; i++)
+	{
+		TSynthInfo *pInfo = &m_Synths[i];
+		memset (pInfo, 0, sizeof *pInfo);
+
+		strncpy (pInfo->Title, s_Builtin[i].pTitle, sizeof pInfo->Title - 1);
+		strncpy (pInfo->Name, s_Builtin[i].pName, sizeof pInfo->Name - 1);
+		pInfo->nMIDINote = pNotes[i];
+		pInfo->bPacked = false;
+	}
+
+	m_nCount = BOOT_CONFIG_SYNTHS;
+}
@@ -0,0 +1,70 @@
+// synthcatalog.h
+//
+// The synths offered by the boot menu. They are read from the index of the
+// synth container (see synthpack.h), if there is one. Otherwise each
+// directory in the root of the SD card, which contains a kernel image, is a
+// synth. The result of this scan is cached in SYNTH_CATALOG_CACHE_FILE and
+// is used as long as the directories and the MIDI notes of the built-in
+// synths do not change, so that the directories are not searched at boot.
+//
+#pragma once
+
+#include <circle/types.h>
+#include "synthpack.h"
+
+#define SYNTH_CATALOG_MAX	512
+#define SYNTH_CATALOG_BLOCK	32		// index entries read or written at once
+
+#define SYNTH_CATALOG_CACHE_FILE	"catalog.bin"
+
+struct TSynthInfo
+{
+	char Title[SYNTH_PACK_TITLE_MAX];
+	char Name[SYNTH_PACK_NAME_MAX];
+	u8 nMIDINote;				// or SYNTH_PACK_NO_NOTE
+
+	// in the container, otherwise in "SD:/<Name>/" CHAINBOOT_IMAGE_NAME
+	bool bPacked;
+	u8 nFlags;				// SYNTH_PACK_COMPRESSED
+	u32 nOffset;
+	u32 nSize;
+	u32 nImageSize;
+	u32 nImageCRC;
+};
+
+class CSynthCatalog
+{
+public:
+	CSynthCatalog (void);
+
+	// pBuiltinNotes are the MIDI notes of the built-in synths
+	// (BOOT_CONFIG_SYNTHS), returns false if there is no synth
+	bool Load (const char *pPackPath, const u32 *pBuiltinNotes);
+
+	unsigned GetCount (void) const		{ return m_nCount; }
+	const TSynthInfo *Get (unsigned nIndex) const;
+
+	// return the index or -1
+	int Find (const char *pName) const;
+
+	bool IsPacked (void) const		{ return m_bPacked; }
+	bool IsFromCache (void) const		{ return m_bFromCache; }
+
+private:
+	// nStamp must match the stamp in the header
+	bool LoadIndex (const char *pPath, u32 nStamp);
+	bool WriteIndex (const char *pPath, u32 nStamp);
+
+	// returns 0 if the root directory cannot be read
+	u32 GetDirectoryStamp (const u32 *pBuiltinNotes);
+	bool ScanDirectories (const u32 *pBuiltinNotes);
+	void Sort (unsigned nFirst);
+
+	void LoadBuiltin (const u32 *pNotes);
+
+private:
+	TSynthInfo m_Synths[SYNTH_CATALOG_MAX];
+	unsigned m_nCount;
+	bool m_bPacked;
+	bool m_bFromCache;
+};
@@ -0,0 +1,33 @@
+// synthimage.h
+//
+// Format of compressed synth kernel images (CHAINBOOT_IMAGE_NAME ".lz4"),
+// built by tools/mkimage. The image is split into chunks of a fixed
+// uncompressed size, which are LZ4 blocks (or stored as is, if they do not
+// compress), so that the loader can decode a chunk while it reads the next
+// one. The header is followed by the table of the chunk sizes and the
+// chunks. All fields are little endian.
+//
+// Does not depend on Circle.
+//
+#pragma once
+
+#include <stdint.h>
+
+#define SYNTH_IMAGE_MAGIC	0x315A534DU	// "MSZ1"
+#define SYNTH_IMAGE_VERSION	1
+
+#define SYNTH_IMAGE_CHUNK_SIZE	0x10000
+#define SYNTH_IMAGE_STORED	0x80000000U	// flag in the chunk size table
+
+struct TSynthImageHeader
+{
+	uint32_t nMagic;
+	uint16_t nVersion;
+	uint16_t nHeaderSize;
+	uint32_t nImageSize;			// uncompressed
+	uint32_t nChunkSize;			// uncompressed, the last chunk may be shorter
+	uint32_t nChunks;
+	uint32_t nImageCRC;			// CRC-32 of the uncompressed image
+};
+
+static_assert (sizeof (TSynthImageHeader) == 24, "TSynthImageHeader must be packed");
@@ -0,0 +1,57 @@
+// synthpack.h
+//
+// Format of the synth container (CHAINBOOT_PACK_NAME), built by
+// tools/mksynthpack. It holds the kernel images of all synths for one
+// Raspberry Pi model behind an index, so that the boot menu reads only the
+// index at boot and each image with a single seek. The images start on
+// SYNTH_PACK_ALIGN boundaries and are either raw or compressed images in
+// the format of synthimage.h. All fields are little endian.
+//
+// The synth catalog caches the result of scanning the synth directories in
+// the same format (an index without images, see synthcatalog.h).
+//
+// Does not depend on Circle.
+//
+#pragma once
+
+#include <stdint.h>
+
+#define SYNTH_PACK_MAGIC	0x4B50534DU	// "MSPK"
+#define SYNTH_PACK_VERSION	1
+
+#define SYNTH_PACK_ALIGN	4096
+#define SYNTH_PACK_TITLE_MAX	32		// including the terminating null
+#define SYNTH_PACK_NAME_MAX	16
+
+#define SYNTH_PACK_NO_NOTE	0xFF
+
+#define SYNTH_PACK_COMPRESSED	0x01		// image is in synthimage.h format
+#define SYNTH_PACK_EXTERNAL	0x02		// image is in the directory "<Name>/"
+
+struct TSynthPackHeader
+{
+	uint32_t nMagic;
+	uint16_t nVersion;
+	uint16_t nHeaderSize;
+	uint32_t nEntries;
+	uint32_t nEntrySize;			// sizeof (TSynthPackEntry)
+	uint32_t nIndexCRC;			// CRC-32 of all entries
+	uint32_t nStamp;			// of the scanned directories, 0 in containers
+};
+
+struct TSynthPackEntry
+{
+	char Title[SYNTH_PACK_TITLE_MAX];	// shown in the menu
+	char Name[SYNTH_PACK_NAME_MAX];		// short name, e.g. "minidexed"
+	uint32_t nOffset;			// of the image from the start of the file
+	uint32_t nSize;				// of the image in the file
+	uint32_t nImageSize;			// uncompressed
+	uint32_t nLoadAddress;
+	uint32_t nImageCRC;			// CRC-32 of the uncompressed image
+	uint8_t nMIDINote;			// selects the synth, or SYNTH_PACK_NO_NOTE
+	uint8_t nFlags;
+	uint16_t nReserved;
+};
+
+static_assert (sizeof (TSynthPackHeader) == 24, "TSynthPackHeader must be packed");
+static_assert (sizeof (TSynthPackEntry) == 72, "TSynthPackEntry must be packed");
@@ -0,0 +1,21 @@
+// teardown.cpp
+
+#include "teardown.h"
+
+// The table order is a valid order of the dependency graph.
+const TBootStageInfo TeardownStages[TeardownStageCount] =
+{
+	// name		core			dependencies				budget us
+	{"log",		0,			0,					20000},
+	{"handoff",	0,			0,					5000},
+	{"display",	0,			BOOT_STAGE (TeardownStageLog),		50000},
+	{"input",	0,			0,					1000},
+	{"usb",		0,			  BOOT_STAGE (TeardownStageHandoff)
+					| BOOT_STAGE (TeardownStageDisplay),	100000},
+	{"sd card",	TEARDOWN_CORE_SD,	0,					10000},
+	{"devices",	0,			  BOOT_STAGE (TeardownStageDisplay)
+					| BOOT_STAGE (TeardownStageHandoff)
+					| BOOT_STAGE (TeardownStageInput)
+					| BOOT_STAGE (TeardownStageUSB),	50000},
+	{"verify",	0,			BOOT_STAGE (TeardownStageCount - 1) - 1, 1000}
+};
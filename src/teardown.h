@@ -0,0 +1,37 @@
+// teardown.h
+//
+// The stages, which shut the boot menu down before a synth is started, run
+// by CBootStages. Stages of different cores run in parallel; core 0 helps
+// with the stages of a core, which is still busy with another task. The
+// whole teardown must be done within TEARDOWN_BUDGET, otherwise the synth
+// is not started and the menu reboots through the firmware.
+//
+// USB is destroyed on core 0, which owns its interrupt and calls its
+// plug-and-play updates, so neither can run into a deleted controller.
+//
+// Parking the secondary cores, masking the interrupt controller, switching
+// the USB controller off (it could continue DMA) and cleaning the caches
+// are left to CChainLoader::Boot(), because there is no way back from them.
+//
+#pragma once
+
+#include "bootstages.h"
+
+#define TEARDOWN_BUDGET		250000		// us for all stages
+
+#define TEARDOWN_CORE_SD	3		// free, once the prefetcher finished
+
+enum TTeardownStage
+{
+	TeardownStageLog,			// write the pending messages
+	TeardownStageHandoff,			// write the handoff block for the synth
+	TeardownStageDisplay,			// stop the display worker
+	TeardownStageInput,			// button and encoder interrupts off
+	TeardownStageUSB,			// destroy the host controller and devices
+	TeardownStageSD,			// unmount the SD card
+	TeardownStageDevices,			// destroy the remaining devices
+	TeardownStageVerify,			// check, that nothing is left running
+	TeardownStageCount
+};
+
+extern const TBootStageInfo TeardownStages[TeardownStageCount];
@@ -0,0 +1,147 @@
+// usbmidiports.cpp
+
+#include "usbmidiports.h"
+#include <circle/devicenameservice.h>
+#include "asynclog.h"
+#include <assert.h>
+
+LOGMODULE ("usbmidi");
+
+#define USB_MIDI_PREFIX		"umidi"		// devices are numbered from 1
+
+CUSBMIDIPorts::CUSBMIDIPorts (void)
+{
+	for (unsigned i = 0; i < USB_MIDI_DEVICES; i++)
+	{
+		m_Device[i].nIndex = i;
+		m_Device[i].pDevice = 0;
+	}
+}
+
+void CUSBMIDIPorts::RegisterMessageHandler (TMIDIMessageHandler *pHandler, void *pParam,
+					    unsigned nFirstPort)
+{
+	for (unsigned i = 0; i < USB_MIDI_DEVICES; i++)
+	{
+		for (unsigned nCable = 0; nCable < USB_MIDI_CABLES; nCable++)
+		{
+			m_Device[i].Parser[nCable].RegisterMessageHandler (
+				pHandler, pParam, nFirstPort + i * USB_MIDI_CABLES + nCable);
+		}
+	}
+}
+
+unsigned CUSBMIDIPorts::Update (void)
+{
+	for (unsigned i = 0; i < USB_MIDI_DEVICES; i++)
+	{
+		TDevice *pSlot = &m_Device[i];
+		if (pSlot->pDevice != 0)
+		{
+			continue;
+		}
+
+		CUSBMIDIDevice *pDevice = static_cast<CUSBMIDIDevice *> (
+			CDeviceNameService::Get ()->GetDevice (USB_MIDI_PREFIX, i + 1, FALSE));
+		if (pDevice == 0)
+		{
+			continue;
+		}
+
+		// no packets arrive for this slot yet, a partial message of the
+		// previous device must not be continued
+		for (unsigned nCable = 0; nCable < USB_MIDI_CABLES; nCable++)
+		{
+			pSlot->Parser[nCable].Reset ();
+		}
+
+		pSlot->pDevice = pDevice;
+		pDevice->RegisterRemovedHandler (DeviceRemovedHandler, pSlot);
+		pDevice->RegisterPacketHandler (PacketHandler, this);
+
+		LOGNOTE (USB_MIDI_PREFIX "%u attached", i + 1);
+	}
+
+	return GetDeviceCount ();
+}
+
+unsigned CUSBMIDIPorts::GetDeviceCount (void) const
+{
+	unsigned nCount = 0;
+	for (unsigned i = 0; i < USB_MIDI_DEVICES; i++)
+	{
+		if (m_Device[i].pDevice != 0)
+		{
+			nCount++;
+		}
+	}
+
+	return nCount;
+}
+
+unsigned CUSBMIDIPorts::GetSysExOverflows (void) const
+{
+	unsigned nCount = 0;
+	for (unsigned i = 0; i < USB_MIDI_DEVICES; i++)
+	{
+		for (unsigned nCable = 0; nCable < USB_MIDI_CABLES; nCable++)
+		{
+			nCount += m_Device[i].Parser[nCable].GetSysExOverflows ();
+		}
+	}
+
+	return nCount;
+}
+
+bool CUSBMIDIPorts::GetDeviceIdentity (unsigned nDevice, u16 *pVendor, u16 *pProduct) const
+{
+	assert (nDevice < USB_MIDI_DEVICES);
+	assert (pVendor != 0 && pProduct != 0);
+
+	CUSBMIDIDevice *pDevice = m_Device[nDevice].pDevice;
+	if (pDevice == 0)
+	{
+		return false;
+	}
+
+	const TUSBDeviceDescriptor *pDescriptor = pDevice->GetDevice ()->GetDeviceDescriptor ();
+	assert (pDescriptor != 0);
+
+	*pVendor = pDescriptor->idVendor;
+	*pProduct = pDescriptor->idProduct;
+
+	return true;
+}
+
+void CUSBMIDIPorts::PacketHandler (unsigned nCable, u8 *pPacket, unsigned nLength,
+				   unsigned nDevice, void *pParam)
+{
+	CUSBMIDIPorts *pThis = static_cast<CUSBMIDIPorts *> (pParam);
+	assert (pThis != 0);
+
+	if (   nDevice < 1 || nDevice > USB_MIDI_DEVICES
+	    || nCable >= USB_MIDI_CABLES)
+	{
+		return;
+	}
+
+	TDevice *pSlot = &pThis->m_Device[nDevice - 1];
+	if (pSlot->pDevice != 0)
+	{
+		pSlot->Parser[nCable].Parse (pPacket, nLength);
+	}
+}
+
+// called from the destructor of the device, after its transfers have stopped
+void CUSBMIDIPorts::DeviceRemovedHandler (CDevice *pDevice, void *pContext)
+{
+	TDevice *pSlot = static_cast<TDevice *> (pContext);
+	assert (pSlot != 0);
+
+	if (pSlot->pDevice == pDevice)
+	{
+		pSlot->pDevice = 0;
+
+		LOGNOTE (USB_MIDI_PREFIX "%u removed", pSlot->nIndex + 1);
+	}
+}
@@ -0,0 +1,62 @@
+// usbmidiports.h
+//
+// Attaches to the USB MIDI devices umidi1..USB_MIDI_DEVICES as they are
+// enumerated and detaches from them when they are removed. Each device and
+// each of its cables has its own parser, so that several controllers can
+// be used at the same time. Update() looks the devices up and is only
+// called when the USB device tree may have changed, so that nothing is
+// polled while no device is plugged in.
+//
+#pragma once
+
+#include <circle/types.h>
+#include <circle/device.h>
+#include <circle/usb/usbmidi.h>
+#include <circle/usb/usbdevice.h>
+#include "midiparser.h"
+
+#define USB_MIDI_DEVICES	4
+#define USB_MIDI_CABLES		16
+
+#define USB_MIDI_PORTS		(USB_MIDI_DEVICES * USB_MIDI_CABLES)
+
+class CUSBMIDIPorts
+{
+public:
+	CUSBMIDIPorts (void);
+
+	// the messages of device nDevice (0-based) and cable nCable are passed
+	// with nPort = nFirstPort + nDevice * USB_MIDI_CABLES + nCable, in
+	// interrupt context
+	void RegisterMessageHandler (TMIDIMessageHandler *pHandler, void *pParam,
+				     unsigned nFirstPort);
+
+	// attaches to devices, which are not attached yet, returns the number
+	// of attached devices; call at TASK_LEVEL, after USB initialization and
+	// whenever CUSBHCIDevice::UpdatePlugAndPlay() returned TRUE
+	unsigned Update (void);
+
+	unsigned GetDeviceCount (void) const;
+
+	// SysEx messages of all ports, which were too long (and were dropped)
+	unsigned GetSysExOverflows (void) const;
+
+	// USB vendor and product ID of device nDevice (0-based), returns false
+	// if it is not attached
+	bool GetDeviceIdentity (unsigned nDevice, u16 *pVendor, u16 *pProduct) const;
+
+private:
+	static void PacketHandler (unsigned nCable, u8 *pPacket, unsigned nLength,
+				   unsigned nDevice, void *pParam);
+	static void DeviceRemovedHandler (CDevice *pDevice, void *pContext);
+
+private:
+	struct TDevice
+	{
+		unsigned nIndex;
+		CUSBMIDIDevice *volatile pDevice;	// 0 if not attached
+		CMIDIParser Parser[USB_MIDI_CABLES];
+	};
+
+	TDevice m_Device[USB_MIDI_DEVICES];
+};
@@ -0,0 +1,225 @@
+//
+// arenacheck.cpp
+//
+// Host tool: checks the arena for the devices of the boot menu (see
+// src/menuarena.h). The kernel asserts at compile time, that the sum of
+// MenuArenaSize<T>() over its devices fits into MENU_ARENA_SIZE. This
+// checks, that this sum bounds what the arena really uses, in any order of
+// construction and also when the objects are constructed on several
+// threads, and that the objects are aligned, destroyed in reverse order
+// and never overlap.
+//
+// usage: arenacheck [-n rounds] [-s seed]
+//
+#include "../src/menuarena.h"
+#include "toolcheck.h"
+#include <circle/logger.h>
+#include <circle/timer.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+static std::vector<int> s_Destroyed;		// by id
+
+void CLogger::Write (const char *pSource, TLogSeverity Severity, const char *pMessage, ...)
+{
+}
+
+CLogger *CLogger::Get (void)
+{
+	static CLogger s_Logger;
+
+	return &s_Logger;
+}
+
+unsigned CTimer::GetClockTicks (void)
+{
+	return 0;
+}
+
+// stand-ins for the devices, in their sizes and alignments
+template <size_t nSize, size_t nAlign>
+struct alignas (nAlign) TDevice
+{
+	TDevice (int nId)
+	:	nId (nId)
+	{
+		memset (Data, nId, sizeof Data);
+	}
+
+	~TDevice (void)
+	{
+		for (u8 uchByte : Data)
+		{
+			Check (uchByte == (u8) nId, "object overwritten");
+		}
+
+		s_Destroyed.push_back (nId);
+	}
+
+	int nId;
+	u8 Data[nSize];
+};
+
+typedef TDevice<3000, 8> TScreen;
+typedef TDevice<200, 8> TSPIMaster;
+typedef TDevice<8000, 16> TCharDevice;
+typedef TDevice<1, 4> TPin;
+typedef TDevice<5000, 64> TUSB;
+
+static constexpr size_t s_nBudget =   MenuArenaSize<TScreen> ()
+				    + MenuArenaSize<TSPIMaster> ()
+				    + MenuArenaSize<TCharDevice> ()
+				    + 3 * MenuArenaSize<TPin> ()
+				    + MenuArenaSize<TUSB> ();
+
+static void *NewDevice (CMenuArena *pArena, unsigned nType, int nId)
+{
+	void *pObject = 0;
+	size_t nAlign = 0;
+	switch (nType)
+	{
+	case 0:	pObject = pArena->New<TScreen> (nId);		nAlign = alignof (TScreen);	break;
+	case 1:	pObject = pArena->New<TSPIMaster> (nId);	nAlign = alignof (TSPIMaster);	break;
+	case 2:	pObject = pArena->New<TCharDevice> (nId);	nAlign = alignof (TCharDevice);	break;
+	case 3:
+	case 4:
+	case 5:	pObject = pArena->New<TPin> (nId);		nAlign = alignof (TPin);	break;
+	case 6:	pObject = pArena->New<TUSB> (nId);		nAlign = alignof (TUSB);	break;
+	}
+
+	Check (pObject != 0, "budget fits");
+	Check (((uintptr_t) pObject & (nAlign - 1)) == 0, "alignment");
+	Check (((uintptr_t) pObject & (MENU_ARENA_ALIGN - 1)) == 0, "arena alignment");
+
+	return pObject;
+}
+
+// the kernel constructs its devices in an order, which depends on the
+// configuration and on the cores
+static void CheckOrder (CMenuArena *pArena, std::mt19937 &rRandom)
+{
+	unsigned Types[] = {0, 1, 2, 3, 4, 5, 6};
+	std::shuffle (std::begin (Types), std::end (Types), rRandom);
+
+	for (unsigned i = 0; i < 7; i++)
+	{
+		NewDevice (pArena, Types[i], i);
+	}
+
+	Check (pArena->GetUsed () <= s_nBudget, "used within budget");
+
+	s_Destroyed.clear ();
+	pArena->Reset ();
+
+	Check (s_Destroyed.size () == 7, "all destroyed");
+	for (unsigned i = 0; i < s_Destroyed.size (); i++)
+	{
+		Check (s_Destroyed[i] == (int) (6 - i), "reverse order");
+	}
+
+	Check (pArena->GetUsed () == 0, "reset");
+}
+
+static void CheckThreads (CMenuArena *pArena)
+{
+	// USB is constructed on another core than the rest
+	std::thread USB ([pArena] { NewDevice (pArena, 6, 6); });
+	for (unsigned i = 0; i < 6; i++)
+	{
+		NewDevice (pArena, i, i);
+	}
+	USB.join ();
+
+	Check (pArena->GetUsed () <= s_nBudget, "used within budget on threads");
+
+	s_Destroyed.clear ();
+	pArena->Reset ();
+	Check (s_Destroyed.size () == 7, "all destroyed on threads");
+}
+
+static void CheckLimits (CMenuArena *pArena)
+{
+	// a device, which failed to initialize, is destroyed at once
+	TSPIMaster *pSPI = pArena->New<TSPIMaster> (1);
+	pArena->New<TPin> (2);
+	s_Destroyed.clear ();
+	pArena->Delete (pSPI);
+	Check (s_Destroyed.size () == 1 && s_Destroyed[0] == 1, "delete");
+	pArena->Reset ();
+	Check (s_Destroyed.size () == 2 && s_Destroyed[1] == 2, "deleted once");
+
+	// out of memory
+	unsigned nObjects = 0;
+	while (pArena->New<TCharDevice> (nObjects) != 0)
+	{
+		nObjects++;
+	}
+	Check (nObjects == MENU_ARENA_SIZE / MenuArenaSize<TCharDevice> (), "memory exhausted");
+	Check (pArena->New<TPin> (0) != 0, "small object fits");
+	pArena->Reset ();
+
+	// out of object entries
+	nObjects = 0;
+	while (pArena->New<TPin> (nObjects) != 0)
+	{
+		nObjects++;
+	}
+	Check (nObjects == MENU_ARENA_OBJECTS, "objects exhausted");
+	pArena->Reset ();
+
+	Check (pArena->GetHighWater () >= MENU_ARENA_SIZE - MenuArenaSize<TCharDevice> (),
+	       "high-water mark");
+}
+
+int main (int argc, char **argv)
+{
+	unsigned nRounds = 10000;
+	unsigned nSeed = 1;
+
+	int nOption;
+	while (optind <= argc && (nOption = getopt (argc, argv, "n:s:")) != -1)
+	{
+		switch (nOption)
+		{
+		case 'n':	nRounds = strtoul (optarg, nullptr, 0);		break;
+		case 's':	nSeed = strtoul (optarg, nullptr, 0);		break;
+
+		default:
+			optind = argc + 1;			// show usage
+			break;
+		}
+	}
+
+	if (nRounds == 0 || optind != argc)
+	{
+		return Usage ("arenacheck [-n rounds] [-s seed]");
+	}
+
+	static_assert (s_nBudget <= MENU_ARENA_SIZE, "budget of the stand-ins");
+
+	std::mt19937 Random (nSeed);
+	static CMenuArena Arena;
+
+	for (unsigned i = 0; i < nRounds; i++)
+	{
+		CheckOrder (&Arena, Random);
+	}
+
+	for (unsigned i = 0; i < nRounds / 10; i++)
+	{
+		CheckThreads (&Arena);
+	}
+
+	CheckLimits (&Arena);
+
+	printf ("%u rounds, budget %u of %u bytes, peak %u bytes\n", nRounds,
+		(unsigned) s_nBudget, MENU_ARENA_SIZE, (unsigned) Arena.GetHighWater ());
+
+	return CheckResult ();
+}
@@ -0,0 +1,382 @@
+//
+// autobootsim.cpp
+//
+// Host tool: runs the boot stages of the menu (see src/menustages.h) with
+// CBootStages on threads in place of cores 0 and 1 and with mock stages,
+// which take the modelled time of the real ones, and reports the time
+// from the start of the kernel to the start of the synth for each way
+// through the boot:
+//
+//	menu		autoboot off, the synth is selected as soon as possible
+//	autoboot	the menu stages are deferred
+//	held		autoboot, but the select button is held for the menu
+//	fallback	autoboot, but the synth cannot be started, the deferred
+//			stages are resumed (to the menu being ready)
+//
+// It checks, that the deferred stages do not run on autoboot, that they
+// run once and in order after they are resumed, and that the stages of
+// both cores overlap. The times are scaled down to keep the runs short.
+//
+// usage: autobootsim [-r rounds] [-s scale] [-v]
+//
+#include "../src/menustages.h"
+#include "toolcheck.h"
+#include <circle/logger.h>
+#include <circle/timer.h>
+#include <atomic>
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <unistd.h>
+
+// modelled duration of the stages on the target in us (RPi 3, ST7789,
+// one USB MIDI device)
+static const unsigned s_Duration[BootStageCount] =
+{
+	3000,			// timer/gpio/i2c
+	40000,			// mount
+	8000,			// config, from the cache
+	500,			// mode, reading the state and sampling the button
+	60000,			// screen
+	15000,			// catalog, from the pack index
+	50,			// midi actions
+	500,			// spi
+	120000,			// lcd, reset and init sequence
+	500,			// encoder/buttons
+	300,			// serial
+	1200000			// usb, enumeration
+};
+
+static const unsigned s_nStdlib = 100000;	// CStdlibAppStdio::Initialize()
+static const unsigned s_nLoad = 150000;		// a 4 MB image, decoded on core 1
+static const unsigned s_nTeardown = 40000;	// see teardownsim
+static const unsigned s_nHoldTime = 200000;	// AutoBootHoldTime default
+
+static bool s_bVerbose;
+static unsigned s_nScale = 20;
+
+static const auto s_Start = std::chrono::steady_clock::now ();
+
+unsigned CTimer::GetClockTicks (void)
+{
+	return std::chrono::duration_cast<std::chrono::microseconds> (
+		std::chrono::steady_clock::now () - s_Start).count () + 1;
+}
+
+void CLogger::Write (const char *pSource, TLogSeverity Severity, const char *pMessage, ...)
+{
+	if (s_bVerbose)
+	{
+		va_list Args;
+		va_start (Args, pMessage);
+		printf ("  %s: ", pSource);
+		vprintf (pMessage, Args);
+		printf ("\n");
+		va_end (Args);
+	}
+}
+
+CLogger *CLogger::Get (void)
+{
+	static CLogger s_Logger;
+
+	return &s_Logger;
+}
+
+// used by CBootStages
+unsigned CBootProfiler::Begin (const char *pName)
+{
+	return 0;
+}
+
+void CBootProfiler::End (unsigned hStage)
+{
+}
+
+static void Sleep (unsigned nModelled)
+{
+	std::this_thread::sleep_for (std::chrono::microseconds (nModelled / s_nScale));
+}
+
+enum TPath
+{
+	PathMenu,
+	PathAutoBoot,
+	PathHeld,
+	PathFallback,
+	PathCount
+};
+
+static const char *s_pPathName[PathCount] = {"menu", "autoboot", "held", "fallback"};
+
+class CSimulation
+{
+public:
+	CSimulation (TPath Path)
+	:	m_Stages (MenuStages, BootStageCount, StageHandler, this, nullptr),
+		m_Path (Path),
+		m_bCore1Free (false)
+	{
+		for (unsigned i = 0; i < BootStageCount; i++)
+		{
+			m_nRuns[i] = 0;
+			m_nStart[i] = 0;
+			m_nEnd[i] = 0;
+		}
+	}
+
+	// like CKernel, returns the modelled time to the synth in us
+	unsigned Run (void)
+	{
+		unsigned nStart = CTimer::GetClockTicks ();
+		Sleep (s_nStdlib);
+
+		// core 1 runs its stages, then tasks (here: the resumed stages)
+		std::thread Core1 ([this]
+		{
+			Check (m_Stages.Run (1), "core 1");
+
+			while (!m_bCore1Free)
+			{
+				std::this_thread::yield ();
+			}
+
+			if (m_Path == PathFallback)
+			{
+				Check (m_Stages.Run (1), "core 1 resumed");
+			}
+		});
+
+		Check (m_Stages.Run (0), "core 0");
+
+		if (m_Path == PathAutoBoot || m_Path == PathFallback)
+		{
+			Check (m_Stages.IsComplete (), "complete while deferred");
+
+			for (unsigned i = 0; i < BootStageCount; i++)
+			{
+				Check (   ((MENU_STAGES_DEFERRED & BOOT_STAGE (i)) != 0)
+				       == !m_Stages.IsDone (i), "deferred stages skipped");
+			}
+
+			Sleep (s_nLoad);
+		}
+
+		if (m_Path == PathFallback)
+		{
+			// CKernel::ResumeMenu()
+			m_Stages.Resume ();
+			Check (!m_Stages.IsComplete (), "incomplete when resumed");
+			m_bCore1Free = true;
+			Check (m_Stages.Run (0), "core 0 resumed");
+		}
+		else if (m_Path != PathAutoBoot)
+		{
+			// selected at once, the teardown waits for USB
+			while (!m_Stages.IsComplete ())
+			{
+				std::this_thread::yield ();
+			}
+
+			Sleep (s_nLoad);
+		}
+
+		m_bCore1Free = true;
+		Core1.join ();
+
+		if (m_Path != PathFallback)
+		{
+			Sleep (s_nTeardown);
+		}
+		else
+		{
+			Check (m_Stages.IsComplete (), "complete");
+		}
+
+		return (CTimer::GetClockTicks () - nStart) * s_nScale;
+	}
+
+	void CheckStages (void) const
+	{
+		for (unsigned i = 0; i < BootStageCount; i++)
+		{
+			bool bDeferred =    (m_Path == PathAutoBoot)
+					 && (MENU_STAGES_DEFERRED & BOOT_STAGE (i));
+			Check (m_nRuns[i] == (bDeferred ? 0 : 1), "runs once");
+
+			for (unsigned j = 0; j < i; j++)
+			{
+				if (   !bDeferred
+				    && (MenuStages[i].nDependencies & BOOT_STAGE (j)))
+				{
+					Check (m_nEnd[j] <= m_nStart[i], "after its dependencies");
+				}
+			}
+		}
+	}
+
+	// some stages of different cores did run at the same time
+	bool IsParallel (void) const
+	{
+		for (unsigned i = 0; i < BootStageCount; i++)
+		{
+			for (unsigned j = 0; j < i; j++)
+			{
+				if (   m_nRuns[i] != 0 && m_nRuns[j] != 0
+				    && MenuStages[i].nCore != MenuStages[j].nCore
+				    && m_nStart[i] < m_nEnd[j]
+				    && m_nStart[j] < m_nEnd[i])
+				{
+					return true;
+				}
+			}
+		}
+
+		return false;
+	}
+
+private:
+	static bool StageHandler (unsigned nStage, void *pParam)
+	{
+		CSimulation *pThis = static_cast<CSimulation *> (pParam);
+
+		pThis->m_nRuns[nStage]++;
+		pThis->m_nStart[nStage] = CTimer::GetClockTicks ();
+
+		Sleep (s_Duration[nStage]);
+
+		// CKernel::SelectBootMode()
+		if (nStage == BootStageMode)
+		{
+			if (pThis->m_Path == PathHeld)
+			{
+				Sleep (s_nHoldTime);
+			}
+			else if (pThis->m_Path != PathMenu)
+			{
+				pThis->m_Stages.Defer (MENU_STAGES_DEFERRED);
+			}
+		}
+
+		pThis->m_nEnd[nStage] = CTimer::GetClockTicks ();
+
+		return true;
+	}
+
+private:
+	CBootStages m_Stages;
+	TPath m_Path;
+
+	std::atomic<bool> m_bCore1Free;
+
+	std::atomic<unsigned> m_nRuns[BootStageCount];
+	unsigned m_nStart[BootStageCount];
+	unsigned m_nEnd[BootStageCount];
+};
+
+// longest path through the stage graph with the modelled durations, only
+// the stages not in nSkip
+static unsigned GetCriticalPath (u32 nSkip)
+{
+	unsigned nFinish[BootStageCount];
+	unsigned nLongest = 0;
+
+	for (unsigned i = 0; i < BootStageCount; i++)
+	{
+		nFinish[i] = 0;
+		if (nSkip & BOOT_STAGE (i))
+		{
+			continue;
+		}
+
+		// the stages of a core run in table order
+		unsigned nStart = 0;
+		for (unsigned j = 0; j < i; j++)
+		{
+			if (   (   (MenuStages[i].nDependencies & BOOT_STAGE (j))
+			        || MenuStages[i].nCore == MenuStages[j].nCore)
+			    && nFinish[j] > nStart)
+			{
+				nStart = nFinish[j];
+			}
+		}
+
+		nFinish[i] = nStart + s_Duration[i];
+		if (nFinish[i] > nLongest)
+		{
+			nLongest = nFinish[i];
+		}
+	}
+
+	return nLongest;
+}
+
+int main (int argc, char **argv)
+{
+	unsigned nRounds = 3;
+
+	int nOption;
+	while (optind <= argc && (nOption = getopt (argc, argv, "r:s:v")) != -1)
+	{
+		switch (nOption)
+		{
+		case 'r':	nRounds = strtoul (optarg, nullptr, 0);		break;
+		case 's':	s_nScale = strtoul (optarg, nullptr, 0);	break;
+		case 'v':	s_bVerbose = true;				break;
+
+		default:
+			optind = argc + 1;			// show usage
+			break;
+		}
+	}
+
+	if (nRounds == 0 || s_nScale == 0 || optind != argc)
+	{
+		return Usage ("autobootsim [-r rounds] [-s scale] [-v]");
+	}
+
+	// nothing, which stays, may depend on a deferred stage
+	for (unsigned i = 0; i < BootStageCount; i++)
+	{
+		Check (   (MENU_STAGES_DEFERRED & BOOT_STAGE (i))
+		       || !(MenuStages[i].nDependencies & MENU_STAGES_DEFERRED), "deferred closure");
+	}
+
+	unsigned nMenu = s_nStdlib + GetCriticalPath (0) + s_nLoad + s_nTeardown;
+	unsigned nAutoBoot = s_nStdlib + GetCriticalPath (MENU_STAGES_DEFERRED) + s_nLoad + s_nTeardown;
+	printf ("%-28s %8u us\n", "menu, modelled", nMenu);
+	printf ("%-28s %8u us\n", "autoboot, modelled", nAutoBoot);
+	Check (nAutoBoot < nMenu, "autoboot is faster");
+
+	for (unsigned nPath = 0; nPath < PathCount; nPath++)
+	{
+		unsigned nWorst = 0;
+		bool bParallel = false;
+		for (unsigned i = 0; i < nRounds; i++)
+		{
+			CSimulation Simulation ((TPath) nPath);
+			unsigned nDuration = Simulation.Run ();
+
+			Simulation.CheckStages ();
+			bParallel |= Simulation.IsParallel ();
+
+			if (nDuration > nWorst)
+			{
+				nWorst = nDuration;
+			}
+		}
+
+		if (nPath == PathMenu)
+		{
+			Check (bParallel, "stages in parallel");
+		}
+
+		char Label[32];
+		snprintf (Label, sizeof Label, "%s, worst", s_pPathName[nPath]);
+		printf ("%-28s %8u us\n", Label, nWorst);
+	}
+
+	return CheckResult ();
+}
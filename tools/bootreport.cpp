@@ -0,0 +1,106 @@
+//
+// bootreport.cpp
+//
+// Host tool: aggregates boot_profile.csv files written by CBootProfiler
+// (one or more boots each) into per-stage duration percentiles.
+//
+// usage: bootreport boot_profile.csv [more.csv ...]
+//
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+struct TStage
+{
+	unsigned nOrder;
+	std::vector<unsigned> Durations;
+};
+
+static unsigned Percentile (const std::vector<unsigned> &rSorted, unsigned nPercent)
+{
+	// nearest rank
+	size_t nRank = (rSorted.size () * nPercent + 99) / 100;
+
+	return rSorted[nRank > 0 ? nRank - 1 : 0];
+}
+
+static bool ReadCSV (const char *pFileName, std::map<std::string, TStage> &rStages)
+{
+	FILE *pFile = fopen (pFileName, "r");
+	if (pFile == nullptr)
+	{
+		perror (pFileName);
+
+		return false;
+	}
+
+	char Line[256];
+	while (fgets (Line, sizeof Line, pFile) != nullptr)
+	{
+		char Name[128];
+		unsigned nCore, nStart, nDuration;
+		if (sscanf (Line, "%127[^,],%u,%u,%u", Name, &nCore, &nStart, &nDuration) != 4)
+		{
+			continue;		// header or garbage
+		}
+
+		auto it = rStages.find (Name);
+		if (it == rStages.end ())
+		{
+			it = rStages.emplace (Name, TStage {(unsigned) rStages.size (), {}}).first;
+		}
+
+		it->second.Durations.push_back (nDuration);
+	}
+
+	fclose (pFile);
+
+	return true;
+}
+
+int main (int argc, char **argv)
+{
+	if (argc < 2)
+	{
+		fprintf (stderr, "usage: %s boot_profile.csv [...]\n", argv[0]);
+
+		return EXIT_FAILURE;
+	}
+
+	std::map<std::string, TStage> Stages;
+	for (int i = 1; i < argc; i++)
+	{
+		if (!ReadCSV (argv[i], Stages))
+		{
+			return EXIT_FAILURE;
+		}
+	}
+
+	std::vector<std::pair<std::string, TStage *>> Ordered;
+	for (auto &rStage : Stages)
+	{
+		Ordered.emplace_back (rStage.first, &rStage.second);
+	}
+	std::sort (Ordered.begin (), Ordered.end (),
+		   [] (const auto &a, const auto &b) { return a.second->nOrder < b.second->nOrder; });
+
+	printf ("%-16s %6s %9s %9s %9s %9s %9s   (us)\n",
+		"stage", "n", "min", "p50", "p90", "p99", "max");
+
+	for (auto &rEntry : Ordered)
+	{
+		std::vector<unsigned> &rDurations = rEntry.second->Durations;
+		std::sort (rDurations.begin (), rDurations.end ());
+
+		printf ("%-16s %6zu %9u %9u %9u %9u %9u\n",
+			rEntry.first.c_str (), rDurations.size (), rDurations.front (),
+			Percentile (rDurations, 50), Percentile (rDurations, 90),
+			Percentile (rDurations, 99), rDurations.back ());
+	}
+
+	return EXIT_SUCCESS;
+}
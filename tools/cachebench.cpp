@@ -0,0 +1,341 @@
+//
+// cachebench.cpp
+//
+// Host tool: drives the FatFs stand-in of the host tools (see fatfsimage.h)
+// on a disk image like a card with the files of the boot menu and counts
+// the card commands per boot, once with the disk read directly and once
+// through CBlockCache (src/blockcache.h), which is set as the device in
+// between like in CKernel::MountSD(). A boot is modelled after the stages:
+// mount, config cache (or parsing both ini files, if the cache is stale),
+// boot state, synth catalog from the container and the load of an image.
+//
+// Both ways must read the same data. A random mix of small reads, large
+// reads and writes must stay coherent with the image.
+//
+// The time of a boot is modelled from the card commands with a command
+// latency and the bus rate of the SD card.
+//
+// usage: cachebench [-l command latency us] [-b bus MB/s] [-n random ops] [-d dir]
+//
+#include "fatfsimage.h"
+#include "../src/blockcache.h"
+#include "../src/fileextent.h"
+#include "../src/crc32.h"
+#include "toolcheck.h"
+#include <circle/logger.h>
+#include <circle/timer.h>
+#include <fatfs/ff.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#define CHAINLOAD_DIRECT_CHUNK_SIZE	0x40000		// as in src/chainloader.h
+#define PACK_ALIGN			4096		// SYNTH_PACK_ALIGN
+#define PACK_SYNTHS			4
+#define IMAGE_SIZE			(2000 * 1024)
+
+void CLogger::Write (const char *pSource, TLogSeverity Severity, const char *pMessage, ...)
+{
+}
+
+CLogger *CLogger::Get (void)
+{
+	static CLogger s_Logger;
+
+	return &s_Logger;
+}
+
+unsigned CTimer::GetClockTicks (void)
+{
+	return 0;
+}
+
+static std::vector<uint8_t> MakeData (size_t nSize, unsigned nSeed)
+{
+	std::vector<uint8_t> Data (nSize);
+	std::mt19937 Random (nSeed);
+	for (auto &rByte : Data)
+	{
+		rByte = Random ();
+	}
+
+	return Data;
+}
+
+// the files of a card with MiniDexed and the boot menu, the root directory
+// has the firmware files first
+static void BuildCard (CFatFsImage *pDisk)
+{
+	bool bOK = true;
+
+	static const char *Firmware[] =
+	{
+		"bootcode.bin", "start.elf", "start4.elf", "fixup.dat", "fixup4.dat",
+		"config.txt", "cmdline.txt", "kernel8.img", "kernel8-rpi4.img", "kernel_2712.img",
+		"armstub8.bin", "LICENCE.broadcom", "COPYING.linux", "README.md"
+	};
+	unsigned nSeed = 1;
+	for (const char *pName : Firmware)
+	{
+		std::vector<uint8_t> Data = MakeData (20000 + nSeed * 3000, nSeed);
+		bOK &= pDisk->AddFile (pName, Data.data (), Data.size ());
+		nSeed++;
+	}
+
+	for (unsigned i = 0; i < 30; i++)
+	{
+		char Name[32];
+		snprintf (Name, sizeof Name, "bcm27%02u-rpi-%u.dtb", 10 + i % 3, i);
+		std::vector<uint8_t> Data = MakeData (30000, nSeed++);
+		bOK &= pDisk->AddFile (Name, Data.data (), Data.size ());
+	}
+
+	bOK &= pDisk->AddDirectory ("performance");
+	for (unsigned i = 0; i < 40; i++)
+	{
+		char Name[32];
+		snprintf (Name, sizeof Name, "performance/%06u.ini", i);
+		std::vector<uint8_t> Data = MakeData (3000, nSeed++);
+		bOK &= pDisk->AddFile (Name, Data.data (), Data.size ());
+	}
+
+	std::vector<uint8_t> Data = MakeData (1500, nSeed++);
+	bOK &= pDisk->AddFile ("SD:/synth.ini", Data.data (), Data.size ());
+	Data = MakeData (7000, nSeed++);
+	bOK &= pDisk->AddFile ("SD:/minidexed.ini", Data.data (), Data.size ());
+	Data = MakeData (1200, nSeed++);
+	bOK &= pDisk->AddFile ("config.bin", Data.data (), Data.size ());
+	Data = MakeData (16 * 512, nSeed++);
+	bOK &= pDisk->AddFile ("SD:/bootstate.log", Data.data (), Data.size ());
+
+	// the index in the first block, the images on PACK_ALIGN boundaries
+	Data = MakeData (PACK_ALIGN + PACK_SYNTHS * IMAGE_SIZE, nSeed++);
+	bOK &= pDisk->AddFile ("SD:/synths8.pak", Data.data (), Data.size ());
+
+	Check (bOK && pDisk->Finish (), "disk image");
+}
+
+// reads like the stages of the boot menu, returns the CRC of all data read
+static uint32_t Boot (CBlockCache *pCache, bool bParseIni)
+{
+	uint32_t nCRC = 0;
+	bool bOK = true;
+
+	FATFS FileSystem;
+	bOK &= f_mount (&FileSystem, "SD:", 1) == FR_OK;
+	if (pCache != nullptr)
+	{
+		pCache->Pin (FileSystem.fatbase, FileSystem.fsize);
+	}
+
+	static uint8_t Buffer[CHAINLOAD_DIRECT_CHUNK_SIZE];
+	auto ReadFile = [&] (const char *pPath, FSIZE_t nOffset, UINT nSize, UINT nPiece)
+	{
+		FIL File;
+		bOK &=    f_open (&File, pPath, FA_READ | FA_OPEN_EXISTING) == FR_OK
+		       && f_lseek (&File, nOffset) == FR_OK;
+		for (UINT nDone = 0; bOK && nDone < nSize; nDone += nPiece)
+		{
+			UINT nChunk = nSize - nDone < nPiece ? nSize - nDone : nPiece;
+			UINT nRead;
+			bOK &= f_read (&File, Buffer, nChunk, &nRead) == FR_OK && nRead == nChunk;
+			nCRC = CRC32Update (nCRC, Buffer, nChunk);
+		}
+		f_close (&File);
+	};
+
+	// config: the stamps of the ini files and the cache
+	FILINFO Info;
+	bOK &= f_stat ("SD:/synth.ini", &Info) == FR_OK;
+	bOK &= f_stat ("SD:/minidexed.ini", &Info) == FR_OK;
+	if (bParseIni)
+	{
+		ReadFile ("SD:/synth.ini", 0, 1500, 1500);
+		ReadFile ("SD:/minidexed.ini", 0, 7000, 7000);
+	}
+	else
+	{
+		ReadFile ("config.bin", 0, 1200, 1200);
+	}
+
+	// boot state: one read of all slots
+	FIL File;
+	TFileExtent Extent;
+	bOK &=    f_open (&File, "SD:/bootstate.log", FA_READ | FA_OPEN_EXISTING) == FR_OK
+	       && FileGetExtent (&File, 0, f_size (&File), &Extent)
+	       && FileReadExtent (&Extent, 0, Buffer, 16 * 512);
+	nCRC = CRC32Update (nCRC, Buffer, 16 * 512);
+	f_close (&File);
+
+	// catalog: header and index
+	ReadFile ("SD:/synths8.pak", 0, 24 + PACK_SYNTHS * 72, 24);
+
+	// load: an image from the container
+	FSIZE_t nOffset = PACK_ALIGN + IMAGE_SIZE;
+	bOK &=    f_open (&File, "SD:/synths8.pak", FA_READ | FA_OPEN_EXISTING) == FR_OK
+	       && f_lseek (&File, nOffset) == FR_OK
+	       && FileGetExtent (&File, nOffset, IMAGE_SIZE, &Extent);
+	for (size_t nDone = 0; bOK && nDone < IMAGE_SIZE; nDone += CHAINLOAD_DIRECT_CHUNK_SIZE)
+	{
+		size_t nChunk = IMAGE_SIZE - nDone < CHAINLOAD_DIRECT_CHUNK_SIZE
+			      ? IMAGE_SIZE - nDone : CHAINLOAD_DIRECT_CHUNK_SIZE;
+		bOK &= FileReadExtent (&Extent, nDone, Buffer, nChunk);
+		nCRC = CRC32Update (nCRC, Buffer, nChunk);
+	}
+	f_close (&File);
+
+	f_mount (nullptr, "SD:", 0);
+
+	Check (bOK, "boot");
+
+	return nCRC;
+}
+
+// small and large reads and writes through the cache, checked against the
+// image read directly
+static void CheckCoherence (CFatFsImage *pDisk, CBlockCache *pCache, unsigned nOps)
+{
+	std::mt19937 Random (42);
+	unsigned nSectors = 4096;		// the beginning with the FAT and directories
+
+	std::vector<uint8_t> Cached (64 * 512), Direct (64 * 512);
+	for (unsigned i = 0; i < nOps; i++)
+	{
+		unsigned nSector = Random () % (nSectors - 64);
+		unsigned nCount = Random () % 4 == 0 ? 8 + Random () % 56 : 1 + Random () % 4;
+		u64 nOffset = (u64) nSector * 512;
+
+		if (Random () % 8 == 0)
+		{
+			for (unsigned j = 0; j < nCount * 512; j++)
+			{
+				Cached[j] = Random ();
+			}
+
+			Check (   pCache->Seek (nOffset) == nOffset
+			       && pCache->Write (Cached.data (), nCount * 512) == (int) nCount * 512, "write");
+
+			continue;
+		}
+
+		// sequential runs now and then
+		Check (   pCache->Seek (nOffset) == nOffset
+		       && pCache->Read (Cached.data (), nCount * 512) == (int) nCount * 512, "read");
+		if (Random () % 2 == 0)
+		{
+			nOffset += nCount * 512;
+			Check (pCache->Read (Cached.data () + nCount * 512, 512) == 512, "read on");
+			nCount++;
+		}
+
+		Check (   pDisk->Seek ((u64) nSector * 512) == (u64) nSector * 512
+		       && pDisk->Read (Direct.data (), nCount * 512) == (int) nCount * 512, "read image");
+		Check (memcmp (Cached.data (), Direct.data (), nCount * 512) == 0, "coherent");
+	}
+}
+
+int main (int argc, char **argv)
+{
+	unsigned nLatency = 150;
+	unsigned nBusRate = 22;
+	unsigned nOps = 200000;
+	const char *pDirectory = "/tmp";
+
+	int nOption;
+	while (optind <= argc && (nOption = getopt (argc, argv, "l:b:n:d:")) != -1)
+	{
+		switch (nOption)
+		{
+		case 'l':	nLatency = strtoul (optarg, nullptr, 0);	break;
+		case 'b':	nBusRate = strtoul (optarg, nullptr, 0);	break;
+		case 'n':	nOps = strtoul (optarg, nullptr, 0);		break;
+		case 'd':	pDirectory = optarg;				break;
+
+		default:
+			optind = argc + 1;			// show usage
+			break;
+		}
+	}
+
+	if (nBusRate == 0 || optind != argc)
+	{
+		return Usage ("cachebench [-l command latency us] [-b bus MB/s] [-n random ops] [-d dir]");
+	}
+
+	printf ("card: %u us per command, %u MB/s\n", nLatency, nBusRate);
+	printf ("%-34s %8s %8s %8s %8s\n", "", "commands", "sectors", "model ms", "hit rate");
+
+	static CBlockCache Cache;
+	std::string Path = std::string (pDirectory) + "/cachebench.img";
+
+	static const unsigned ClusterSectors[] = {8, 64};
+	for (unsigned nClusterSectors : ClusterSectors)
+	{
+		CFatFsImage Disk (Path.c_str (), 64 * 1024 * 2, nClusterSectors);
+		BuildCard (&Disk);
+
+		for (int bParseIni = 0; bParseIni <= 1; bParseIni++)
+		{
+			uint32_t nExpected = 0;
+			for (int bCached = 0; bCached <= 1; bCached++)
+			{
+				CFatFsImage::SetDevice (&Disk);
+				if (bCached)
+				{
+					Cache.Setup (&Disk);
+					CFatFsImage::SetDevice (&Cache);
+				}
+
+				CFatFsImage::ResetStats ();
+				uint32_t nCRC = Boot (bCached ? &Cache : nullptr, bParseIni);
+				if (!bCached)
+				{
+					nExpected = nCRC;
+				}
+				Check (nCRC == nExpected, "same data");
+
+				const TDiskStats &rStats = CFatFsImage::GetStats ();
+				double fModel =   rStats.nReadCommands * nLatency / 1e3
+						+ rStats.nReadSectors * 512.0 / (nBusRate * 1e3);
+
+				const TBlockCacheStats &rCache = Cache.GetStats ();
+				unsigned nLookups = rCache.nHits + rCache.nMisses;
+
+				char Label[64];
+				snprintf (Label, sizeof Label, "%u KB clusters, %s, %s", nClusterSectors / 2,
+					  bParseIni ? "ini" : "config cache", bCached ? "cached" : "direct");
+				char HitRate[16] = "-";
+				if (bCached && nLookups != 0)
+				{
+					snprintf (HitRate, sizeof HitRate, "%u%%", rCache.nHits * 100 / nLookups);
+				}
+				printf ("%-34s %8u %8u %8.1f %8s\n", Label, rStats.nReadCommands,
+					rStats.nReadSectors, fModel, HitRate);
+
+				if (bCached)
+				{
+					Check (rCache.nCommands == rStats.nReadCommands, "commands counted");
+					Check (rCache.nSectors == rStats.nReadSectors, "sectors counted");
+				}
+			}
+		}
+
+		// a FAT sector read again is pinned
+		Cache.Setup (&Disk);
+		CFatFsImage::SetDevice (&Cache);
+		Boot (&Cache, true);
+		unsigned nCommands = Cache.GetStats ().nCommands;
+		uint8_t Sector[512];
+		Check (   Cache.Seek (512) == 512
+		       && Cache.Read (Sector, sizeof Sector) == sizeof Sector, "read FAT");
+		Check (Cache.GetStats ().nCommands == nCommands, "FAT pinned");
+
+		CheckCoherence (&Disk, &Cache, nOps);
+	}
+
+	return CheckResult ();
+}
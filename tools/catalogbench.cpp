@@ -0,0 +1,280 @@
+//
+// catalogbench.cpp
+//
+// Host tool: estimates the time to load the synth catalog of the boot menu
+// (see src/synthcatalog.h) at boot for 3, 50 and 500 synths in the three
+// ways it can be done: scanning the synth directories, reading the cached
+// index of the last scan and reading the index of a synth container.
+//
+// The SD card is modelled by the latency of a single sector read and its
+// read bandwidth, the file system like FatFs with one sector window: a
+// path lookup searches the root directory from its start. The CPU time for
+// the CRCs and sorting is measured on the host and scaled by the slowdown
+// of the target CPU.
+//
+// usage: catalogbench [-l latency us] [-b MB/s] [-s slowdown] [-f root files]
+//
+#include "../src/synthpack.h"
+#include "../src/crc32.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#define SECTOR_SIZE	512
+#define DIR_ENTRY_SIZE	32
+#define NOTES		128
+
+static const unsigned s_Counts[] = {3, 50, 500};
+
+static volatile uint32_t s_nSink;	// keeps the timed work from being optimized away
+
+struct TSynth
+{
+	char Title[SYNTH_PACK_TITLE_MAX];
+	char Name[SYNTH_PACK_NAME_MAX];
+	uint8_t nMIDINote;
+	uint8_t nFlags;
+	uint32_t nOffset;
+	uint32_t nSize;
+	uint32_t nImageSize;
+	uint32_t nImageCRC;
+};
+
+class CModel
+{
+public:
+	CModel (double fLatency, double fBandwidth, unsigned nRootFiles)
+	:	m_fLatency (fLatency),
+		m_fBandwidth (fBandwidth),
+		m_nRootFiles (nRootFiles),
+		m_nReads (0),
+		m_fTime (0.0)
+	{
+	}
+
+	void Reset (void)
+	{
+		m_nReads = 0;
+		m_fTime = 0.0;
+	}
+
+	// single sector reads through the FatFs window
+	void ReadSectors (unsigned nSectors)
+	{
+		m_nReads += nSectors;
+		m_fTime += nSectors * (m_fLatency + SECTOR_SIZE / m_fBandwidth);
+	}
+
+	// f_read() of whole sectors goes to the card in one request
+	void ReadFile (size_t nBytes)
+	{
+		unsigned nSectors = (nBytes + SECTOR_SIZE - 1) / SECTOR_SIZE;
+		m_nReads++;
+		m_fTime += m_fLatency + nSectors * SECTOR_SIZE / m_fBandwidth;
+	}
+
+	void Compute (double fSeconds)
+	{
+		m_fTime += fSeconds;
+	}
+
+	// the synth directories follow the other files in the root directory,
+	// each name takes one long name entry and the short entry
+	unsigned GetRootSectors (unsigned nSynths) const
+	{
+		return ((m_nRootFiles + nSynths) * 2 * DIR_ENTRY_SIZE + SECTOR_SIZE - 1) / SECTOR_SIZE;
+	}
+
+	unsigned GetSectorOf (unsigned nEntry) const
+	{
+		return (m_nRootFiles + nEntry) * 2 * DIR_ENTRY_SIZE / SECTOR_SIZE + 1;
+	}
+
+	unsigned GetReads (void) const	{ return m_nReads; }
+	double GetTime (void) const	{ return m_fTime * 1000.0; }	// ms
+
+private:
+	double m_fLatency;		// s
+	double m_fBandwidth;		// bytes/s
+	unsigned m_nRootFiles;
+
+	unsigned m_nReads;
+	double m_fTime;
+};
+
+static double Elapsed (std::chrono::steady_clock::time_point Start)
+{
+	std::chrono::duration<double> Time = std::chrono::steady_clock::now () - Start;
+
+	return Time.count ();
+}
+
+static void MakeSynths (unsigned nCount, std::vector<TSynth> &rSynths)
+{
+	rSynths.resize (nCount);
+	for (unsigned i = 0; i < nCount; i++)
+	{
+		TSynth &rSynth = rSynths[i];
+		memset (&rSynth, 0, sizeof rSynth);
+
+		// the directories are found in creation order
+		snprintf (rSynth.Name, sizeof rSynth.Name, "synth%03u", (i * 7919) % nCount);
+		strcpy (rSynth.Title, rSynth.Name);
+		rSynth.nMIDINote = i < NOTES ? i : SYNTH_PACK_NO_NOTE;
+	}
+}
+
+static void MakeIndex (const std::vector<TSynth> &rSynths, std::vector<TSynthPackEntry> &rIndex)
+{
+	rIndex.resize (rSynths.size ());
+	for (size_t i = 0; i < rSynths.size (); i++)
+	{
+		memset (&rIndex[i], 0, sizeof rIndex[i]);
+		memcpy (rIndex[i].Title, rSynths[i].Title, sizeof rIndex[i].Title);
+		memcpy (rIndex[i].Name, rSynths[i].Name, sizeof rIndex[i].Name);
+		rIndex[i].nLoadAddress = 0x80000;
+		rIndex[i].nMIDINote = rSynths[i].nMIDINote;
+		rIndex[i].nFlags = SYNTH_PACK_EXTERNAL;
+	}
+}
+
+// CPU work of loading an index: CRC, conversion
+static double LoadIndex (const std::vector<TSynthPackEntry> &rIndex, std::vector<TSynth> &rSynths)
+{
+	auto Start = std::chrono::steady_clock::now ();
+
+	uint32_t nCRC = CRC32Update (0, rIndex.data (), rIndex.size () * sizeof (TSynthPackEntry));
+
+	rSynths.resize (rIndex.size ());
+	for (size_t i = 0; i < rIndex.size (); i++)
+	{
+		memcpy (rSynths[i].Title, rIndex[i].Title, sizeof rSynths[i].Title);
+		memcpy (rSynths[i].Name, rIndex[i].Name, sizeof rSynths[i].Name);
+		rSynths[i].nMIDINote = rIndex[i].nMIDINote;
+		rSynths[i].nFlags = rIndex[i].nFlags;
+	}
+
+	double fTime = Elapsed (Start);
+	s_nSink = nCRC;
+
+	return fTime;
+}
+
+// CPU work of a scan: stamp, insertion sort, index for the cache
+static double Scan (std::vector<TSynth> &rSynths, std::vector<TSynthPackEntry> &rIndex)
+{
+	auto Start = std::chrono::steady_clock::now ();
+
+	uint32_t nStamp = 0;
+	for (const TSynth &rSynth : rSynths)
+	{
+		nStamp = CRC32Update (nStamp, rSynth.Name, strlen (rSynth.Name));
+	}
+
+	for (size_t i = 1; i < rSynths.size (); i++)
+	{
+		TSynth Synth = rSynths[i];
+
+		size_t j = i;
+		for (; j > 0 && strcmp (rSynths[j-1].Name, Synth.Name) > 0; j--)
+		{
+			rSynths[j] = rSynths[j-1];
+		}
+
+		rSynths[j] = Synth;
+	}
+
+	MakeIndex (rSynths, rIndex);
+	uint32_t nCRC = CRC32Update (0, rIndex.data (), rIndex.size () * sizeof (TSynthPackEntry));
+
+	double fTime = Elapsed (Start);
+	s_nSink = nStamp + nCRC;
+
+	return fTime;
+}
+
+int main (int argc, char **argv)
+{
+	double fLatency = 250.0;
+	double fBandwidth = 20.0;
+	double fSlowdown = 10.0;
+	unsigned nRootFiles = 20;
+
+	int nOption;
+	while (optind <= argc && (nOption = getopt (argc, argv, "l:b:s:f:")) != -1)
+	{
+		switch (nOption)
+		{
+		case 'l':	fLatency = atof (optarg);		break;
+		case 'b':	fBandwidth = atof (optarg);		break;
+		case 's':	fSlowdown = atof (optarg);		break;
+		case 'f':	nRootFiles = strtoul (optarg, nullptr, 0); break;
+
+		default:
+			optind = argc + 1;			// show usage
+			break;
+		}
+	}
+
+	if (   fLatency < 0.0 || fBandwidth <= 0.0 || fSlowdown <= 0.0
+	    || optind != argc)
+	{
+		fprintf (stderr, "usage: catalogbench [-l latency us] [-b MB/s] [-s slowdown] "
+				 "[-f root files]\n");
+
+		return EXIT_FAILURE;
+	}
+
+	CModel Model (fLatency / 1e6, fBandwidth * 1e6, nRootFiles);
+
+	printf ("SD latency %.0f us, %.1f MB/s, CPU slowdown %.1f, %u other files\n",
+		fLatency, fBandwidth, fSlowdown, nRootFiles);
+	printf ("%-7s %10s %7s %10s %7s %10s %7s\n", "synths", "scan ms", "reads",
+		"cached ms", "reads", "pack ms", "reads");
+
+	for (unsigned nCount : s_Counts)
+	{
+		std::vector<TSynth> Synths;
+		std::vector<TSynthPackEntry> Index;
+		unsigned nRootSectors = Model.GetRootSectors (nCount);
+		size_t nIndexSize = sizeof (TSynthPackHeader) + nCount * sizeof (TSynthPackEntry);
+
+		// scan: list the root directory, then look up the compressed and
+		// the raw image in each directory (one sector each)
+		Model.Reset ();
+		Model.ReadSectors (nRootSectors);
+		for (unsigned i = 0; i < nCount; i++)
+		{
+			Model.ReadSectors (2 * (Model.GetSectorOf (i) + 1));
+		}
+		MakeSynths (nCount, Synths);
+		Model.Compute (Scan (Synths, Index) * fSlowdown);
+		double fScan = Model.GetTime ();
+		unsigned nScanReads = Model.GetReads ();
+
+		// cache: list the root directory for the stamp, open and read the
+		// cache file, which is one of the other files
+		Model.Reset ();
+		Model.ReadSectors (nRootSectors);
+		Model.ReadSectors (Model.GetSectorOf (0));
+		Model.ReadFile (nIndexSize);
+		Model.Compute (LoadIndex (Index, Synths) * fSlowdown);
+		double fCached = Model.GetTime ();
+		unsigned nCachedReads = Model.GetReads ();
+
+		// container: there are no synth directories
+		Model.Reset ();
+		Model.ReadSectors (Model.GetSectorOf (0));
+		Model.ReadFile (nIndexSize);
+		Model.Compute (LoadIndex (Index, Synths) * fSlowdown);
+
+		printf ("%-7u %10.2f %7u %10.2f %7u %10.2f %7u\n", nCount,
+			fScan, nScanReads, fCached, nCachedReads, Model.GetTime (), Model.GetReads ());
+	}
+
+	return EXIT_SUCCESS;
+}
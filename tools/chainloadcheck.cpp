@@ -0,0 +1,515 @@
+//
+// chainloadcheck.cpp
+//
+// Host tool: runs CChainLoader (src/chainloader.h) against a disk image with
+// the FatFs stand-in of the host tools (see fatfsimage.h), with threads in
+// place of the secondary cores. ChainBootRelocate() and ChainBootPark() are
+// replaced by stubs, which check what the assembler code would get: the
+// staged image with its padding, the relocation target, the device tree
+// pointer and the park slots, and that all secondary cores have acked the
+// current park token and the interrupt sources are quiesced, before the
+// image is started.
+//
+// Load() must accept the raw and compressed images in the synth container
+// and in the synth directories (also a fragmented one, one with a CRC file
+// and without the decoder task), and must reject a corrupt, a truncated, an
+// oversized and a missing image, a raw image with a wrong or an invalid CRC
+// file and a cancelled load. With SetCRCRequired() only the images with a
+// CRC must be accepted. Boot() must return, if a core does not park in time.
+//
+// usage: chainloadcheck [-d dir] [-v]
+//
+#include "../src/chainloader.h"
+#include "../src/crc32.h"
+#include "fatfsimage.h"
+#include "imagewriter.h"
+#include "toolcheck.h"
+#include <circle/logger.h>
+#include <circle/timer.h>
+#include <circle/memio.h>
+#include <circle/memorymap.h>
+#include <circle/synchronize.h>
+#include <circle/bcm2835.h>
+#include <circle/bcmpropertytags.h>
+#include <fatfs/ff.h>
+#include <atomic>
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+#define DTB_ADDRESS	0x2EFF2000		// as passed by the firmware
+
+// thrown by the stubs in place of starting the image or parking for good
+struct TStarted {};
+struct TParked {};
+
+// what the code, which runs on a core, has done
+struct TCoreState
+{
+	bool bIRQsOff;
+	bool bFIQsOff;
+	bool bCacheCleaned;
+	bool bICacheInvalidated;
+};
+
+static thread_local TCoreState s_Core;
+
+static bool s_bVerbose;
+static std::atomic<unsigned> s_nLogErrors (0);
+static std::atomic<unsigned> s_nLogWarnings (0);
+
+static std::atomic<u32> s_LowMemory[MEM_KERNEL_START / 4];	// below the kernel
+static unsigned s_nICDisabled;			// ARM_IC registers written
+static bool s_bUSBPoweredOff;
+
+static std::atomic<unsigned> s_nParked (0);
+static std::atomic<bool> s_bRelease (false);
+static u32 s_ParkToken[CORES];
+
+static const TBuffer *s_pExpected;		// image, which Boot() must start
+static unsigned s_nExpectedCores;
+static std::atomic<unsigned> s_nStarted (0);
+
+static const auto s_Start = std::chrono::steady_clock::now ();
+
+unsigned CTimer::GetClockTicks (void)
+{
+	return std::chrono::duration_cast<std::chrono::microseconds> (
+		std::chrono::steady_clock::now () - s_Start).count () + 1;
+}
+
+void CLogger::Write (const char *pSource, TLogSeverity Severity, const char *pMessage, ...)
+{
+	if (Severity <= LogError)
+	{
+		s_nLogErrors++;
+	}
+	else if (Severity == LogWarning)
+	{
+		s_nLogWarnings++;
+	}
+
+	if (s_bVerbose)
+	{
+		va_list Args;
+		va_start (Args, pMessage);
+		printf ("  %s: ", pSource);
+		vprintf (pMessage, Args);
+		printf ("\n");
+		va_end (Args);
+	}
+}
+
+CLogger *CLogger::Get (void)
+{
+	static CLogger s_Logger;
+
+	return &s_Logger;
+}
+
+u32 read32 (uintptr nAddress)
+{
+	Check (nAddress < MEM_KERNEL_START && nAddress % 4 == 0, "read32 address");
+
+	return s_LowMemory[nAddress / 4 % (MEM_KERNEL_START / 4)];
+}
+
+void write32 (uintptr nAddress, u32 nValue)
+{
+	switch (nAddress)
+	{
+	case ARM_IC_FIQ_CONTROL:
+		Check (nValue == 0, "FIQ off");
+		s_nICDisabled++;
+		return;
+
+	case ARM_IC_DISABLE_IRQS_1:
+	case ARM_IC_DISABLE_IRQS_2:
+	case ARM_IC_DISABLE_BASIC_IRQS:
+		Check (nValue == (u32) -1, "IRQs off");
+		s_nICDisabled++;
+		return;
+	}
+
+	Check (nAddress < MEM_KERNEL_START && nAddress % 4 == 0, "write32 address");
+	s_LowMemory[nAddress / 4 % (MEM_KERNEL_START / 4)] = nValue;
+}
+
+void DisableIRQs (void)			{ s_Core.bIRQsOff = true; }
+void DisableFIQs (void)			{ s_Core.bFIQsOff = true; }
+void CleanDataCache (void)		{ s_Core.bCacheCleaned = true; }
+void InvalidateInstructionCache (void)	{ s_Core.bICacheInvalidated = true; }
+
+void CleanAndInvalidateDataCacheRange (u64 nAddress, u64 nLength)
+{
+	Check (   nAddress >= CHAINBOOT_PARK_ACK
+	       && nAddress + nLength <= CHAINBOOT_PARK_ACK + 4 * CORES, "ack range");
+}
+
+bool CBcmPropertyTags::GetTag (u32 nTagId, void *pTag, unsigned nTagSize, unsigned nRequestParmSize)
+{
+	const TPropertyTagPowerState *pState = static_cast<TPropertyTagPowerState *> (pTag);
+	Check (   nTagId == PROPTAG_SET_POWER_STATE
+	       && nTagSize == sizeof *pState
+	       && pState->nDeviceId == DEVICE_ID_USB_HCD
+	       && pState->nState == (POWER_STATE_OFF | POWER_STATE_WAIT), "USB power off");
+	s_bUSBPoweredOff = true;
+
+	return true;
+}
+
+// the MMU is off in the real code, so the ack is written around the cache
+void ChainBootPark (uintptr nMailbox, uintptr nAck, u32 nToken, uintptr nSlot)
+{
+	unsigned nCore = (nAck - CHAINBOOT_PARK_ACK) / 4;
+	Check (   1 <= nCore && nCore < CORES
+	       && nAck == CHAINBOOT_PARK_ACK + 4 * nCore
+	       && nMailbox == CHAINBOOT_SPIN_TABLE + 8 * nCore
+	       && nSlot == CHAINBOOT_PARK_PAGE + CHAINBOOT_SLOT_SIZE * nCore, "park addresses");
+	Check ((nToken & 1) != 0, "park token");
+	Check (s_Core.bIRQsOff && s_Core.bFIQsOff && s_Core.bCacheCleaned, "core quiesced");
+
+	s_ParkToken[nCore] = nToken;
+	write32 (nAck, nToken);
+	s_nParked++;
+
+	while (!s_bRelease)
+	{
+		std::this_thread::yield ();
+	}
+
+	throw TParked ();
+}
+
+void ChainBootRelocate (uintptr nDest, uintptr nSource, size_t nSize, uintptr nDTB, uintptr nSlot)
+{
+	s_nStarted++;
+
+	Check (nDest == MEM_KERNEL_START && nSlot == CHAINBOOT_PARK_PAGE, "relocation");
+	Check (nDTB == DTB_ADDRESS, "device tree");
+
+	// all secondary cores must be parked with the current token
+	for (unsigned nCore = 1; nCore <= s_nExpectedCores; nCore++)
+	{
+		Check (read32 (CHAINBOOT_PARK_ACK + 4 * nCore) == s_ParkToken[nCore], "parked");
+	}
+
+	Check (   s_Core.bIRQsOff && s_Core.bFIQsOff && s_nICDisabled == 4
+	       && s_bUSBPoweredOff, "interrupts quiesced");
+	Check (s_Core.bCacheCleaned && s_Core.bICacheInvalidated, "caches");
+
+	// copied in 16 byte units, the padding must be zero
+	const TBuffer &rImage = *s_pExpected;
+	const u8 *pSource = reinterpret_cast<const u8 *> (nSource);
+	Check (   nSource % 16 == 0
+	       && nSize == ((rImage.size () + 15) & ~15)
+	       && memcmp (pSource, rImage.data (), rImage.size ()) == 0, "image");
+	for (size_t i = rImage.size (); i < nSize; i++)
+	{
+		Check (pSource[i] == 0, "padding");
+	}
+
+	throw TStarted ();
+}
+
+// returns true, if the image was started
+static bool Boot (CChainLoader *pLoader, unsigned nSecondaryCores, const TBuffer *pExpected)
+{
+	s_Core = TCoreState ();
+	s_nICDisabled = 0;
+	s_bUSBPoweredOff = false;
+	s_pExpected = pExpected;
+	s_nExpectedCores = nSecondaryCores;
+
+	try
+	{
+		pLoader->Boot (nSecondaryCores);
+	}
+	catch (const TStarted &)
+	{
+		return true;
+	}
+
+	return false;
+}
+
+// a secondary core parks, when Boot() requests it, core 3 runs the chunk
+// decoder before
+static void SecondaryCore (unsigned nCore, CChainLoader *pLoader)
+{
+	if (nCore == 3)
+	{
+		CChunkDecoder::TaskHandler (pLoader->GetDecoder ());
+	}
+
+	while (!CChainLoader::IsParkRequested ())
+	{
+		std::this_thread::yield ();
+	}
+
+	try
+	{
+		CChainLoader::ParkCore (nCore);
+	}
+	catch (const TParked &)
+	{
+	}
+}
+
+static TBuffer MakeImage (size_t nSize, unsigned nSeed)
+{
+	// code like, compresses to about a half
+	std::mt19937 Random (nSeed);
+	TBuffer Image (nSize);
+	for (size_t i = 0; i < Image.size (); i++)
+	{
+		Image[i] = Random () % 4 == 0 ? Random () : Image[i / 2] ^ (i & 0x0F);
+	}
+
+	return Image;
+}
+
+static bool Cancel (void *pParam)
+{
+	unsigned *pCalls = static_cast<unsigned *> (pParam);
+
+	return ++*pCalls > 3;
+}
+
+int main (int argc, char **argv)
+{
+	const char *pDirectory = "/tmp";
+
+	int nOption;
+	while (optind <= argc && (nOption = getopt (argc, argv, "d:v")) != -1)
+	{
+		switch (nOption)
+		{
+		case 'd':	pDirectory = optarg;		break;
+		case 'v':	s_bVerbose = true;		break;
+
+		default:
+			optind = argc + 1;			// show usage
+			break;
+		}
+	}
+
+	if (optind != argc)
+	{
+		return Usage ("chainloadcheck [-d dir] [-v]");
+	}
+
+	// odd sizes, so there is padding
+	TBuffer Raw = MakeImage (1500 * 1024 + 5, 1);
+	TBuffer Packed = MakeImage (2100 * 1024 + 11, 2);
+	TBuffer Plain = MakeImage (700 * 1024 + 1, 3);
+	TBuffer Huge = MakeImage (KERNEL_MAX_SIZE + 512, 4);
+
+	TBuffer Compressed, Corrupt, NoCRC;
+	Check (   BuildImage (Packed, 1, Compressed)
+	       && BuildImage (Plain, 1, Corrupt)
+	       && BuildImage (Plain, 1, NoCRC), "build images");
+	TSynthImageHeader Header;
+	memcpy (&Header, Corrupt.data (), sizeof Header);
+	Header.nImageCRC ^= 1;
+	memcpy (Corrupt.data (), &Header, sizeof Header);
+	Header.nImageCRC = 0;				// unknown
+	memcpy (NoCRC.data (), &Header, sizeof Header);
+
+	// the images on SYNTH_PACK_ALIGN boundaries, the index is not used by Load()
+	TBuffer Pack (SYNTH_PACK_ALIGN);
+	auto Append = [&Pack] (const TBuffer &rImage)
+	{
+		u32 nOffset = Pack.size ();
+		Pack.insert (Pack.end (), rImage.begin (), rImage.end ());
+		Pack.resize ((Pack.size () + SYNTH_PACK_ALIGN - 1) & ~(SYNTH_PACK_ALIGN - 1));
+		return nOffset;
+	};
+	u32 nRawOffset = Append (Raw);
+	u32 nCompressedOffset = Append (Compressed);
+
+	u32 nRawCRC = CRC32Update (0, Raw.data (), Raw.size ());
+	u32 nPackedCRC = CRC32Update (0, Packed.data (), Packed.size ());
+
+	char RawCRC[32], BadCRC[32];
+	snprintf (RawCRC, sizeof RawCRC, "%08x  kernel8.img\n", nRawCRC);
+	snprintf (BadCRC, sizeof BadCRC, "%08X\n", nRawCRC ^ 1);
+
+	std::string Path = std::string (pDirectory) + "/chainloadcheck.img";
+	CFatFsImage Disk (Path.c_str (), 64 * 1024 * 2, 8);
+	Check (   Disk.AddFile ("SD:/synths8.pak", Pack.data (), Pack.size ())
+	       && Disk.AddDirectory ("SD:/plain")
+	       && Disk.AddFile ("SD:/plain/kernel8.img", Plain.data (), Plain.size ())
+	       && Disk.AddDirectory ("SD:/fragmented")
+	       && Disk.AddFile ("SD:/fragmented/kernel8.img", Plain.data (), Plain.size (), 3)
+	       && Disk.AddDirectory ("SD:/checked")
+	       && Disk.AddFile ("SD:/checked/kernel8.img", Raw.data (), Raw.size ())
+	       && Disk.AddFile ("SD:/checked/kernel8.img.crc", RawCRC, strlen (RawCRC))
+	       && Disk.AddDirectory ("SD:/badcrcfile")
+	       && Disk.AddFile ("SD:/badcrcfile/kernel8.img", Raw.data (), Raw.size ())
+	       && Disk.AddFile ("SD:/badcrcfile/kernel8.img.crc", BadCRC, strlen (BadCRC))
+	       && Disk.AddDirectory ("SD:/invalidcrc")
+	       && Disk.AddFile ("SD:/invalidcrc/kernel8.img", Raw.data (), Raw.size ())
+	       && Disk.AddFile ("SD:/invalidcrc/kernel8.img.crc", "12345", 5)
+	       && Disk.AddDirectory ("SD:/compressed")
+	       && Disk.AddFile ("SD:/compressed/kernel8.img", Plain.data (), Plain.size ())
+	       && Disk.AddFile ("SD:/compressed/kernel8.img.lz4", Compressed.data (),
+				Compressed.size ())
+	       && Disk.AddDirectory ("SD:/lz4nocrc")
+	       && Disk.AddFile ("SD:/lz4nocrc/kernel8.img.lz4", NoCRC.data (), NoCRC.size ())
+	       && Disk.AddDirectory ("SD:/corrupt")
+	       && Disk.AddFile ("SD:/corrupt/kernel8.img.lz4", Corrupt.data (), Corrupt.size ())
+	       && Disk.AddDirectory ("SD:/huge")
+	       && Disk.AddFile ("SD:/huge/kernel8.img", Huge.data (), Huge.size ())
+	       && Disk.AddDirectory ("SD:/missing")
+	       && Disk.Finish (), "disk image");
+
+	FATFS FileSystem;
+	Check (f_mount (&FileSystem, "SD:", 1) == FR_OK, "mount");
+
+	write32 (CHAINBOOT_DTB_PTR, DTB_ADDRESS);
+
+	auto Synth = [] (const char *pName, bool bPacked, u8 nFlags, u32 nOffset,
+			 const TBuffer &rFile, const TBuffer &rImage, u32 nCRC)
+	{
+		TSynthInfo Info;
+		memset (&Info, 0, sizeof Info);
+		strcpy (Info.Title, pName);
+		strcpy (Info.Name, pName);
+		Info.nMIDINote = SYNTH_PACK_NO_NOTE;
+		Info.bPacked = bPacked;
+		Info.nFlags = nFlags;
+		Info.nOffset = nOffset;
+		Info.nSize = rFile.size ();
+		Info.nImageSize = rImage.size ();
+		Info.nImageCRC = nCRC;
+		return Info;
+	};
+
+	struct
+	{
+		TSynthInfo Info;
+		const TBuffer *pImage;			// nullptr if Load() must fail
+		bool bFragmented;
+		bool bHasCRC;				// accepted with SetCRCRequired()
+	}
+	Cases[] =
+	{
+		{Synth ("packraw", true, 0, nRawOffset, Raw, Raw, nRawCRC),		&Raw,	false, true},
+		{Synth ("packnocrc", true, 0, nRawOffset, Raw, Raw, 0),			&Raw,	false, false},
+		{Synth ("packlz4", true, SYNTH_PACK_COMPRESSED, nCompressedOffset, Compressed,
+			Packed, nPackedCRC),						&Packed, false, true},
+		{Synth ("plain", false, 0, 0, Plain, Plain, 0),				&Plain,	false, false},
+		{Synth ("fragmented", false, 0, 0, Plain, Plain, 0),			&Plain,	true,  false},
+		{Synth ("checked", false, 0, 0, Raw, Raw, 0),				&Raw,	false, true},
+		{Synth ("compressed", false, 0, 0, Compressed, Packed, 0),		&Packed, false, true},
+		{Synth ("lz4nocrc", false, 0, 0, NoCRC, Plain, 0),			&Plain,	false, false},
+		{Synth ("packbadcrc", true, 0, nRawOffset, Raw, Raw, nRawCRC ^ 1),	nullptr, false, true},
+		{Synth ("packbadsize", true, 0, nRawOffset, Raw, Plain, 0),		nullptr, false, false},
+		{Synth ("packbadlz4", true, SYNTH_PACK_COMPRESSED, nCompressedOffset, Compressed,
+			Packed, nPackedCRC ^ 1),					nullptr, false, true},
+		{Synth ("badcrcfile", false, 0, 0, Raw, Raw, 0),			nullptr, false, true},
+		{Synth ("invalidcrc", false, 0, 0, Raw, Raw, 0),			nullptr, false, true},
+		{Synth ("corrupt", false, 0, 0, Corrupt, Plain, 0),			nullptr, false, true},
+		{Synth ("huge", false, 0, 0, Huge, Huge, 0),				nullptr, false, false},
+		{Synth ("missing", false, 0, 0, Plain, Plain, 0),			nullptr, false, false}
+	};
+
+	CChainLoader Loader;
+
+	auto Load = [&Loader] (const TSynthInfo &rInfo, const TBuffer *pImage, bool bFragmented)
+	{
+		unsigned nErrors = s_nLogErrors;
+		unsigned nWarnings = s_nLogWarnings;
+
+		bool bOK = Loader.Load (&rInfo);
+		Check (bOK == (pImage != nullptr), rInfo.Name);
+		Check (Loader.IsLoaded (&rInfo) == bOK, "loaded");
+		Check (Loader.GetImageSize () == (pImage != nullptr && bOK ? pImage->size () : 0), "image size");
+		Check ((s_nLogErrors != nErrors) == !bOK, "error logged");
+		Check ((s_nLogWarnings != nWarnings) == bFragmented, "fragmented");
+	};
+
+	// decoded by the loader itself
+	for (const auto &rCase : Cases)
+	{
+		Load (rCase.Info, rCase.pImage, rCase.bFragmented);
+	}
+
+	// an image without a CRC is rejected, before it is read
+	Loader.SetCRCRequired (true);
+	for (const auto &rCase : Cases)
+	{
+		Load (rCase.Info, rCase.bHasCRC ? rCase.pImage : nullptr,
+		      rCase.bHasCRC && rCase.bFragmented);
+	}
+	Loader.SetCRCRequired (false);
+
+	// the secondary cores, core 3 decodes until it is parked
+	std::vector<std::thread> Cores;
+	for (unsigned nCore = 1; nCore < CORES; nCore++)
+	{
+		Cores.emplace_back (SecondaryCore, nCore, &Loader);
+	}
+
+	while (!Loader.GetDecoder ()->IsRunning ())
+	{
+		std::this_thread::yield ();
+	}
+
+	for (const auto &rCase : Cases)
+	{
+		Load (rCase.Info, rCase.pImage, rCase.bFragmented);
+	}
+
+	unsigned nCalls = 0;
+	Check (   !Loader.Load (&Cases[0].Info, Cancel, &nCalls)
+	       && !Loader.IsLoaded () && nCalls == 4, "cancelled");
+
+	// a compressed image is started with all cores parked
+	Load (Cases[2].Info, Cases[2].pImage, false);
+	Check (Boot (&Loader, CORES - 1, &Packed), "boot");
+	Check (s_nParked == CORES - 1 && s_nStarted == 1, "all cores parked");
+	Check (s_ParkToken[1] == s_ParkToken[2] && s_ParkToken[2] == s_ParkToken[3], "one token");
+
+	// the acks of the last time must not count
+	std::this_thread::sleep_for (std::chrono::milliseconds (2));
+	unsigned nErrors = s_nLogErrors;
+	Check (!Boot (&Loader, CORES - 1, &Packed), "core did not park");
+	Check (s_nStarted == 1 && s_nLogErrors == nErrors + 1, "park timeout");
+
+	s_bRelease = true;
+	for (auto &rCore : Cores)
+	{
+		rCore.join ();
+	}
+
+	// each image as it is started, without secondary cores, in reverse, so
+	// that a smaller image follows a larger one and its padding is not zero
+	// by chance
+	for (auto it = std::rbegin (Cases); it != std::rend (Cases); ++it)
+	{
+		const auto &rCase = *it;
+		if (rCase.pImage != nullptr)
+		{
+			Load (rCase.Info, rCase.pImage, rCase.bFragmented);
+			Check (Boot (&Loader, 0, rCase.pImage), rCase.Info.Name);
+		}
+	}
+
+	Check (!Loader.GetDecoder ()->IsRunning (), "decoder stopped");
+
+	f_mount (nullptr, "SD:", 0);
+
+	printf ("%u images started, %u cores parked\n", s_nStarted.load (), s_nParked.load ());
+
+	return CheckResult ();
+}
@@ -0,0 +1,316 @@
+//
+// crcbench.cpp
+//
+// Host tool: measures the throughput of the CRC-32 code paths of
+// src/crc32.h, with which the boot menu verifies the synth images, and
+// checks that they agree with the bytewise CRC for all alignments and
+// lengths and when continued in chunks. The CRC32 instructions are used,
+// when the host has them (an AArch64 host, see CRCFLAGS in the Makefile),
+// otherwise only the portable code path is measured.
+//
+// The verification of a compressed image is measured like the chunk
+// decoder does it (the CRC of each chunk right after decoding it) and with
+// a separate pass over the decoded image for comparison. The image is
+// larger than the L2 cache of the Raspberry Pi (512 KB to 2 MB), but fits
+// into the caches of a usual host, so it is evicted from the caches before
+// each decode and before the separate pass, as far as the host allows it.
+// What streaming saves is the time to read the image from memory again,
+// which is measured on its own. A corrupt image must not match its CRC.
+//
+// usage: crcbench [-s image KB] [-r rounds] [image]
+//
+#include "../src/crc32.h"
+#include "../src/lz4.h"
+#include "imagewriter.h"
+#include "toolcheck.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+#include <unistd.h>
+
+#if defined (__x86_64__) || defined (__i386__)
+	#include <immintrin.h>
+#endif
+
+#define CHAINLOAD_DIRECT_CHUNK_SIZE	0x40000		// as in src/chainloader.h
+
+typedef uint32_t TCRCFunction (uint32_t nCRC, const void *pData, size_t nLength);
+
+static volatile uint32_t s_nSink;	// keeps the timed work from being optimized away
+
+// the previous implementation, as a reference
+static uint32_t CRC32Bytewise (uint32_t nCRC, const void *pData, size_t nLength)
+{
+	static uint32_t Table[256];
+	if (Table[1] == 0)
+	{
+		for (uint32_t i = 0; i < 256; i++)
+		{
+			uint32_t nValue = i;
+			for (unsigned j = 0; j < 8; j++)
+			{
+				nValue = (nValue >> 1) ^ (nValue & 1 ? 0xEDB88320U : 0);
+			}
+
+			Table[i] = nValue;
+		}
+	}
+
+	const uint8_t *pByte = static_cast<const uint8_t *> (pData);
+
+	nCRC = ~nCRC;
+	while (nLength--)
+	{
+		nCRC = Table[(nCRC ^ *pByte++) & 0xFF] ^ (nCRC >> 8);
+	}
+
+	return ~nCRC;
+}
+
+static double Now (void)
+{
+	return std::chrono::duration<double> (
+		std::chrono::steady_clock::now ().time_since_epoch ()).count ();
+}
+
+// writes back and invalidates the cache lines of the data
+static bool Evict (const void *pData, size_t nLength)
+{
+	const uint8_t *pByte = static_cast<const uint8_t *> (pData);
+
+#if defined (__x86_64__) || defined (__i386__)
+	for (size_t i = 0; i < nLength; i += 64)
+	{
+		_mm_clflush (pByte + i);
+	}
+	_mm_mfence ();
+
+	return true;
+#elif defined (__aarch64__)
+	for (size_t i = 0; i < nLength; i += 64)
+	{
+		asm volatile ("dc civac, %0" :: "r" (pByte + i) : "memory");
+	}
+	asm volatile ("dsb sy" ::: "memory");
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+static void CheckFunction (TCRCFunction *pFunction, const char *pName)
+{
+	Check ((*pFunction) (0, "123456789", 9) == 0xCBF43926, pName);
+
+	std::mt19937 Random (1);
+	std::vector<uint8_t> Data (4096 + 64);
+	for (auto &rByte : Data)
+	{
+		rByte = Random ();
+	}
+
+	for (unsigned i = 0; i < 20000; i++)
+	{
+		size_t nOffset = Random () % 64;
+		size_t nLength = Random () % 4096;
+		size_t nSplit = nLength != 0 ? Random () % nLength : 0;
+		uint32_t nStart = Random ();
+
+		uint32_t nExpected = CRC32Bytewise (nStart, &Data[nOffset], nLength);
+		uint32_t nCRC = (*pFunction) (nStart, &Data[nOffset], nSplit);
+		nCRC = (*pFunction) (nCRC, &Data[nOffset + nSplit], nLength - nSplit);
+
+		Check (nCRC == nExpected, pName);
+	}
+}
+
+// returns GB/s
+static double Measure (TCRCFunction *pFunction, const std::vector<uint8_t> &rImage, unsigned nRounds)
+{
+	double fStart = Now ();
+	for (unsigned i = 0; i < nRounds; i++)
+	{
+		// like ReadRaw(), in the chunks of the direct read
+		uint32_t nCRC = 0;
+		for (size_t nOffset = 0; nOffset < rImage.size (); nOffset += CHAINLOAD_DIRECT_CHUNK_SIZE)
+		{
+			size_t nChunk = rImage.size () - nOffset < CHAINLOAD_DIRECT_CHUNK_SIZE
+				      ? rImage.size () - nOffset : CHAINLOAD_DIRECT_CHUNK_SIZE;
+			nCRC = (*pFunction) (nCRC, &rImage[nOffset], nChunk);
+		}
+
+		s_nSink = nCRC;
+	}
+
+	return (double) rImage.size () * nRounds / (Now () - fStart) / 1e9;
+}
+
+// returns the time in seconds to read the evicted image once
+static double ReadPass (const std::vector<uint8_t> &rImage)
+{
+	Evict (rImage.data (), rImage.size ());
+
+	double fStart = Now ();
+
+	uint64_t nSum = 0;
+	for (size_t nOffset = 0; nOffset + 8 <= rImage.size (); nOffset += 8)
+	{
+		uint64_t nWord;
+		memcpy (&nWord, &rImage[nOffset], sizeof nWord);
+		nSum += nWord;
+	}
+	s_nSink = nSum;
+
+	return Now () - fStart;
+}
+
+// decodes all chunks into rImage, with bStreamed the CRC is updated after
+// each chunk, otherwise in a separate pass, returns the time in seconds
+// without the evictions
+static double Decode (const std::vector<TImageChunk> &rChunks, std::vector<uint8_t> &rImage,
+		      bool bStreamed, uint32_t *pCRC)
+{
+	Evict (rImage.data (), rImage.size ());
+
+	double fStart = Now ();
+
+	uint32_t nCRC = 0;
+	size_t nOffset = 0;
+	for (const TImageChunk &rChunk : rChunks)
+	{
+		if (rChunk.bStored)
+		{
+			memcpy (&rImage[nOffset], rChunk.Data.data (), rChunk.nSize);
+		}
+		else if (LZ4Decompress (rChunk.Data.data (), rChunk.Data.size (), &rImage[nOffset],
+					rChunk.nSize) != (int) rChunk.nSize)
+		{
+			Check (false, "decode");
+		}
+
+		if (bStreamed)
+		{
+			nCRC = CRC32Update (nCRC, &rImage[nOffset], rChunk.nSize);
+		}
+
+		nOffset += rChunk.nSize;
+	}
+
+	double fTime = Now () - fStart;
+
+	if (!bStreamed)
+	{
+		// the first chunks have been evicted by the later ones on the target
+		Evict (rImage.data (), rImage.size ());
+
+		fStart = Now ();
+		nCRC = CRC32Update (0, rImage.data (), rImage.size ());
+		fTime += Now () - fStart;
+	}
+
+	*pCRC = nCRC;
+
+	return fTime;
+}
+
+int main (int argc, char **argv)
+{
+	unsigned nImageKB = 2048;
+	unsigned nRounds = 50;
+
+	int nOption;
+	while (optind <= argc && (nOption = getopt (argc, argv, "s:r:")) != -1)
+	{
+		switch (nOption)
+		{
+		case 's':	nImageKB = strtoul (optarg, nullptr, 0);	break;
+		case 'r':	nRounds = strtoul (optarg, nullptr, 0);		break;
+
+		default:
+			optind = argc + 1;			// show usage
+			break;
+		}
+	}
+
+	if (nImageKB == 0 || nRounds == 0 || optind > argc || argc - optind > 1)
+	{
+		return Usage ("crcbench [-s image KB] [-r rounds] [image]");
+	}
+
+	TBuffer Image;
+	if (optind < argc)
+	{
+		if (!ReadFile (argv[optind], Image) || Image.empty ())
+		{
+			return EXIT_FAILURE;
+		}
+	}
+	else
+	{
+		// code like, compresses to about a half
+		std::mt19937 Random (2);
+		Image.resize (nImageKB * 1024);
+		for (size_t i = 0; i < Image.size (); i++)
+		{
+			Image[i] = Random () % 4 == 0 ? Random () : Image[i / 2] ^ (i & 0x0F);
+		}
+	}
+
+	CheckFunction (CRC32Bytewise, "bytewise");
+	CheckFunction (CRC32UpdatePortable, "portable");
+#ifdef CRC32_HARDWARE
+	CheckFunction (CRC32UpdateHardware, "hardware");
+#endif
+	CheckFunction (CRC32Update, "CRC32Update");
+
+	printf ("image: %u KB\n", (unsigned) (Image.size () / 1024));
+	printf ("%-28s %8s\n", "", "GB/s");
+	printf ("%-28s %8.2f\n", "bytewise (previous)", Measure (CRC32Bytewise, Image, nRounds));
+	printf ("%-28s %8.2f\n", "portable (slicing by 8)", Measure (CRC32UpdatePortable, Image, nRounds));
+#ifdef CRC32_HARDWARE
+	printf ("%-28s %8.2f\n", "CRC32 instructions", Measure (CRC32UpdateHardware, Image, nRounds));
+#else
+	printf ("%-28s %8s\n", "CRC32 instructions", "n/a");
+#endif
+
+	// a compressed image, verified while it is decoded
+	std::vector<TImageChunk> Chunks;
+	CompressImage (Image, 1, Chunks);
+	uint32_t nExpected = CRC32Update (0, Image.data (), Image.size ());
+
+	std::vector<uint8_t> Decoded (Image.size ());
+	double fTime[2] = {0.0, 0.0};
+	double fReadTime = 0.0;
+	for (unsigned i = 0; i < nRounds; i++)
+	{
+		for (unsigned nStreamed = 0; nStreamed <= 1; nStreamed++)
+		{
+			uint32_t nCRC;
+			fTime[nStreamed] += Decode (Chunks, Decoded, nStreamed, &nCRC);
+			Check (nCRC == nExpected, "decoded CRC");
+		}
+
+		fReadTime += ReadPass (Decoded);
+	}
+
+	printf ("decode and verify, ms per image: %.3f streamed, %.3f with a separate pass%s\n",
+		fTime[1] * 1e3 / nRounds, fTime[0] * 1e3 / nRounds,
+		Evict (nullptr, 0) ? "" : " (image not evicted)");
+	printf ("reading the image from memory again: %.3f ms\n", fReadTime * 1e3 / nRounds);
+
+	// a single flipped bit must be detected
+	std::mt19937 Random (3);
+	for (unsigned i = 0; i < 1000; i++)
+	{
+		size_t nBit = Random () % (Image.size () * 8);
+		Image[nBit / 8] ^= 1 << nBit % 8;
+		Check (CRC32Update (0, Image.data (), Image.size ()) != nExpected, "corruption detected");
+		Image[nBit / 8] ^= 1 << nBit % 8;
+	}
+
+	return CheckResult ();
+}
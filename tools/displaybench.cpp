@@ -0,0 +1,329 @@
+//
+// displaybench.cpp
+//
+// Host tool: measures, how long the menu loop is blocked per frame with an
+// ST7789 panel, when it flushes the frame itself and when it publishes the
+// frame to the display worker (src/displayworker.h), which runs in a thread
+// in place of core 2.
+//
+// The panel is a mock SPI bus, which spins for the transfer time of each
+// byte at the SPI clock, like the polled transfers of Circle's CSPIMaster.
+// CST7789Device draws each character as a cell of the 8x16 font (doubled
+// with the large font) with two bytes per pixel after setting the address
+// window. The mock applies the characters to a grid, which must show the
+// last frame at the end.
+//
+// The menu steps through the synths every interval (a held button or an
+// encoder), so the worker must skip frames, when the bus is slower.
+//
+// usage: displaybench [-c SPI clock kHz] [-n steps] [-i interval us] [-s]
+//        -s small font
+//
+#include "../src/displayworker.h"
+#include "../src/chainloader.h"
+#include "toolcheck.h"
+#include <circle/device.h>
+#include <circle/logger.h>
+#include <circle/timer.h>
+#include <circle/writebuffer.h>
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+#define COLUMNS		16
+#define ROWS		2
+
+#define WINDOW_BYTES	11			// CASET, RASET, RAMWR with parameters
+
+static const char *s_pTitles[] =
+{
+	"MiniDexed", "MiniJV880", "mt32-pi", "MiniSynth Pi", "Synthmata", "TAL-NoiseMaker",
+	"DX7 Factory", "MiniDexed TX816"
+};
+
+static const unsigned s_nTitles = sizeof s_pTitles / sizeof s_pTitles[0];
+
+static auto s_Start = std::chrono::steady_clock::now ();
+
+static unsigned s_nFramesShown;
+static unsigned s_nFramesSkipped;
+
+unsigned CTimer::GetClockTicks (void)
+{
+	return std::chrono::duration_cast<std::chrono::microseconds> (
+		std::chrono::steady_clock::now () - s_Start).count () + 1;
+}
+
+// picks up the counters, which CDisplayWorker::Stop() logs
+void CLogger::Write (const char *pSource, TLogSeverity Severity, const char *pMessage, ...)
+{
+	va_list Args;
+	va_start (Args, pMessage);
+	char Message[256];
+	vsnprintf (Message, sizeof Message, pMessage, Args);
+	va_end (Args);
+
+	if (sscanf (Message, "%u frames shown, %u skipped", &s_nFramesShown, &s_nFramesSkipped) != 2)
+	{
+		printf ("%s: %s\n", pSource, Message);
+	}
+}
+
+CLogger *CLogger::Get (void)
+{
+	static CLogger s_Logger;
+
+	return &s_Logger;
+}
+
+volatile bool CChainLoader::s_bParkRequested = false;
+
+static double Now (void)
+{
+	return std::chrono::duration<double, std::micro> (
+		std::chrono::steady_clock::now () - s_Start).count ();
+}
+
+class CMockSPIDisplay : public CDevice
+{
+public:
+	CMockSPIDisplay (unsigned nClockKHz, bool bLargeFont)
+	:	m_fByteTime (8000.0 / nClockKHz),
+		m_nCellBytes (8 * 16 * 2 * (bLargeFont ? 4 : 1) + WINDOW_BYTES),
+		m_nRow (0),
+		m_nColumn (0),
+		m_nBusBytes (0),
+		m_fBusTime (0),
+		m_nUpdates (0)
+	{
+		m_Cells.assign (ROWS, std::string (COLUMNS, ' '));
+	}
+
+	// a CWriteBufferDevice::Update() writes all bytes of a frame at once
+	int Write (const void *pBuffer, size_t nCount) override
+	{
+		std::string Data (static_cast<const char *> (pBuffer), nCount);
+		const char *pData = Data.c_str ();
+		for (size_t i = 0; i < nCount; )
+		{
+			unsigned nRow, nColumn;
+			int nLength = 0;
+			if (   sscanf (pData + i, "\x1B[%u;%uH%n", &nRow, &nColumn, &nLength) == 2
+			    && nLength > 0)
+			{
+				Check (   1 <= nRow && nRow <= ROWS
+				       && 1 <= nColumn && nColumn <= COLUMNS, "cursor position");
+				m_nRow = nRow - 1;
+				m_nColumn = nColumn - 1;
+				i += nLength;
+
+				continue;
+			}
+
+			Check (pData[i] >= ' ' && m_nRow < ROWS && m_nColumn < COLUMNS, "character");
+			if (m_nRow < ROWS && m_nColumn < COLUMNS)
+			{
+				m_Cells[m_nRow][m_nColumn++] = pData[i];
+			}
+			i++;
+
+			Transfer (m_nCellBytes);
+		}
+
+		m_nUpdates++;
+
+		return nCount;
+	}
+
+	bool Shows (const TLCDCells &rCells) const
+	{
+		for (unsigned nRow = 0; nRow < ROWS; nRow++)
+		{
+			if (m_Cells[nRow] != std::string (rCells.Cell[nRow], COLUMNS))
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	// the bus time of the mock, as it was spun
+	double GetTimePerByte (void) const	{ return m_fBusTime / m_nBusBytes; }
+
+	unsigned GetUpdates (void) const	{ return m_nUpdates; }
+
+private:
+	void Transfer (unsigned nBytes)
+	{
+		double fStart = Now ();
+		double fEnd = fStart + nBytes * m_fByteTime;
+		while (Now () < fEnd)
+		{
+			// polled, the core is busy
+		}
+
+		m_nBusBytes += nBytes;
+		m_fBusTime += Now () - fStart;
+	}
+
+private:
+	double m_fByteTime;			// us
+	unsigned m_nCellBytes;
+
+	std::vector<std::string> m_Cells;
+	unsigned m_nRow;
+	unsigned m_nColumn;
+
+	unsigned long m_nBusBytes;
+	double m_fBusTime;
+	unsigned m_nUpdates;
+};
+
+static void MakeFrame (CLCDFrame *pFrame, unsigned nSelected)
+{
+	char Line[COLUMNS + 1];
+	snprintf (Line, sizeof Line, "%s %s %s", nSelected > 0 ? "<" : " ",
+		  s_pTitles[nSelected], nSelected < s_nTitles - 1 ? ">" : " ");
+
+	pFrame->Clear ();
+	pFrame->Print (0, "Select Synth");
+	pFrame->Print (1, Line);
+}
+
+struct TResult
+{
+	double fMean;				// us the menu is blocked per step
+	double fMax;
+};
+
+// through all synths and back, again and again
+static unsigned GetSelected (unsigned nStep)
+{
+	unsigned nPosition = nStep % (2 * s_nTitles - 2);
+
+	return nPosition < s_nTitles ? nPosition : 2 * s_nTitles - 2 - nPosition;
+}
+
+static TResult Run (unsigned nClockKHz, bool bLargeFont, unsigned nSteps, unsigned nInterval,
+		    bool bWorker)
+{
+	CMockSPIDisplay Display (nClockKHz, bLargeFont);
+	CWriteBufferDevice Buffer (&Display);
+	CLCDFrame Frame;
+	Frame.SetSize (COLUMNS, ROWS);
+
+	CDisplayWorker Worker;
+	std::thread Core2;
+	if (bWorker)
+	{
+		Worker.Setup (&Buffer, COLUMNS, ROWS);
+		Core2 = std::thread (CDisplayWorker::TaskHandler, &Worker);
+	}
+
+	TResult Result = {0, 0};
+	double fNext = Now ();
+	for (unsigned i = 0; i < nSteps; i++)
+	{
+		MakeFrame (&Frame, GetSelected (i));
+
+		double fStart = Now ();
+		if (bWorker)
+		{
+			Worker.Publish (Frame.GetCells ());
+		}
+		else
+		{
+			Frame.Flush (&Buffer);
+			Buffer.Update ();
+		}
+		double fTime = Now () - fStart;
+
+		Result.fMean += fTime / nSteps;
+		if (fTime > Result.fMax)
+		{
+			Result.fMax = fTime;
+		}
+
+		// the rest of the interval is left for the worker
+		fNext += nInterval;
+		while (Now () < fNext)
+		{
+			std::this_thread::sleep_for (std::chrono::microseconds (100));
+		}
+	}
+
+	if (bWorker)
+	{
+		// let the worker show the last frame
+		std::this_thread::sleep_for (std::chrono::milliseconds (200));
+
+		Worker.Stop ();
+		Core2.join ();
+
+		// a frame, which equals the one on the panel, sends nothing
+		Check (s_nFramesShown >= Display.GetUpdates (), "frames shown");
+		Check (s_nFramesShown + s_nFramesSkipped == nSteps, "frames shown or skipped");
+	}
+
+	Check (Display.Shows (Frame.GetCells ()), "last frame shown");
+
+	printf ("%-10s %10.2f %10.1f %10.1f", bWorker ? "worker" : "menu",
+		Display.GetTimePerByte (), Result.fMean, Result.fMax);
+	if (bWorker)
+	{
+		printf (" %10u %10u", s_nFramesShown, s_nFramesSkipped);
+	}
+	printf ("\n");
+
+	return Result;
+}
+
+int main (int argc, char **argv)
+{
+	unsigned nClockKHz = 15000;		// SPI_DEF_CLOCK
+	unsigned nSteps = 200;
+	unsigned nInterval = 5000;
+	bool bLargeFont = true;
+
+	int nOption;
+	while (optind <= argc && (nOption = getopt (argc, argv, "c:n:i:s")) != -1)
+	{
+		switch (nOption)
+		{
+		case 'c':	nClockKHz = strtoul (optarg, nullptr, 0);	break;
+		case 'n':	nSteps = strtoul (optarg, nullptr, 0);		break;
+		case 'i':	nInterval = strtoul (optarg, nullptr, 0);	break;
+		case 's':	bLargeFont = false;				break;
+
+		default:
+			optind = argc + 1;			// show usage
+			break;
+		}
+	}
+
+	if (nClockKHz == 0 || nSteps < 2 || optind != argc)
+	{
+		return Usage ("displaybench [-c SPI clock kHz] [-n steps] [-i interval us] [-s]");
+	}
+
+	printf ("%ux%u, %s font, SPI %u kHz (%.2f us per byte), %u steps every %u us\n",
+		COLUMNS, ROWS, bLargeFont ? "large" : "small", nClockKHz, 8000.0 / nClockKHz,
+		nSteps, nInterval);
+	printf ("%-10s %10s %10s %10s %10s %10s\n", "flush by", "us/byte", "mean us", "max us",
+		"shown", "skipped");
+
+	TResult Menu = Run (nClockKHz, bLargeFont, nSteps, nInterval, false);
+	TResult Worker = Run (nClockKHz, bLargeFont, nSteps, nInterval, true);
+
+	// the host may preempt the menu thread, so only the mean is compared
+	Check (Worker.fMean * 10 < Menu.fMean, "menu not blocked by the bus");
+
+	return CheckResult ();
+}
@@ -0,0 +1,506 @@
+//
+// eventloopsim.cpp
+//
+// Host tool: replays a timeline of button edges (with contact bounce and
+// short glitches) and USB MIDI events against a model of the main loop of
+// the boot menu (CKernel::Run()) in simulated time, and reports the
+// latency distribution of the button presses and of the MIDI events.
+//
+//	event	the event driven loop: the GPIO and USB interrupts trigger the
+//		debouncers (src/debouncer.h) and fill the MIDI queue
+//		(src/midiqueue.h), the loop sleeps in WFI until the next
+//		interrupt or timer tick, when there is nothing to do
+//	polled	the previous loop: it polls every 10 ms and blocks for
+//		200 ms after each press, a held button repeats
+//
+// The event driven loop must report each press once, ignore the glitches,
+// report a press within the debounce time, the bounce and one timer tick,
+// and must not drop MIDI events. The timeline is generated, or read from a
+// file with lines "<us> button <n> <0|1>" and "<us> midi" in time order.
+//
+// usage: eventloopsim [-n presses] [-m MIDI events/s] [-s seed] [timeline]
+//
+#include "../src/debouncer.h"
+#include "../src/midiqueue.h"
+#include "toolcheck.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include <unistd.h>
+
+#define BUTTONS		3			// prev, next, select
+#define QUEUE_SIZE	64			// MIDI_QUEUE_SIZE in src/kernel.h
+#define TICK_US		10000			// HZ 100
+#define BOUNCE_US	3000			// longest contact bounce
+#define POLL_US		10000			// MsDelay(10) of the polled loop
+#define BLOCK_US	200000			// DelayMs(200) after a press
+
+// modelled cost of the work in the loop in us
+#define LOOP_US		20			// one pass without work
+#define MIDI_US		5			// one MIDI event
+#define ACTION_US	100			// MoveSelection(), the display request
+
+struct TTimelineEvent
+{
+	unsigned nTime;
+	int nButton;				// -1 for a MIDI event
+	bool bActive;				// pressed
+	bool bPress;				// first edge of a press, see MarkPresses()
+};
+
+typedef std::vector<TTimelineEvent> TTimeline;
+
+struct TResult
+{
+	std::vector<unsigned> ButtonLatency;
+	std::vector<unsigned> MIDILatency;
+	unsigned nActions;			// presses reported, also repeats and glitches
+	unsigned nMissed;			// presses
+	unsigned nDropped;			// MIDI events
+};
+
+static unsigned NextTick (unsigned nTime)
+{
+	return (nTime / TICK_US + 1) * TICK_US;
+}
+
+// nPresses presses of random buttons with bounce and a glitch now and then,
+// MIDI events at nMIDIRate per second with a burst of 300 (a SysEx dump
+// split into USB packets) once a second
+static void MakeTimeline (unsigned nPresses, unsigned nMIDIRate, unsigned nSeed, TTimeline &rTimeline)
+{
+	std::mt19937 Random (nSeed);
+	unsigned nTime = 100000;
+
+	for (unsigned i = 0; i < nPresses; i++)
+	{
+		int nButton = Random () % BUTTONS;
+
+		// a glitch, which is shorter than the debounce time
+		if (Random () % 4 == 0)
+		{
+			unsigned nGlitch = nTime + Random () % 50000;
+			rTimeline.push_back ({nGlitch, nButton, true});
+			rTimeline.push_back ({nGlitch + 1000, nButton, false});
+			nTime = nGlitch + 50000;
+		}
+
+		unsigned nHold = 60000 + Random () % 400000;
+		for (int bActive = 1; bActive >= 0; bActive--)
+		{
+			unsigned nEdge = nTime;
+			rTimeline.push_back ({nEdge, nButton, !!bActive});
+
+			// an even number of bounces, so it ends on the new level
+			unsigned nBounces = 2 * (Random () % 3);
+			for (unsigned j = 0; j < nBounces; j++)
+			{
+				nEdge += 1 + Random () % (BOUNCE_US / (nBounces + 1));
+				rTimeline.push_back ({nEdge, nButton, !!(bActive ^ ((j & 1) == 0))});
+			}
+
+			nTime += bActive ? nHold : 100000 + Random () % 500000;
+		}
+	}
+
+	unsigned nEnd = nTime;
+	if (nMIDIRate != 0)
+	{
+		std::exponential_distribution<double> Interval (nMIDIRate / 1e6);
+		for (double fTime = 100000.0; fTime < nEnd; fTime += Interval (Random))
+		{
+			rTimeline.push_back ({(unsigned) fTime, -1});
+		}
+
+		for (unsigned nBurst = 1000000; nBurst < nEnd; nBurst += 1000000)
+		{
+			for (unsigned j = 0; j < 300; j++)
+			{
+				rTimeline.push_back ({nBurst + j * 100, -1});
+			}
+		}
+	}
+
+	std::stable_sort (rTimeline.begin (), rTimeline.end (),
+			  [] (const TTimelineEvent &rA, const TTimelineEvent &rB)
+			  { return rA.nTime < rB.nTime; });
+}
+
+static bool ReadTimeline (const char *pFileName, TTimeline &rTimeline)
+{
+	FILE *pFile = fopen (pFileName, "r");
+	if (pFile == nullptr)
+	{
+		perror (pFileName);
+
+		return false;
+	}
+
+	char Line[100];
+	unsigned nLine = 0;
+	while (fgets (Line, sizeof Line, pFile) != nullptr)
+	{
+		nLine++;
+
+		unsigned nTime, nButton, nLevel;
+		if (sscanf (Line, "%u button %u %u", &nTime, &nButton, &nLevel) == 3 && nButton < BUTTONS)
+		{
+			rTimeline.push_back ({nTime, (int) nButton, !!nLevel});
+		}
+		else if (sscanf (Line, "%u midi", &nTime) == 1)
+		{
+			rTimeline.push_back ({nTime, -1});
+		}
+		else if (Line[0] != '#' && Line[0] != '\n')
+		{
+			fprintf (stderr, "%s(%u): Invalid line\n", pFileName, nLine);
+			fclose (pFile);
+
+			return false;
+		}
+
+		if (rTimeline.size () > 1 && rTimeline.back ().nTime < rTimeline[rTimeline.size () - 2].nTime)
+		{
+			fprintf (stderr, "%s(%u): Not in time order\n", pFileName, nLine);
+			fclose (pFile);
+
+			return false;
+		}
+	}
+
+	fclose (pFile);
+
+	return true;
+}
+
+// The edges of a button, which are less than BOUNCE_US apart, are one
+// group. A group, which leaves the button pressed for DEBOUNCE_TIME_US at
+// least, is a press, which starts with its first edge.
+static void MarkPresses (TTimeline &rTimeline)
+{
+	for (int nButton = 0; nButton < BUTTONS; nButton++)
+	{
+		std::vector<TTimelineEvent *> Edges;
+		for (TTimelineEvent &rEvent : rTimeline)
+		{
+			if (rEvent.nButton == nButton)
+			{
+				rEvent.bPress = false;
+				Edges.push_back (&rEvent);
+			}
+		}
+
+		bool bActive = false;			// before the group
+		for (size_t i = 0; i < Edges.size (); )
+		{
+			size_t nLast = i;
+			while (   nLast + 1 < Edges.size ()
+			       && Edges[nLast + 1]->nTime - Edges[nLast]->nTime < BOUNCE_US)
+			{
+				nLast++;
+			}
+
+			bool bPressed = Edges[nLast]->bActive;
+			if (   bPressed && !bActive
+			    && (   nLast + 1 == Edges.size ()
+				|| Edges[nLast + 1]->nTime - Edges[nLast]->nTime >= DEBOUNCE_TIME_US))
+			{
+				Edges[i]->bPress = true;
+			}
+
+			bActive = bPressed;
+			i = nLast + 1;
+		}
+	}
+}
+
+class CLoopModel
+{
+public:
+	CLoopModel (const TTimeline &rTimeline, bool bEventDriven)
+	:	m_rTimeline (rTimeline),
+		m_bEventDriven (bEventDriven),
+		m_nNext (0),
+		m_nTime (0)
+	{
+		for (unsigned i = 0; i < BUTTONS; i++)
+		{
+			m_bLevel[i] = false;
+			m_nPressTime[i] = 0;
+			m_bPending[i] = false;
+		}
+
+		m_Result.nActions = 0;
+		m_Result.nMissed = 0;
+		m_Result.nDropped = 0;
+	}
+
+	const TResult &Run (void)
+	{
+		while (m_nNext < m_rTimeline.size ())
+		{
+			Interrupts ();
+
+			m_nTime += LOOP_US;
+			if (m_bEventDriven)
+			{
+				ServiceButtons ();
+			}
+			else
+			{
+				PollButtons ();
+			}
+			ProcessMIDI ();
+
+			if (!m_bEventDriven)
+			{
+				m_nTime += POLL_US;
+			}
+			else if (IsIdle ())
+			{
+				// WFI until the next interrupt or timer tick
+				unsigned nWakeUp = NextTick (m_nTime);
+				if (   m_nNext < m_rTimeline.size ()
+				    && m_rTimeline[m_nNext].nTime < nWakeUp)
+				{
+					nWakeUp = m_rTimeline[m_nNext].nTime;
+				}
+
+				if (nWakeUp > m_nTime)
+				{
+					m_nTime = nWakeUp;
+				}
+			}
+		}
+
+		// the last press and MIDI events
+		for (unsigned nEnd = m_nTime + 2 * BLOCK_US; m_nTime < nEnd; m_nTime += TICK_US)
+		{
+			m_bEventDriven ? ServiceButtons () : PollButtons ();
+			ProcessMIDI ();
+		}
+
+		return m_Result;
+	}
+
+private:
+	// what the interrupt handlers did until now
+	void Interrupts (void)
+	{
+		for (; m_nNext < m_rTimeline.size () && m_rTimeline[m_nNext].nTime <= m_nTime; m_nNext++)
+		{
+			const TTimelineEvent &rEvent = m_rTimeline[m_nNext];
+			if (rEvent.nButton < 0)
+			{
+				TMIDIEvent Event;
+				Event.nTimestamp = rEvent.nTime;
+				Event.nSource = MIDISourceUSB;
+				Event.nLength = 0;
+				if (!m_Queue.Enqueue (Event))
+				{
+					m_Result.nDropped++;
+				}
+
+				continue;
+			}
+
+			m_bLevel[rEvent.nButton] = rEvent.bActive;
+			m_Debouncer[rEvent.nButton].Trigger ();
+
+			if (rEvent.bPress)
+			{
+				m_Result.nMissed += m_bPending[rEvent.nButton];
+
+				m_nPressTime[rEvent.nButton] = rEvent.nTime;
+				m_bPending[rEvent.nButton] = true;
+			}
+		}
+	}
+
+	// CKernel::ServiceButtons()
+	void ServiceButtons (void)
+	{
+		for (unsigned i = 0; i < BUTTONS; i++)
+		{
+			if (m_Debouncer[i].Update (m_bLevel[i], m_nTime) == CDebouncer::EventPressed)
+			{
+				Action (i);
+			}
+		}
+	}
+
+	// the previous loop, a press is acted on, while the level is active
+	void PollButtons (void)
+	{
+		for (unsigned i = 0; i < BUTTONS; i++)
+		{
+			if (m_bLevel[i])
+			{
+				Action (i);
+				m_nTime += BLOCK_US;
+				Interrupts ();
+			}
+		}
+	}
+
+	// a repeat of a held button or a glitch is not a press
+	void Action (unsigned nButton)
+	{
+		m_nTime += ACTION_US;
+		m_Result.nActions++;
+
+		if (m_bPending[nButton])
+		{
+			m_Result.ButtonLatency.push_back (m_nTime - m_nPressTime[nButton]);
+			m_bPending[nButton] = false;
+		}
+	}
+
+	// CKernel::ProcessMIDIInput()
+	void ProcessMIDI (void)
+	{
+		TMIDIEvent Event;
+		while (m_Queue.Dequeue (&Event))
+		{
+			m_nTime += MIDI_US;
+			m_Result.MIDILatency.push_back (m_nTime - Event.nTimestamp);
+		}
+	}
+
+	// CKernel::WaitForEvent(), the interrupts, which occurred meanwhile,
+	// are pending and end WFI at once
+	bool IsIdle (void)
+	{
+		if (   m_nNext < m_rTimeline.size ()
+		    && m_rTimeline[m_nNext].nTime <= m_nTime)
+		{
+			return false;
+		}
+
+		bool bIdle = m_Queue.IsEmpty ();
+		for (unsigned i = 0; bIdle && i < BUTTONS; i++)
+		{
+			bIdle = !m_Debouncer[i].IsTriggered ();
+		}
+
+		return bIdle;
+	}
+
+private:
+	const TTimeline &m_rTimeline;
+	bool m_bEventDriven;
+
+	size_t m_nNext;				// next timeline event
+	unsigned m_nTime;			// us
+
+	bool m_bLevel[BUTTONS];
+	CDebouncer m_Debouncer[BUTTONS];
+	CMIDIEventQueue<QUEUE_SIZE> m_Queue;
+
+	unsigned m_nPressTime[BUTTONS];
+	bool m_bPending[BUTTONS];		// pressed, not acted on yet
+
+	TResult m_Result;
+};
+
+static unsigned Percentile (std::vector<unsigned> &rValues, unsigned nPercent)
+{
+	if (rValues.empty ())
+	{
+		return 0;
+	}
+
+	std::sort (rValues.begin (), rValues.end ());
+
+	return rValues[(rValues.size () - 1) * nPercent / 100];
+}
+
+static void Report (const char *pName, std::vector<unsigned> &rLatency)
+{
+	printf ("%-20s %8u %8u %8u %8u %8u\n", pName, (unsigned) rLatency.size (),
+		Percentile (rLatency, 0), Percentile (rLatency, 50), Percentile (rLatency, 99),
+		Percentile (rLatency, 100));
+}
+
+int main (int argc, char **argv)
+{
+	unsigned nPresses = 500;
+	unsigned nMIDIRate = 200;
+	unsigned nSeed = 1;
+
+	int nOption;
+	while (optind <= argc && (nOption = getopt (argc, argv, "n:m:s:")) != -1)
+	{
+		switch (nOption)
+		{
+		case 'n':	nPresses = strtoul (optarg, nullptr, 0);	break;
+		case 'm':	nMIDIRate = strtoul (optarg, nullptr, 0);	break;
+		case 's':	nSeed = strtoul (optarg, nullptr, 0);		break;
+
+		default:
+			optind = argc + 1;			// show usage
+			break;
+		}
+	}
+
+	if (optind > argc || argc - optind > 1)
+	{
+		return Usage ("eventloopsim [-n presses] [-m MIDI events/s] [-s seed] [timeline]");
+	}
+
+	TTimeline Timeline;
+	if (optind < argc)
+	{
+		if (!ReadTimeline (argv[optind], Timeline))
+		{
+			return EXIT_FAILURE;
+		}
+	}
+	else
+	{
+		MakeTimeline (nPresses, nMIDIRate, nSeed, Timeline);
+	}
+	MarkPresses (Timeline);
+
+	unsigned nExpected = 0;
+	unsigned nMIDIEvents = 0;
+	for (const TTimelineEvent &rEvent : Timeline)
+	{
+		nExpected += rEvent.bPress;
+		nMIDIEvents += rEvent.nButton < 0;
+	}
+
+	printf ("%u presses, %u MIDI events in %.1f s\n", nExpected, nMIDIEvents,
+		Timeline.empty () ? 0.0 : Timeline.back ().nTime / 1e6);
+	printf ("%-20s %8s %8s %8s %8s %8s\n", "latency in us", "count", "min", "median", "99%", "max");
+
+	for (int bEventDriven = 1; bEventDriven >= 0; bEventDriven--)
+	{
+		CLoopModel Loop (Timeline, bEventDriven);
+		TResult Result = Loop.Run ();
+
+		const char *pLoop = bEventDriven ? "event" : "polled";
+		char Label[32];
+		snprintf (Label, sizeof Label, "%s, buttons", pLoop);
+		Report (Label, Result.ButtonLatency);
+		snprintf (Label, sizeof Label, "%s, MIDI", pLoop);
+		Report (Label, Result.MIDILatency);
+		printf ("%-20s %u presses missed, %u extra actions, %u MIDI events dropped\n", "",
+			Result.nMissed, Result.nActions - (unsigned) Result.ButtonLatency.size (),
+			Result.nDropped);
+
+		if (bEventDriven)
+		{
+			Check (   Result.nActions == nExpected
+			       && Result.ButtonLatency.size () == nExpected, "each press once");
+			Check (   Percentile (Result.ButtonLatency, 0) >= DEBOUNCE_TIME_US
+			       && Percentile (Result.ButtonLatency, 100)
+				  <= DEBOUNCE_TIME_US + BOUNCE_US + TICK_US + 1000, "press latency");
+			Check (Result.nDropped == 0, "no MIDI event dropped");
+		}
+	}
+
+	return CheckResult ();
+}
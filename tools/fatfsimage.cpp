@@ -0,0 +1,686 @@
+//
+// fatfsimage.cpp
+//
+// The disk image and the FatFs stand-in on it (see mock/fatfs/ff.h)
+//
+#include "fatfsimage.h"
+#include <fatfs/ff.h>
+#include <fatfs/diskio.h>
+#include <cassert>
+#include <cstring>
+#include <fcntl.h>
+#include <strings.h>
+#include <unistd.h>
+
+#define SECTOR_SIZE	FF_MAX_SS
+#define LABEL_MAGIC	0x4946534DU	// "MSFI"
+#define END_OF_CHAIN	0x0FFFFFFFU
+#define NAME_MAX_LEN	22
+
+struct TLabel
+{
+	uint32_t nMagic;
+	uint32_t nClusterSectors;
+	uint32_t nFATEntries;
+	uint32_t nFATSector;
+	uint32_t nFATSectors;
+	uint32_t nDataSector;
+	uint32_t nRootCluster;
+};
+
+struct TEntry
+{
+	char Name[NAME_MAX_LEN];		// "" ends the directory
+	uint8_t nAttr;
+	uint8_t nReserved;
+	uint32_t nCluster;
+	uint32_t nSize;
+};
+
+static_assert (sizeof (TEntry) == 32, "TEntry must be packed");
+
+static CDevice *s_pDevice;
+static TDiskStats s_Stats;
+static FATFS *s_pFileSystem;
+
+CFatFsImage::CFatFsImage (const char *pPath, unsigned nSectors, unsigned nClusterSectors)
+:	m_Path (pPath),
+	m_nSize ((uint64_t) nSectors * SECTOR_SIZE),
+	m_nPosition (0),
+	m_nClusterSectors (nClusterSectors),
+	m_nNextCluster (2)
+{
+	assert (nClusterSectors > 0 && nClusterSectors <= 128);
+
+	m_hFile = open (pPath, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	assert (m_hFile >= 0);
+	int nResult = ftruncate (m_hFile, (off_t) nSectors * SECTOR_SIZE);
+	assert (nResult == 0);
+	(void) nResult;
+
+	uint32_t nClusters = nSectors / nClusterSectors;
+	m_nFATSector = 1;
+	m_nDataSector = m_nFATSector + (nClusters * 4 + SECTOR_SIZE - 1) / SECTOR_SIZE;
+	m_nDataSector = (m_nDataSector + nClusterSectors - 1) / nClusterSectors * nClusterSectors;
+	m_FAT.assign ((nSectors - m_nDataSector) / nClusterSectors + 2, 0);
+	m_FAT[0] = m_FAT[1] = END_OF_CHAIN;
+
+	m_Directories[""].nCluster = Allocate ();
+}
+
+CFatFsImage::~CFatFsImage (void)
+{
+	if (s_pDevice == this)
+	{
+		s_pDevice = nullptr;
+	}
+
+	close (m_hFile);
+	unlink (m_Path.c_str ());
+}
+
+bool CFatFsImage::AddDirectory (const char *pPath)
+{
+	std::string Path = Normalize (pPath);
+	if (m_Directories.count (Path))
+	{
+		return false;
+	}
+
+	uint32_t nCluster = Allocate ();
+	if (   nCluster == 0
+	    || !AddEntry (Path, AM_DIR, nCluster, 0))
+	{
+		return false;
+	}
+
+	m_Directories[Path].nCluster = nCluster;
+
+	return true;
+}
+
+bool CFatFsImage::AddFile (const char *pPath, const void *pData, size_t nSize, unsigned nFragment)
+{
+	size_t nClusterSize = m_nClusterSectors * SECTOR_SIZE;
+	const uint8_t *pBytes = static_cast<const uint8_t *> (pData);
+
+	uint32_t nFirst = 0;
+	uint32_t nPrevious = 0;
+	for (size_t nOffset = 0, nIndex = 0; nOffset < nSize; nOffset += nClusterSize, nIndex++)
+	{
+		if (nFragment != 0 && nIndex != 0 && nIndex % nFragment == 0)
+		{
+			Allocate ();		// of another file
+		}
+
+		uint32_t nCluster = Allocate ();
+		if (nCluster == 0)
+		{
+			return false;
+		}
+
+		if (nPrevious != 0)
+		{
+			m_FAT[nPrevious] = nCluster;
+		}
+		else
+		{
+			nFirst = nCluster;
+		}
+		nPrevious = nCluster;
+
+		size_t nChunk = nSize - nOffset < nClusterSize ? nSize - nOffset : nClusterSize;
+		off_t nPosition = ((off_t) m_nDataSector + (off_t) (nCluster - 2) * m_nClusterSectors)
+				  * SECTOR_SIZE;
+		if (pwrite (m_hFile, pBytes + nOffset, nChunk, nPosition) != (ssize_t) nChunk)
+		{
+			return false;
+		}
+	}
+
+	return AddEntry (Normalize (pPath), 0, nFirst, nSize);
+}
+
+bool CFatFsImage::Finish (void)
+{
+	size_t nFATSize = m_FAT.size () * sizeof m_FAT[0];
+
+	TLabel Label;
+	memset (&Label, 0, sizeof Label);
+	Label.nMagic = LABEL_MAGIC;
+	Label.nClusterSectors = m_nClusterSectors;
+	Label.nFATEntries = m_FAT.size ();
+	Label.nFATSector = m_nFATSector;
+	Label.nFATSectors = (nFATSize + SECTOR_SIZE - 1) / SECTOR_SIZE;
+	Label.nDataSector = m_nDataSector;
+	Label.nRootCluster = m_Directories[""].nCluster;
+
+	if (   pwrite (m_hFile, &Label, sizeof Label, 0) != sizeof Label
+	    || pwrite (m_hFile, m_FAT.data (), nFATSize, (off_t) m_nFATSector * SECTOR_SIZE)
+		!= (ssize_t) nFATSize)
+	{
+		return false;
+	}
+
+	for (auto &rDirectory : m_Directories)
+	{
+		std::vector<uint8_t> &rEntries = rDirectory.second.Entries;
+		off_t nPosition = (  (off_t) m_nDataSector
+				   + (off_t) (rDirectory.second.nCluster - 2) * m_nClusterSectors)
+				  * SECTOR_SIZE;
+		if (   !rEntries.empty ()
+		    && pwrite (m_hFile, rEntries.data (), rEntries.size (), nPosition)
+			!= (ssize_t) rEntries.size ())
+		{
+			return false;
+		}
+	}
+
+	s_pDevice = this;
+
+	return true;
+}
+
+int CFatFsImage::Read (void *pBuffer, size_t nCount)
+{
+	s_Stats.nReadCommands++;
+	s_Stats.nReadSectors += nCount / SECTOR_SIZE;
+
+	if (   m_nPosition + nCount > m_nSize
+	    || pread (m_hFile, pBuffer, nCount, m_nPosition) != (ssize_t) nCount)
+	{
+		return -1;
+	}
+
+	m_nPosition += nCount;
+
+	return nCount;
+}
+
+int CFatFsImage::Write (const void *pBuffer, size_t nCount)
+{
+	s_Stats.nWriteCommands++;
+
+	if (   m_nPosition + nCount > m_nSize
+	    || pwrite (m_hFile, pBuffer, nCount, m_nPosition) != (ssize_t) nCount)
+	{
+		return -1;
+	}
+
+	m_nPosition += nCount;
+
+	return nCount;
+}
+
+u64 CFatFsImage::Seek (u64 ullOffset)
+{
+	m_nPosition = ullOffset;
+
+	return m_nPosition;
+}
+
+u64 CFatFsImage::GetSize (void) const
+{
+	return m_nSize;
+}
+
+void CFatFsImage::SetDevice (CDevice *pDevice)
+{
+	s_pDevice = pDevice;
+}
+
+const TDiskStats &CFatFsImage::GetStats (void)
+{
+	return s_Stats;
+}
+
+void CFatFsImage::ResetStats (void)
+{
+	memset (&s_Stats, 0, sizeof s_Stats);
+}
+
+uint32_t CFatFsImage::Allocate (void)
+{
+	if (m_nNextCluster >= m_FAT.size ())
+	{
+		return 0;
+	}
+
+	m_FAT[m_nNextCluster] = END_OF_CHAIN;
+
+	return m_nNextCluster++;
+}
+
+bool CFatFsImage::AddEntry (const std::string &rPath, uint8_t nAttr, uint32_t nCluster, uint32_t nSize)
+{
+	size_t nSlash = rPath.rfind ('/');
+	std::string Parent = nSlash == std::string::npos ? "" : rPath.substr (0, nSlash);
+	std::string Name = nSlash == std::string::npos ? rPath : rPath.substr (nSlash + 1);
+
+	auto Directory = m_Directories.find (Parent);
+	if (   Directory == m_Directories.end ()
+	    || Name.empty ()
+	    || Name.size () >= NAME_MAX_LEN)
+	{
+		return false;
+	}
+
+	// the terminating empty entry must fit too
+	std::vector<uint8_t> &rEntries = Directory->second.Entries;
+	if (rEntries.size () + 2 * sizeof (TEntry) > m_nClusterSectors * SECTOR_SIZE)
+	{
+		return false;
+	}
+
+	TEntry Entry;
+	memset (&Entry, 0, sizeof Entry);
+	strcpy (Entry.Name, Name.c_str ());
+	Entry.nAttr = nAttr;
+	Entry.nCluster = nCluster;
+	Entry.nSize = nSize;
+
+	const uint8_t *pEntry = reinterpret_cast<const uint8_t *> (&Entry);
+	rEntries.insert (rEntries.end (), pEntry, pEntry + sizeof Entry);
+
+	return true;
+}
+
+std::string CFatFsImage::Normalize (const char *pPath)
+{
+	if (strncmp (pPath, "SD:", 3) == 0)
+	{
+		pPath += 3;
+	}
+
+	while (*pPath == '/')
+	{
+		pPath++;
+	}
+
+	return pPath;
+}
+
+// like Circle's FatFs glue
+DRESULT disk_read (BYTE pdrv, BYTE *buff, LBA_t sector, UINT count)
+{
+	if (s_pDevice == nullptr)
+	{
+		return RES_NOTRDY;
+	}
+
+	u64 nOffset = (u64) sector * SECTOR_SIZE;
+	int nSize = count * SECTOR_SIZE;
+	if (   s_pDevice->Seek (nOffset) != nOffset
+	    || s_pDevice->Read (buff, nSize) != nSize)
+	{
+		return RES_ERROR;
+	}
+
+	return RES_OK;
+}
+
+DRESULT disk_write (BYTE pdrv, const BYTE *buff, LBA_t sector, UINT count)
+{
+	if (s_pDevice == nullptr)
+	{
+		return RES_NOTRDY;
+	}
+
+	u64 nOffset = (u64) sector * SECTOR_SIZE;
+	int nSize = count * SECTOR_SIZE;
+	if (   s_pDevice->Seek (nOffset) != nOffset
+	    || s_pDevice->Write (buff, nSize) != nSize)
+	{
+		return RES_ERROR;
+	}
+
+	return RES_OK;
+}
+
+// FatFs stand-in, the sector and FAT access follows FatFs R0.14
+
+static LBA_t ClusterToSector (const FATFS *fs, DWORD clst)
+{
+	return fs->database + (LBA_t) (clst - 2) * fs->csize;
+}
+
+static bool MoveWindow (FATFS *fs, LBA_t sect)
+{
+	if (sect == fs->winsect)
+	{
+		return true;
+	}
+
+	if (disk_read (fs->pdrv, fs->win, sect, 1) != RES_OK)
+	{
+		fs->winsect = (LBA_t) -1;
+
+		return false;
+	}
+
+	fs->winsect = sect;
+
+	return true;
+}
+
+static DWORD GetFAT (FATFS *fs, DWORD clst)
+{
+	if (   clst < 2
+	    || clst >= fs->n_fatent
+	    || !MoveWindow (fs, fs->fatbase + clst / (SECTOR_SIZE / 4)))
+	{
+		return 1;			// error
+	}
+
+	DWORD nValue;
+	memcpy (&nValue, fs->win + clst % (SECTOR_SIZE / 4) * 4, sizeof nValue);
+
+	return nValue & 0x0FFFFFFF;
+}
+
+// searches the path through the directories, which are read through the
+// window like FatFs does
+static FRESULT FindEntry (FATFS *fs, const TCHAR *path, TEntry *pEntry)
+{
+	if (fs == nullptr)
+	{
+		return FR_NOT_ENABLED;
+	}
+
+	if (strncmp (path, "SD:", 3) == 0)
+	{
+		path += 3;
+	}
+
+	DWORD nDirectory = fs->dirbase;
+	while (*path != '\0')
+	{
+		while (*path == '/')
+		{
+			path++;
+		}
+
+		size_t nLength = strcspn (path, "/");
+		if (nLength == 0)
+		{
+			break;
+		}
+
+		bool bFound = false;
+		for (unsigned nSector = 0; !bFound && nSector < fs->csize; nSector++)
+		{
+			if (!MoveWindow (fs, ClusterToSector (fs, nDirectory) + nSector))
+			{
+				return FR_DISK_ERR;
+			}
+
+			const TEntry *pEntries = reinterpret_cast<const TEntry *> (fs->win);
+			for (unsigned i = 0; i < SECTOR_SIZE / sizeof (TEntry); i++)
+			{
+				if (pEntries[i].Name[0] == '\0')
+				{
+					return path[nLength] == '\0' ? FR_NO_FILE : FR_NO_PATH;
+				}
+
+				if (   strlen (pEntries[i].Name) == nLength
+				    && strncasecmp (pEntries[i].Name, path, nLength) == 0)
+				{
+					*pEntry = pEntries[i];
+					bFound = true;
+
+					break;
+				}
+			}
+		}
+
+		if (!bFound)
+		{
+			return FR_NO_FILE;
+		}
+
+		path += nLength;
+		if (*path != '\0')
+		{
+			if (!(pEntry->nAttr & AM_DIR))
+			{
+				return FR_NO_PATH;
+			}
+
+			nDirectory = pEntry->nCluster;
+		}
+	}
+
+	return FR_OK;
+}
+
+FRESULT f_mount (FATFS *fs, const TCHAR *path, BYTE opt)
+{
+	s_pFileSystem = nullptr;
+
+	if (fs == nullptr)
+	{
+		return FR_OK;
+	}
+
+	memset (fs, 0, sizeof *fs);
+	fs->winsect = (LBA_t) -1;
+	if (!MoveWindow (fs, 0))
+	{
+		return FR_DISK_ERR;
+	}
+
+	TLabel Label;
+	memcpy (&Label, fs->win, sizeof Label);
+	if (Label.nMagic != LABEL_MAGIC)
+	{
+		return FR_NO_FILESYSTEM;
+	}
+
+	fs->fs_type = 3;
+	fs->csize = Label.nClusterSectors;
+	fs->n_fatent = Label.nFATEntries;
+	fs->fsize = Label.nFATSectors;
+	fs->fatbase = Label.nFATSector;
+	fs->dirbase = Label.nRootCluster;
+	fs->database = Label.nDataSector;
+
+	s_pFileSystem = fs;
+
+	return FR_OK;
+}
+
+FRESULT f_open (FIL *fp, const TCHAR *path, BYTE mode)
+{
+	memset (fp, 0, sizeof *fp);
+
+	if (mode & FA_WRITE)
+	{
+		return FR_WRITE_PROTECTED;
+	}
+
+	TEntry Entry;
+	FRESULT Result = FindEntry (s_pFileSystem, path, &Entry);
+	if (Result != FR_OK)
+	{
+		return Result;
+	}
+
+	if (Entry.nAttr & AM_DIR)
+	{
+		return FR_NO_FILE;
+	}
+
+	fp->obj.fs = s_pFileSystem;
+	fp->obj.attr = Entry.nAttr;
+	fp->obj.sclust = Entry.nCluster;
+	fp->obj.objsize = Entry.nSize;
+	fp->flag = mode;
+	fp->sect = (LBA_t) -1;
+
+	return FR_OK;
+}
+
+FRESULT f_close (FIL *fp)
+{
+	fp->obj.fs = nullptr;
+
+	return FR_OK;
+}
+
+FRESULT f_read (FIL *fp, void *buff, UINT btr, UINT *br)
+{
+	FATFS *fs = fp->obj.fs;
+	BYTE *rbuff = static_cast<BYTE *> (buff);
+	*br = 0;
+
+	FSIZE_t remain = fp->obj.objsize - fp->fptr;
+	if (btr > remain)
+	{
+		btr = remain;
+	}
+
+	for (UINT rcnt; btr != 0; rbuff += rcnt, fp->fptr += rcnt, *br += rcnt, btr -= rcnt)
+	{
+		if (fp->fptr % SECTOR_SIZE == 0)
+		{
+			UINT csect = (fp->fptr / SECTOR_SIZE) & (fs->csize - 1);
+			if (csect == 0)
+			{
+				DWORD clst = fp->fptr == 0 ? fp->obj.sclust : GetFAT (fs, fp->clust);
+				if (clst < 2)
+				{
+					return FR_INT_ERR;
+				}
+
+				fp->clust = clst;
+			}
+
+			LBA_t sect = ClusterToSector (fs, fp->clust) + csect;
+
+			// whole sectors straight to the destination, up to the end
+			// of the cluster
+			UINT cc = btr / SECTOR_SIZE;
+			if (cc != 0)
+			{
+				if (csect + cc > fs->csize)
+				{
+					cc = fs->csize - csect;
+				}
+
+				if (disk_read (fs->pdrv, rbuff, sect, cc) != RES_OK)
+				{
+					return FR_DISK_ERR;
+				}
+
+				rcnt = cc * SECTOR_SIZE;
+
+				continue;
+			}
+
+			if (fp->sect != sect)
+			{
+				if (disk_read (fs->pdrv, fp->buf, sect, 1) != RES_OK)
+				{
+					return FR_DISK_ERR;
+				}
+			}
+
+			fp->sect = sect;
+		}
+
+		rcnt = SECTOR_SIZE - fp->fptr % SECTOR_SIZE;
+		if (rcnt > btr)
+		{
+			rcnt = btr;
+		}
+
+		memcpy (rbuff, fp->buf + fp->fptr % SECTOR_SIZE, rcnt);
+	}
+
+	return FR_OK;
+}
+
+FRESULT f_lseek (FIL *fp, FSIZE_t ofs)
+{
+	FATFS *fs = fp->obj.fs;
+
+	if (ofs > fp->obj.objsize)
+	{
+		ofs = fp->obj.objsize;
+	}
+
+	FSIZE_t ifptr = fp->fptr;
+	LBA_t nsect = 0;
+	fp->fptr = 0;
+
+	if (ofs > 0)
+	{
+		FSIZE_t bcs = (FSIZE_t) fs->csize * SECTOR_SIZE;
+		DWORD clst;
+		if (   ifptr > 0
+		    && (ofs - 1) / bcs >= (ifptr - 1) / bcs)
+		{
+			// forward from the current cluster
+			fp->fptr = (ifptr - 1) & ~(bcs - 1);
+			ofs -= fp->fptr;
+			clst = fp->clust;
+		}
+		else
+		{
+			clst = fp->obj.sclust;
+			fp->clust = clst;
+		}
+
+		if (clst != 0)
+		{
+			while (ofs > bcs)
+			{
+				ofs -= bcs;
+				fp->fptr += bcs;
+				clst = GetFAT (fs, clst);
+				if (clst < 2 || clst >= fs->n_fatent)
+				{
+					return FR_INT_ERR;
+				}
+
+				fp->clust = clst;
+			}
+
+			fp->fptr += ofs;
+			if (ofs % SECTOR_SIZE != 0)
+			{
+				nsect = ClusterToSector (fs, clst) + ofs / SECTOR_SIZE;
+			}
+		}
+	}
+
+	if (   fp->fptr % SECTOR_SIZE != 0
+	    && nsect != fp->sect)
+	{
+		if (disk_read (fs->pdrv, fp->buf, nsect, 1) != RES_OK)
+		{
+			return FR_DISK_ERR;
+		}
+
+		fp->sect = nsect;
+	}
+
+	return FR_OK;
+}
+
+FRESULT f_stat (const TCHAR *path, FILINFO *fno)
+{
+	TEntry Entry;
+	FRESULT Result = FindEntry (s_pFileSystem, path, &Entry);
+	if (Result != FR_OK)
+	{
+		return Result;
+	}
+
+	memset (fno, 0, sizeof *fno);
+	fno->fsize = Entry.nSize;
+	fno->fattrib = Entry.nAttr;
+	strncpy (fno->fname, Entry.Name, sizeof fno->fname - 1);
+
+	return FR_OK;
+}
@@ -0,0 +1,81 @@
+//
+// fatfsimage.h
+//
+// Disk image for the FatFs stand-in of the host tools (tools/mock/fatfs).
+// The layout is like FAT, but simpler: sector 0 holds the label, the FAT
+// with 32 bit entries follows, then the clusters from 2 on. A directory is
+// one cluster of 32 byte entries. The image is a block device, which counts
+// the requests. After Finish() disk_read() and disk_write() use it, like
+// Circle's FatFs glue uses the device "emmc1", unless another device (which
+// may put a layer in between) is set with SetDevice().
+//
+#pragma once
+
+#include <circle/device.h>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+struct TDiskStats
+{
+	unsigned nReadCommands;
+	unsigned nReadSectors;
+	unsigned nWriteCommands;
+};
+
+class CFatFsImage : public CDevice
+{
+public:
+	// the image file is removed again by the destructor
+	CFatFsImage (const char *pPath, unsigned nSectors, unsigned nClusterSectors);
+	~CFatFsImage (void);
+
+	// the parent directory must exist, paths may start with "SD:/"
+	bool AddDirectory (const char *pPath);
+
+	// with nFragment != 0 the file is split into runs of nFragment
+	// clusters, with a cluster of another file between them
+	bool AddFile (const char *pPath, const void *pData, size_t nSize, unsigned nFragment = 0);
+
+	// writes the FAT and the directories, disk_read() reads the image then
+	bool Finish (void);
+
+	int Read (void *pBuffer, size_t nCount) override;
+	int Write (const void *pBuffer, size_t nCount) override;
+	u64 Seek (u64 ullOffset) override;
+	u64 GetSize (void) const override;
+
+	static void SetDevice (CDevice *pDevice);
+
+	static const TDiskStats &GetStats (void);
+	static void ResetStats (void);
+
+private:
+	struct TDirectory
+	{
+		uint32_t nCluster;
+		std::vector<uint8_t> Entries;
+	};
+
+	uint32_t Allocate (void);
+	bool AddEntry (const std::string &rPath, uint8_t nAttr, uint32_t nCluster, uint32_t nSize);
+
+	static std::string Normalize (const char *pPath);
+
+private:
+	int m_hFile;
+	std::string m_Path;
+	uint64_t m_nSize;
+	uint64_t m_nPosition;
+
+	unsigned m_nClusterSectors;
+	uint32_t m_nFATSector;
+	uint32_t m_nDataSector;
+
+	std::vector<uint32_t> m_FAT;
+	uint32_t m_nNextCluster;
+
+	std::map<std::string, TDirectory> m_Directories;
+};
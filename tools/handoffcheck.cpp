@@ -0,0 +1,363 @@
+//
+// handoffcheck.cpp
+//
+// Host tool: checks the handoff block from the boot menu to the synth (see
+// src/handoff.h). A block with all settings, a display, the USB MIDI
+// devices and a full boot profile is written like the menu does and read
+// back like a synth would. The reader must return what was written, skip
+// records it does not know and reject any block, which was damaged, cut
+// off or is too old. The CRC must match the one of the boot menu.
+//
+// The timing compares writing and reading the block with what a synth does
+// without it, which is parsing the settings from the text of the ini file.
+//
+// usage: handoffcheck [-n rounds]
+//
+#include "../src/handoff.h"
+#include "../src/bootconfig.h"
+#include "../src/crc32.h"
+#include "../src/bootprofiler.h"
+#include "../src/usbmidiports.h"
+#include "toolcheck.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+
+static volatile unsigned s_nSink;	// keeps the timed work from being optimized away
+
+// the settings with values different from the defaults, where the range
+// allows
+static void SetConfig (TBootConfig *pConfig)
+{
+	BootConfigSetDefaults (pConfig);
+
+	for (unsigned i = 0; i < BootConfigGetKeyCount (); i++)
+	{
+		unsigned nFile;
+		const char *pKey = BootConfigGetKeyName (i, &nFile);
+		std::string Value = std::to_string (BootConfigGetValue (pConfig, i) + 1);
+		if (BootConfigSet (pConfig, nFile, pKey, Value.c_str ()) != BootConfigOK)
+		{
+			Value = std::to_string (BootConfigGetValue (pConfig, i) - 1);
+			BootConfigSet (pConfig, nFile, pKey, Value.c_str ());
+		}
+	}
+}
+
+// like CKernel::WriteHandoff() with the largest content
+static size_t WriteBlock (void *pBlock, const TBootConfig &rConfig, uint32_t nTimestamp)
+{
+	CHandoffWriter Handoff (pBlock, HANDOFF_SIZE);
+
+	for (unsigned i = 0; i < BootConfigGetKeyCount (); i++)
+	{
+		THandoffConfig Config;
+		strncpy (Config.Key, BootConfigGetKeyName (i), sizeof Config.Key);
+		Config.Key[sizeof Config.Key - 1] = '\0';
+		Config.nValue = BootConfigGetValue (&rConfig, i);
+		Handoff.Add (HandoffRecordConfig, Config);
+	}
+
+	THandoffDisplay Display;
+	memset (&Display, 0, sizeof Display);
+	Display.nType = HandoffDisplayST7789;
+	Display.nRotation = 1;
+	Display.bInitialized = 1;
+	Display.nColumns = rConfig.nLCDColumns;
+	Display.nRows = rConfig.nLCDRows;
+	Display.nWidth = rConfig.nST7789Width;
+	Display.nHeight = rConfig.nST7789Height;
+	Handoff.Add (HandoffRecordDisplay, Display);
+
+	for (unsigned i = 0; i < USB_MIDI_DEVICES; i++)
+	{
+		THandoffUSBMIDI Device;
+		memset (&Device, 0, sizeof Device);
+		Device.nDevice = i;
+		Device.nVendor = 0x1000 + i;
+		Device.nProduct = 0x2000 + i;
+		Handoff.Add (HandoffRecordUSBMIDI, Device);
+	}
+
+	for (unsigned i = 0; i < BOOT_PROFILE_MAX_STAGES; i++)
+	{
+		THandoffStage Stage;
+		memset (&Stage, 0, sizeof Stage);
+		snprintf (Stage.Name, sizeof Stage.Name, "stage %u", i);
+		Stage.nCore = i % 4;
+		Stage.nStart = 1000 * i;
+		Stage.nDuration = 10 * i;
+		Handoff.Add (HandoffRecordStage, Stage);
+	}
+
+	THandoffSynth Synth;
+	memset (&Synth, 0, sizeof Synth);
+	strcpy (Synth.Name, "minidexed");
+	Synth.nImageSize = 1234567;
+	Synth.nImageCRC = 0xDEADBEEF;
+	Handoff.Add (HandoffRecordSynth, Synth);
+
+	Check (!Handoff.HasOverflowed (), "largest block fits");
+
+	return Handoff.Finish (nTimestamp);
+}
+
+// what a synth takes over from the block
+static unsigned ReadBlock (const void *pBlock, TBootConfig *pConfig)
+{
+	CHandoffReader Handoff (pBlock, HANDOFF_SIZE);
+	if (!Handoff.IsValid ())
+	{
+		return 0;
+	}
+
+	uint32_t *pField = reinterpret_cast<uint32_t *> (pConfig);
+	for (unsigned i = 0; i < BootConfigGetKeyCount (); i++)
+	{
+		Handoff.GetConfig (BootConfigGetKeyName (i), &pField[i]);
+	}
+
+	unsigned nFound = 0;
+	nFound += Handoff.GetDisplay () != 0;
+	for (unsigned i = 0; Handoff.GetUSBMIDIDevice (i) != 0; i++)
+	{
+		nFound++;
+	}
+	nFound += Handoff.GetSynth () != 0;
+
+	return nFound;
+}
+
+static void CheckRoundTrip (void)
+{
+	TBootConfig Config;
+	SetConfig (&Config);
+
+	static uint8_t Block[HANDOFF_SIZE];
+	size_t nSize = WriteBlock (Block, Config, 5000000);
+	printf ("%-28s %8u of %u bytes\n", "largest block", (unsigned) nSize, HANDOFF_SIZE);
+
+	CHandoffReader Handoff (Block, HANDOFF_SIZE, 5000000 + HANDOFF_MAX_AGE);
+	Check (Handoff.IsValid (), "valid");
+
+	for (unsigned i = 0; i < BootConfigGetKeyCount (); i++)
+	{
+		const char *pKey = BootConfigGetKeyName (i);
+		Check (strlen (pKey) < HANDOFF_KEY_MAX, "key length");
+
+		uint32_t nValue;
+		Check (   Handoff.GetConfig (pKey, &nValue)
+		       && nValue == BootConfigGetValue (&Config, i), "config");
+	}
+
+	uint32_t nValue;
+	Check (!Handoff.GetConfig ("LCDColumn", &nValue), "unknown key");
+
+	const THandoffDisplay *pDisplay = Handoff.GetDisplay ();
+	Check (   pDisplay != 0
+	       && pDisplay->nType == HandoffDisplayST7789
+	       && pDisplay->nColumns == Config.nLCDColumns
+	       && pDisplay->nWidth == Config.nST7789Width, "display");
+
+	for (unsigned i = 0; i < USB_MIDI_DEVICES; i++)
+	{
+		const THandoffUSBMIDI *pDevice = Handoff.GetUSBMIDIDevice (i);
+		Check (   pDevice != 0
+		       && pDevice->nDevice == i
+		       && pDevice->nVendor == 0x1000 + i
+		       && pDevice->nProduct == 0x2000 + i, "usb midi device");
+	}
+	Check (Handoff.GetUSBMIDIDevice (USB_MIDI_DEVICES) == 0, "usb midi device count");
+
+	for (unsigned i = 0; i < BOOT_PROFILE_MAX_STAGES; i++)
+	{
+		const THandoffStage *pStage = Handoff.GetStage (i);
+		Check (   pStage != 0
+		       && pStage->nStart == 1000 * i
+		       && strncmp (pStage->Name, "stage", 5) == 0, "boot stage");
+	}
+
+	const THandoffSynth *pSynth = Handoff.GetSynth ();
+	Check (   pSynth != 0
+	       && strcmp (pSynth->Name, "minidexed") == 0
+	       && pSynth->nImageCRC == 0xDEADBEEF, "synth");
+
+	// the synth must use the same CRC as the menu
+	const THandoffHeader *pHeader = reinterpret_cast<const THandoffHeader *> (Block);
+	Check (pHeader->nCRC == CRC32Update (0, Block + sizeof *pHeader, pHeader->nSize), "crc32.h");
+
+	// too old or from the future (the timer was reset)
+	Check (!CHandoffReader (Block, HANDOFF_SIZE, 5000000 + HANDOFF_MAX_AGE + 1).IsValid (), "age");
+	Check (!CHandoffReader (Block, HANDOFF_SIZE, 4999999).IsValid (), "timestamp");
+
+	CHandoffReader::Invalidate (Block);
+	Check (!CHandoffReader (Block, HANDOFF_SIZE).IsValid (), "invalidated");
+}
+
+static void CheckDamage (void)
+{
+	TBootConfig Config;
+	SetConfig (&Config);
+
+	static uint8_t Block[HANDOFF_SIZE];
+	size_t nSize = WriteBlock (Block, Config, 0);
+
+	// each bit
+	unsigned nAccepted = 0;
+	for (size_t i = 0; i < nSize * 8; i++)
+	{
+		Block[i / 8] ^= 1 << (i % 8);
+		nAccepted += CHandoffReader (Block, HANDOFF_SIZE).IsValid ();
+		Block[i / 8] ^= 1 << (i % 8);
+	}
+
+	// only the timestamp is not covered
+	Check (nAccepted == 8 * sizeof (uint32_t), "bit errors detected");
+	Check (CHandoffReader (Block, HANDOFF_SIZE).IsValid (), "restored");
+
+	// the block does not fit into what the reader may access
+	Check (!CHandoffReader (Block, nSize - 1).IsValid (), "cut off");
+	Check (!CHandoffReader (Block, sizeof (THandoffHeader) - 1).IsValid (), "no header");
+
+	// a new version of the menu may add records and fields
+	static uint8_t Newer[HANDOFF_SIZE];
+	CHandoffWriter Writer (Newer, HANDOFF_SIZE);
+	uint8_t Unknown[7] = {1, 2, 3, 4, 5, 6, 7};
+	Writer.Add (0x100, Unknown, sizeof Unknown);
+	struct {THandoffDisplay Display; uint32_t nNewField;} Display;
+	memset (&Display, 0, sizeof Display);
+	Display.Display.nColumns = 20;
+	Writer.Add (HandoffRecordDisplay, Display);
+	THandoffSynth Short;
+	Writer.Add (HandoffRecordSynth, &Short, sizeof Short - 1);
+	Writer.Finish (0);
+
+	CHandoffReader Handoff (Newer, HANDOFF_SIZE);
+	Check (Handoff.IsValid (), "newer block");
+	Check (Handoff.GetDisplay () != 0 && Handoff.GetDisplay ()->nColumns == 20, "record skipped");
+	Check (Handoff.GetSynth () == 0, "short record");
+
+	// a full block drops records
+	static uint8_t Small[64];
+	CHandoffWriter Full (Small, sizeof Small);
+	THandoffStage Stage;
+	memset (&Stage, 0, sizeof Stage);
+	Check (Full.Add (HandoffRecordStage, Stage), "first record");
+	Check (!Full.Add (HandoffRecordStage, Stage) && Full.HasOverflowed (), "block full");
+	Full.Finish (0);
+	Check (CHandoffReader (Small, sizeof Small).GetStage (0) != 0, "full block valid");
+}
+
+// the synth without the block: minidexed.ini as text
+static std::string MakeIni (const TBootConfig &rConfig)
+{
+	std::string Ini;
+	for (unsigned i = 0; i < BootConfigGetKeyCount (); i++)
+	{
+		Ini += "# setting\n";
+		Ini += BootConfigGetKeyName (i);
+		Ini += "=" + std::to_string (BootConfigGetValue (&rConfig, i)) + "\n";
+	}
+
+	return Ini;
+}
+
+static unsigned ParseIni (const std::string &rIni, TBootConfig *pConfig)
+{
+	BootConfigSetDefaults (pConfig);
+
+	unsigned nSet = 0;
+	char Line[128];
+	const char *p = rIni.c_str ();
+	while (*p)
+	{
+		size_t nLength = strcspn (p, "\n");
+		if (nLength < sizeof Line && *p != '#')
+		{
+			memcpy (Line, p, nLength);
+			Line[nLength] = '\0';
+
+			char *pValue = strchr (Line, '=');
+			if (pValue != 0)
+			{
+				*pValue++ = '\0';
+				for (unsigned nFile = 0; nFile < BootConfigFileCount; nFile++)
+				{
+					nSet += BootConfigSet (pConfig, nFile, Line, pValue) == BootConfigOK;
+				}
+			}
+		}
+
+		p += nLength + (p[nLength] != '\0');
+	}
+
+	return nSet;
+}
+
+template <class TFunction>
+static double Time (unsigned nRounds, TFunction Function)
+{
+	auto Start = std::chrono::steady_clock::now ();
+
+	for (unsigned i = 0; i < nRounds; i++)
+	{
+		s_nSink += Function (i);
+	}
+
+	return std::chrono::duration<double, std::nano> (
+		std::chrono::steady_clock::now () - Start).count () / nRounds;
+}
+
+int main (int argc, char **argv)
+{
+	unsigned nRounds = 100000;
+
+	int nOption;
+	while (optind <= argc && (nOption = getopt (argc, argv, "n:")) != -1)
+	{
+		switch (nOption)
+		{
+		case 'n':	nRounds = strtoul (optarg, nullptr, 0);		break;
+
+		default:
+			optind = argc + 1;			// show usage
+			break;
+		}
+	}
+
+	if (nRounds == 0 || optind != argc)
+	{
+		return Usage ("handoffcheck [-n rounds]");
+	}
+
+	CheckRoundTrip ();
+	CheckDamage ();
+
+	TBootConfig Config;
+	SetConfig (&Config);
+	std::string Ini = MakeIni (Config);
+
+	static uint8_t Block[HANDOFF_SIZE];
+	double fWrite = Time (nRounds, [&] (unsigned i)
+		{ return (unsigned) WriteBlock (Block, Config, i); });
+
+	TBootConfig Read;
+	double fRead = Time (nRounds, [&] (unsigned i)
+		{ return ReadBlock (Block, &Read); });
+	Check (memcmp (&Read, &Config, sizeof Config) == 0, "settings read back");
+
+	TBootConfig Parsed;
+	double fParse = Time (nRounds, [&] (unsigned i)
+		{ return ParseIni (Ini, &Parsed); });
+	Check (memcmp (&Parsed, &Config, sizeof Config) == 0, "settings parsed");
+
+	printf ("%u rounds\n", nRounds);
+	printf ("%-28s %8.0f ns\n", "write block (menu)", fWrite);
+	printf ("%-28s %8.0f ns\n", "check and read (synth)", fRead);
+	printf ("%-28s %8.0f ns\n", "parse ini text (synth)", fParse);
+
+	return CheckResult ();
+}
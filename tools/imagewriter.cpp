@@ -0,0 +1,133 @@
+//
+// imagewriter.cpp
+//
+#include "imagewriter.h"
+#include "lz4encoder.h"
+#include "../src/synthimage.h"
+#include "../src/crc32.h"
+#include "../src/lz4.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+bool ReadFile (const char *pFileName, TBuffer &rContent)
+{
+	FILE *pFile = fopen (pFileName, "rb");
+	if (pFile == nullptr)
+	{
+		perror (pFileName);
+
+		return false;
+	}
+
+	uint8_t Buffer[4096];
+	size_t nRead;
+	while ((nRead = fread (Buffer, 1, sizeof Buffer, pFile)) > 0)
+	{
+		rContent.insert (rContent.end (), Buffer, Buffer + nRead);
+	}
+
+	fclose (pFile);
+
+	return true;
+}
+
+void CompressImage (const TBuffer &rImage, unsigned nLevel, std::vector<TImageChunk> &rChunks)
+{
+	for (size_t nOffset = 0; nOffset < rImage.size (); nOffset += SYNTH_IMAGE_CHUNK_SIZE)
+	{
+		TImageChunk Chunk;
+		Chunk.nSize = std::min<size_t> (rImage.size () - nOffset, SYNTH_IMAGE_CHUNK_SIZE);
+		Chunk.Data.resize (SYNTH_IMAGE_CHUNK_SIZE);
+
+		// a chunk, which does not get smaller, is stored
+		size_t nSize = LZ4Compress (&rImage[nOffset], Chunk.nSize,
+					    Chunk.Data.data (), Chunk.nSize - 1, nLevel);
+		Chunk.bStored = nSize == 0;
+		if (Chunk.bStored)
+		{
+			Chunk.Data.assign (rImage.begin () + nOffset,
+					   rImage.begin () + nOffset + Chunk.nSize);
+		}
+		else
+		{
+			Chunk.Data.resize (nSize);
+		}
+
+		rChunks.push_back (std::move (Chunk));
+	}
+}
+
+double DecodeChunk (const TImageChunk &rChunk, const uint8_t *pExpected)
+{
+	uint8_t Buffer[SYNTH_IMAGE_CHUNK_SIZE];
+
+	auto Start = std::chrono::steady_clock::now ();
+
+	int nResult;
+	if (rChunk.bStored)
+	{
+		memcpy (Buffer, rChunk.Data.data (), rChunk.nSize);
+		nResult = rChunk.nSize;
+	}
+	else
+	{
+		nResult = LZ4Decompress (rChunk.Data.data (), rChunk.Data.size (), Buffer, sizeof Buffer);
+	}
+
+	std::chrono::duration<double> Time = std::chrono::steady_clock::now () - Start;
+
+	if (   nResult != (int) rChunk.nSize
+	    || memcmp (Buffer, pExpected, rChunk.nSize) != 0)
+	{
+		return -1.0;
+	}
+
+	return Time.count ();
+}
+
+static void Append (TBuffer &rFile, const void *pData, size_t nSize)
+{
+	const uint8_t *p = static_cast<const uint8_t *> (pData);
+	rFile.insert (rFile.end (), p, p + nSize);
+}
+
+bool BuildImage (const TBuffer &rImage, unsigned nLevel, TBuffer &rFile)
+{
+	std::vector<TImageChunk> Chunks;
+	CompressImage (rImage, nLevel, Chunks);
+
+	TSynthImageHeader Header;
+	memset (&Header, 0, sizeof Header);
+	Header.nMagic = SYNTH_IMAGE_MAGIC;
+	Header.nVersion = SYNTH_IMAGE_VERSION;
+	Header.nHeaderSize = sizeof Header;
+	Header.nImageSize = rImage.size ();
+	Header.nChunkSize = SYNTH_IMAGE_CHUNK_SIZE;
+	Header.nChunks = Chunks.size ();
+	Header.nImageCRC = CRC32Update (0, rImage.data (), rImage.size ());
+
+	rFile.clear ();
+	Append (rFile, &Header, sizeof Header);
+
+	for (size_t i = 0; i < Chunks.size (); i++)
+	{
+		if (DecodeChunk (Chunks[i], &rImage[i * SYNTH_IMAGE_CHUNK_SIZE]) < 0.0)
+		{
+			fprintf (stderr, "Chunk %zu does not decode\n", i);
+
+			return false;
+		}
+
+		uint32_t nSize = Chunks[i].Data.size () | (Chunks[i].bStored ? SYNTH_IMAGE_STORED : 0);
+		Append (rFile, &nSize, sizeof nSize);
+	}
+
+	for (const TImageChunk &rChunk : Chunks)
+	{
+		Append (rFile, rChunk.Data.data (), rChunk.Data.size ());
+	}
+
+	return true;
+}
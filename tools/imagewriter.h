@@ -0,0 +1,31 @@
+//
+// imagewriter.h
+//
+// Builds compressed synth images (src/synthimage.h) for the host tools.
+//
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+typedef std::vector<uint8_t> TBuffer;
+
+struct TImageChunk
+{
+	TBuffer Data;
+	bool bStored;				// Data is not compressed
+	size_t nSize;				// uncompressed
+};
+
+bool ReadFile (const char *pFileName, TBuffer &rContent);
+
+// splits the image into chunks and compresses them
+void CompressImage (const TBuffer &rImage, unsigned nLevel, std::vector<TImageChunk> &rChunks);
+
+// returns the decoding time in seconds, or -1.0 if the result differs
+double DecodeChunk (const TImageChunk &rChunk, const uint8_t *pExpected);
+
+// compresses rImage into a complete image file, returns false if a chunk
+// did not decode back to the original data
+bool BuildImage (const TBuffer &rImage, unsigned nLevel, TBuffer &rFile);
@@ -0,0 +1,344 @@
+//
+// lcdbench.cpp
+//
+// Host tool: counts the bytes, which the boot menu sends to a character
+// display per selection step, before and after CLCDFrame (src/lcdframe.h).
+// The display is a mock CCharDevice, which counts the bytes and applies
+// them to a character grid like Circle's CCharDevice does ("\E[r;cH",
+// "\E[H", "\E[J", "\E[?25l", '\n'), so that both ways are also checked to
+// show the menu.
+//
+//	before	clear the display and write all lines on every step
+//	after	CLCDFrame, only the changed cells with cursor moves
+//
+// The menu is drawn like CKernel::UpdateDisplay() does, with two rows the
+// selected title between arrows, with more rows a page of titles. The
+// selection steps through all synths and back, then jumps at random (a
+// MIDI program change). The time per step is modelled for an HD44780 on
+// an I2C backpack.
+//
+// usage: lcdbench [-n random steps] [-b us per byte]
+//
+#include "../src/lcdframe.h"
+#include "toolcheck.h"
+#include <circle/device.h>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+static const char *s_pTitles[] =
+{
+	"MiniDexed", "MiniJV880", "mt32-pi", "MiniSynth Pi", "Synthmata", "TAL-NoiseMaker",
+	"DX7 Factory", "MiniDexed TX816", "OB-Xd", "Vital Lite", "Dexed 4 Op", "Organ"
+};
+
+static const unsigned s_nTitles = sizeof s_pTitles / sizeof s_pTitles[0];
+
+class CCountingDisplay : public CDevice
+{
+public:
+	CCountingDisplay (unsigned nColumns, unsigned nRows)
+	:	m_nColumns (nColumns),
+		m_nRows (nRows),
+		m_nBytes (0),
+		m_nRow (0),
+		m_nColumn (0)
+	{
+		m_Cells.assign (nRows, std::string (nColumns, ' '));
+	}
+
+	int Write (const void *pBuffer, size_t nCount) override
+	{
+		m_nBytes += nCount;
+		m_Pending.append (static_cast<const char *> (pBuffer), nCount);
+
+		// an escape sequence may be split across writes
+		size_t nUsed = 0;
+		while (nUsed < m_Pending.size ())
+		{
+			size_t nLength = Apply (m_Pending.c_str () + nUsed, m_Pending.size () - nUsed);
+			if (nLength == 0)
+			{
+				break;
+			}
+
+			nUsed += nLength;
+		}
+		m_Pending.erase (0, nUsed);
+
+		return nCount;
+	}
+
+	unsigned GetBytes (void) const		{ return m_nBytes; }
+	void ResetBytes (void)			{ m_nBytes = 0; }
+
+	bool Shows (const std::vector<std::string> &rLines) const
+	{
+		return m_Pending.empty () && m_Cells == rLines;
+	}
+
+private:
+	// returns the bytes used, 0 if the sequence is incomplete
+	size_t Apply (const char *pData, size_t nLength)
+	{
+		if (pData[0] == '\n')
+		{
+			m_nRow++;
+			m_nColumn = 0;
+
+			return 1;
+		}
+
+		if (pData[0] != '\x1B')
+		{
+			if (m_nRow < m_nRows && m_nColumn < m_nColumns)
+			{
+				m_Cells[m_nRow][m_nColumn] = pData[0];
+			}
+			m_nColumn++;
+
+			return 1;
+		}
+
+		// "\E[" [?] digits [; digits] letter
+		size_t i = 1;
+		if (i < nLength && pData[i] == '[')
+		{
+			i++;
+		}
+		while (i < nLength && (pData[i] == '?' || pData[i] == ';' || isdigit (pData[i])))
+		{
+			i++;
+		}
+		if (i >= nLength)
+		{
+			return 0;
+		}
+
+		std::string Sequence (pData, i + 1);
+		unsigned nRow, nColumn;
+		if (sscanf (Sequence.c_str (), "\x1B[%u;%uH", &nRow, &nColumn) == 2)
+		{
+			Check (   1 <= nRow && nRow <= m_nRows
+			       && 1 <= nColumn && nColumn <= m_nColumns, "cursor position");
+			m_nRow = nRow - 1;
+			m_nColumn = nColumn - 1;
+		}
+		else if (Sequence == "\x1B[H")
+		{
+			m_nRow = 0;
+			m_nColumn = 0;
+		}
+		else if (Sequence == "\x1B[J")
+		{
+			for (unsigned nRow = m_nRow; nRow < m_nRows; nRow++)
+			{
+				for (unsigned nColumn = nRow == m_nRow ? m_nColumn : 0; nColumn < m_nColumns; nColumn++)
+				{
+					m_Cells[nRow][nColumn] = ' ';
+				}
+			}
+		}
+		else
+		{
+			Check (Sequence == "\x1B[?25l", "escape sequence");
+		}
+
+		return i + 1;
+	}
+
+private:
+	unsigned m_nColumns;
+	unsigned m_nRows;
+	unsigned m_nBytes;
+
+	std::vector<std::string> m_Cells;
+	unsigned m_nRow;
+	unsigned m_nColumn;
+	std::string m_Pending;
+};
+
+// the lines of the menu like CKernel::UpdateDisplay(), not padded
+static std::vector<std::string> GetMenu (unsigned nColumns, unsigned nRows, unsigned nSelected)
+{
+	std::vector<std::string> Lines (nRows);
+	char Line[LCD_FRAME_MAX_COLUMNS + 1];
+
+	Lines[0] = "Select Synth";
+	if (nRows <= 2)
+	{
+		snprintf (Line, sizeof Line, "%s %s %s", nSelected > 0 ? "<" : " ",
+			  s_pTitles[nSelected], nSelected < s_nTitles - 1 ? ">" : " ");
+		Lines[nRows - 1] = Line;
+	}
+	else
+	{
+		snprintf (Line, sizeof Line, "%u/%u", nSelected + 1, s_nTitles);
+		Lines[0].resize (nColumns - strlen (Line), ' ');
+		Lines[0] += Line;
+
+		unsigned nPageSize = nRows - 1;
+		unsigned nFirst = nSelected - nSelected % nPageSize;
+		for (unsigned i = 0; i < nPageSize && nFirst + i < s_nTitles; i++)
+		{
+			snprintf (Line, sizeof Line, "%c%s", nFirst + i == nSelected ? '>' : ' ',
+				  s_pTitles[nFirst + i]);
+			Lines[1 + i] = Line;
+		}
+	}
+
+	for (std::string &rLine : Lines)
+	{
+		rLine.resize (nColumns, ' ');
+	}
+
+	return Lines;
+}
+
+// the previous UpdateDisplay()
+static void DrawBefore (CDevice *pDisplay, const std::vector<std::string> &rMenu)
+{
+	static const char Clear[] = "\x1B[H\x1B[J\x1B[?25l";
+	pDisplay->Write (Clear, strlen (Clear));
+
+	for (unsigned nRow = 0; nRow < rMenu.size (); nRow++)
+	{
+		std::string Line = rMenu[nRow];
+		Line.erase (Line.find_last_not_of (' ') + 1);
+		if (nRow + 1 < rMenu.size ())
+		{
+			Line += '\n';
+		}
+
+		pDisplay->Write (Line.c_str (), Line.size ());
+	}
+}
+
+static void DrawAfter (CLCDFrame *pFrame, CDevice *pDisplay, const std::vector<std::string> &rMenu)
+{
+	pFrame->Clear ();
+	for (unsigned nRow = 0; nRow < rMenu.size (); nRow++)
+	{
+		pFrame->Print (nRow, rMenu[nRow].c_str ());
+	}
+
+	unsigned nBytes = pFrame->Flush (pDisplay);
+	Check (nBytes == static_cast<CCountingDisplay *> (pDisplay)->GetBytes (), "bytes returned");
+}
+
+int main (int argc, char **argv)
+{
+	unsigned nRandomSteps = 1000;
+	unsigned nByteTime = 250;		// 4 nibbles of 9 bits at 100 kHz, with overhead
+
+	int nOption;
+	while (optind <= argc && (nOption = getopt (argc, argv, "n:b:")) != -1)
+	{
+		switch (nOption)
+		{
+		case 'n':	nRandomSteps = strtoul (optarg, nullptr, 0);	break;
+		case 'b':	nByteTime = strtoul (optarg, nullptr, 0);	break;
+
+		default:
+			optind = argc + 1;			// show usage
+			break;
+		}
+	}
+
+	if (optind != argc)
+	{
+		return Usage ("lcdbench [-n random steps] [-b us per byte]");
+	}
+
+	// through all synths and back, then random jumps
+	std::vector<unsigned> Steps;
+	for (unsigned i = 0; i < s_nTitles; i++)
+	{
+		Steps.push_back (i);
+	}
+	for (unsigned i = s_nTitles - 1; i-- > 0; )
+	{
+		Steps.push_back (i);
+	}
+	std::mt19937 Random (1);
+	for (unsigned i = 0; i < nRandomSteps; i++)
+	{
+		Steps.push_back (Random () % s_nTitles);
+	}
+
+	printf ("%u synths, %u steps, %u us per byte\n", s_nTitles, (unsigned) Steps.size () - 1, nByteTime);
+	printf ("%-12s %14s %14s %14s %10s %10s\n", "display", "before B/step", "after B/step",
+		"after max B", "before ms", "after ms");
+
+	static const struct
+	{
+		unsigned nColumns;
+		unsigned nRows;
+	}
+	Sizes[] = {{16, 2}, {20, 2}, {20, 4}, {40, 4}};
+
+	for (const auto &rSize : Sizes)
+	{
+		CCountingDisplay Before (rSize.nColumns, rSize.nRows);
+		CCountingDisplay After (rSize.nColumns, rSize.nRows);
+		CLCDFrame Frame;
+		Frame.SetSize (rSize.nColumns, rSize.nRows);
+
+		unsigned nBefore = 0, nAfter = 0, nAfterMax = 0;
+		for (unsigned i = 0; i < Steps.size (); i++)
+		{
+			std::vector<std::string> Menu = GetMenu (rSize.nColumns, rSize.nRows, Steps[i]);
+
+			Before.ResetBytes ();
+			DrawBefore (&Before, Menu);
+			Check (Before.Shows (Menu), "before shows the menu");
+
+			After.ResetBytes ();
+			DrawAfter (&Frame, &After, Menu);
+			Check (After.Shows (Menu), "after shows the menu");
+
+			// the first frame is drawn in full
+			if (i == 0)
+			{
+				continue;
+			}
+
+			nBefore += Before.GetBytes ();
+			nAfter += After.GetBytes ();
+			if (After.GetBytes () > nAfterMax)
+			{
+				nAfterMax = After.GetBytes ();
+			}
+
+			if (Steps[i] == Steps[i - 1])
+			{
+				Check (After.GetBytes () == 0, "nothing for the same frame");
+			}
+		}
+
+		unsigned nSteps = Steps.size () - 1;
+		Check (nAfter < nBefore, "fewer bytes");
+
+		char Label[16];
+		snprintf (Label, sizeof Label, "%ux%u", rSize.nColumns, rSize.nRows);
+		printf ("%-12s %14.1f %14.1f %14u %10.1f %10.1f\n", Label, (double) nBefore / nSteps,
+			(double) nAfter / nSteps, nAfterMax,
+			(double) nBefore / nSteps * nByteTime / 1000, (double) nAfter / nSteps * nByteTime / 1000);
+	}
+
+	// MiniDexed -> MiniJV880 on 16x2
+	CCountingDisplay Display (16, 2);
+	CLCDFrame Frame;
+	Frame.SetSize (16, 2);
+	DrawAfter (&Frame, &Display, GetMenu (16, 2, 0));
+	Display.ResetBytes ();
+	DrawAfter (&Frame, &Display, GetMenu (16, 2, 1));
+	printf ("MiniDexed -> MiniJV880, 16x2: %u bytes\n", Display.GetBytes ());
+
+	return CheckResult ();
+}
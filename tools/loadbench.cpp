@@ -0,0 +1,230 @@
+//
+// loadbench.cpp
+//
+// Host tool: compares the two ways, in which CChainLoader::ReadRaw() loads
+// a raw synth image, on a disk image with the FatFs stand-in of the host
+// tools (see fatfsimage.h). The generic path reads CHAINLOAD_CHUNK_SIZE
+// chunks with f_read(), which splits them at the cluster boundaries and
+// follows the FAT. The direct path resolves the extent of the image once
+// (src/fileextent.h) and reads CHAINLOAD_DIRECT_CHUNK_SIZE chunks with one
+// disk_read() each. Both must deliver the image, a fragmented image must
+// be rejected by FileGetExtent() and fall back to the generic path.
+//
+// The time is modelled from the disk requests with a command latency and
+// the bus rate of the SD card, and measured for the disk image on the host,
+// for an image in the synth container and an image in its own file, with
+// small and large clusters.
+//
+// usage: loadbench [-s image KB] [-l command latency us] [-b bus MB/s] [-d dir]
+//
+#include "fatfsimage.h"
+#include "../src/fileextent.h"
+#include "toolcheck.h"
+#include <fatfs/ff.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+// as in src/chainloader.h
+#define CHAINLOAD_CHUNK_SIZE		0x10000
+#define CHAINLOAD_DIRECT_CHUNK_SIZE	0x40000
+#define KERNEL_MAX_SIZE			0x400000
+
+#define PACK_OFFSET		4096		// SYNTH_PACK_ALIGN
+
+static bool ReadGeneric (FIL *pFile, uint8_t *pBuffer, size_t nSize)
+{
+	for (size_t nOffset = 0; nOffset < nSize; nOffset += CHAINLOAD_CHUNK_SIZE)
+	{
+		UINT nChunk = nSize - nOffset < CHAINLOAD_CHUNK_SIZE ? nSize - nOffset
+								    : CHAINLOAD_CHUNK_SIZE;
+		UINT nRead = 0;
+		if (   f_read (pFile, pBuffer + nOffset, nChunk, &nRead) != FR_OK
+		    || nRead != nChunk)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static bool ReadDirect (const TFileExtent *pExtent, uint8_t *pBuffer, size_t nSize)
+{
+	for (size_t nOffset = 0; nOffset < nSize; nOffset += CHAINLOAD_DIRECT_CHUNK_SIZE)
+	{
+		size_t nChunk = nSize - nOffset < CHAINLOAD_DIRECT_CHUNK_SIZE
+			      ? nSize - nOffset : CHAINLOAD_DIRECT_CHUNK_SIZE;
+		if (!FileReadExtent (pExtent, nOffset, pBuffer + nOffset, nChunk))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+struct TResult
+{
+	bool bDirect;				// the extent was used
+	TDiskStats Stats;
+	unsigned nOpenCommands;			// of f_open() and the first f_lseek()
+	double fSeconds;			// on the host
+};
+
+// like CChainLoader::Load() and ReadRaw()
+static TResult Load (const char *pPath, FSIZE_t nOffset, const std::vector<uint8_t> &rImage,
+		     bool bTryDirect)
+{
+	static uint8_t Staging[KERNEL_MAX_SIZE];
+	memset (Staging, 0, sizeof Staging);
+
+	TResult Result;
+	Result.bDirect = false;
+
+	CFatFsImage::ResetStats ();
+	auto Start = std::chrono::steady_clock::now ();
+
+	FIL File;
+	bool bOK =    f_open (&File, pPath, FA_READ | FA_OPEN_EXISTING) == FR_OK
+		   && f_lseek (&File, nOffset) == FR_OK;
+	Result.nOpenCommands = CFatFsImage::GetStats ().nReadCommands;
+
+	TFileExtent Extent;
+	if (   bOK
+	    && bTryDirect
+	    && FileGetExtent (&File, nOffset, rImage.size (), &Extent))
+	{
+		Result.bDirect = true;
+		bOK = ReadDirect (&Extent, Staging, rImage.size ());
+	}
+	else if (bOK)
+	{
+		bOK =    f_lseek (&File, nOffset) == FR_OK
+		      && ReadGeneric (&File, Staging, rImage.size ());
+	}
+
+	f_close (&File);
+
+	Result.fSeconds = std::chrono::duration<double> (std::chrono::steady_clock::now () - Start).count ();
+	Result.Stats = CFatFsImage::GetStats ();
+
+	Check (bOK, "load");
+	Check (memcmp (Staging, rImage.data (), rImage.size ()) == 0, "image loaded");
+
+	return Result;
+}
+
+int main (int argc, char **argv)
+{
+	unsigned nImageSize = 3500 * 1024;
+	unsigned nLatency = 150;
+	unsigned nBusRate = 22;
+	const char *pDirectory = "/tmp";
+
+	int nOption;
+	while (optind <= argc && (nOption = getopt (argc, argv, "s:l:b:d:")) != -1)
+	{
+		switch (nOption)
+		{
+		case 's':	nImageSize = strtoul (optarg, nullptr, 0) * 1024;	break;
+		case 'l':	nLatency = strtoul (optarg, nullptr, 0);		break;
+		case 'b':	nBusRate = strtoul (optarg, nullptr, 0);		break;
+		case 'd':	pDirectory = optarg;					break;
+
+		default:
+			optind = argc + 1;			// show usage
+			break;
+		}
+	}
+
+	if (   nImageSize == 0 || nImageSize > KERNEL_MAX_SIZE
+	    || nBusRate == 0 || optind != argc)
+	{
+		return Usage ("loadbench [-s image KB] [-l command latency us] [-b bus MB/s] [-d dir]");
+	}
+
+	// odd size, so the last sector is partial
+	std::vector<uint8_t> Image (nImageSize - 123);
+	std::mt19937 Random (1);
+	for (auto &rByte : Image)
+	{
+		rByte = Random ();
+	}
+
+	std::vector<uint8_t> Pack (PACK_OFFSET + Image.size () + 1000, 0);
+	memcpy (Pack.data () + PACK_OFFSET, Image.data (), Image.size ());
+
+	printf ("%u KB image, card: %u us per command, %u MB/s\n",
+		(unsigned) (Image.size () / 1024), nLatency, nBusRate);
+	printf ("%-36s %8s %8s %10s %10s\n", "", "commands", "sectors", "model MB/s", "host MB/s");
+
+	static const unsigned ClusterSectors[] = {8, 64};
+	for (unsigned nClusterSectors : ClusterSectors)
+	{
+		std::string Path = std::string (pDirectory) + "/loadbench.img";
+		CFatFsImage Disk (Path.c_str (), 64 * 1024 * 2, nClusterSectors);
+		Check (   Disk.AddDirectory ("SD:/minidexed")
+		       && Disk.AddDirectory ("SD:/fragmented")
+		       && Disk.AddFile ("SD:/synths8.pak", Pack.data (), Pack.size ())
+		       && Disk.AddFile ("SD:/minidexed/kernel8.img", Image.data (), Image.size ())
+		       && Disk.AddFile ("SD:/fragmented/kernel8.img", Image.data (), Image.size (), 3)
+		       && Disk.Finish (), "disk image");
+
+		FATFS FileSystem;
+		Check (f_mount (&FileSystem, "SD:", 1) == FR_OK, "mount");
+
+		struct
+		{
+			const char *pName;
+			const char *pPath;
+			FSIZE_t nOffset;
+			bool bContiguous;
+		}
+		Cases[] =
+		{
+			{"container",	"SD:/synths8.pak",		PACK_OFFSET,	true},
+			{"file",	"SD:/minidexed/kernel8.img",	0,		true},
+			{"fragmented",	"SD:/fragmented/kernel8.img",	0,		false}
+		};
+
+		for (const auto &rCase : Cases)
+		{
+			for (int bDirect = 0; bDirect <= 1; bDirect++)
+			{
+				TResult Result = Load (rCase.pPath, rCase.nOffset, Image, bDirect);
+				Check (Result.bDirect == (bDirect && rCase.bContiguous), "extent");
+
+				double fModel =   Result.Stats.nReadCommands * nLatency / 1e6
+						+ Result.Stats.nReadSectors * 512.0 / (nBusRate * 1e6);
+				double fMB = Image.size () / 1e6;
+
+				char Label[64];
+				snprintf (Label, sizeof Label, "%s, %u KB clusters, %s", rCase.pName,
+					  nClusterSectors / 2,
+					  bDirect ? (Result.bDirect ? "direct" : "fallback") : "f_read");
+				printf ("%-36s %8u %8u %10.1f %10.0f\n", Label, Result.Stats.nReadCommands,
+					Result.Stats.nReadSectors, fMB / fModel, fMB / Result.fSeconds);
+
+				if (Result.bDirect)
+				{
+					// one per chunk, the rest is FAT sectors for the extent
+					unsigned nChunks =   (Image.size () + CHAINLOAD_DIRECT_CHUNK_SIZE - 1)
+							   / CHAINLOAD_DIRECT_CHUNK_SIZE;
+					unsigned nFATSectors = Image.size () / (nClusterSectors * 512) / 128 + 2;
+					Check (  Result.Stats.nReadCommands - Result.nOpenCommands
+					       <= nChunks + nFATSectors, "direct commands");
+				}
+			}
+		}
+
+		f_mount (nullptr, "SD:", 0);
+	}
+
+	return CheckResult ();
+}
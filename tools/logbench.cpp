@@ -0,0 +1,343 @@
+//
+// logbench.cpp
+//
+// Host tool: checks the deferred logger of the boot menu (see
+// src/asynclog.h) and measures what a log call costs the caller, when it
+// is recorded into the ring, against writing it at once.
+//
+// The checks compare the formatted messages with printf(), exercise the
+// rate limiter and the full ring and let several threads log concurrently
+// while one thread drains. For the timing the Circle logger is modelled by
+// formatting the message and by the time to send it over the serial
+// console, which blocks the caller when written at once.
+//
+// usage: logbench [-n calls] [-t threads] [-b baud]
+//
+#include "../src/asynclog.h"
+#include "toolcheck.h"
+#include <circle/timer.h>
+#include <atomic>
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+LOGMODULE ("logbench");
+
+static std::atomic<unsigned> s_nClock (0);
+static std::atomic<unsigned> s_nClockStep (0);		// added on each read
+
+static std::string s_LastText;
+static unsigned s_nLines;
+static bool s_bRecord = true;
+
+static volatile unsigned s_nSink;	// keeps the timed work from being optimized away
+
+unsigned CTimer::GetClockTicks (void)
+{
+	return s_nClock.fetch_add (s_nClockStep, std::memory_order_relaxed);
+}
+
+void CLogger::Write (const char *pSource, TLogSeverity Severity, const char *pMessage, ...)
+{
+	char Buffer[ASYNC_LOG_TEXT_MAX + 64];
+
+	va_list Args;
+	va_start (Args, pMessage);
+	int nLength = vsnprintf (Buffer, sizeof Buffer, pMessage, Args);
+	va_end (Args);
+
+	s_nSink += nLength;
+	s_nLines++;
+
+	if (s_bRecord)
+	{
+		s_LastText = Buffer;
+	}
+}
+
+CLogger *CLogger::Get (void)
+{
+	static CLogger s_Logger;
+
+	return &s_Logger;
+}
+
+static std::string Printf (const char *pFormat, ...)
+{
+	char Buffer[ASYNC_LOG_TEXT_MAX];
+
+	va_list Args;
+	va_start (Args, pFormat);
+	vsnprintf (Buffer, sizeof Buffer, pFormat, Args);
+	va_end (Args);
+
+	return Buffer;
+}
+
+#define CHECK_FORMAT(format, ...)						\
+	do									\
+	{									\
+		LOGNOTE (format, __VA_ARGS__);					\
+		pLog->Flush ();							\
+		Check (s_LastText == Printf (format, __VA_ARGS__), format);	\
+	}									\
+	while (0)
+
+static void CheckFormat (CAsyncLog *pLog)
+{
+	const char *pNull = nullptr;
+	std::string Long (100, 'x');
+
+	CHECK_FORMAT ("%u synths (%s)", 42u, "scanned");
+	CHECK_FORMAT ("%-16s core %u  start %8u us  %8u us", "catalog", 0u, 123456u, 789u);
+	CHECK_FORMAT ("%d %i %5d|%-5d|%05d", -1, -2147483647 - 1, 42, 42, -42);
+	CHECK_FORMAT ("%x %X %08X %#x %o", 0xBEEFu, 0xBEEFu, 0x80000u, 255u, 8u);
+	CHECK_FORMAT ("%lu %llu %ld %lld", 4000000000ul, 1ull << 40, -5l, -(1ll << 40));
+	CHECK_FORMAT ("%.*s: Unsupported load address 0x%X", 4, "kernel8", 0x80000u);
+	CHECK_FORMAT ("%*u|%-*u|", 6, 12u, 6, 12u);
+	CHECK_FORMAT ("%c%c %3c", 'o', 'k', '!');
+	CHECK_FORMAT ("%.2f %e %g", 3.14159, 1.0e-9, 0.5f);
+	CHECK_FORMAT ("%u%% hit rate", 99u);
+	CHECK_FORMAT ("%p", (void *) 0x1234);
+	CHECK_FORMAT ("%s %s %s", "first", "second", "third");
+	CHECK_FORMAT ("%s", pNull);
+
+	// strings beyond ASYNC_LOG_STRINGS are cut or replaced by "..."
+	LOGNOTE ("%s|%s", Long.c_str (), "lost");
+	pLog->Flush ();
+	Check (s_LastText == Long.substr (0, ASYNC_LOG_STRINGS - 1) + "|...", "string space");
+
+	// arguments beyond ASYNC_LOG_ARGS are shown as '?'
+	LOGNOTE ("%u %u %u %u %u %u %u", 1u, 2u, 3u, 4u, 5u, 6u, 7u);
+	pLog->Flush ();
+	Check (s_LastText == "1 2 3 4 5 6 ?", "argument count");
+}
+
+static void CheckRateLimit (CAsyncLog *pLog)
+{
+	s_nClockStep = 0;
+
+	unsigned nLines = s_nLines;
+	for (unsigned i = 0; i < 3 * ASYNC_LOG_BURST; i++)
+	{
+		LOGWARN ("burst %u", i);
+	}
+	pLog->Flush ();
+	Check (s_nLines - nLines == ASYNC_LOG_BURST, "burst written");
+
+	// the next message after the window reports the suppressed ones
+	s_nClock += ASYNC_LOG_WINDOW;
+	for (unsigned i = 0; i < 2; i++)
+	{
+		LOGWARN ("burst %u", i);
+	}
+	pLog->Flush ();
+	Check (s_LastText == "burst 1", "suppressed reported once");
+	Check (pLog->GetSuppressed () == 2 * ASYNC_LOG_BURST, "suppressed total");
+
+	// the window of the last message starts later
+	s_nClock += ASYNC_LOG_WINDOW;
+	for (unsigned i = 0; i <= ASYNC_LOG_BURST + 5; i++)
+	{
+		if (i == ASYNC_LOG_BURST + 5)
+		{
+			s_nClock += ASYNC_LOG_WINDOW;
+		}
+
+		LOGWARN ("again %u", i);
+	}
+	s_nClock += 20000;
+	pLog->Flush ();
+	Check (s_LastText == Printf ("again %u (5 suppressed before) (deferred 20 ms)",
+				     ASYNC_LOG_BURST + 5), "suppressed count");
+}
+
+static void CheckFull (CAsyncLog *pLog)
+{
+	s_nClockStep = ASYNC_LOG_WINDOW;		// no rate limit
+
+	unsigned nLines = s_nLines;
+	for (unsigned i = 0; i < ASYNC_LOG_EVENTS + 10; i++)
+	{
+		LOGDBG ("fill %u", i);
+	}
+	Check (!pLog->IsEmpty (), "not empty");
+	pLog->Flush ();
+	Check (pLog->IsEmpty (), "empty");
+	Check (s_nLines - nLines == ASYNC_LOG_EVENTS, "ring full");
+	Check (s_LastText.find (Printf ("fill %u ", ASYNC_LOG_EVENTS - 1)) == 0, "oldest kept");
+	Check (pLog->GetDropped () == 10, "dropped");
+}
+
+static void Producer (unsigned nThread, unsigned nCalls)
+{
+	for (unsigned i = 0; i < nCalls; i++)
+	{
+		LOGDBG ("thread %u message %u", nThread, i);
+
+		std::this_thread::yield ();
+	}
+}
+
+// the messages of each thread must be written in order, the others are
+// dropped, when the ring is full
+static void CheckThreads (CAsyncLog *pLog, unsigned nThreads, unsigned nCalls)
+{
+	s_nClockStep = ASYNC_LOG_WINDOW;
+
+	std::atomic<bool> bDone (false);
+	std::vector<unsigned> Next (nThreads, 0);
+	unsigned nReceived = 0;
+	bool bOrdered = true;
+
+	unsigned nLines = s_nLines;
+	unsigned nDropped = pLog->GetDropped ();
+	std::thread Consumer ([&]
+	{
+		for (;;)
+		{
+			bool bLast = bDone.load ();
+
+			unsigned nLine = s_nLines;
+			while (pLog->Drain (1))
+			{
+				unsigned nThread, nMessage;
+				if (   s_nLines != nLine + 1
+				    || sscanf (s_LastText.c_str (), "thread %u message %u",
+					       &nThread, &nMessage) != 2
+				    || nThread >= nThreads
+				    || nMessage < Next[nThread])
+				{
+					bOrdered = false;
+				}
+				else
+				{
+					Next[nThread] = nMessage + 1;
+				}
+
+				nReceived++;
+				nLine = s_nLines;
+			}
+
+			if (bLast)
+			{
+				break;
+			}
+
+			std::this_thread::yield ();
+		}
+	});
+
+	std::vector<std::thread> Producers;
+	for (unsigned i = 0; i < nThreads; i++)
+	{
+		Producers.emplace_back (Producer, i, nCalls);
+	}
+
+	for (std::thread &rThread : Producers)
+	{
+		rThread.join ();
+	}
+
+	bDone = true;
+	Consumer.join ();
+
+	printf ("%u threads: %u of %u messages written\n", nThreads, nReceived, nThreads * nCalls);
+
+	Check (bOrdered, "order per thread");
+	Check (s_nLines - nLines == nReceived, "messages written");
+	Check (nReceived + pLog->GetDropped () - nDropped == nThreads * nCalls, "messages lost");
+}
+
+static double TimeCalls (CAsyncLog *pLog, unsigned nCalls, bool bAsync)
+{
+	s_nClockStep = ASYNC_LOG_WINDOW;
+	s_bRecord = false;
+
+	if (bAsync)
+	{
+		pLog->Start ();
+	}
+	else
+	{
+		pLog->Stop ();
+	}
+
+	double fTotal = 0.0;
+	for (unsigned nDone = 0; nDone < nCalls; nDone += ASYNC_LOG_EVENTS / 2)
+	{
+		auto Start = std::chrono::steady_clock::now ();
+
+		for (unsigned i = 0; i < ASYNC_LOG_EVENTS / 2; i++)
+		{
+			LOGNOTE ("%-16s core %u  start %8u us  %8u us", "catalog", 0u, i, nDone);
+		}
+
+		fTotal += std::chrono::duration<double, std::nano> (
+				std::chrono::steady_clock::now () - Start).count ();
+
+		pLog->Flush ();
+	}
+
+	s_bRecord = true;
+	pLog->Start ();
+
+	return fTotal / nCalls;
+}
+
+int main (int argc, char **argv)
+{
+	unsigned nCalls = 1000000;
+	unsigned nThreads = 4;
+	unsigned nBaud = 115200;
+
+	int nOption;
+	while (optind <= argc && (nOption = getopt (argc, argv, "n:t:b:")) != -1)
+	{
+		switch (nOption)
+		{
+		case 'n':	nCalls = strtoul (optarg, nullptr, 0);		break;
+		case 't':	nThreads = strtoul (optarg, nullptr, 0);	break;
+		case 'b':	nBaud = strtoul (optarg, nullptr, 0);		break;
+
+		default:
+			optind = argc + 1;			// show usage
+			break;
+		}
+	}
+
+	if (nCalls == 0 || nThreads == 0 || nBaud == 0 || optind != argc)
+	{
+		return Usage ("logbench [-n calls] [-t threads] [-b baud]");
+	}
+
+	static CAsyncLog Log;
+	Log.Start ();
+
+	CheckFormat (&Log);
+	CheckRateLimit (&Log);
+	CheckFull (&Log);
+	CheckThreads (&Log, nThreads, nCalls / nThreads);
+
+	double fAsync = TimeCalls (&Log, nCalls, true);
+	double fSync = TimeCalls (&Log, nCalls, false);
+
+	// "00:00:01.23 bootprofile: " and CR LF around a typical message,
+	// 10 bits per character
+	unsigned nChars = 25 + strlen (Printf ("%-16s core %u  start %8u us  %8u us",
+					       "catalog", 0u, 0u, 0u).c_str ()) + 2;
+	double fSerial = nChars * 10 * 1e9 / nBaud;
+
+	printf ("%u calls per mode\n", nCalls);
+	printf ("%-28s %12.0f ns\n", "deferred", fAsync);
+	printf ("%-28s %12.0f ns\n", "at once, formatting", fSync);
+	printf ("%-28s %12.0f ns\n", "at once, with serial", fSync + fSerial);
+
+	return CheckResult ();
+}
@@ -0,0 +1,217 @@
+//
+// lz4encoder.cpp
+//
+#include "lz4encoder.h"
+#include <cstring>
+#include <vector>
+
+#define MIN_MATCH	4
+#define LAST_LITERALS	5		// the block ends with at least 5 literals
+#define MATCH_LIMIT	12		// no match starts in the last 12 bytes
+#define MAX_OFFSET	65535
+#define HASH_BITS	16
+
+static inline uint32_t Read32 (const uint8_t *p)
+{
+	uint32_t nValue;
+	memcpy (&nValue, p, sizeof nValue);
+
+	return nValue;
+}
+
+static inline unsigned Hash (const uint8_t *p)
+{
+	return (Read32 (p) * 2654435761U) >> (32 - HASH_BITS);
+}
+
+class CBlockWriter
+{
+public:
+	CBlockWriter (uint8_t *pDest, size_t nDestSize)
+	:	m_pOut (pDest), m_pEnd (pDest + nDestSize), m_pStart (pDest), m_bOverflow (false)
+	{
+	}
+
+	void Sequence (const uint8_t *pLiterals, size_t nLiterals, size_t nOffset, size_t nMatch)
+	{
+		uint8_t *pToken = Reserve (1);
+		if (pToken == nullptr)
+		{
+			return;
+		}
+
+		*pToken = (nLiterals < 15 ? nLiterals : 15) << 4;
+		if (nLiterals >= 15)
+		{
+			Length (nLiterals - 15);
+		}
+
+		uint8_t *pOut = Reserve (nLiterals);
+		if (pOut == nullptr)
+		{
+			return;
+		}
+		memcpy (pOut, pLiterals, nLiterals);
+
+		if (nMatch == 0)
+		{
+			return;			// last sequence
+		}
+
+		pOut = Reserve (2);
+		if (pOut == nullptr)
+		{
+			return;
+		}
+		pOut[0] = nOffset & 0xFF;
+		pOut[1] = nOffset >> 8;
+
+		nMatch -= MIN_MATCH;
+		*pToken |= nMatch < 15 ? nMatch : 15;
+		if (nMatch >= 15)
+		{
+			Length (nMatch - 15);
+		}
+	}
+
+	size_t GetSize (void) const
+	{
+		return m_bOverflow ? 0 : m_pOut - m_pStart;
+	}
+
+private:
+	uint8_t *Reserve (size_t nBytes)
+	{
+		if (m_bOverflow || (size_t) (m_pEnd - m_pOut) < nBytes)
+		{
+			m_bOverflow = true;
+
+			return nullptr;
+		}
+
+		uint8_t *pOut = m_pOut;
+		m_pOut += nBytes;
+
+		return pOut;
+	}
+
+	void Length (size_t nLength)
+	{
+		for (; nLength >= 255; nLength -= 255)
+		{
+			uint8_t *pOut = Reserve (1);
+			if (pOut == nullptr)
+			{
+				return;
+			}
+			*pOut = 255;
+		}
+
+		uint8_t *pOut = Reserve (1);
+		if (pOut != nullptr)
+		{
+			*pOut = nLength;
+		}
+	}
+
+private:
+	uint8_t *m_pOut;
+	uint8_t *m_pEnd;
+	uint8_t *m_pStart;
+	bool m_bOverflow;
+};
+
+size_t LZ4Compress (const uint8_t *pSource, size_t nSourceSize,
+		    uint8_t *pDest, size_t nDestSize, unsigned nLevel)
+{
+	if (nLevel < LZ4_LEVEL_MIN)
+	{
+		nLevel = LZ4_LEVEL_MIN;
+	}
+	else if (nLevel > LZ4_LEVEL_MAX)
+	{
+		nLevel = LZ4_LEVEL_MAX;
+	}
+
+	unsigned nMaxProbes = 1U << (nLevel - 1);	// 1..256
+
+	// position + 1 of the last occurrence of a hash, 0 if none, and the
+	// chain of earlier positions with the same hash
+	std::vector<uint32_t> Head (1U << HASH_BITS, 0);
+	std::vector<uint32_t> Chain (nSourceSize, 0);
+
+	CBlockWriter Writer (pDest, nDestSize);
+
+	size_t nAnchor = 0;
+	size_t nPos = 0;
+
+	auto Insert = [&] (size_t nAt)
+	{
+		unsigned nHash = Hash (pSource + nAt);
+		Chain[nAt] = Head[nHash];
+		Head[nHash] = nAt + 1;
+	};
+
+	if (nSourceSize >= MATCH_LIMIT + 1)
+	{
+		size_t nMatchLimit = nSourceSize - MATCH_LIMIT;
+		size_t nEndLimit = nSourceSize - LAST_LITERALS;
+
+		while (nPos < nMatchLimit)
+		{
+			size_t nBestLength = 0;
+			size_t nBestOffset = 0;
+
+			uint32_t nCandidate = Head[Hash (pSource + nPos)];
+			for (unsigned nProbe = 0; nCandidate != 0 && nProbe < nMaxProbes; nProbe++)
+			{
+				size_t nFrom = nCandidate - 1;
+				if (nPos - nFrom > MAX_OFFSET)
+				{
+					break;
+				}
+
+				if (Read32 (pSource + nFrom) == Read32 (pSource + nPos))
+				{
+					size_t nLength = MIN_MATCH;
+					while (   nPos + nLength < nEndLimit
+					       && pSource[nFrom + nLength] == pSource[nPos + nLength])
+					{
+						nLength++;
+					}
+
+					if (nLength > nBestLength)
+					{
+						nBestLength = nLength;
+						nBestOffset = nPos - nFrom;
+					}
+				}
+
+				nCandidate = Chain[nFrom];
+			}
+
+			Insert (nPos);
+
+			if (nBestLength < MIN_MATCH)
+			{
+				nPos++;
+
+				continue;
+			}
+
+			Writer.Sequence (pSource + nAnchor, nPos - nAnchor, nBestOffset, nBestLength);
+
+			for (size_t i = 1; i < nBestLength && nPos + i < nMatchLimit; i++)
+			{
+				Insert (nPos + i);
+			}
+
+			nPos += nBestLength;
+			nAnchor = nPos;
+		}
+	}
+
+	Writer.Sequence (pSource + nAnchor, nSourceSize - nAnchor, 0, 0);
+
+	return Writer.GetSize ();
+}
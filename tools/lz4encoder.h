@@ -0,0 +1,18 @@
+//
+// lz4encoder.h
+//
+// LZ4 block compressor for the host tools. The level (1..9) sets how many
+// earlier positions with the same hash are tried per match, level 1 is a
+// single probe like the LZ4 fast mode.
+//
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#define LZ4_LEVEL_MIN	1
+#define LZ4_LEVEL_MAX	9
+
+// returns the size of the block, or 0 if it does not fit into nDestSize
+size_t LZ4Compress (const uint8_t *pSource, size_t nSourceSize,
+		    uint8_t *pDest, size_t nDestSize, unsigned nLevel);
@@ -0,0 +1,302 @@
+//
+// menustagesim.cpp
+//
+// Host tool: runs the bring-up stages of the menu (see src/menustages.h)
+// with CBootStages and mock stages, which take the modelled time of the
+// real ones with an injected random latency, once on one thread like the
+// single core build does (all stages in table order on core 0) and once on
+// threads in place of cores 0 and 1, where USB enumerates on core 1. The
+// critical path of the stage graph is computed for the same latencies and
+// reported along with the measured durations and their reduction.
+//
+// It checks, that each stage runs once and only after its dependencies,
+// that the stages of both cores overlap and that the runs on two cores
+// take about their critical path and are faster than the ones on one core
+// on average. The times are scaled down to keep the runs short.
+//
+// usage: menustagesim [-r rounds] [-j jitter %] [-s scale] [-v]
+//
+#include "../src/menustages.h"
+#include "toolcheck.h"
+#include <circle/logger.h>
+#include <circle/timer.h>
+#include <atomic>
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include <unistd.h>
+
+// modelled duration of the stages on the target in us (RPi 3, ST7789,
+// one USB MIDI device), as in autobootsim
+static const unsigned s_Duration[BootStageCount] =
+{
+	3000,			// timer/gpio/i2c
+	40000,			// mount
+	8000,			// config, from the cache
+	500,			// mode, reading the state and sampling the button
+	60000,			// screen
+	15000,			// catalog, from the pack index
+	50,			// midi actions
+	500,			// spi
+	120000,			// lcd, reset and init sequence
+	500,			// encoder/buttons
+	300,			// serial
+	1200000			// usb, enumeration
+};
+
+static bool s_bVerbose;
+static unsigned s_nScale = 20;
+
+static const auto s_Start = std::chrono::steady_clock::now ();
+
+unsigned CTimer::GetClockTicks (void)
+{
+	return std::chrono::duration_cast<std::chrono::microseconds> (
+		std::chrono::steady_clock::now () - s_Start).count () + 1;
+}
+
+void CLogger::Write (const char *pSource, TLogSeverity Severity, const char *pMessage, ...)
+{
+	if (s_bVerbose)
+	{
+		va_list Args;
+		va_start (Args, pMessage);
+		printf ("  %s: ", pSource);
+		vprintf (pMessage, Args);
+		printf ("\n");
+		va_end (Args);
+	}
+}
+
+CLogger *CLogger::Get (void)
+{
+	static CLogger s_Logger;
+
+	return &s_Logger;
+}
+
+// used by CBootStages
+unsigned CBootProfiler::Begin (const char *pName)
+{
+	return 0;
+}
+
+void CBootProfiler::End (unsigned hStage)
+{
+}
+
+class CSimulation
+{
+public:
+	CSimulation (const unsigned *pDuration)
+	:	m_Stages (MenuStages, BootStageCount, StageHandler, this, nullptr),
+		m_pDuration (pDuration)
+	{
+		for (unsigned i = 0; i < BootStageCount; i++)
+		{
+			m_nRuns[i] = 0;
+			m_nStart[i] = 0;
+			m_nEnd[i] = 0;
+		}
+	}
+
+	// like CKernel, returns the modelled time until all stages are done in us
+	unsigned Run (bool bMultiCore)
+	{
+		unsigned nStart = CTimer::GetClockTicks ();
+
+		if (bMultiCore)
+		{
+			std::thread Core1 ([this] { Check (m_Stages.Run (1), "core 1"); });
+			Check (m_Stages.Run (0), "core 0");
+			Core1.join ();
+		}
+		else
+		{
+			Check (m_Stages.Run (0, true), "single core");
+		}
+
+		Check (m_Stages.IsComplete (), "complete");
+
+		return (CTimer::GetClockTicks () - nStart) * s_nScale;
+	}
+
+	void CheckStages (void) const
+	{
+		for (unsigned i = 0; i < BootStageCount; i++)
+		{
+			Check (m_nRuns[i] == 1, "runs once");
+
+			for (unsigned j = 0; j < i; j++)
+			{
+				if (MenuStages[i].nDependencies & BOOT_STAGE (j))
+				{
+					Check (m_nEnd[j] <= m_nStart[i], "after its dependencies");
+				}
+			}
+		}
+	}
+
+	// some stages of different cores did run at the same time
+	bool IsParallel (void) const
+	{
+		for (unsigned i = 0; i < BootStageCount; i++)
+		{
+			for (unsigned j = 0; j < i; j++)
+			{
+				if (   MenuStages[i].nCore != MenuStages[j].nCore
+				    && m_nStart[i] < m_nEnd[j]
+				    && m_nStart[j] < m_nEnd[i])
+				{
+					return true;
+				}
+			}
+		}
+
+		return false;
+	}
+
+private:
+	static bool StageHandler (unsigned nStage, void *pParam)
+	{
+		CSimulation *pThis = static_cast<CSimulation *> (pParam);
+
+		pThis->m_nRuns[nStage]++;
+		pThis->m_nStart[nStage] = CTimer::GetClockTicks ();
+
+		std::this_thread::sleep_for (
+			std::chrono::microseconds (pThis->m_pDuration[nStage] / s_nScale));
+
+		pThis->m_nEnd[nStage] = CTimer::GetClockTicks ();
+
+		return true;
+	}
+
+private:
+	CBootStages m_Stages;
+	const unsigned *m_pDuration;
+
+	std::atomic<unsigned> m_nRuns[BootStageCount];
+	unsigned m_nStart[BootStageCount];
+	unsigned m_nEnd[BootStageCount];
+};
+
+// longest path through the stage graph, the stages of a core run in table
+// order, *pSum is set to the time on one core
+static unsigned GetCriticalPath (const unsigned *pDuration, unsigned *pSum)
+{
+	unsigned nFinish[BootStageCount];
+	unsigned nLongest = 0;
+	*pSum = 0;
+
+	for (unsigned i = 0; i < BootStageCount; i++)
+	{
+		unsigned nStart = 0;
+		for (unsigned j = 0; j < i; j++)
+		{
+			if (   (   (MenuStages[i].nDependencies & BOOT_STAGE (j))
+			        || MenuStages[i].nCore == MenuStages[j].nCore)
+			    && nFinish[j] > nStart)
+			{
+				nStart = nFinish[j];
+			}
+		}
+
+		nFinish[i] = nStart + pDuration[i];
+		if (nFinish[i] > nLongest)
+		{
+			nLongest = nFinish[i];
+		}
+
+		*pSum += pDuration[i];
+	}
+
+	return nLongest;
+}
+
+int main (int argc, char **argv)
+{
+	unsigned nRounds = 5;
+	unsigned nJitter = 30;
+
+	int nOption;
+	while (optind <= argc && (nOption = getopt (argc, argv, "r:j:s:v")) != -1)
+	{
+		switch (nOption)
+		{
+		case 'r':	nRounds = strtoul (optarg, nullptr, 0);		break;
+		case 'j':	nJitter = strtoul (optarg, nullptr, 0);		break;
+		case 's':	s_nScale = strtoul (optarg, nullptr, 0);	break;
+		case 'v':	s_bVerbose = true;				break;
+
+		default:
+			optind = argc + 1;			// show usage
+			break;
+		}
+	}
+
+	if (nRounds == 0 || nJitter >= 100 || s_nScale == 0 || optind != argc)
+	{
+		return Usage ("menustagesim [-r rounds] [-j jitter %] [-s scale] [-v]");
+	}
+
+	unsigned nSum;
+	unsigned nCriticalPath = GetCriticalPath (s_Duration, &nSum);
+	printf ("%-28s %8u us (%u us on one core, %u%% shorter)\n", "critical path, modelled",
+		nCriticalPath, nSum, 100 - nCriticalPath * 100 / nSum);
+	Check (nCriticalPath < nSum, "shorter on two cores");
+
+	printf ("%-10s %10s %10s %10s %10s\n", "round", "one core", "two cores", "critical", "shorter");
+
+	std::mt19937 Random (1);
+	unsigned nTotal[2] = {0, 0};
+	unsigned nTotalPath = 0;
+	for (unsigned nRound = 0; nRound < nRounds; nRound++)
+	{
+		// each stage takes its modelled time +/- nJitter percent
+		unsigned Duration[BootStageCount];
+		for (unsigned i = 0; i < BootStageCount; i++)
+		{
+			int nPercent = (int) (Random () % (2 * nJitter + 1)) - (int) nJitter;
+			Duration[i] = s_Duration[i] * (100 + nPercent) / 100;
+		}
+
+		unsigned nRoundSum;
+		unsigned nRoundPath = GetCriticalPath (Duration, &nRoundSum);
+
+		unsigned nMeasured[2];
+		for (unsigned nMultiCore = 0; nMultiCore <= 1; nMultiCore++)
+		{
+			CSimulation Simulation (Duration);
+			nMeasured[nMultiCore] = Simulation.Run (nMultiCore);
+			Simulation.CheckStages ();
+
+			if (nMultiCore)
+			{
+				Check (Simulation.IsParallel (), "stages in parallel");
+			}
+
+			nTotal[nMultiCore] += nMeasured[nMultiCore];
+		}
+
+		// the sleeps take at least their time, the rest is the host
+		Check (nMeasured[0] >= nRoundSum * 99 / 100, "one core takes the sum");
+		Check (nMeasured[1] >= nRoundPath * 99 / 100, "two cores take the critical path");
+		nTotalPath += nRoundPath;
+
+		printf ("%-10u %10u %10u %10u %9d%%\n", nRound + 1, nMeasured[0], nMeasured[1],
+			nRoundPath, 100 - (int) (nMeasured[1] * 100ULL / nMeasured[0]));
+	}
+
+	printf ("%-10s %10u %10u %10s %9d%%\n", "mean", nTotal[0] / nRounds, nTotal[1] / nRounds,
+		"", 100 - (int) (nTotal[1] * 100ULL / nTotal[0]));
+
+	// a single round may be delayed by the host
+	Check (nTotal[1] < nTotal[0], "faster on two cores");
+	Check (nTotal[1] < nTotalPath * 5 / 4, "about the critical path");
+
+	return CheckResult ();
+}
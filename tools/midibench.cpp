@@ -0,0 +1,199 @@
+//
+// midibench.cpp
+//
+// Host tool: measures the cost of dispatching a MIDI message to a menu
+// action with the table of src/midiactions.h and with the former chain of
+// comparisons, which searched the MIDI notes of the synths linearly. The
+// messages are a random mix of notes, controllers, program changes and
+// clock, like a keyboard or sequencer connected while the menu is shown.
+//
+// usage: midibench [-n messages] [-s seed]
+//
+#include "../src/midiactions.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include <unistd.h>
+
+#define BUTTON_NEXT	47		// defaults of minidexed.ini
+#define BUTTON_PREV	46
+#define BUTTON_SELECT	49
+
+static const unsigned s_Counts[] = {3, 50, 500};
+
+struct TMessage
+{
+	uint8_t Data[3];
+	unsigned nLength;
+};
+
+// the former HandleMIDIPacket()
+class CChain
+{
+public:
+	CChain (unsigned nSynths)
+	{
+		for (unsigned i = 0; i < nSynths; i++)
+		{
+			m_Notes.push_back (i < 128 ? i : 0xFF);
+		}
+	}
+
+	TMIDIAction Lookup (const uint8_t *pMessage, unsigned nLength, unsigned *pParam) const
+	{
+		uint8_t uchStatus = pMessage[0] & 0xF0;
+		if (uchStatus == 0xB0 && nLength >= 3)
+		{
+			if (pMessage[2] > 0)
+			{
+				if (pMessage[1] == BUTTON_NEXT)		return MIDIActionNext;
+				else if (pMessage[1] == BUTTON_PREV)	return MIDIActionPrev;
+				else if (pMessage[1] == BUTTON_SELECT)	return MIDIActionSelect;
+			}
+		}
+		else if (uchStatus == 0x90 && nLength >= 3 && pMessage[2] > 0)
+		{
+			for (unsigned i = 0; i < m_Notes.size (); i++)
+			{
+				if (m_Notes[i] == pMessage[1])
+				{
+					*pParam = i;
+
+					return MIDIActionLaunch;
+				}
+			}
+		}
+
+		return MIDIActionNone;
+	}
+
+private:
+	std::vector<uint8_t> m_Notes;
+};
+
+static void MakeTable (unsigned nSynths, CMIDIActionTable &rTable)
+{
+	rTable.Map (MIDIActionTypeControl, MIDI_ACTION_OMNI, BUTTON_NEXT, MIDIActionNext);
+	rTable.Map (MIDIActionTypeControl, MIDI_ACTION_OMNI, BUTTON_PREV, MIDIActionPrev);
+	rTable.Map (MIDIActionTypeControl, MIDI_ACTION_OMNI, BUTTON_SELECT, MIDIActionSelect);
+
+	for (unsigned i = 0; i < nSynths && i < 128; i++)
+	{
+		rTable.Map (MIDIActionTypeNoteOn, MIDI_ACTION_OMNI, i, MIDIActionLaunch, i);
+	}
+}
+
+static void MakeMessages (unsigned nCount, unsigned nSeed, std::vector<TMessage> &rMessages)
+{
+	std::mt19937 Random (nSeed);
+	std::uniform_int_distribution<unsigned> Byte (0, 127);
+	std::uniform_int_distribution<unsigned> Kind (0, 9);
+
+	rMessages.resize (nCount);
+	for (TMessage &rMessage : rMessages)
+	{
+		uint8_t uchChannel = Byte (Random) & 0x0F;
+
+		switch (Kind (Random))
+		{
+		case 0: case 1: case 2: case 3:			// note on
+			rMessage = {{(uint8_t) (0x90 | uchChannel), (uint8_t) Byte (Random),
+				     (uint8_t) Byte (Random)}, 3};
+			break;
+
+		case 4: case 5:					// note off
+			rMessage = {{(uint8_t) (0x80 | uchChannel), (uint8_t) Byte (Random), 0}, 3};
+			break;
+
+		case 6: case 7:					// control change
+			rMessage = {{(uint8_t) (0xB0 | uchChannel), (uint8_t) Byte (Random),
+				     (uint8_t) Byte (Random)}, 3};
+			break;
+
+		case 8:						// program change
+			rMessage = {{(uint8_t) (0xC0 | uchChannel), (uint8_t) Byte (Random), 0}, 2};
+			break;
+
+		default:					// timing clock
+			rMessage = {{0xF8, 0, 0}, 1};
+			break;
+		}
+	}
+}
+
+template <class TDispatcher>
+static double Measure (const TDispatcher &rDispatcher, const std::vector<TMessage> &rMessages,
+		       unsigned *pActions)
+{
+	unsigned nActions = 0;
+
+	auto Start = std::chrono::steady_clock::now ();
+
+	for (const TMessage &rMessage : rMessages)
+	{
+		unsigned nParam = 0;
+		if (rDispatcher.Lookup (rMessage.Data, rMessage.nLength, &nParam) != MIDIActionNone)
+		{
+			nActions += 1 + nParam;
+		}
+	}
+
+	std::chrono::duration<double> Time = std::chrono::steady_clock::now () - Start;
+
+	*pActions = nActions;
+
+	return Time.count () * 1e9 / rMessages.size ();
+}
+
+int main (int argc, char **argv)
+{
+	unsigned nMessages = 10000000;
+	unsigned nSeed = 1;
+
+	int nOption;
+	while (optind <= argc && (nOption = getopt (argc, argv, "n:s:")) != -1)
+	{
+		switch (nOption)
+		{
+		case 'n':	nMessages = strtoul (optarg, nullptr, 0);	break;
+		case 's':	nSeed = strtoul (optarg, nullptr, 0);		break;
+
+		default:
+			optind = argc + 1;			// show usage
+			break;
+		}
+	}
+
+	if (nMessages == 0 || optind != argc)
+	{
+		fprintf (stderr, "usage: midibench [-n messages] [-s seed]\n");
+
+		return EXIT_FAILURE;
+	}
+
+	std::vector<TMessage> Messages;
+	MakeMessages (nMessages, nSeed, Messages);
+
+	printf ("%u messages\n", nMessages);
+	printf ("%-7s %12s %12s\n", "synths", "table ns", "chain ns");
+
+	for (unsigned nSynths : s_Counts)
+	{
+		static CMIDIActionTable Table;
+		Table.Clear ();
+		MakeTable (nSynths, Table);
+
+		CChain Chain (nSynths);
+
+		unsigned nTableActions, nChainActions;
+		double fTable = Measure (Table, Messages, &nTableActions);
+		double fChain = Measure (Chain, Messages, &nChainActions);
+
+		printf ("%-7u %12.2f %12.2f%s\n", nSynths, fTable, fChain,
+			nTableActions != nChainActions ? "  (results differ)" : "");
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,327 @@
+//
+// midiparsercheck.cpp
+//
+// Host tool: checks the MIDI byte parser of the boot menu (see
+// src/midiparser.h) with hand written cases (running status, SysEx, realtime
+// bytes interleaved anywhere, system common messages, undefined and orphan
+// bytes, oversized SysEx) and with a generated performance, which has clock
+// and active sensing bytes inside the other messages, running status and
+// voice dumps. The performance must be parsed to the messages it was made
+// of, in one piece and split at random points.
+//
+// The throughput of Parse() is measured on the performance and on recorded
+// MIDI dumps (raw bytes, e.g. .syx files), if they are given.
+//
+// usage: midiparsercheck [-n performance KB] [-r rounds] [dump ...]
+//
+#include "../src/midiparser.h"
+#include "toolcheck.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include <unistd.h>
+
+typedef std::vector<u8> TMessage;
+typedef std::vector<u8> TBuffer;
+
+static std::vector<TMessage> s_Messages;
+static unsigned s_nMessages;
+
+static void MessageHandler (unsigned nPort, const u8 *pMessage, unsigned nLength, void *pParam)
+{
+	Check (nPort == 5, "port");
+	s_Messages.emplace_back (pMessage, pMessage + nLength);
+}
+
+static void CountHandler (unsigned nPort, const u8 *pMessage, unsigned nLength, void *pParam)
+{
+	s_nMessages++;
+}
+
+static bool ReadFile (const char *pFileName, TBuffer &rContent)
+{
+	FILE *pFile = fopen (pFileName, "rb");
+	if (pFile == nullptr)
+	{
+		perror (pFileName);
+
+		return false;
+	}
+
+	u8 Buffer[4096];
+	size_t nRead;
+	while ((nRead = fread (Buffer, 1, sizeof Buffer, pFile)) > 0)
+	{
+		rContent.insert (rContent.end (), Buffer, Buffer + nRead);
+	}
+
+	fclose (pFile);
+
+	return true;
+}
+
+static std::vector<TMessage> Parse (CMIDIParser *pParser, const TBuffer &rData)
+{
+	s_Messages.clear ();
+	pParser->Parse (rData.data (), rData.size ());
+
+	return s_Messages;
+}
+
+static void CheckCase (const char *pName, const TBuffer &rInput,
+		       const std::vector<TMessage> &rExpected, unsigned nSysExOverflows = 0)
+{
+	CMIDIParser Parser;
+	Parser.RegisterMessageHandler (MessageHandler, nullptr, 5);
+
+	Check (Parse (&Parser, rInput) == rExpected, pName);
+	Check (Parser.GetSysExOverflows () == nSysExOverflows, pName);
+}
+
+static void CheckCases (void)
+{
+	CheckCase ("note on", {0x90, 0x3C, 0x64}, {{0x90, 0x3C, 0x64}});
+	CheckCase ("running status", {0x90, 0x3C, 0x64, 0x3E, 0x64, 0x40, 0x00},
+		   {{0x90, 0x3C, 0x64}, {0x90, 0x3E, 0x64}, {0x90, 0x40, 0x00}});
+	CheckCase ("running status, two bytes", {0xC0, 0x05, 0x06}, {{0xC0, 0x05}, {0xC0, 0x06}});
+	CheckCase ("realtime inside", {0x90, 0xF8, 0x3C, 0xFE, 0x64},
+		   {{0xF8}, {0xFE}, {0x90, 0x3C, 0x64}});
+	CheckCase ("realtime keeps running status", {0x90, 0x3C, 0x64, 0xF8, 0x3E, 0x64},
+		   {{0x90, 0x3C, 0x64}, {0xF8}, {0x90, 0x3E, 0x64}});
+	CheckCase ("status interrupts", {0x90, 0x3C, 0x80, 0x3C, 0x00}, {{0x80, 0x3C, 0x00}});
+	CheckCase ("orphan data", {0x3C, 0x64, 0x90, 0x3C, 0x64}, {{0x90, 0x3C, 0x64}});
+	CheckCase ("undefined", {0xF4, 0xF9, 0xFD, 0x90, 0x3C, 0xF5, 0x3C, 0x64}, {});
+	CheckCase ("system common", {0xF2, 0x01, 0x02, 0xF3, 0x07, 0xF1, 0x30, 0xF6},
+		   {{0xF2, 0x01, 0x02}, {0xF3, 0x07}, {0xF1, 0x30}, {0xF6}});
+	CheckCase ("system common cancels running status",
+		   {0x90, 0x3C, 0x64, 0xF3, 0x01, 0x3E, 0x64}, {{0x90, 0x3C, 0x64}, {0xF3, 0x01}});
+	CheckCase ("sysex", {0xF0, 0x43, 0x10, 0x01, 0xF7}, {{0xF0, 0x43, 0x10, 0x01, 0xF7}});
+	CheckCase ("realtime inside sysex", {0xF0, 0x43, 0xF8, 0x10, 0xF7},
+		   {{0xF8}, {0xF0, 0x43, 0x10, 0xF7}});
+	CheckCase ("sysex ended by status", {0xF0, 0x43, 0x10, 0x90, 0x3C, 0x64},
+		   {{0xF0, 0x43, 0x10}, {0x90, 0x3C, 0x64}});
+	CheckCase ("end without sysex", {0xF7, 0x90, 0x3C, 0x64}, {{0x90, 0x3C, 0x64}});
+
+	// the largest SysEx, which fits, and one byte more
+	for (unsigned nData = MIDI_SYSEX_MAX_SIZE - 2; nData <= MIDI_SYSEX_MAX_SIZE - 1; nData++)
+	{
+		TBuffer SysEx (nData + 2, 0x55);
+		SysEx.front () = 0xF0;
+		SysEx.back () = 0xF7;
+		TBuffer Input = SysEx;
+		Input.insert (Input.end (), {0xB0, 0x07, 0x7F});
+
+		bool bFits = SysEx.size () <= MIDI_SYSEX_MAX_SIZE;
+		std::vector<TMessage> Expected;
+		if (bFits)
+		{
+			Expected.push_back (SysEx);
+		}
+		Expected.push_back ({0xB0, 0x07, 0x7F});
+
+		CheckCase (bFits ? "largest sysex" : "oversized sysex", Input, Expected, !bFits);
+	}
+
+	CMIDIParser Parser;
+	Parser.RegisterMessageHandler (MessageHandler, nullptr, 5);
+	Check (Parse (&Parser, {0x90, 0x3C}).empty (), "partial");
+	Parser.Reset ();
+	Check (Parse (&Parser, {0x64, 0x3E, 0x64}).empty (), "reset");
+}
+
+// a performance with nSize bytes or more, rExpected are the messages in the
+// order, in which the parser must emit them
+static void MakePerformance (size_t nSize, TBuffer &rData, std::vector<TMessage> &rExpected)
+{
+	std::mt19937 Random (1);
+	u8 uchStatus = 0;
+
+	// a realtime byte may come between any two bytes
+	auto Put = [&] (u8 uchByte)
+	{
+		if (Random () % 16 == 0)
+		{
+			u8 uchRealtime = Random () % 8 == 0 ? 0xFE : 0xF8;
+			rData.push_back (uchRealtime);
+			rExpected.push_back ({uchRealtime});
+		}
+
+		rData.push_back (uchByte);
+	};
+
+	while (rData.size () < nSize)
+	{
+		unsigned nKind = Random () % 100;
+		if (nKind < 2)
+		{
+			// a voice dump of a DX7 (155 data bytes) or a bank (4096, too long)
+			unsigned nData = Random () % 4 == 0 ? 4096 : 155;
+			TMessage SysEx = {0xF0, 0x43, 0x00, 0x00};
+			for (unsigned i = 0; i < nData; i++)
+			{
+				SysEx.push_back (Random () & 0x7F);
+			}
+			SysEx.push_back (0xF7);
+
+			for (u8 uchByte : SysEx)
+			{
+				Put (uchByte);
+			}
+
+			if (SysEx.size () <= MIDI_SYSEX_MAX_SIZE)
+			{
+				rExpected.push_back (SysEx);
+			}
+
+			uchStatus = 0;
+
+			continue;
+		}
+
+		TMessage Message;
+		if (nKind < 60)
+		{
+			Message = {(u8) (0x90 | Random () % 2), (u8) (Random () & 0x7F),
+				   (u8) (Random () % 2 ? Random () & 0x7F : 0)};
+		}
+		else if (nKind < 85)
+		{
+			Message = {(u8) (0xB0 | Random () % 2), (u8) (Random () % 8),
+				   (u8) (Random () & 0x7F)};
+		}
+		else if (nKind < 95)
+		{
+			Message = {0xE0, (u8) (Random () & 0x7F), (u8) (Random () & 0x7F)};
+		}
+		else if (nKind < 98)
+		{
+			Message = {0xC0, (u8) (Random () & 0x7F)};
+		}
+		else
+		{
+			Message = {0xD0, (u8) (Random () & 0x7F)};
+		}
+
+		// running status, as a sender would use it
+		for (unsigned i = Message[0] == uchStatus ? 1 : 0; i < Message.size (); i++)
+		{
+			Put (Message[i]);
+		}
+		uchStatus = Message[0];
+
+		rExpected.push_back (Message);
+	}
+}
+
+static double Now (void)
+{
+	return std::chrono::duration<double> (
+		std::chrono::steady_clock::now ().time_since_epoch ()).count ();
+}
+
+// returns bytes per us
+static double Measure (const TBuffer &rData, unsigned nRounds, unsigned *pMessages)
+{
+	CMIDIParser Parser;
+	Parser.RegisterMessageHandler (CountHandler);
+
+	s_nMessages = 0;
+	double fStart = Now ();
+	for (unsigned i = 0; i < nRounds; i++)
+	{
+		// in the packet size of USB MIDI, like the parsers of the ports get it
+		for (size_t nOffset = 0; nOffset < rData.size (); nOffset += 3)
+		{
+			Parser.Parse (&rData[nOffset], rData.size () - nOffset < 3 ? rData.size () - nOffset : 3);
+		}
+	}
+	double fTime = Now () - fStart;
+
+	*pMessages = s_nMessages / nRounds;
+
+	return rData.size () * nRounds / fTime / 1e6;
+}
+
+int main (int argc, char **argv)
+{
+	unsigned nPerformanceKB = 1024;
+	unsigned nRounds = 20;
+
+	int nOption;
+	while (optind <= argc && (nOption = getopt (argc, argv, "n:r:")) != -1)
+	{
+		switch (nOption)
+		{
+		case 'n':	nPerformanceKB = strtoul (optarg, nullptr, 0);	break;
+		case 'r':	nRounds = strtoul (optarg, nullptr, 0);		break;
+
+		default:
+			optind = argc + 1;			// show usage
+			break;
+		}
+	}
+
+	if (nPerformanceKB == 0 || nRounds == 0 || optind > argc)
+	{
+		return Usage ("midiparsercheck [-n performance KB] [-r rounds] [dump ...]");
+	}
+
+	CheckCases ();
+
+	TBuffer Performance;
+	std::vector<TMessage> Expected;
+	MakePerformance (nPerformanceKB * 1024, Performance, Expected);
+
+	CMIDIParser Parser;
+	Parser.RegisterMessageHandler (MessageHandler, nullptr, 5);
+	Check (Parse (&Parser, Performance) == Expected, "performance");
+	unsigned nSysExOverflows = Parser.GetSysExOverflows ();
+	Check (nSysExOverflows != 0, "bank dumps dropped");
+
+	// split at random points, byte by byte in between
+	std::mt19937 Random (2);
+	s_Messages.clear ();
+	for (size_t nOffset = 0; nOffset < Performance.size (); )
+	{
+		size_t nChunk = Random () % 64;
+		if (nChunk > Performance.size () - nOffset)
+		{
+			nChunk = Performance.size () - nOffset;
+		}
+
+		if (nChunk == 0)
+		{
+			Parser.Parse (Performance[nOffset++]);
+
+			continue;
+		}
+
+		Parser.Parse (&Performance[nOffset], nChunk);
+		nOffset += nChunk;
+	}
+	Check (s_Messages == Expected, "performance in pieces");
+	Check (Parser.GetSysExOverflows () == 2 * nSysExOverflows, "overflows counted");
+
+	printf ("%-28s %10s %10s %10s\n", "", "bytes", "messages", "bytes/us");
+
+	unsigned nMessages;
+	double fRate = Measure (Performance, nRounds, &nMessages);
+	printf ("%-28s %10u %10u %10.1f\n", "performance", (unsigned) Performance.size (),
+		nMessages, fRate);
+
+	for (int i = optind; i < argc; i++)
+	{
+		TBuffer Dump;
+		if (!ReadFile (argv[i], Dump) || Dump.empty ())
+		{
+			return EXIT_FAILURE;
+		}
+
+		fRate = Measure (Dump, nRounds, &nMessages);
+		printf ("%-28.28s %10u %10u %10.1f\n", argv[i], (unsigned) Dump.size (), nMessages, fRate);
+	}
+
+	return CheckResult ();
+}
@@ -0,0 +1,227 @@
+//
+// midiqueuecheck.cpp
+//
+// Host tool: stress test of the MIDI event queue of the boot menu (see
+// src/midiqueue.h) with one producer thread in place of the USB interrupt
+// or the serial poll and one consumer thread in place of the main loop.
+//
+// The producer numbers its events and yields after each burst of half a
+// queue, or of two queues in a flood (a SysEx dump), while the consumer is
+// slowed down, so that the queue runs full. When it retries a full queue,
+// each event must arrive once and in order. When it drops the event, like
+// the interrupt handler does, the events, which arrive, must still be in
+// order. GetOverflows() must count each time the queue was full.
+//
+// usage: midiqueuecheck [-n events] [-r rounds]
+//
+#include "../src/midiqueue.h"
+#include "toolcheck.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <unistd.h>
+
+#define QUEUE_SIZE	64			// MIDI_QUEUE_SIZE in src/kernel.h
+
+typedef CMIDIEventQueue<QUEUE_SIZE> TQueue;
+
+static TMIDIEvent MakeEvent (unsigned nSequence)
+{
+	TMIDIEvent Event;
+	Event.nTimestamp = nSequence;
+	Event.nSource = MIDISourceUSB;
+	Event.nDevice = nSequence % 7;
+	Event.nCable = nSequence % 16;
+	Event.nLength = 3;
+	Event.Message[0] = 0x90 | (nSequence & 0x0F);
+	Event.Message[1] = (nSequence >> 4) & 0x7F;
+	Event.Message[2] = (nSequence >> 11) & 0x7F;
+
+	return Event;
+}
+
+// the whole event must be the one, which was enqueued
+static bool IsValid (const TMIDIEvent &rEvent)
+{
+	TMIDIEvent Expected = MakeEvent (rEvent.nTimestamp);
+
+	return    rEvent.nSource == Expected.nSource
+	       && rEvent.nDevice == Expected.nDevice
+	       && rEvent.nCable == Expected.nCable
+	       && rEvent.nLength == Expected.nLength
+	       && rEvent.Message[0] == Expected.Message[0]
+	       && rEvent.Message[1] == Expected.Message[1]
+	       && rEvent.Message[2] == Expected.Message[2];
+}
+
+struct TResult
+{
+	unsigned nReceived;
+	unsigned nDropped;
+	double fSeconds;
+};
+
+// with bDrop the producer drops an event, if the queue is full, otherwise
+// it retries, the consumer spins nDelay times after each event
+static TResult Run (unsigned nEvents, unsigned nBurst, bool bDrop, unsigned nDelay)
+{
+	TQueue *pQueue = new TQueue;
+	std::atomic<bool> bDone (false);
+	unsigned nDropped = 0;
+	unsigned nFull = 0;
+
+	auto Start = std::chrono::steady_clock::now ();
+
+	std::thread Producer ([&]
+	{
+		for (unsigned i = 0; i < nEvents; i++)
+		{
+			TMIDIEvent Event = MakeEvent (i);
+			while (!pQueue->Enqueue (Event))
+			{
+				nFull++;
+				if (bDrop)
+				{
+					nDropped++;
+
+					break;
+				}
+
+				std::this_thread::yield ();
+			}
+
+			if (i % nBurst == nBurst - 1)
+			{
+				std::this_thread::yield ();
+			}
+		}
+
+		bDone = true;
+	});
+
+	unsigned nReceived = 0;
+	unsigned nNext = 0;				// lowest sequence number expected
+	std::thread Consumer ([&]
+	{
+		for (;;)
+		{
+			// bDone must be read before the queue is found empty
+			bool bLast = bDone;
+
+			TMIDIEvent Event;
+			if (!pQueue->Dequeue (&Event))
+			{
+				if (bLast)
+				{
+					break;
+				}
+
+				std::this_thread::yield ();
+
+				continue;
+			}
+
+			Check (IsValid (Event), "event intact");
+			Check (   Event.nTimestamp >= nNext
+			       && (bDrop || Event.nTimestamp == nNext), "in order");
+			nNext = Event.nTimestamp + 1;
+			nReceived++;
+
+			for (volatile unsigned j = 0; j < nDelay; j++)
+			{
+			}
+		}
+	});
+
+	Producer.join ();
+	Consumer.join ();
+
+	TResult Result;
+	Result.nReceived = nReceived;
+	Result.nDropped = nDropped;
+	Result.fSeconds = std::chrono::duration<double> (std::chrono::steady_clock::now () - Start).count ();
+
+	Check (pQueue->IsEmpty (), "empty at the end");
+	Check (pQueue->GetOverflows () == nFull, "overflows counted");
+	Check (nReceived + nDropped == nEvents, "no loss");
+	if (!bDrop)
+	{
+		Check (nDropped == 0, "nothing dropped");
+	}
+
+	delete pQueue;
+
+	return Result;
+}
+
+int main (int argc, char **argv)
+{
+	unsigned nEvents = 2000000;
+	unsigned nRounds = 3;
+
+	int nOption;
+	while (optind <= argc && (nOption = getopt (argc, argv, "n:r:")) != -1)
+	{
+		switch (nOption)
+		{
+		case 'n':	nEvents = strtoul (optarg, nullptr, 0);		break;
+		case 'r':	nRounds = strtoul (optarg, nullptr, 0);		break;
+
+		default:
+			optind = argc + 1;			// show usage
+			break;
+		}
+	}
+
+	if (nEvents == 0 || nRounds == 0 || optind != argc)
+	{
+		return Usage ("midiqueuecheck [-n events] [-r rounds]");
+	}
+
+	// wraps the indices, which are compared by their difference
+	TQueue Queue;
+	for (unsigned i = 0; i < 3 * QUEUE_SIZE; i++)
+	{
+		Check (Queue.Enqueue (MakeEvent (i)), "enqueue");
+		TMIDIEvent Event;
+		Check (Queue.Dequeue (&Event) && Event.nTimestamp == i, "dequeue");
+	}
+	for (unsigned i = 0; i < QUEUE_SIZE; i++)
+	{
+		Check (Queue.Enqueue (MakeEvent (i)), "fill");
+	}
+	Check (!Queue.Enqueue (MakeEvent (0)) && Queue.GetOverflows () == 1, "full");
+
+	printf ("%u events, queue of %u\n", nEvents, QUEUE_SIZE);
+	printf ("%-28s %10s %10s %10s\n", "", "received", "dropped", "Mevents/s");
+
+	static const struct
+	{
+		const char *pName;
+		unsigned nBurst;
+		bool bDrop;
+		unsigned nDelay;
+	}
+	Modes[] =
+	{
+		{"retry",		QUEUE_SIZE / 2,	false,	0},
+		{"retry, flood",	QUEUE_SIZE * 2,	false,	50},
+		{"drop",		QUEUE_SIZE / 2,	true,	0},
+		{"drop, flood",		QUEUE_SIZE * 2,	true,	50}
+	};
+
+	for (const auto &rMode : Modes)
+	{
+		for (unsigned i = 0; i < nRounds; i++)
+		{
+			TResult Result = Run (nEvents, rMode.nBurst, rMode.bDrop, rMode.nDelay);
+
+			printf ("%-28s %10u %10u %10.1f\n", rMode.pName, Result.nReceived,
+				Result.nDropped, nEvents / Result.fSeconds / 1e6);
+		}
+	}
+
+	return CheckResult ();
+}
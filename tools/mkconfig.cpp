@@ -0,0 +1,306 @@
+//
+// mkconfig.cpp
+//
+// Host tool: compiles synth.ini and minidexed.ini into the config cache
+// (config.bin), which the boot menu reads instead of parsing the ini files.
+// The cache is only used while the size and modification time of both ini
+// files match, so copy the ini files to the SD card together with it.
+//
+// Entries with unknown or misspelled keys and invalid values are reported.
+// With -c the ini files are only checked against the schema, the exit code
+// is non-zero if there was a problem.
+//
+// With -b it compares the time to parse both ini files with the time to
+// read and check the cache instead.
+//
+// usage: mkconfig [-b count] synth.ini minidexed.ini config.bin
+//        mkconfig -c synth.ini minidexed.ini
+//
+#include "../src/bootconfig.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <utility>
+#include <vector>
+#include <sys/stat.h>
+
+// key/value pairs in file order
+typedef std::vector<std::pair<std::string, std::string>> TProperties;
+
+static bool ReadFile (const char *pFileName, std::string &rContent)
+{
+	FILE *pFile = fopen (pFileName, "rb");
+	if (pFile == nullptr)
+	{
+		perror (pFileName);
+
+		return false;
+	}
+
+	char Buffer[4096];
+	size_t nRead;
+	while ((nRead = fread (Buffer, 1, sizeof Buffer, pFile)) > 0)
+	{
+		rContent.append (Buffer, nRead);
+	}
+
+	fclose (pFile);
+
+	return true;
+}
+
+static std::string Trim (const std::string &rString)
+{
+	size_t nFirst = rString.find_first_not_of (" \t\r");
+	if (nFirst == std::string::npos)
+	{
+		return "";
+	}
+
+	size_t nLast = rString.find_last_not_of (" \t\r");
+
+	return rString.substr (nFirst, nLast - nFirst + 1);
+}
+
+static void ParseProperties (const std::string &rContent, TProperties &rProperties)
+{
+	size_t nPos = 0;
+	while (nPos < rContent.size ())
+	{
+		size_t nEnd = rContent.find ('\n', nPos);
+		if (nEnd == std::string::npos)
+		{
+			nEnd = rContent.size ();
+		}
+
+		std::string Line = rContent.substr (nPos, nEnd - nPos);
+		nPos = nEnd + 1;
+
+		size_t nComment = Line.find ('#');
+		if (nComment != std::string::npos)
+		{
+			Line.erase (nComment);
+		}
+
+		size_t nEqual = Line.find ('=');
+		if (nEqual == std::string::npos)
+		{
+			continue;
+		}
+
+		rProperties.emplace_back (Trim (Line.substr (0, nEqual)), Trim (Line.substr (nEqual + 1)));
+	}
+}
+
+// returns the number of problems
+static unsigned Apply (TBootConfig *pConfig, unsigned nFile, const char *pFileName,
+		       const TProperties &rProperties, bool bReport)
+{
+	unsigned nProblems = 0;
+
+	for (const auto &rProperty : rProperties)
+	{
+		const char *pKey = rProperty.first.c_str ();
+		const char *pValue = rProperty.second.c_str ();
+
+		TBootConfigResult Result = BootConfigSet (pConfig, nFile, pKey, pValue);
+		if (Result == BootConfigOK || Result == BootConfigIgnored)
+		{
+			continue;
+		}
+
+		nProblems++;
+
+		if (!bReport)
+		{
+			continue;
+		}
+
+		if (Result == BootConfigMisspelledKey)
+		{
+			fprintf (stderr, "%s: %s: Did you mean %s?\n", pFileName, pKey,
+				 BootConfigGetSimilarKey (pKey));
+		}
+		else
+		{
+			fprintf (stderr, "%s: %s=%s: %s\n", pFileName, pKey, pValue,
+				 BootConfigGetResultText (Result));
+		}
+	}
+
+	return nProblems;
+}
+
+// size and modification time as FatFs reports them (FAT keeps local time)
+static bool GetStamp (const char *pFileName, TBootConfigStamp *pStamp)
+{
+	struct stat Stat;
+	if (stat (pFileName, &Stat) != 0)
+	{
+		perror (pFileName);
+
+		return false;
+	}
+
+	struct tm Time;
+	localtime_r (&Stat.st_mtime, &Time);
+
+	pStamp->nSize = Stat.st_size;
+	pStamp->nDate = (Time.tm_year - 80) << 9 | (Time.tm_mon + 1) << 5 | Time.tm_mday;
+	pStamp->nTime = Time.tm_hour << 11 | Time.tm_min << 5 | Time.tm_sec / 2;
+
+	return true;
+}
+
+static bool Compile (const char *const *ppIniName, TBootConfigCache *pCache,
+		     bool bReport = false, unsigned *pProblems = nullptr)
+{
+	TBootConfigStamp Stamps[BootConfigFileCount];
+
+	memset (pCache, 0, sizeof *pCache);
+	BootConfigSetDefaults (&pCache->Config);
+
+	unsigned nProblems = 0;
+	for (unsigned nFile = 0; nFile < BootConfigFileCount; nFile++)
+	{
+		std::string Content;
+		if (   !ReadFile (ppIniName[nFile], Content)
+		    || !GetStamp (ppIniName[nFile], &Stamps[nFile]))
+		{
+			return false;
+		}
+
+		TProperties Properties;
+		ParseProperties (Content, Properties);
+
+		nProblems += Apply (&pCache->Config, nFile, ppIniName[nFile], Properties, bReport);
+	}
+
+	BootConfigSeal (pCache, Stamps);
+
+	if (pProblems != nullptr)
+	{
+		*pProblems = nProblems;
+	}
+
+	return true;
+}
+
+static int Benchmark (unsigned nCount, const char *const *ppIniName, const char *pCacheName)
+{
+	typedef std::chrono::steady_clock TClock;
+
+	TBootConfigCache Cache;
+
+	TClock::time_point Start = TClock::now ();
+	for (unsigned i = 0; i < nCount; i++)
+	{
+		if (!Compile (ppIniName, &Cache))
+		{
+			return EXIT_FAILURE;
+		}
+	}
+	TClock::duration Parse = TClock::now () - Start;
+
+	Start = TClock::now ();
+	for (unsigned i = 0; i < nCount; i++)
+	{
+		TBootConfigStamp Stamps[BootConfigFileCount];
+		for (unsigned nFile = 0; nFile < BootConfigFileCount; nFile++)
+		{
+			if (!GetStamp (ppIniName[nFile], &Stamps[nFile]))
+			{
+				return EXIT_FAILURE;
+			}
+		}
+
+		FILE *pFile = fopen (pCacheName, "rb");
+		if (pFile == nullptr)
+		{
+			perror (pCacheName);
+
+			return EXIT_FAILURE;
+		}
+
+		bool bOK =    fread (&Cache, sizeof Cache, 1, pFile) == 1
+			   && BootConfigIsValid (&Cache, Stamps);
+		fclose (pFile);
+
+		if (!bOK)
+		{
+			fprintf (stderr, "%s: Invalid or outdated cache\n", pCacheName);
+
+			return EXIT_FAILURE;
+		}
+	}
+	TClock::duration Read = TClock::now () - Start;
+
+	using std::chrono::nanoseconds;
+	printf ("parse ini files: %10.2f us\n",
+		std::chrono::duration_cast<nanoseconds> (Parse).count () / 1000.0 / nCount);
+	printf ("read cache:      %10.2f us\n",
+		std::chrono::duration_cast<nanoseconds> (Read).count () / 1000.0 / nCount);
+
+	return EXIT_SUCCESS;
+}
+
+int main (int argc, char **argv)
+{
+	if (argc == 4 && strcmp (argv[1], "-c") == 0)
+	{
+		const char *const IniName[BootConfigFileCount] = {argv[2], argv[3]};
+
+		TBootConfigCache Cache;
+		unsigned nProblems;
+		if (!Compile (IniName, &Cache, true, &nProblems))
+		{
+			return EXIT_FAILURE;
+		}
+
+		return nProblems == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	unsigned nBenchmark = 0;
+	if (argc == 6 && strcmp (argv[1], "-b") == 0)
+	{
+		nBenchmark = strtoul (argv[2], nullptr, 0);
+		argc -= 2;
+		argv += 2;
+	}
+
+	if (argc != 4 || argv[1][0] == '-')
+	{
+		fprintf (stderr, "usage: mkconfig [-b count] synth.ini minidexed.ini config.bin\n"
+				 "       mkconfig -c synth.ini minidexed.ini\n");
+
+		return EXIT_FAILURE;
+	}
+
+	const char *const IniName[BootConfigFileCount] = {argv[1], argv[2]};
+
+	if (nBenchmark > 0)
+	{
+		return Benchmark (nBenchmark, IniName, argv[3]);
+	}
+
+	TBootConfigCache Cache;
+	if (!Compile (IniName, &Cache, true))
+	{
+		return EXIT_FAILURE;
+	}
+
+	FILE *pFile = fopen (argv[3], "wb");
+	if (   pFile == nullptr
+	    || fwrite (&Cache, sizeof Cache, 1, pFile) != 1
+	    || fclose (pFile) != 0)
+	{
+		perror (argv[3]);
+
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
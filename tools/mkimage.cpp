@@ -0,0 +1,217 @@
+//
+// mkimage.cpp
+//
+// Host tool: compresses a synth kernel image into the chunked LZ4 format
+// of src/synthimage.h. Copy the result next to the raw image as
+// kernel*.img.lz4, the boot menu prefers it then.
+//
+// With -c it writes the CRC-32 of a raw image next to it into
+// kernel*.img.crc, against which the boot menu checks the image.
+//
+// With -b it reports the effective load speed of the image at all
+// compression levels compared to a raw read. The SD card is modelled by
+// its read bandwidth (-r), decoding is timed on the host and scaled by the
+// slowdown of the target CPU (-s). "2 cores" overlaps reading and decoding
+// with two input buffers like the boot menu, "1 core" does not.
+//
+// usage: mkimage [-l level] kernel8.img kernel8.img.lz4
+//        mkimage -c kernel8.img
+//        mkimage -b [-r MB/s] [-s slowdown] kernel8.img
+//
+#include "../src/synthimage.h"
+#include "../src/crc32.h"
+#include "imagewriter.h"
+#include "lz4encoder.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+static int Pack (const char *pInput, const char *pOutput, unsigned nLevel)
+{
+	TBuffer Image;
+	if (!ReadFile (pInput, Image))
+	{
+		return EXIT_FAILURE;
+	}
+
+	if (Image.empty ())
+	{
+		fprintf (stderr, "%s: Empty image\n", pInput);
+
+		return EXIT_FAILURE;
+	}
+
+	TBuffer File;
+	if (!BuildImage (Image, nLevel, File))
+	{
+		fprintf (stderr, "%s: Cannot compress\n", pInput);
+
+		return EXIT_FAILURE;
+	}
+
+	FILE *pFile = fopen (pOutput, "wb");
+	if (   pFile == nullptr
+	    || fwrite (File.data (), 1, File.size (), pFile) != File.size ()
+	    || fclose (pFile) != 0)
+	{
+		perror (pOutput);
+
+		return EXIT_FAILURE;
+	}
+
+	printf ("%s: %zu -> %zu bytes (%.1f%%)\n", pOutput, Image.size (), File.size (),
+		100.0 * File.size () / Image.size ());
+
+	return EXIT_SUCCESS;
+}
+
+static int WriteCRC (const char *pInput)
+{
+	TBuffer Image;
+	if (!ReadFile (pInput, Image))
+	{
+		return EXIT_FAILURE;
+	}
+
+	if (Image.empty ())
+	{
+		fprintf (stderr, "%s: Empty image\n", pInput);
+
+		return EXIT_FAILURE;
+	}
+
+	// the suffix is CHAINBOOT_CRC_SUFFIX in src/chainloader.h
+	std::string Output = std::string (pInput) + ".crc";
+	uint32_t nCRC = CRC32Update (0, Image.data (), Image.size ());
+
+	FILE *pFile = fopen (Output.c_str (), "w");
+	if (   pFile == nullptr
+	    || fprintf (pFile, "%08X\n", nCRC) < 0
+	    || fclose (pFile) != 0)
+	{
+		perror (Output.c_str ());
+
+		return EXIT_FAILURE;
+	}
+
+	printf ("%s: %08X\n", Output.c_str (), nCRC);
+
+	return EXIT_SUCCESS;
+}
+
+static int Benchmark (const char *pInput, double fBandwidth, double fSlowdown)
+{
+	TBuffer Image;
+	if (!ReadFile (pInput, Image))
+	{
+		return EXIT_FAILURE;
+	}
+
+	double fImage = Image.size ();
+	double fBytesPerSecond = fBandwidth * 1e6;
+
+	printf ("%s: %zu bytes, SD %.1f MB/s, CPU slowdown %.1f\n",
+		pInput, Image.size (), fBandwidth, fSlowdown);
+	printf ("%-6s %7s %12s %12s %12s\n", "level", "ratio", "pack MB/s", "1 core MB/s", "2 cores MB/s");
+	printf ("%-6s %6.1f%% %12s %12.1f %12.1f\n", "raw", 100.0, "-", fBandwidth, fBandwidth);
+
+	for (unsigned nLevel = LZ4_LEVEL_MIN; nLevel <= LZ4_LEVEL_MAX; nLevel++)
+	{
+		std::vector<TImageChunk> Chunks;
+
+		auto Start = std::chrono::steady_clock::now ();
+		CompressImage (Image, nLevel, Chunks);
+		std::chrono::duration<double> PackTime = std::chrono::steady_clock::now () - Start;
+
+		size_t nPacked = sizeof (TSynthImageHeader);
+		double fSerial = 0.0;
+
+		// two input buffers: chunk i can be read, when chunk i-2 is decoded
+		double fReadEnd = 0.0;
+		std::vector<double> DecodeEnd;
+
+		for (size_t i = 0; i < Chunks.size (); i++)
+		{
+			double fDecode = DecodeChunk (Chunks[i], &Image[i * SYNTH_IMAGE_CHUNK_SIZE]);
+			if (fDecode < 0.0)
+			{
+				fprintf (stderr, "Level %u: Chunk %zu does not decode\n", nLevel, i);
+
+				return EXIT_FAILURE;
+			}
+			fDecode *= fSlowdown;
+
+			double fRead = (Chunks[i].Data.size () + sizeof (uint32_t)) / fBytesPerSecond;
+			nPacked += Chunks[i].Data.size () + sizeof (uint32_t);
+
+			fSerial += fRead + fDecode;
+
+			double fReadStart = std::max (fReadEnd, i >= 2 ? DecodeEnd[i - 2] : 0.0);
+			fReadEnd = fReadStart + fRead;
+
+			double fDecodeStart = std::max (fReadEnd, i >= 1 ? DecodeEnd[i - 1] : 0.0);
+			DecodeEnd.push_back (fDecodeStart + fDecode);
+		}
+
+		printf ("%-6u %6.1f%% %12.1f %12.1f %12.1f\n", nLevel, 100.0 * nPacked / fImage,
+			fImage / 1e6 / PackTime.count (), fImage / 1e6 / fSerial,
+			fImage / 1e6 / DecodeEnd.back ());
+	}
+
+	return EXIT_SUCCESS;
+}
+
+int main (int argc, char **argv)
+{
+	bool bBenchmark = false;
+	bool bCRC = false;
+	unsigned nLevel = 9;
+	double fBandwidth = 20.0;
+	double fSlowdown = 1.0;
+
+	int nOption;
+	while (optind <= argc && (nOption = getopt (argc, argv, "bcl:r:s:")) != -1)
+	{
+		switch (nOption)
+		{
+		case 'b':	bBenchmark = true;			break;
+		case 'c':	bCRC = true;				break;
+		case 'l':	nLevel = strtoul (optarg, nullptr, 0);	break;
+		case 'r':	fBandwidth = atof (optarg);		break;
+		case 's':	fSlowdown = atof (optarg);		break;
+
+		default:
+			optind = argc + 1;			// show usage
+			break;
+		}
+	}
+
+	if (   nLevel < LZ4_LEVEL_MIN || nLevel > LZ4_LEVEL_MAX
+	    || fBandwidth <= 0.0 || fSlowdown <= 0.0
+	    || (bBenchmark && bCRC)
+	    || argc - optind != (bBenchmark || bCRC ? 1 : 2))
+	{
+		fprintf (stderr, "usage: mkimage [-l level] kernel8.img kernel8.img.lz4\n"
+				 "       mkimage -c kernel8.img\n"
+				 "       mkimage -b [-r MB/s] [-s slowdown] kernel8.img\n");
+
+		return EXIT_FAILURE;
+	}
+
+	if (bBenchmark)
+	{
+		return Benchmark (argv[optind], fBandwidth, fSlowdown);
+	}
+
+	if (bCRC)
+	{
+		return WriteCRC (argv[optind]);
+	}
+
+	return Pack (argv[optind], argv[optind + 1], nLevel);
+}
@@ -0,0 +1,244 @@
+//
+// mksynthpack.cpp
+//
+// Host tool: builds the synth container of src/synthpack.h from the kernel
+// images of the synths for one Raspberry Pi model. Each synth is given as
+// "Title,name,note,image", note is the MIDI note, which selects the synth,
+// or "-". Images are compressed (with -l level) unless -r is given or they
+// do not get smaller. Copy the result to the root of the SD card as
+// synths8.pak (synths8-rpi4.pak, synths_2712.pak), the boot menu uses it
+// instead of the synth directories then.
+//
+// usage: mksynthpack [-l level | -r] synths8.pak Title,name,note,image ...
+//
+#include "../src/synthpack.h"
+#include "../src/crc32.h"
+#include "imagewriter.h"
+#include "lz4encoder.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#define LOAD_ADDRESS	0x80000			// MEM_KERNEL_START on AArch64
+
+struct TSynth
+{
+	TSynthPackEntry Entry;
+	TBuffer Data;
+};
+
+static bool ParseSynth (const char *pArg, unsigned nLevel, TSynth &rSynth)
+{
+	std::vector<std::string> Fields;
+	std::string Arg (pArg);
+	size_t nStart = 0;
+	for (unsigned i = 0; i < 3; i++)
+	{
+		size_t nComma = Arg.find (',', nStart);
+		if (nComma == std::string::npos)
+		{
+			break;
+		}
+
+		Fields.push_back (Arg.substr (nStart, nComma - nStart));
+		nStart = nComma + 1;
+	}
+	Fields.push_back (Arg.substr (nStart));
+
+	if (   Fields.size () != 4
+	    || Fields[0].empty () || Fields[0].size () >= SYNTH_PACK_TITLE_MAX
+	    || Fields[1].empty () || Fields[1].size () >= SYNTH_PACK_NAME_MAX)
+	{
+		fprintf (stderr, "%s: Invalid synth\n", pArg);
+
+		return false;
+	}
+
+	TSynthPackEntry &rEntry = rSynth.Entry;
+	memset (&rEntry, 0, sizeof rEntry);
+	strcpy (rEntry.Title, Fields[0].c_str ());
+	strcpy (rEntry.Name, Fields[1].c_str ());
+	rEntry.nLoadAddress = LOAD_ADDRESS;
+
+	rEntry.nMIDINote = SYNTH_PACK_NO_NOTE;
+	if (Fields[2] != "-")
+	{
+		char *pEnd;
+		unsigned long nNote = strtoul (Fields[2].c_str (), &pEnd, 0);
+		if (Fields[2].empty () || *pEnd != '\0' || nNote > 127)
+		{
+			fprintf (stderr, "%s: Invalid MIDI note\n", pArg);
+
+			return false;
+		}
+
+		rEntry.nMIDINote = nNote;
+	}
+
+	TBuffer Image;
+	if (!ReadFile (Fields[3].c_str (), Image))
+	{
+		return false;
+	}
+
+	if (Image.empty ())
+	{
+		fprintf (stderr, "%s: Empty image\n", Fields[3].c_str ());
+
+		return false;
+	}
+
+	rEntry.nImageSize = Image.size ();
+	rEntry.nImageCRC = CRC32Update (0, Image.data (), Image.size ());
+
+	if (nLevel != 0)
+	{
+		if (!BuildImage (Image, nLevel, rSynth.Data))
+		{
+			fprintf (stderr, "%s: Cannot compress\n", Fields[3].c_str ());
+
+			return false;
+		}
+
+		if (rSynth.Data.size () < Image.size ())
+		{
+			rEntry.nFlags = SYNTH_PACK_COMPRESSED;
+		}
+	}
+
+	if (!(rEntry.nFlags & SYNTH_PACK_COMPRESSED))
+	{
+		rSynth.Data = std::move (Image);
+	}
+
+	rEntry.nSize = rSynth.Data.size ();
+
+	return true;
+}
+
+static size_t Align (size_t nOffset)
+{
+	return (nOffset + SYNTH_PACK_ALIGN - 1) & ~(size_t) (SYNTH_PACK_ALIGN - 1);
+}
+
+static int Build (const char *pOutput, char **ppSynths, unsigned nSynths, unsigned nLevel)
+{
+	std::vector<TSynth> Synths (nSynths);
+	for (unsigned i = 0; i < nSynths; i++)
+	{
+		if (!ParseSynth (ppSynths[i], nLevel, Synths[i]))
+		{
+			return EXIT_FAILURE;
+		}
+
+		for (unsigned j = 0; j < i; j++)
+		{
+			if (strcmp (Synths[i].Entry.Name, Synths[j].Entry.Name) == 0)
+			{
+				fprintf (stderr, "%s: Duplicate name\n", Synths[i].Entry.Name);
+
+				return EXIT_FAILURE;
+			}
+
+			if (   Synths[i].Entry.nMIDINote != SYNTH_PACK_NO_NOTE
+			    && Synths[i].Entry.nMIDINote == Synths[j].Entry.nMIDINote)
+			{
+				fprintf (stderr, "%s: MIDI note %u is used by %s\n", Synths[i].Entry.Name,
+					 Synths[i].Entry.nMIDINote, Synths[j].Entry.Name);
+
+				return EXIT_FAILURE;
+			}
+		}
+	}
+
+	size_t nOffset = Align (sizeof (TSynthPackHeader) + nSynths * sizeof (TSynthPackEntry));
+	for (TSynth &rSynth : Synths)
+	{
+		if (nOffset + rSynth.Data.size () > UINT32_MAX)
+		{
+			fprintf (stderr, "%s: Container too large\n", pOutput);
+
+			return EXIT_FAILURE;
+		}
+
+		rSynth.Entry.nOffset = nOffset;
+		nOffset = Align (nOffset + rSynth.Data.size ());
+	}
+
+	TSynthPackHeader Header;
+	memset (&Header, 0, sizeof Header);
+	Header.nMagic = SYNTH_PACK_MAGIC;
+	Header.nVersion = SYNTH_PACK_VERSION;
+	Header.nHeaderSize = sizeof Header;
+	Header.nEntries = nSynths;
+	Header.nEntrySize = sizeof (TSynthPackEntry);
+	for (const TSynth &rSynth : Synths)
+	{
+		Header.nIndexCRC = CRC32Update (Header.nIndexCRC, &rSynth.Entry, sizeof rSynth.Entry);
+	}
+
+	TBuffer File (nOffset, 0);
+	memcpy (File.data (), &Header, sizeof Header);
+	for (unsigned i = 0; i < nSynths; i++)
+	{
+		memcpy (&File[sizeof Header + i * sizeof (TSynthPackEntry)],
+			&Synths[i].Entry, sizeof (TSynthPackEntry));
+		memcpy (&File[Synths[i].Entry.nOffset], Synths[i].Data.data (), Synths[i].Data.size ());
+	}
+
+	FILE *pFile = fopen (pOutput, "wb");
+	if (   pFile == nullptr
+	    || fwrite (File.data (), 1, File.size (), pFile) != File.size ()
+	    || fclose (pFile) != 0)
+	{
+		perror (pOutput);
+
+		return EXIT_FAILURE;
+	}
+
+	for (const TSynth &rSynth : Synths)
+	{
+		const TSynthPackEntry &rEntry = rSynth.Entry;
+		printf ("%-16s %-32s note %3s  offset 0x%08X  %8u -> %8u bytes%s\n",
+			rEntry.Name, rEntry.Title,
+			rEntry.nMIDINote == SYNTH_PACK_NO_NOTE ? "-"
+				: std::to_string (rEntry.nMIDINote).c_str (),
+			rEntry.nOffset, rEntry.nImageSize, rEntry.nSize,
+			rEntry.nFlags & SYNTH_PACK_COMPRESSED ? " (lz4)" : "");
+	}
+	printf ("%s: %u synths, %zu bytes\n", pOutput, nSynths, File.size ());
+
+	return EXIT_SUCCESS;
+}
+
+int main (int argc, char **argv)
+{
+	unsigned nLevel = 9;
+
+	int nOption;
+	while (optind <= argc && (nOption = getopt (argc, argv, "l:r")) != -1)
+	{
+		switch (nOption)
+		{
+		case 'l':	nLevel = strtoul (optarg, nullptr, 0);	break;
+		case 'r':	nLevel = 0;				break;
+
+		default:
+			optind = argc + 1;			// show usage
+			break;
+		}
+	}
+
+	if (   (nLevel != 0 && (nLevel < LZ4_LEVEL_MIN || nLevel > LZ4_LEVEL_MAX))
+	    || argc - optind < 2)
+	{
+		fprintf (stderr, "usage: mksynthpack [-l level | -r] synths8.pak Title,name,note,image ...\n");
+
+		return EXIT_FAILURE;
+	}
+
+	return Build (argv[optind], &argv[optind + 1], argc - optind - 1, nLevel);
+}
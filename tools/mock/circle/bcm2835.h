@@ -0,0 +1,17 @@
+//
+// bcm2835.h
+//
+// Mock of Circle for the host tools, only what they use
+//
+#pragma once
+
+#define ARM_IO_BASE		0x3F000000
+
+#define ARM_IC_BASE		(ARM_IO_BASE + 0xB000)
+#define ARM_IC_FIQ_CONTROL	(ARM_IC_BASE + 0x20C)
+#define ARM_IC_DISABLE_IRQS_1	(ARM_IC_BASE + 0x21C)
+#define ARM_IC_DISABLE_IRQS_2	(ARM_IC_BASE + 0x220)
+#define ARM_IC_DISABLE_BASIC_IRQS (ARM_IC_BASE + 0x224)
+
+#define ARM_GICD_BASE		0xFF841000
+#define ARM_GICC_BASE		0xFF842000
@@ -0,0 +1,37 @@
+//
+// bcmpropertytags.h
+//
+// Mock of Circle for the host tools, GetTag() is implemented by the tool
+//
+#pragma once
+
+#include <circle/types.h>
+
+#define PROPTAG_SET_POWER_STATE	0x00028001
+
+struct TPropertyTag
+{
+	u32 nTagId;
+	u32 nValueBufSize;
+	u32 nValueLength;
+};
+
+struct TPropertyTagPowerState
+{
+	TPropertyTag Tag;
+	u32 nDeviceId;
+	#define DEVICE_ID_SD_CARD	0
+	#define DEVICE_ID_USB_HCD	3
+	u32 nState;
+	#define POWER_STATE_OFF		(0 << 0)
+	#define POWER_STATE_ON		(1 << 0)
+	#define POWER_STATE_WAIT	(1 << 1)
+};
+
+class CBcmPropertyTags
+{
+public:
+	CBcmPropertyTags (bool bEarlyUse = false)	{}
+
+	bool GetTag (u32 nTagId, void *pTag, unsigned nTagSize, unsigned nRequestParmSize = 0);
+};
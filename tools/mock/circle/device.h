@@ -0,0 +1,50 @@
+//
+// device.h
+//
+// Mock of Circle for the host tools, the removed handler is called from the
+// destructor like in Circle, block devices implement Read(), Write(), Seek()
+// and GetSize()
+//
+#pragma once
+
+#include <circle/types.h>
+
+class CDevice;
+
+typedef void TDeviceRemovedHandler (CDevice *pDevice, void *pContext);
+
+class CDevice
+{
+public:
+	CDevice (void)
+	:	m_pRemovedHandler (nullptr),
+		m_pRemovedContext (nullptr)
+	{
+	}
+
+	virtual ~CDevice (void)
+	{
+		if (m_pRemovedHandler != nullptr)
+		{
+			(*m_pRemovedHandler) (this, m_pRemovedContext);
+		}
+	}
+
+	// return the number of bytes or < 0 on error
+	virtual int Read (void *pBuffer, size_t nCount)		{ return -1; }
+	virtual int Write (const void *pBuffer, size_t nCount)	{ return -1; }
+
+	// returns the resulting offset
+	virtual u64 Seek (u64 ullOffset)			{ return (u64) -1; }
+	virtual u64 GetSize (void) const			{ return 0; }
+
+	void RegisterRemovedHandler (TDeviceRemovedHandler *pHandler, void *pContext = nullptr)
+	{
+		m_pRemovedHandler = pHandler;
+		m_pRemovedContext = pContext;
+	}
+
+private:
+	TDeviceRemovedHandler *m_pRemovedHandler;
+	void *m_pRemovedContext;
+};
@@ -0,0 +1,17 @@
+//
+// devicenameservice.h
+//
+// Mock of Circle for the host tools, implemented by the tool
+//
+#pragma once
+
+#include <circle/device.h>
+
+class CDeviceNameService
+{
+public:
+	CDevice *GetDevice (const char *pName, boolean bBlockDevice);
+	CDevice *GetDevice (const char *pPrefix, unsigned nIndex, boolean bBlockDevice);
+
+	static CDeviceNameService *Get (void);
+};
@@ -0,0 +1,32 @@
+//
+// logger.h
+//
+// Mock of Circle for the host tools, implemented by the tool
+//
+#pragma once
+
+#include <circle/types.h>
+
+enum TLogSeverity
+{
+	LogPanic,
+	LogError,
+	LogWarning,
+	LogNotice,
+	LogDebug
+};
+
+class CLogger
+{
+public:
+	void Write (const char *pSource, TLogSeverity Severity, const char *pMessage, ...);
+
+	static CLogger *Get (void);
+};
+
+#define LOGMODULE(name)	static const char From[] = name
+#define LOGPANIC(...)	CLogger::Get ()->Write (From, LogPanic, __VA_ARGS__)
+#define LOGERR(...)	CLogger::Get ()->Write (From, LogError, __VA_ARGS__)
+#define LOGWARN(...)	CLogger::Get ()->Write (From, LogWarning, __VA_ARGS__)
+#define LOGNOTE(...)	CLogger::Get ()->Write (From, LogNotice, __VA_ARGS__)
+#define LOGDBG(...)	CLogger::Get ()->Write (From, LogDebug, __VA_ARGS__)
@@ -0,0 +1,11 @@
+//
+// memio.h
+//
+// Mock of Circle for the host tools, implemented by the tool
+//
+#pragma once
+
+#include <circle/types.h>
+
+u32 read32 (uintptr nAddress);
+void write32 (uintptr nAddress, u32 nValue);
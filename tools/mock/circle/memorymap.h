@@ -0,0 +1,10 @@
+//
+// memorymap.h
+//
+// Mock of Circle for the host tools, only what they use
+//
+#pragma once
+
+#define MEGABYTE		0x100000
+
+#define MEM_KERNEL_START	0x80000
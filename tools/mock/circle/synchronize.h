@@ -0,0 +1,19 @@
+//
+// synchronize.h
+//
+// Mock of Circle for the host tools, implemented by the tool, the barriers
+// are fences
+//
+#pragma once
+
+#include <circle/types.h>
+
+void DisableIRQs (void);
+void DisableFIQs (void);
+
+void CleanDataCache (void);
+void InvalidateInstructionCache (void);
+void CleanAndInvalidateDataCacheRange (u64 nAddress, u64 nLength);
+
+#define DataSyncBarrier()	__atomic_thread_fence (__ATOMIC_SEQ_CST)
+#define DataMemBarrier()	__atomic_thread_fence (__ATOMIC_SEQ_CST)
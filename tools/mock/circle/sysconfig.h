@@ -0,0 +1,10 @@
+//
+// sysconfig.h
+//
+// Mock of Circle for the host tools, only what they use
+//
+#pragma once
+
+#define KERNEL_MAX_SIZE		(4 * 0x100000)
+
+#define CORES			4
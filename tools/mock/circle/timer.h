@@ -0,0 +1,14 @@
+//
+// timer.h
+//
+// Mock of Circle for the host tools, implemented by the tool
+//
+#pragma once
+
+#include <circle/types.h>
+
+class CTimer
+{
+public:
+	static unsigned GetClockTicks (void);		// us
+};
@@ -0,0 +1,22 @@
+//
+// types.h
+//
+// Mock of Circle for the host tools, only what they use
+//
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+
+typedef bool boolean;
+#define FALSE	false
+#define TRUE	true
+
+typedef uintptr_t uintptr;
+
+#define PACKED	__attribute__ ((packed))
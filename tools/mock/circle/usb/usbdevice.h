@@ -0,0 +1,47 @@
+//
+// usbdevice.h
+//
+// Mock of Circle for the host tools, only the device descriptor
+//
+#pragma once
+
+#include <circle/types.h>
+
+struct TUSBDeviceDescriptor
+{
+	u8	bLength;
+	u8	bDescriptorType;
+	u16	bcdUSB;
+	u8	bDeviceClass;
+	u8	bDeviceSubClass;
+	u8	bDeviceProtocol;
+	u8	bMaxPacketSize0;
+	u16	idVendor;
+	u16	idProduct;
+	u16	bcdDevice;
+	u8	iManufacturer;
+	u8	iProduct;
+	u8	iSerialNumber;
+	u8	bNumConfigurations;
+}
+PACKED;
+
+class CUSBDevice
+{
+public:
+	CUSBDevice (u16 usVendor = 0, u16 usProduct = 0)
+	:	m_DeviceDescriptor ()
+	{
+		m_DeviceDescriptor.bLength = sizeof m_DeviceDescriptor;
+		m_DeviceDescriptor.idVendor = usVendor;
+		m_DeviceDescriptor.idProduct = usProduct;
+	}
+
+	const TUSBDeviceDescriptor *GetDeviceDescriptor (void) const
+	{
+		return &m_DeviceDescriptor;
+	}
+
+private:
+	TUSBDeviceDescriptor m_DeviceDescriptor;
+};
@@ -0,0 +1,50 @@
+//
+// usbmidi.h
+//
+// Mock of Circle for the host tools, Receive() delivers a USB MIDI event
+// packet like the completion routine of the device
+//
+#pragma once
+
+#include <circle/device.h>
+#include <circle/usb/usbdevice.h>
+
+typedef void TMIDIPacketHandlerEx (unsigned nCable, u8 *pPacket, unsigned nLength,
+				   unsigned nDevice, void *pParam);
+
+class CUSBMIDIDevice : public CDevice
+{
+public:
+	CUSBMIDIDevice (unsigned nDevice, u16 usVendor = 0, u16 usProduct = 0)
+	:	m_Device (usVendor, usProduct),
+		m_nDevice (nDevice),
+		m_pPacketHandler (nullptr),
+		m_pParam (nullptr)
+	{
+	}
+
+	void RegisterPacketHandler (TMIDIPacketHandlerEx *pPacketHandler, void *pParam = nullptr)
+	{
+		m_pPacketHandler = pPacketHandler;
+		m_pParam = pParam;
+	}
+
+	CUSBDevice *GetDevice (void)
+	{
+		return &m_Device;
+	}
+
+	void Receive (unsigned nCable, u8 *pPacket, unsigned nLength)
+	{
+		if (m_pPacketHandler != nullptr)
+		{
+			(*m_pPacketHandler) (nCable, pPacket, nLength, m_nDevice, m_pParam);
+		}
+	}
+
+private:
+	CUSBDevice m_Device;
+	unsigned m_nDevice;
+	TMIDIPacketHandlerEx *m_pPacketHandler;
+	void *m_pParam;
+};
@@ -0,0 +1,40 @@
+//
+// writebuffer.h
+//
+// Mock of Circle for the host tools, Write() collects the bytes, Update()
+// passes them to the device in one write
+//
+#pragma once
+
+#include <circle/device.h>
+#include <circle/types.h>
+#include <string>
+
+class CWriteBufferDevice : public CDevice
+{
+public:
+	CWriteBufferDevice (CDevice *pDevice)
+	:	m_pDevice (pDevice)
+	{
+	}
+
+	int Write (const void *pBuffer, size_t nCount) override
+	{
+		m_Buffer.append (static_cast<const char *> (pBuffer), nCount);
+
+		return nCount;
+	}
+
+	void Update (void)
+	{
+		if (!m_Buffer.empty ())
+		{
+			m_pDevice->Write (m_Buffer.data (), m_Buffer.size ());
+			m_Buffer.clear ();
+		}
+	}
+
+private:
+	CDevice *m_pDevice;
+	std::string m_Buffer;
+};
@@ -0,0 +1,21 @@
+//
+// diskio.h
+//
+// Mock of FatFs for the host tools, disk_read() reads the disk image of
+// tools/fatfsimage.h and counts the requests
+//
+#pragma once
+
+#include <fatfs/ff.h>
+
+typedef enum
+{
+	RES_OK = 0,
+	RES_ERROR,
+	RES_WRPRT,
+	RES_NOTRDY,
+	RES_PARERR
+} DRESULT;
+
+DRESULT disk_read (BYTE pdrv, BYTE *buff, LBA_t sector, UINT count);
+DRESULT disk_write (BYTE pdrv, const BYTE *buff, LBA_t sector, UINT count);
@@ -0,0 +1,100 @@
+//
+// ff.h
+//
+// Mock of FatFs for the host tools, a read-only stand-in on a disk image
+// (see tools/fatfsimage.h). The structures have the fields of FatFs, which
+// the boot menu uses, and f_read(), f_lseek() and the FAT lookups issue the
+// disk_read() requests, which FatFs R0.14 does for the same access.
+//
+#pragma once
+
+#include <stdint.h>
+
+typedef unsigned int UINT;
+typedef unsigned char BYTE;
+typedef uint16_t WORD;
+typedef uint32_t DWORD;
+typedef uint64_t QWORD;
+typedef DWORD LBA_t;
+typedef DWORD FSIZE_t;
+typedef char TCHAR;
+
+#define FF_MAX_SS	512
+#define FF_MIN_SS	512
+#define FF_USE_EXPAND	0
+
+typedef struct
+{
+	BYTE fs_type;
+	BYTE pdrv;
+	BYTE csize;			// sectors per cluster
+	BYTE wflag;
+	DWORD n_fatent;
+	DWORD fsize;			// sectors per FAT
+	LBA_t fatbase;
+	LBA_t dirbase;			// first cluster of the root directory
+	LBA_t database;
+	LBA_t winsect;			// sector in win[]
+	BYTE win[FF_MAX_SS];
+} FATFS;
+
+typedef struct
+{
+	FATFS *fs;
+	BYTE attr;
+	DWORD sclust;
+	FSIZE_t objsize;
+} FFOBJID;
+
+typedef struct
+{
+	FFOBJID obj;
+	BYTE flag;
+	FSIZE_t fptr;
+	DWORD clust;			// of fptr
+	LBA_t sect;			// in buf[]
+	BYTE buf[FF_MAX_SS];
+} FIL;
+
+typedef struct
+{
+	FSIZE_t fsize;
+	WORD fdate;
+	WORD ftime;
+	BYTE fattrib;
+	TCHAR fname[256];
+} FILINFO;
+
+typedef enum
+{
+	FR_OK = 0,
+	FR_DISK_ERR,
+	FR_INT_ERR,
+	FR_NOT_READY,
+	FR_NO_FILE,
+	FR_NO_PATH,
+	FR_INVALID_NAME,
+	FR_DENIED,
+	FR_EXIST,
+	FR_INVALID_OBJECT,
+	FR_WRITE_PROTECTED,
+	FR_INVALID_DRIVE,
+	FR_NOT_ENABLED,
+	FR_NO_FILESYSTEM
+} FRESULT;
+
+#define FA_READ			0x01
+#define FA_WRITE		0x02
+#define FA_OPEN_EXISTING	0x00
+
+#define AM_DIR			0x10
+
+FRESULT f_mount (FATFS *fs, const TCHAR *path, BYTE opt);
+FRESULT f_open (FIL *fp, const TCHAR *path, BYTE mode);
+FRESULT f_close (FIL *fp);
+FRESULT f_read (FIL *fp, void *buff, UINT btr, UINT *br);
+FRESULT f_lseek (FIL *fp, FSIZE_t ofs);
+FRESULT f_stat (const TCHAR *path, FILINFO *fno);
+
+#define f_size(fp)	((fp)->obj.objsize)
+#define f_tell(fp)	((fp)->fptr)
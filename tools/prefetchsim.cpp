@@ -0,0 +1,212 @@
+//
+// prefetchsim.cpp
+//
+// Host tool: simulates the synth prefetcher of the boot menu (see
+// src/prefetcher.h) for a user, who scrolls through the menu with random
+// dwell times and then presses Select. The SD card is modelled by its read
+// bandwidth, a load can be cancelled between chunks only. Prints the hit
+// rate and the time to launch with and without prefetching.
+//
+// usage: prefetchsim [-b MB/s] [-d mean dwell ms] [-n sessions] [-s seed]
+//
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include <unistd.h>
+
+#define CHUNK_SIZE	0x10000		// CHAINLOAD_CHUNK_SIZE
+
+// typical image sizes of MiniDexed, MiniJV880 and mt32-pi
+static const double s_ImageSize[] = {2.9e6, 1.6e6, 1.2e6};
+static const unsigned s_nSynths = sizeof s_ImageSize / sizeof s_ImageSize[0];
+
+struct TResult
+{
+	unsigned nHits;
+	unsigned nPartialHits;
+	unsigned nMisses;
+	std::vector<double> Prefetched;	// time to launch in ms
+	std::vector<double> Direct;
+};
+
+class CSimulation
+{
+public:
+	CSimulation (double fBandwidth)		// bytes/s
+	:	m_fChunkTime (CHUNK_SIZE / fBandwidth * 1000.0),
+		m_nLoaded (s_nSynths),
+		m_nLoading (s_nSynths),
+		m_fLoadStart (0.0)
+	{
+	}
+
+	double GetLoadTime (unsigned nSynth) const
+	{
+		return GetChunks (nSynth) * m_fChunkTime;
+	}
+
+	// the highlighted synth changes at fTime (ms)
+	void Select (unsigned nSynth, double fTime)
+	{
+		Advance (fTime);
+
+		if (m_nLoading < s_nSynths)
+		{
+			// the current chunk is finished first
+			fTime = m_fLoadStart + (ChunksDone (fTime) + 1) * m_fChunkTime;
+			m_nLoading = s_nSynths;
+		}
+
+		if (m_nLoaded != nSynth)
+		{
+			m_nLoaded = s_nSynths;		// the buffer is overwritten
+			m_nLoading = nSynth;
+			m_fLoadStart = fTime;
+		}
+	}
+
+	// Select is pressed for nSynth at fTime, returns the time to launch
+	double Launch (unsigned nSynth, double fTime, TResult *pResult)
+	{
+		Advance (fTime);
+
+		if (m_nLoaded == nSynth)
+		{
+			pResult->nHits++;
+
+			return 0.0;
+		}
+
+		if (m_nLoading == nSynth)
+		{
+			pResult->nPartialHits++;
+
+			return m_fLoadStart + GetLoadTime (nSynth) - fTime;
+		}
+
+		pResult->nMisses++;
+
+		return GetLoadTime (nSynth);
+	}
+
+private:
+	unsigned GetChunks (unsigned nSynth) const
+	{
+		return (unsigned) ((s_ImageSize[nSynth] + CHUNK_SIZE - 1) / CHUNK_SIZE);
+	}
+
+	unsigned ChunksDone (double fTime) const
+	{
+		return (unsigned) ((fTime - m_fLoadStart) / m_fChunkTime);
+	}
+
+	void Advance (double fTime)
+	{
+		if (   m_nLoading < s_nSynths
+		    && fTime >= m_fLoadStart + GetLoadTime (m_nLoading))
+		{
+			m_nLoaded = m_nLoading;
+			m_nLoading = s_nSynths;
+		}
+	}
+
+private:
+	double m_fChunkTime;
+	unsigned m_nLoaded;			// s_nSynths if none
+	unsigned m_nLoading;			// s_nSynths if idle
+	double m_fLoadStart;
+};
+
+static double Percentile (std::vector<double> &rValues, unsigned nPercent)
+{
+	std::sort (rValues.begin (), rValues.end ());
+	size_t nRank = (rValues.size () * nPercent + 99) / 100;
+
+	return rValues[nRank > 0 ? nRank - 1 : 0];
+}
+
+static double Mean (const std::vector<double> &rValues)
+{
+	double fSum = 0.0;
+	for (double fValue : rValues)
+	{
+		fSum += fValue;
+	}
+
+	return fSum / rValues.size ();
+}
+
+int main (int argc, char **argv)
+{
+	double fBandwidth = 20.0;		// MB/s
+	double fDwell = 800.0;			// ms
+	unsigned nSessions = 10000;
+	unsigned nSeed = 1;
+
+	int nOption;
+	while (optind <= argc && (nOption = getopt (argc, argv, "b:d:n:s:")) != -1)
+	{
+		switch (nOption)
+		{
+		case 'b':	fBandwidth = atof (optarg);		break;
+		case 'd':	fDwell = atof (optarg);			break;
+		case 'n':	nSessions = strtoul (optarg, nullptr, 0);	break;
+		case 's':	nSeed = strtoul (optarg, nullptr, 0);	break;
+
+		default:
+			fprintf (stderr, "usage: %s [-b MB/s] [-d mean dwell ms] [-n sessions] [-s seed]\n",
+				 argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (fBandwidth <= 0.0 || fDwell < 0.0 || nSessions == 0)
+	{
+		fprintf (stderr, "Invalid parameters\n");
+
+		return EXIT_FAILURE;
+	}
+
+	std::mt19937 Random (nSeed);
+	std::exponential_distribution<double> Dwell (fDwell > 0.0 ? 1.0 / fDwell : 1e9);
+	std::uniform_int_distribution<unsigned> Moves (0, 2 * s_nSynths);
+	std::bernoulli_distribution Forward (0.7);
+
+	TResult Result = {0, 0, 0, {}, {}};
+
+	for (unsigned nSession = 0; nSession < nSessions; nSession++)
+	{
+		CSimulation Simulation (fBandwidth * 1e6);
+
+		// the prefetcher starts with the first entry, when the menu is up
+		unsigned nSynth = 0;
+		double fTime = 0.0;
+		Simulation.Select (nSynth, fTime);
+
+		for (unsigned nMoves = Moves (Random); nMoves > 0; nMoves--)
+		{
+			fTime += Dwell (Random);
+			nSynth = (nSynth + (Forward (Random) ? 1 : s_nSynths - 1)) % s_nSynths;
+			Simulation.Select (nSynth, fTime);
+		}
+
+		fTime += Dwell (Random);
+
+		Result.Prefetched.push_back (Simulation.Launch (nSynth, fTime, &Result));
+		Result.Direct.push_back (Simulation.GetLoadTime (nSynth));
+	}
+
+	printf ("%u sessions, %.1f MB/s, %.0f ms mean dwell time\n", nSessions, fBandwidth, fDwell);
+	printf ("prefetch: %u hits, %u partial hits, %u misses (%.1f%% hit rate)\n",
+		Result.nHits, Result.nPartialHits, Result.nMisses,
+		100.0 * (Result.nHits + Result.nPartialHits) / nSessions);
+	printf ("%-16s %9s %9s %9s   (ms)\n", "time to launch", "mean", "p50", "p90");
+	printf ("%-16s %9.1f %9.1f %9.1f\n", "prefetched", Mean (Result.Prefetched),
+		Percentile (Result.Prefetched, 50), Percentile (Result.Prefetched, 90));
+	printf ("%-16s %9.1f %9.1f %9.1f\n", "direct", Mean (Result.Direct),
+		Percentile (Result.Direct, 50), Percentile (Result.Direct, 90));
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,439 @@
+//
+// statelogcheck.cpp
+//
+// Host tool: checks the record log, which keeps the boot state of the menu
+// (see src/statelog.h), on a card in memory. The newest record must be
+// recovered after every append, also after the log wrapped around, the
+// slots must wear evenly and a formatted log must not return stale records
+// of the sectors. A power loss is simulated at every write of a run, the
+// sector is torn after a number of bytes, with the old content or garbage
+// in the rest of it. Recover() must return the record before the torn one
+// (or the torn one, if it was complete) and the log must go on from there.
+//
+// The timing compares writing the state on a launch with rewriting an ini
+// file through FatFs, modelled with the number of card commands each takes
+// and the latency of a single block command of a typical SD card.
+//
+// usage: statelogcheck [-n rounds] [-w write latency us] [-r read latency us]
+//
+#include "../src/statelog.h"
+#include "../src/crc32.h"
+#include "toolcheck.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <unistd.h>
+
+#define SLOTS		16
+
+// single block commands of FatFs R0.14 for f_open (FA_CREATE_ALWAYS),
+// f_write() of 1 KB and f_close() of an existing synth.ini on FAT32 with
+// two FATs: the directory entry is written on truncation and on close, the
+// FAT sector twice (both copies) on freeing and on allocating the cluster,
+// the data with one multi-block write and the FSInfo sector
+#define INI_REWRITE_WRITES	8
+#define INI_REWRITE_READS	4
+#define INI_REWRITE_HOT		2	// writes of the same directory sector
+
+static volatile unsigned s_nSink;	// keeps the timed work from being optimized away
+
+// like TBootStateData
+struct TState
+{
+	char LastSynth[16];
+	uint32_t nLaunches;
+	uint32_t Stats[5];
+};
+
+static void MakeState (TState *pState, unsigned nLaunch)
+{
+	memset (pState, 0, sizeof *pState);
+	snprintf (pState->LastSynth, sizeof pState->LastSynth, "synth%u", nLaunch % 7);
+	pState->nLaunches = nLaunch;
+	for (unsigned i = 0; i < 5; i++)
+	{
+		pState->Stats[i] = nLaunch * 1000 + i;
+	}
+}
+
+class CCard
+{
+public:
+	CCard (unsigned nSectors)
+	:	m_Sectors (nSectors * STATE_LOG_SECTOR_SIZE, 0),
+		m_Writes (nSectors, 0),
+		m_nReadCommands (0),
+		m_nWriteCommands (0),
+		m_nTearAt (0),
+		m_nTearBytes (0),
+		m_bGarbage (false),
+		m_bPowered (true),
+		m_bTornComplete (false)
+	{
+	}
+
+	// the nWrite-th write from now on is cut off after nBytes, the card
+	// loses power then
+	void Tear (unsigned nWrite, unsigned nBytes, bool bGarbage)
+	{
+		m_nTearAt = m_nWriteCommands + nWrite + 1;
+		m_nTearBytes = nBytes;
+		m_bGarbage = bGarbage;
+	}
+
+	void PowerOn (void)
+	{
+		m_bPowered = true;
+		m_nTearAt = 0;
+	}
+
+	bool IsPowered (void) const			{ return m_bPowered; }
+
+	// the torn sector holds the header and data of the record anyway,
+	// because the bytes not written were the same or unused
+	bool IsTornComplete (void) const		{ return m_bTornComplete; }
+
+	void Fill (uint8_t uchByte)
+	{
+		std::fill (m_Sectors.begin (), m_Sectors.end (), uchByte);
+	}
+
+	uint8_t *GetSector (unsigned nSector)		{ return &m_Sectors[nSector * STATE_LOG_SECTOR_SIZE]; }
+
+	unsigned GetReadCommands (void) const		{ return m_nReadCommands; }
+	unsigned GetWriteCommands (void) const		{ return m_nWriteCommands; }
+	unsigned GetWrites (unsigned nSector) const	{ return m_Writes[nSector]; }
+
+	static bool ReadHandler (unsigned nSector, unsigned nCount, void *pBuffer, void *pParam)
+	{
+		CCard *pThis = static_cast<CCard *> (pParam);
+		if (   !pThis->m_bPowered
+		    || (nSector + nCount) * STATE_LOG_SECTOR_SIZE > pThis->m_Sectors.size ())
+		{
+			return false;
+		}
+
+		pThis->m_nReadCommands++;
+		memcpy (pBuffer, pThis->GetSector (nSector), nCount * STATE_LOG_SECTOR_SIZE);
+
+		return true;
+	}
+
+	static bool WriteHandler (unsigned nSector, const void *pBuffer, void *pParam)
+	{
+		CCard *pThis = static_cast<CCard *> (pParam);
+		if (   !pThis->m_bPowered
+		    || (nSector + 1) * STATE_LOG_SECTOR_SIZE > pThis->m_Sectors.size ())
+		{
+			return false;
+		}
+
+		pThis->m_nWriteCommands++;
+		pThis->m_Writes[nSector]++;
+
+		uint8_t *pSector = pThis->GetSector (nSector);
+		if (pThis->m_nWriteCommands != pThis->m_nTearAt)
+		{
+			memcpy (pSector, pBuffer, STATE_LOG_SECTOR_SIZE);
+
+			return true;
+		}
+
+		memcpy (pSector, pBuffer, pThis->m_nTearBytes);
+		if (pThis->m_bGarbage)
+		{
+			for (unsigned i = pThis->m_nTearBytes; i < STATE_LOG_SECTOR_SIZE; i++)
+			{
+				pSector[i] = rand ();
+			}
+		}
+
+		const TStateLogRecord *pRecord = static_cast<const TStateLogRecord *> (pBuffer);
+		pThis->m_bTornComplete = memcmp (pSector, pRecord,
+						 sizeof pRecord->Header + pRecord->Header.nSize) == 0;
+		pThis->m_bPowered = false;
+
+		return false;
+	}
+
+private:
+	std::vector<uint8_t> m_Sectors;
+	std::vector<unsigned> m_Writes;
+
+	unsigned m_nReadCommands;
+	unsigned m_nWriteCommands;
+
+	unsigned m_nTearAt;
+	unsigned m_nTearBytes;
+	bool m_bGarbage;
+	bool m_bPowered;
+	bool m_bTornComplete;
+};
+
+// returns the nLaunches of the recovered state, 0 if none
+static unsigned RecoverLaunches (CCard *pCard, CStateLog *pLog = nullptr)
+{
+	CStateLog Log (SLOTS, CCard::ReadHandler, CCard::WriteHandler, pCard);
+	if (pLog == nullptr)
+	{
+		pLog = &Log;
+	}
+
+	TState State;
+	if (!pLog->Recover (&State, sizeof State))
+	{
+		return 0;
+	}
+
+	TState Expected;
+	MakeState (&Expected, State.nLaunches);
+	Check (memcmp (&State, &Expected, sizeof State) == 0, "recovered state");
+
+	return State.nLaunches;
+}
+
+static void CheckAppend (void)
+{
+	CCard Card (SLOTS);
+	CStateLog Log (SLOTS, CCard::ReadHandler, CCard::WriteHandler, &Card);
+	Check (Log.Format (), "format");
+	Check (RecoverLaunches (&Card) == 0, "empty log");
+
+	const unsigned nLaunches = 10 * SLOTS + 3;
+	for (unsigned i = 1; i <= nLaunches; i++)
+	{
+		TState State;
+		MakeState (&State, i);
+		Check (Log.Append (&State, sizeof State), "append");
+		Check (RecoverLaunches (&Card) == i, "newest record");
+	}
+
+	// one read command for all slots
+	unsigned nReads = Card.GetReadCommands ();
+	RecoverLaunches (&Card);
+	Check (Card.GetReadCommands () == nReads + 1, "one read");
+
+	// each append wrote one sector, the slots in turn
+	unsigned nMin = ~0U, nMax = 0;
+	for (unsigned i = 0; i < SLOTS; i++)
+	{
+		nMin = std::min (nMin, Card.GetWrites (i));
+		nMax = std::max (nMax, Card.GetWrites (i));
+	}
+	Check (Card.GetWriteCommands () == SLOTS + nLaunches, "one write per append");
+	Check (nMax - nMin <= 1, "even wear");
+
+	// a recovered log goes on after the newest record
+	CStateLog Log2 (SLOTS, CCard::ReadHandler, CCard::WriteHandler, &Card);
+	Check (RecoverLaunches (&Card, &Log2) == nLaunches, "recover");
+	Check (Log2.GetNextSlot () == nLaunches % SLOTS, "next slot");
+	TState State;
+	MakeState (&State, nLaunches + 1);
+	Check (Log2.Append (&State, sizeof State), "append recovered");
+	Check (RecoverLaunches (&Card) == nLaunches + 1, "appended after recovery");
+
+	// a shorter record (older version) is zero-filled
+	Check (Log2.Append (&State, 16), "append short");
+	TState Short;
+	memset (&Short, 0xFF, sizeof Short);
+	Check (Log2.Recover (&Short, sizeof Short), "recover short");
+	Check (memcmp (Short.LastSynth, State.LastSynth, 16) == 0 && Short.nLaunches == 0, "zero-filled");
+}
+
+static void CheckStale (void)
+{
+	// records of a deleted log, with higher sequence numbers
+	CCard Card (SLOTS);
+	CStateLog Old (SLOTS, CCard::ReadHandler, CCard::WriteHandler, &Card);
+	Old.Format ();
+	for (unsigned i = 1; i <= 1000; i++)
+	{
+		TState State;
+		MakeState (&State, i);
+		Old.Append (&State, sizeof State);
+	}
+
+	CStateLog Log (SLOTS, CCard::ReadHandler, CCard::WriteHandler, &Card);
+	Check (Log.Format (), "format stale");
+	Check (RecoverLaunches (&Card) == 0, "no stale records");
+
+	// erased flash and random content
+	Card.Fill (0xFF);
+	Check (RecoverLaunches (&Card) == 0, "erased");
+	for (unsigned i = 0; i < SLOTS * STATE_LOG_SECTOR_SIZE; i++)
+	{
+		Card.GetSector (0)[i] = rand ();
+	}
+	Check (RecoverLaunches (&Card) == 0, "garbage");
+}
+
+// the sequence number wraps around from 0xFFFFFFFF to 1
+static void CheckWrap (void)
+{
+	CCard Card (SLOTS);
+	uint32_t nSequence = 0xFFFFFFFFU - SLOTS / 2;
+	for (unsigned i = 0; i < SLOTS; i++)
+	{
+		TStateLogRecord Record;
+		memset (&Record, 0, sizeof Record);
+		Record.Header.nMagic = STATE_LOG_MAGIC;
+		Record.Header.nVersion = STATE_LOG_VERSION;
+		Record.Header.nSize = sizeof (TState);
+		Record.Header.nSequence = nSequence;
+		MakeState (reinterpret_cast<TState *> (Record.Data), i + 1);
+		Record.Header.nCRC = CRC32Update (CRC32Update (0, &Record.Header, sizeof Record.Header),
+						  Record.Data, Record.Header.nSize);
+		Check (CStateLog::IsValid (&Record), "crafted record");
+		memcpy (Card.GetSector (i), &Record, sizeof Record);
+
+		if (++nSequence == 0)
+		{
+			nSequence = 1;
+		}
+	}
+
+	CStateLog Log (SLOTS, CCard::ReadHandler, CCard::WriteHandler, &Card);
+	Check (RecoverLaunches (&Card, &Log) == SLOTS, "wrapped sequence");
+	TState State;
+	MakeState (&State, SLOTS + 1);
+	Check (Log.Append (&State, sizeof State), "append wrapped");
+	Check (Log.GetSequence () == nSequence, "sequence after wrap");
+	Check (RecoverLaunches (&Card) == SLOTS + 1, "appended after wrap");
+}
+
+// power loss at write nWrite of a run of launches
+static void CheckTorn (unsigned nLaunches)
+{
+	static const unsigned TearBytes[] = {0, 1, 4, 12, 16, 17, 55, 56, 255, 511, 512};
+
+	unsigned nRuns = 0;
+	for (unsigned nWrite = 0; nWrite < nLaunches; nWrite++)
+	{
+		for (unsigned nBytes : TearBytes)
+		{
+			for (int bGarbage = 0; bGarbage <= 1; bGarbage++)
+			{
+				CCard Card (SLOTS);
+				CStateLog Log (SLOTS, CCard::ReadHandler, CCard::WriteHandler, &Card);
+				Log.Format ();
+				Card.Tear (nWrite, nBytes, bGarbage);
+
+				unsigned nDone = 0;
+				for (unsigned i = 1; i <= nLaunches && Card.IsPowered (); i++)
+				{
+					TState State;
+					MakeState (&State, i);
+					if (Log.Append (&State, sizeof State))
+					{
+						nDone = i;
+					}
+				}
+				Check (nDone == nWrite, "appends before the power loss");
+
+				// the torn record is recovered only if it is complete
+				Card.PowerOn ();
+				CStateLog Log2 (SLOTS, CCard::ReadHandler, CCard::WriteHandler, &Card);
+				unsigned nRecovered = RecoverLaunches (&Card, &Log2);
+				unsigned nExpected = Card.IsTornComplete () ? nWrite + 1 : nWrite;
+				Check (nRecovered == nExpected, "recovered after power loss");
+
+				// and goes on from there, the torn slot is written again
+				if (nRecovered == 0)
+				{
+					Log2.Format ();
+				}
+				TState State;
+				MakeState (&State, nRecovered + 1);
+				Check (Log2.Append (&State, sizeof State), "append after power loss");
+				Check (RecoverLaunches (&Card) == nRecovered + 1, "appended after power loss");
+
+				nRuns++;
+			}
+		}
+	}
+
+	printf ("%-32s %8u runs\n", "power loss", nRuns);
+}
+
+template <class TFunction>
+static double Time (unsigned nRounds, TFunction Function)
+{
+	auto Start = std::chrono::steady_clock::now ();
+
+	for (unsigned i = 0; i < nRounds; i++)
+	{
+		s_nSink += Function (i);
+	}
+
+	return std::chrono::duration<double, std::nano> (
+		std::chrono::steady_clock::now () - Start).count () / nRounds;
+}
+
+int main (int argc, char **argv)
+{
+	unsigned nRounds = 100000;
+	unsigned nWriteLatency = 2000;
+	unsigned nReadLatency = 250;
+
+	int nOption;
+	while (optind <= argc && (nOption = getopt (argc, argv, "n:w:r:")) != -1)
+	{
+		switch (nOption)
+		{
+		case 'n':	nRounds = strtoul (optarg, nullptr, 0);		break;
+		case 'w':	nWriteLatency = strtoul (optarg, nullptr, 0);	break;
+		case 'r':	nReadLatency = strtoul (optarg, nullptr, 0);	break;
+
+		default:
+			optind = argc + 1;			// show usage
+			break;
+		}
+	}
+
+	if (nRounds == 0 || optind != argc)
+	{
+		return Usage ("statelogcheck [-n rounds] [-w write latency us] [-r read latency us]");
+	}
+
+	CheckAppend ();
+	CheckStale ();
+	CheckWrap ();
+	CheckTorn (3 * SLOTS);
+
+	CCard Card (SLOTS);
+	CStateLog Log (SLOTS, CCard::ReadHandler, CCard::WriteHandler, &Card);
+	Log.Format ();
+
+	TState State;
+	MakeState (&State, 1);
+	unsigned nWrites = Card.GetWriteCommands ();
+	double fAppend = Time (nRounds, [&] (unsigned i)
+		{ State.nLaunches = i; return (unsigned) Log.Append (&State, sizeof State); });
+	double fWrites = (double) (Card.GetWriteCommands () - nWrites) / nRounds;
+
+	unsigned nReads = Card.GetReadCommands ();
+	double fRecover = Time (nRounds, [&] (unsigned i)
+		{ return (unsigned) Log.Recover (&State, sizeof State); });
+	double fReads = (double) (Card.GetReadCommands () - nReads) / nRounds;
+
+	double fLog = fAppend / 1000 + fWrites * nWriteLatency;
+	double fIni = INI_REWRITE_WRITES * nWriteLatency + INI_REWRITE_READS * nReadLatency;
+
+	printf ("%u rounds, card: %u us per write, %u us per read command\n",
+		nRounds, nWriteLatency, nReadLatency);
+	printf ("%-32s %8.0f ns\n", "append (cpu)", fAppend);
+	printf ("%-32s %8.0f ns\n", "recover (cpu)", fRecover);
+	printf ("%-32s %8.2f write, 0 read commands\n", "launch, log", fWrites);
+	printf ("%-32s %8u write, %u read commands\n", "launch, ini rewrite",
+		INI_REWRITE_WRITES, INI_REWRITE_READS);
+	printf ("%-32s %8.2f read commands\n", "boot, log", fReads);
+	printf ("%-32s %8.0f us\n", "launch, log, modelled", fLog);
+	printf ("%-32s %8.0f us\n", "launch, ini rewrite, modelled", fIni);
+	printf ("%-32s %8.3f log, %u ini rewrite\n", "writes of hottest sector/launch",
+		1.0 / SLOTS, INI_REWRITE_HOT);
+	Check (fLog < fIni, "log is faster");
+
+	return CheckResult ();
+}
@@ -0,0 +1,366 @@
+//
+// teardownsim.cpp
+//
+// Host tool: runs the teardown stages of the boot menu (see src/teardown.h)
+// with CBootStages on threads in place of the cores and with mock stages,
+// which take the modelled time of the real ones. It checks, that each
+// stage runs once and only after its dependencies, that stages of
+// different cores overlap, that core 0 takes over the stages of a busy
+// core and that a stage, which takes too long, makes the teardown fail
+// within its budget. USB, which is still coming up, must fail the teardown
+// at the deadline instead of holding it. The critical path of the stage graph is reported
+// along with the measured duration.
+//
+// usage: teardownsim [-r rounds] [-v]
+//
+#include "../src/teardown.h"
+#include "toolcheck.h"
+#include <circle/logger.h>
+#include <circle/timer.h>
+#include <atomic>
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <unistd.h>
+
+// modelled duration of the stages on the target in us
+static const unsigned s_Duration[TeardownStageCount] =
+{
+	5000,			// log, flushing pending messages to the serial console
+	100,			// handoff, about 3 KB
+	2000,			// display, the worker finishes its frame
+	50,			// input
+	30000,			// usb, removing the devices and the host controller
+	500,			// sd card
+	3000,			// devices
+	10			// verify
+};
+
+static bool s_bVerbose;
+static std::atomic<unsigned> s_nLogErrors (0);
+
+static const auto s_Start = std::chrono::steady_clock::now ();
+
+unsigned CTimer::GetClockTicks (void)
+{
+	return std::chrono::duration_cast<std::chrono::microseconds> (
+		std::chrono::steady_clock::now () - s_Start).count () + 1;
+}
+
+void CLogger::Write (const char *pSource, TLogSeverity Severity, const char *pMessage, ...)
+{
+	if (Severity <= LogError)
+	{
+		s_nLogErrors++;
+	}
+
+	if (s_bVerbose)
+	{
+		va_list Args;
+		va_start (Args, pMessage);
+		printf ("  %s: ", pSource);
+		vprintf (pMessage, Args);
+		printf ("\n");
+		va_end (Args);
+	}
+}
+
+CLogger *CLogger::Get (void)
+{
+	static CLogger s_Logger;
+
+	return &s_Logger;
+}
+
+// used by CBootStages
+unsigned CBootProfiler::Begin (const char *pName)
+{
+	return 0;
+}
+
+void CBootProfiler::End (unsigned hStage)
+{
+}
+
+class CSimulation
+{
+public:
+	// nBusyCore (0 for none) does not take its stages, nSlowStage takes
+	// nSlowDuration us, with bUSBStarting USB does not come up
+	CSimulation (unsigned nBusyCore = 0, unsigned nSlowStage = TeardownStageCount,
+		     unsigned nSlowDuration = 0, bool bUSBStarting = false)
+	:	m_Stages (TeardownStages, TeardownStageCount, StageHandler, this, nullptr),
+		m_nBusyCore (nBusyCore),
+		m_nSlowStage (nSlowStage),
+		m_nSlowDuration (nSlowDuration),
+		m_bUSBStarting (bUSBStarting)
+	{
+		for (unsigned i = 0; i < TeardownStageCount; i++)
+		{
+			m_nRuns[i] = 0;
+			m_nStart[i] = 0;
+			m_nEnd[i] = 0;
+			m_nCore[i] = 0;
+		}
+	}
+
+	// returns the duration in us, *pOK is the result of core 0
+	unsigned Run (bool *pOK)
+	{
+		unsigned nStart = CTimer::GetClockTicks ();
+		m_Stages.SetDeadline ((nStart + TEARDOWN_BUDGET) | 1);
+		m_Stages.EnableHelping ();
+
+		std::thread SD ([this] { RunCore (TEARDOWN_CORE_SD); });
+
+		s_nCore = 0;
+		*pOK = m_Stages.Run (0);
+		unsigned nDuration = CTimer::GetClockTicks () - nStart;
+
+		// a stage, which is over time, does not come back earlier
+		SD.join ();
+
+		return nDuration;
+	}
+
+	void CheckOrder (void) const
+	{
+		for (unsigned i = 0; i < TeardownStageCount; i++)
+		{
+			Check (m_nRuns[i] == 1, "runs once");
+
+			for (unsigned j = 0; j < i; j++)
+			{
+				if (TeardownStages[i].nDependencies & BOOT_STAGE (j))
+				{
+					Check (m_nEnd[j] <= m_nStart[i], "after its dependencies");
+				}
+			}
+		}
+	}
+
+	bool HasRun (unsigned nStage) const
+	{
+		return m_nRuns[nStage] != 0;
+	}
+
+	unsigned GetCore (unsigned nStage) const
+	{
+		return m_nCore[nStage];
+	}
+
+	// some stages of different cores did run at the same time
+	bool IsParallel (void) const
+	{
+		for (unsigned i = 0; i < TeardownStageCount; i++)
+		{
+			for (unsigned j = 0; j < i; j++)
+			{
+				if (   m_nCore[i] != m_nCore[j]
+				    && m_nStart[i] < m_nEnd[j]
+				    && m_nStart[j] < m_nEnd[i])
+				{
+					return true;
+				}
+			}
+		}
+
+		return false;
+	}
+
+private:
+	void RunCore (unsigned nCore)
+	{
+		if (nCore == m_nBusyCore)
+		{
+			return;
+		}
+
+		s_nCore = nCore;
+		m_Stages.Run (nCore);
+	}
+
+	static bool StageHandler (unsigned nStage, void *pParam)
+	{
+		CSimulation *pThis = static_cast<CSimulation *> (pParam);
+
+		pThis->m_nRuns[nStage]++;
+		pThis->m_nCore[nStage] = s_nCore;
+		pThis->m_nStart[nStage] = CTimer::GetClockTicks ();
+
+		// like CKernel::TeardownStageHandler()
+		if (   nStage == TeardownStageUSB
+		    && pThis->m_bUSBStarting)
+		{
+			while (!pThis->m_Stages.IsTimedOut ())
+			{
+				std::this_thread::yield ();
+			}
+
+			pThis->m_nEnd[nStage] = CTimer::GetClockTicks ();
+
+			return false;
+		}
+
+		unsigned nDuration = nStage == pThis->m_nSlowStage ? pThis->m_nSlowDuration
+								   : s_Duration[nStage];
+		std::this_thread::sleep_for (std::chrono::microseconds (nDuration));
+
+		pThis->m_nEnd[nStage] = CTimer::GetClockTicks ();
+
+		return true;
+	}
+
+private:
+	CBootStages m_Stages;
+
+	unsigned m_nBusyCore;
+	unsigned m_nSlowStage;
+	unsigned m_nSlowDuration;
+	bool m_bUSBStarting;
+
+	std::atomic<unsigned> m_nRuns[TeardownStageCount];
+	unsigned m_nStart[TeardownStageCount];
+	unsigned m_nEnd[TeardownStageCount];
+	unsigned m_nCore[TeardownStageCount];
+
+	static thread_local unsigned s_nCore;
+};
+
+thread_local unsigned CSimulation::s_nCore;
+
+// longest path through the stage graph with the modelled durations
+static unsigned GetCriticalPath (unsigned *pSum)
+{
+	unsigned nFinish[TeardownStageCount];
+	unsigned nLongest = 0;
+	*pSum = 0;
+
+	for (unsigned i = 0; i < TeardownStageCount; i++)
+	{
+		unsigned nStart = 0;
+		for (unsigned j = 0; j < i; j++)
+		{
+			if (   (TeardownStages[i].nDependencies & BOOT_STAGE (j))
+			    && nFinish[j] > nStart)
+			{
+				nStart = nFinish[j];
+			}
+		}
+
+		nFinish[i] = nStart + s_Duration[i];
+		if (nFinish[i] > nLongest)
+		{
+			nLongest = nFinish[i];
+		}
+
+		*pSum += s_Duration[i];
+	}
+
+	return nLongest;
+}
+
+int main (int argc, char **argv)
+{
+	unsigned nRounds = 20;
+
+	int nOption;
+	while (optind <= argc && (nOption = getopt (argc, argv, "r:v")) != -1)
+	{
+		switch (nOption)
+		{
+		case 'r':	nRounds = strtoul (optarg, nullptr, 0);		break;
+		case 'v':	s_bVerbose = true;				break;
+
+		default:
+			optind = argc + 1;			// show usage
+			break;
+		}
+	}
+
+	if (nRounds == 0 || optind != argc)
+	{
+		return Usage ("teardownsim [-r rounds] [-v]");
+	}
+
+	for (unsigned i = 0; i < TeardownStageCount; i++)
+	{
+		Check (TeardownStages[i].nBudget >= s_Duration[i], "stage budget");
+	}
+
+	unsigned nSum;
+	unsigned nCriticalPath = GetCriticalPath (&nSum);
+	printf ("%-28s %8u us (%u us in sequence, budget %u us)\n", "critical path, modelled",
+		nCriticalPath, nSum, TEARDOWN_BUDGET);
+	Check (nCriticalPath < TEARDOWN_BUDGET, "critical path within budget");
+
+	// all cores free
+	unsigned nWorst = 0;
+	bool bParallel = false;
+	for (unsigned i = 0; i < nRounds; i++)
+	{
+		CSimulation Simulation;
+		bool bOK;
+		unsigned nDuration = Simulation.Run (&bOK);
+
+		Check (bOK, "teardown");
+		Simulation.CheckOrder ();
+		Check (Simulation.GetCore (TeardownStageUSB) == 0, "usb on core 0");
+		bParallel |= Simulation.IsParallel ();
+
+		if (nDuration > nWorst)
+		{
+			nWorst = nDuration;
+		}
+	}
+	Check (bParallel, "stages in parallel");
+	printf ("%-28s %8u us\n", "all cores free, worst", nWorst);
+
+	// core 0 helps with the stages of a busy core
+	static const unsigned s_BusyCores[] = {TEARDOWN_CORE_SD};
+	for (unsigned nCore : s_BusyCores)
+	{
+		CSimulation Simulation (nCore);
+		bool bOK;
+		unsigned nDuration = Simulation.Run (&bOK);
+
+		Check (bOK, "teardown with a busy core");
+		Simulation.CheckOrder ();
+		for (unsigned i = 0; i < TeardownStageCount; i++)
+		{
+			if (TeardownStages[i].nCore == nCore)
+			{
+				Check (Simulation.GetCore (i) == 0, "helped by core 0");
+			}
+		}
+
+		char Label[32];
+		snprintf (Label, sizeof Label, "core %u busy", nCore);
+		printf ("%-28s %8u us\n", Label, nDuration);
+	}
+
+	// a stage over time fails the teardown, the following stages do not run
+	unsigned nLogErrors = s_nLogErrors;
+	CSimulation Simulation (0, TeardownStageUSB, TEARDOWN_BUDGET + 50000);
+	bool bOK;
+	unsigned nDuration = Simulation.Run (&bOK);
+	Check (!bOK, "teardown over time fails");
+	Check (!Simulation.HasRun (TeardownStageVerify), "not verified");
+	Check (s_nLogErrors > nLogErrors, "reported");
+	Check (nDuration < TEARDOWN_BUDGET + 50000 + 20000, "fails in time");
+	printf ("%-28s %8u us\n", "usb over time", nDuration);
+
+	// USB is still coming up, the teardown fails at the deadline
+	nLogErrors = s_nLogErrors;
+	CSimulation Starting (0, TeardownStageCount, 0, true);
+	nDuration = Starting.Run (&bOK);
+	Check (!bOK, "teardown with usb starting fails");
+	Check (!Starting.HasRun (TeardownStageDevices), "devices not destroyed");
+	Check (s_nLogErrors > nLogErrors, "reported");
+	Check (nDuration < TEARDOWN_BUDGET + 20000, "fails at the deadline");
+	printf ("%-28s %8u us\n", "usb still starting", nDuration);
+
+	return CheckResult ();
+}
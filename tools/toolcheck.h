@@ -0,0 +1,55 @@
+//
+// toolcheck.h
+//
+// Shared by the host tools, which check the code of the boot menu: Check()
+// counts the failed checks (and prints the first CHECK_REPORT_MAX of them),
+// CheckResult() prints the summary and returns the exit code of main().
+// Check() may be called from several threads.
+//
+#pragma once
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+
+#define CHECK_REPORT_MAX	10
+
+inline std::atomic<unsigned> &CheckErrors (void)
+{
+	static std::atomic<unsigned> s_nErrors (0);
+
+	return s_nErrors;
+}
+
+inline void Check (bool bCondition, const char *pWhat)
+{
+	if (!bCondition)
+	{
+		if (CheckErrors ()++ < CHECK_REPORT_MAX)
+		{
+			printf ("FAILED: %s\n", pWhat);
+		}
+	}
+}
+
+inline int CheckResult (void)
+{
+	if (CheckErrors () != 0)
+	{
+		printf ("%u errors\n", CheckErrors ().load ());
+
+		return EXIT_FAILURE;
+	}
+
+	printf ("OK\n");
+
+	return EXIT_SUCCESS;
+}
+
+// prints the usage line of the tool, returns the exit code of main()
+inline int Usage (const char *pUsage)
+{
+	fprintf (stderr, "usage: %s\n", pUsage);
+
+	return EXIT_FAILURE;
+}
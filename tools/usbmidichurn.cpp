@@ -0,0 +1,332 @@
+//
+// usbmidichurn.cpp
+//
+// Host tool: exercises the USB MIDI hotplug of the boot menu (see
+// src/usbmidiports.h) against a mock device name service. Random devices
+// are plugged in and removed while random messages arrive on random cables,
+// SysEx messages are split across packets and interleaved between cables.
+// Devices get the lowest free number like in Circle, so a new device often
+// reuses the name of a removed one. Update() is only called, when the
+// device tree changed, like in the boot menu.
+//
+// Checks that each message of an attached device arrives once, complete
+// and on its own port, that nothing arrives from devices which are not
+// served, and that the log has one line per attach and remove.
+//
+// usage: usbmidichurn [-d max devices] [-n steps] [-s seed]
+//
+#include "../src/usbmidiports.h"
+#include <circle/devicenameservice.h>
+#include <circle/logger.h>
+#include <circle/timer.h>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#define SYSEX_SIZE	8			// split into three packets
+
+static std::map<std::string, CDevice *> s_Devices;
+static unsigned s_nLogLines;
+
+CDevice *CDeviceNameService::GetDevice (const char *pName, boolean bBlockDevice)
+{
+	auto it = s_Devices.find (pName);
+
+	return it != s_Devices.end () ? it->second : nullptr;
+}
+
+CDevice *CDeviceNameService::GetDevice (const char *pPrefix, unsigned nIndex, boolean bBlockDevice)
+{
+	return GetDevice ((pPrefix + std::to_string (nIndex)).c_str (), bBlockDevice);
+}
+
+CDeviceNameService *CDeviceNameService::Get (void)
+{
+	static CDeviceNameService s_NameService;
+
+	return &s_NameService;
+}
+
+void CLogger::Write (const char *pSource, TLogSeverity Severity, const char *pMessage, ...)
+{
+	s_nLogLines++;
+}
+
+CLogger *CLogger::Get (void)
+{
+	static CLogger s_Logger;
+
+	return &s_Logger;
+}
+
+unsigned CTimer::GetClockTicks (void)
+{
+	return 0;
+}
+
+struct TMessage
+{
+	unsigned nPort;
+	std::vector<u8> Data;
+};
+
+class CChurn
+{
+public:
+	CChurn (unsigned nMaxDevices, unsigned nSeed)
+	:	m_nMaxDevices (nMaxDevices),
+		m_Random (nSeed),
+		m_bTreeChanged (false),
+		m_nErrors (0),
+		m_nDelivered (0),
+		m_nAttaches (0),
+		m_nRemoves (0)
+	{
+		m_Ports.RegisterMessageHandler (MessageHandler, this, 0);
+	}
+
+	~CChurn (void)
+	{
+		for (unsigned nDevice = 1; nDevice <= m_nMaxDevices; nDevice++)
+		{
+			Unplug (nDevice);
+		}
+	}
+
+	void Step (void)
+	{
+		switch (Random (10))
+		{
+		case 0:
+			Plug ();
+			break;
+
+		case 1:
+			Unplug (1 + Random (m_nMaxDevices));
+			break;
+
+		default:
+			Traffic ();
+			break;
+		}
+
+		if (m_bTreeChanged)
+		{
+			m_Ports.Update ();
+			m_bTreeChanged = false;
+		}
+	}
+
+	bool Report (unsigned nSteps) const
+	{
+		unsigned nExpectedLog = m_nAttaches + m_nRemoves;
+
+		printf ("%u steps, %u devices attached, %u removed, %u messages delivered\n",
+			nSteps, m_nAttaches, m_nRemoves, m_nDelivered);
+		printf ("%u log lines (%u expected), %zu messages missing, %u errors\n",
+			s_nLogLines, nExpectedLog, m_Expected.size (), m_nErrors);
+
+		return m_nErrors == 0 && m_Expected.empty () && s_nLogLines == nExpectedLog;
+	}
+
+private:
+	unsigned Random (unsigned nRange)
+	{
+		return std::uniform_int_distribution<unsigned> (0, nRange - 1) (m_Random);
+	}
+
+	static std::string GetName (unsigned nDevice)
+	{
+		return "umidi" + std::to_string (nDevice);
+	}
+
+	// the lowest free number, like CNumberPool in Circle
+	void Plug (void)
+	{
+		for (unsigned nDevice = 1; nDevice <= m_nMaxDevices; nDevice++)
+		{
+			if (s_Devices.count (GetName (nDevice)) == 0)
+			{
+				s_Devices[GetName (nDevice)] = new CUSBMIDIDevice (nDevice);
+				m_bTreeChanged = true;
+
+				if (nDevice <= USB_MIDI_DEVICES)
+				{
+					m_nAttaches++;
+				}
+
+				return;
+			}
+		}
+	}
+
+	void Unplug (unsigned nDevice)
+	{
+		auto it = s_Devices.find (GetName (nDevice));
+		if (it == s_Devices.end ())
+		{
+			return;
+		}
+
+		CDevice *pDevice = it->second;
+		s_Devices.erase (it);
+		delete pDevice;				// calls the removed handler
+		m_bTreeChanged = true;
+
+		if (nDevice <= USB_MIDI_DEVICES)
+		{
+			m_nRemoves++;
+		}
+
+		// a SysEx in progress is lost with the device
+		for (unsigned nCable = 0; nCable < USB_MIDI_CABLES; nCable++)
+		{
+			m_SysEx.erase (Key (nDevice, nCable));
+		}
+	}
+
+	void Traffic (void)
+	{
+		unsigned nDevice = 1 + Random (m_nMaxDevices);
+		auto it = s_Devices.find (GetName (nDevice));
+		if (it == s_Devices.end ())
+		{
+			return;
+		}
+
+		CUSBMIDIDevice *pDevice = static_cast<CUSBMIDIDevice *> (it->second);
+		unsigned nCable = Random (USB_MIDI_CABLES);
+		unsigned nKey = Key (nDevice, nCable);
+
+		std::vector<u8> Packet;
+		auto SysEx = m_SysEx.find (nKey);
+		if (SysEx != m_SysEx.end ())
+		{
+			// next part of a SysEx, which was started on this cable
+			std::vector<u8> &rData = SysEx->second;
+			unsigned nOffset = rData.size ();
+			for (unsigned i = 0; i < 3 && nOffset + i < SYSEX_SIZE; i++)
+			{
+				Packet.push_back (i + nOffset == SYSEX_SIZE - 1 ? 0xF7 : Random (128));
+				rData.push_back (Packet.back ());
+			}
+
+			if (rData.size () == SYSEX_SIZE)
+			{
+				Expect (nDevice, nCable, rData);
+				m_SysEx.erase (SysEx);
+			}
+		}
+		else if (Random (8) == 0)
+		{
+			Packet = {0xF0, (u8) Random (128), (u8) Random (128)};
+			m_SysEx[nKey] = Packet;
+		}
+		else
+		{
+			Packet = {(u8) (0x90 | Random (16)), (u8) Random (128), (u8) Random (128)};
+			Expect (nDevice, nCable, Packet);
+		}
+
+		pDevice->Receive (nCable, Packet.data (), Packet.size ());
+	}
+
+	void Expect (unsigned nDevice, unsigned nCable, const std::vector<u8> &rData)
+	{
+		if (nDevice <= USB_MIDI_DEVICES)
+		{
+			m_Expected.push_back ({(nDevice - 1) * USB_MIDI_CABLES + nCable, rData});
+		}
+	}
+
+	static unsigned Key (unsigned nDevice, unsigned nCable)
+	{
+		return nDevice * USB_MIDI_CABLES + nCable;
+	}
+
+	static void MessageHandler (unsigned nPort, const u8 *pMessage, unsigned nLength, void *pParam)
+	{
+		CChurn *pThis = static_cast<CChurn *> (pParam);
+
+		std::vector<u8> Data (pMessage, pMessage + nLength);
+		if (   pThis->m_Expected.empty ()
+		    || pThis->m_Expected.front ().nPort != nPort
+		    || pThis->m_Expected.front ().Data != Data)
+		{
+			if (pThis->m_nErrors++ < 10)
+			{
+				fprintf (stderr, "Unexpected message on port %u\n", nPort);
+			}
+
+			return;
+		}
+
+		pThis->m_Expected.pop_front ();
+		pThis->m_nDelivered++;
+	}
+
+private:
+	unsigned m_nMaxDevices;
+	std::mt19937 m_Random;
+
+	CUSBMIDIPorts m_Ports;
+	bool m_bTreeChanged;
+
+	std::map<unsigned, std::vector<u8>> m_SysEx;	// in progress by Key()
+	std::deque<TMessage> m_Expected;
+
+	unsigned m_nErrors;
+	unsigned m_nDelivered;
+	unsigned m_nAttaches;
+	unsigned m_nRemoves;
+};
+
+int main (int argc, char **argv)
+{
+	unsigned nMaxDevices = USB_MIDI_DEVICES + 2;
+	unsigned nSteps = 1000000;
+	unsigned nSeed = 1;
+
+	int nOption;
+	while (optind <= argc && (nOption = getopt (argc, argv, "d:n:s:")) != -1)
+	{
+		switch (nOption)
+		{
+		case 'd':	nMaxDevices = strtoul (optarg, nullptr, 0);	break;
+		case 'n':	nSteps = strtoul (optarg, nullptr, 0);		break;
+		case 's':	nSeed = strtoul (optarg, nullptr, 0);		break;
+
+		default:
+			optind = argc + 1;			// show usage
+			break;
+		}
+	}
+
+	if (nMaxDevices == 0 || optind != argc)
+	{
+		fprintf (stderr, "usage: usbmidichurn [-d max devices] [-n steps] [-s seed]\n");
+
+		return EXIT_FAILURE;
+	}
+
+	bool bOK;
+	{
+		CChurn Churn (nMaxDevices, nSeed);
+		for (unsigned i = 0; i < nSteps; i++)
+		{
+			Churn.Step ();
+		}
+
+		bOK = Churn.Report (nSteps);
+	}
+
+	printf ("%s\n", bOK ? "OK" : "FAILED");
+
+	return bOK ? EXIT_SUCCESS : EXIT_FAILURE;
+}